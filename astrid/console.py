@@ -301,11 +301,8 @@ to be restarted to take effect.
 
         elif action == 'c':
             for note in notes:
-                try:
-                    os.unlink('/tmp/astrid-midimap-device%s-note%s' % (device, note))
-                    print('Removed all notemaps for device %s note %s' % (device, note))
-                except FileNotFoundError as e:
-                    pass
+                subprocess.run(['astrid-rmnotemap', device, note, '-1'])
+                print('Removed all notemaps for device %s note %s' % (device, note))
 
         elif action == 'l':
             for note in notes:
@@ -336,6 +333,18 @@ to be restarted to take effect.
             print('Could not invoke astrid-msg: %s' % e)
             print(traceback.format_exc())
 
+    def do_m(self, cmd):
+        parts = cmd.split(' ')
+        instrument = parts[0]
+        params = ' '.join(parts[1:])
+
+        try:
+            logger.info('Sending voice msg to %s w/params:\n  %s' % (instrument, params))
+            subprocess.run(['astrid-msg', 'm', instrument, params])
+        except Exception as e:
+            print('Could not invoke astrid-msg: %s' % e)
+            print(traceback.format_exc())
+
     def do_set(self, cmd):
         parts = [ p.strip() for p in cmd.split() ]
         k = parts[0]
@@ -35,6 +35,8 @@ def midi_update_callback(event, device_id=None):
     if mt == NOTE_ON:
         logger.info('NOTE ON event %s (device %s)' % (event, device_id))
         setnote(msg[1], msg[2], device_id)
+        # The only place notemaps are triggered from MIDI input: 
+        # instrument listeners leave it to us so each note fires once
         trigger_notemap(msg[1], device_id)
 
     elif mt == NOTE_OFF:
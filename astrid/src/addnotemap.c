@@ -22,5 +22,10 @@ int main(int argc, char * argv[]) {
         return 1;
     }
 
+    if(lpmidi_save_notemap(device_id) < 0) {
+        fprintf(stderr, "addnotemap: Could not save notemap\n");
+        return 1;
+    }
+
     return 0;
 }
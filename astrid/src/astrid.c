@@ -2,6 +2,8 @@
 
 static volatile int * astrid_instrument_is_running;
 static pthread_mutex_t astrid_nursery_lock = PTHREAD_MUTEX_INITIALIZER;
+static lpstats_t * astrid_stats_page = NULL; /* see astrid_stats_open */
+static lpofflineclock_t * astrid_offline_clock = NULL; /* virtual clock of a flat out headless driver, shared across forks */
 
 void handle_instrument_shutdown(__attribute__((unused)) int sig) {
     *astrid_instrument_is_running = 0;
@@ -19,6 +21,413 @@ void lptimeit_since(struct timespec * start) {
     start->tv_nsec = now.tv_nsec;
 }
 
+/* REALTIME
+ * LOGGING
+ * ********/
+static lplogring_t astrid_log_rings[ASTRID_LOG_MAXTHREADS];
+static atomic_int astrid_log_numrings = 0;
+static atomic_int astrid_log_running = 0;
+static atomic_size_t astrid_log_unclaimed_dropped = 0;
+static _Thread_local lplogring_t * astrid_log_thread_ring = NULL;
+static pthread_t astrid_log_drain_thread;
+static FILE * astrid_log_out = NULL;
+static pthread_key_t astrid_log_ring_key;
+static pthread_once_t astrid_log_once = PTHREAD_ONCE_INIT;
+
+/* Hands the ring back when its thread exits, so a 
+ * later thread can claim it. Anything still queued 
+ * in the ring is drained as usual. */
+static void astrid_log_release_ring(void * arg) {
+    lplogring_t * ring = (lplogring_t *)arg;
+    atomic_store_explicit(&ring->in_use, 0, memory_order_release);
+}
+
+static void astrid_log_atfork_child(void) {
+    /* The drain thread isn't forked along with us, so the 
+     * child logs straight to syslog. The parent still drains 
+     * the records the child inherited, so drop its copies. */
+    int r;
+
+    atomic_store(&astrid_log_running, 0);
+    for(r=0; r < ASTRID_LOG_MAXTHREADS; r++) {
+        atomic_store(&astrid_log_rings[r].tail, atomic_load(&astrid_log_rings[r].head));
+        atomic_store(&astrid_log_rings[r].dropped, 0);
+        atomic_store(&astrid_log_rings[r].in_use, 0);
+    }
+    atomic_store(&astrid_log_numrings, 0);
+    atomic_store(&astrid_log_unclaimed_dropped, 0);
+    astrid_log_thread_ring = NULL;
+}
+
+static void astrid_log_init_once(void) {
+    pthread_key_create(&astrid_log_ring_key, astrid_log_release_ring);
+    pthread_atfork(NULL, NULL, astrid_log_atfork_child);
+}
+
+/* Claims a free ring for the calling thread, or 
+ * returns NULL when every ring is taken. */
+static lplogring_t * astrid_log_claim_ring(void) {
+    lplogring_t * ring;
+    int r, numrings, free_ring;
+
+    for(r=0; r < ASTRID_LOG_MAXTHREADS; r++) {
+        ring = &astrid_log_rings[r];
+        free_ring = 0;
+        if(!atomic_compare_exchange_strong_explicit(&ring->in_use, &free_ring, 1, memory_order_acq_rel, memory_order_relaxed)) continue;
+
+        /* the drain thread scans up to the highest ring ever claimed */
+        numrings = atomic_load(&astrid_log_numrings);
+        while(numrings <= r && !atomic_compare_exchange_weak(&astrid_log_numrings, &numrings, r+1));
+
+        pthread_setspecific(astrid_log_ring_key, ring);
+        return ring;
+    }
+
+    return NULL;
+}
+
+/* Reads one conversion spec at fmt (just past the %), and 
+ * returns its length. The conversion char lands in conv and 
+ * the length modifier (if any) in mod: 'L' for ll, 'l', 'z', 
+ * 'j', 't', or 'h'. */
+static size_t astrid_log_spec(const char * fmt, char * conv, char * mod) {
+    size_t i = 0;
+
+    *mod = 0;
+    while(fmt[i] != 0 && strchr("-+ #0123456789.", fmt[i]) != NULL) i++;
+    while(fmt[i] != 0 && strchr("hlLqjzt", fmt[i]) != NULL) {
+        if(fmt[i] == 'l' && *mod == 'l') {
+            *mod = 'L';
+        } else if(fmt[i] != 'h' || *mod == 0) {
+            *mod = (fmt[i] == 'q') ? 'L' : fmt[i];
+        }
+        i++;
+    }
+    *conv = fmt[i];
+    return (fmt[i] == 0) ? i : i + 1;
+}
+
+void astrid_log_write(int level, const char * fmt, ...) {
+    lplogring_t * ring;
+    lplogrecord_t * record;
+    const char * c, * s;
+    char conv, mod;
+    size_t head, tail, len;
+    va_list args;
+
+    if(!atomic_load_explicit(&astrid_log_running, memory_order_acquire)) {
+        /* nothing is draining the rings (a CLI tool, or shutdown) so log directly */
+        va_start(args, fmt);
+        vsyslog(level, fmt, args);
+        va_end(args);
+        return;
+    }
+
+    if((ring = astrid_log_thread_ring) == NULL) {
+        /* claim a ring the first time this thread logs */
+        if((ring = astrid_log_thread_ring = astrid_log_claim_ring()) == NULL) {
+            atomic_fetch_add_explicit(&astrid_log_unclaimed_dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if(head - tail >= ASTRID_LOG_RINGSIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    record = &ring->records[head & (ASTRID_LOG_RINGSIZE-1)];
+    record->level = level;
+    record->fmt = fmt;
+    record->numargs = 0;
+    record->strsize = 0;
+    clock_gettime(CLOCK_REALTIME, &record->time);
+
+    /* Pull the args off by type, formatting is left for the drain thread */
+    va_start(args, fmt);
+    for(c=fmt; *c != 0; c++) {
+        if(*c != '%') continue;
+        if(*(c+1) == '%') {
+            c++;
+            continue;
+        }
+
+        c += astrid_log_spec(c+1, &conv, &mod);
+        if(record->numargs == ASTRID_LOG_MAXARGS) break;
+
+        switch(conv) {
+            case 'd': case 'i': case 'c':
+            case 'u': case 'x': case 'X': case 'o':
+                switch(mod) {
+                    case 'L': record->args[record->numargs].i = va_arg(args, long long); break;
+                    case 'l': record->args[record->numargs].i = va_arg(args, long); break;
+                    case 'z': record->args[record->numargs].i = (long long)va_arg(args, size_t); break;
+                    case 'j': record->args[record->numargs].i = (long long)va_arg(args, intmax_t); break;
+                    case 't': record->args[record->numargs].i = va_arg(args, ptrdiff_t); break;
+                    default: 
+                        record->args[record->numargs].i = (strchr("di", conv) != NULL) ? va_arg(args, int) : (long long)va_arg(args, unsigned int);
+                        break;
+                }
+                break;
+
+            case 'f': case 'F': case 'e': case 'E':
+            case 'g': case 'G': case 'a': case 'A':
+                record->args[record->numargs].f = (mod == 'L') ? (double)va_arg(args, long double) : va_arg(args, double);
+                break;
+
+            case 's':
+                /* strings are copied into the record, truncated if need be */
+                s = va_arg(args, const char *);
+                if(s == NULL) s = "(null)";
+                len = strnlen(s, ASTRID_LOG_STRSIZE - record->strsize - 1);
+                memcpy(record->strs + record->strsize, s, len);
+                record->strs[record->strsize + len] = 0;
+                record->args[record->numargs].s = record->strsize;
+                record->strsize += len + ((record->strsize + len + 1 < ASTRID_LOG_STRSIZE) ? 1 : 0);
+                break;
+
+            case 'p':
+                record->args[record->numargs].p = va_arg(args, void *);
+                break;
+
+            default:
+                /* unsupported conversion: stop here, the rest is printed as-is */
+                goto astrid_log_write_done;
+        }
+        record->numargs += 1;
+    }
+
+astrid_log_write_done:
+    va_end(args);
+    atomic_store_explicit(&ring->head, head+1, memory_order_release);
+}
+
+static void astrid_log_format(lplogrecord_t * record, char * line, size_t size) {
+    const char * c;
+    char spec[32];
+    char conv, mod;
+    size_t pos = 0, speclen;
+    int arg = 0, written;
+
+    for(c=record->fmt; *c != 0 && pos < size-1; c++) {
+        if(*c != '%') {
+            line[pos++] = *c;
+            continue;
+        }
+
+        if(*(c+1) == '%') {
+            line[pos++] = '%';
+            c++;
+            continue;
+        }
+
+        if(arg == record->numargs) break;
+
+        /* rebuild the spec with a length modifier that matches the stored arg */
+        speclen = astrid_log_spec(c+1, &conv, &mod);
+        if(speclen + 3 > sizeof(spec)) break;
+        spec[0] = '%';
+        memcpy(spec+1, c+1, speclen);
+        spec[speclen+1] = 0;
+        c += speclen;
+
+        written = 0;
+        switch(conv) {
+            case 'd': case 'i': case 'c':
+            case 'u': case 'x': case 'X': case 'o':
+                if(conv == 'c') {
+                    written = snprintf(line+pos, size-pos, "%c", (int)record->args[arg].i);
+                    break;
+                }
+                /* swap the old modifier for ll */
+                speclen = strspn(spec+1, "-+ #0123456789.") + 1;
+                spec[speclen] = 'l';
+                spec[speclen+1] = 'l';
+                spec[speclen+2] = conv;
+                spec[speclen+3] = 0;
+                if(strchr("di", conv) != NULL) {
+                    written = snprintf(line+pos, size-pos, spec, record->args[arg].i);
+                } else {
+                    written = snprintf(line+pos, size-pos, spec, (unsigned long long)record->args[arg].i);
+                }
+                break;
+
+            case 'f': case 'F': case 'e': case 'E':
+            case 'g': case 'G': case 'a': case 'A':
+                speclen = strspn(spec+1, "-+ #0123456789.") + 1;
+                spec[speclen] = conv;
+                spec[speclen+1] = 0;
+                written = snprintf(line+pos, size-pos, spec, record->args[arg].f);
+                break;
+
+            case 's':
+                written = snprintf(line+pos, size-pos, spec, record->strs + record->args[arg].s);
+                break;
+
+            case 'p':
+                written = snprintf(line+pos, size-pos, spec, record->args[arg].p);
+                break;
+        }
+
+        if(written > 0) pos += (size_t)written;
+        if(pos >= size) pos = size-1;
+        arg += 1;
+    }
+
+    /* tack on whatever was left unformatted */
+    if(*c != 0 && pos < size-1) pos += (size_t)snprintf(line+pos, size-pos, "%s", c);
+    if(pos >= size) pos = size-1;
+    line[pos] = 0;
+}
+
+static void astrid_log_drain(void) {
+    lplogring_t * ring;
+    lplogrecord_t * record;
+    char line[ASTRID_LOG_MAXLINE];
+    struct tm tm;
+    size_t head, tail, dropped;
+    int r, numrings;
+
+    numrings = atomic_load(&astrid_log_numrings);
+    if(numrings > ASTRID_LOG_MAXTHREADS) numrings = ASTRID_LOG_MAXTHREADS;
+
+    for(r=0; r < numrings; r++) {
+        ring = &astrid_log_rings[r];
+        tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while(tail != head) {
+            record = &ring->records[tail & (ASTRID_LOG_RINGSIZE-1)];
+            astrid_log_format(record, line, sizeof(line));
+            if(astrid_log_out != NULL) {
+                localtime_r(&record->time.tv_sec, &tm);
+                fprintf(astrid_log_out, "%02d:%02d:%02d.%06ld %s", tm.tm_hour, tm.tm_min, tm.tm_sec, record->time.tv_nsec / 1000, line);
+            } else {
+                syslog(record->level, "%s", line);
+            }
+            tail += 1;
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        }
+
+        if((dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed)) > 0) {
+            syslog(LOG_WARNING, "astrid log: dropped %ld records from a full ring\n", dropped);
+        }
+    }
+
+    if((dropped = atomic_exchange_explicit(&astrid_log_unclaimed_dropped, 0, memory_order_relaxed)) > 0) {
+        syslog(LOG_WARNING, "astrid log: dropped %ld records from threads that found every ring taken\n", dropped);
+    }
+
+    if(astrid_log_out != NULL) fflush(astrid_log_out);
+}
+
+static void * astrid_log_drain_thread_main(__attribute__((unused)) void * arg) {
+    while(atomic_load_explicit(&astrid_log_running, memory_order_acquire)) {
+        astrid_log_drain();
+        usleep((useconds_t)ASTRID_LOG_DRAIN_INTERVAL);
+    }
+
+    return NULL;
+}
+
+/* Starts the drain thread. Records go to syslog, or to 
+ * out instead when it isn't NULL. */
+int astrid_log_start(FILE * out) {
+    pthread_once(&astrid_log_once, astrid_log_init_once);
+    astrid_log_out = out;
+    atomic_store(&astrid_log_running, 1);
+    if(pthread_create(&astrid_log_drain_thread, NULL, astrid_log_drain_thread_main, NULL) != 0) {
+        atomic_store(&astrid_log_running, 0);
+        syslog(LOG_ERR, "astrid_log_start: Could not start drain thread. (%d) %s\n", errno, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Stops the drain thread and flushes whatever is left. Logging 
+ * after this goes straight to syslog again. */
+int astrid_log_stop(void) {
+    int ret;
+
+    if(!atomic_exchange(&astrid_log_running, 0)) return 0;
+
+    if((ret = pthread_join(astrid_log_drain_thread, NULL)) != 0) {
+        syslog(LOG_ERR, "astrid_log_stop: Could not join drain thread. (%d) %s\n", ret, strerror(ret));
+        return -1;
+    }
+
+    astrid_log_drain();
+    return 0;
+}
+
+/* sem_wait on a shared memory lock, timed into the stats page */
+static int astrid_stats_sem_wait(sem_t * sem) {
+    struct timespec start, end;
+    int ret;
+
+    if(astrid_stats_page == NULL) return sem_wait(sem);
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    ret = sem_wait(sem);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+    if(ret == 0) {
+        astrid_stats_hist_record(&astrid_stats_page->sem_wait_ns, (size_t)((end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec)));
+    }
+
+    return ret;
+}
+
+/* Process-shared mutex that survives its owner dying: 
+ * the next locker gets EOWNERDEAD, marks it consistent 
+ * and carries on. Whatever the lock guards has to be safe 
+ * to use after an interrupted critical section. */
+int astrid_robust_mutex_init(pthread_mutex_t * lock) {
+    pthread_mutexattr_t attr;
+    int err;
+
+    if((err = pthread_mutexattr_init(&attr)) != 0) return err;
+    if((err = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED)) == 0) {
+        if((err = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST)) == 0) {
+            err = pthread_mutex_init(lock, &attr);
+        }
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    return err;
+}
+
+/* Locks a robust mutex, timed into the stats page like the semaphores */
+int astrid_robust_mutex_lock(pthread_mutex_t * lock, const char * name) {
+    /* Returns 0, or 1 if the last owner died holding the lock 
+     * and whatever it guards may be half updated */
+    struct timespec start, end;
+    int err, recovered = 0;
+
+    if(astrid_stats_page != NULL) clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    err = pthread_mutex_lock(lock);
+
+    if(err == EOWNERDEAD) {
+        syslog(LOG_WARNING, "%s: the previous owner of the lock died holding it, recovering\n", name);
+        err = pthread_mutex_consistent(lock);
+        recovered = 1;
+    }
+
+    if(err != 0) {
+        syslog(LOG_ERR, "%s: Could not take the lock. (%d) %s\n", name, err, strerror(err));
+        return -1;
+    }
+
+    if(astrid_stats_page != NULL) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        astrid_stats_hist_record(&astrid_stats_page->sem_wait_ns, (size_t)((end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec)));
+    }
+
+    return recovered;
+}
+
 /* sqlite3 is pretty slow to build, so sessiondb are 
  * disabled for most astrid modules */
 #ifdef LPSESSIONDB
@@ -405,7 +814,7 @@ int lpipc_setvalue(char * path, void * value, size_t size) {
     }
 
     /* Aquire a lock on the semaphore */
-    if(sem_wait(sem) < 0) {
+    if(astrid_stats_sem_wait(sem) < 0) {
         syslog(LOG_ERR, "lpipc_setvalue failed to decrementsem %s. Error: %s\n", semname, strerror(errno));
         return -1;
     }
@@ -495,7 +904,7 @@ int lpipc_getvalue(char * path, void ** value) {
     }
 
     /* Aquire a lock on the semaphore */
-    if(sem_wait(sem) < 0) {
+    if(astrid_stats_sem_wait(sem) < 0) {
         syslog(LOG_ERR, "lpipc_setvalue failed to decrementsem %s. Error: %s\n", semname, strerror(errno));
         return -1;
     }
@@ -576,6 +985,102 @@ int lpipc_destroyvalue(char * path) {
 }
 
 
+/* BLOCK
+ * KERNELS
+ * *******/
+static inline lpv4f_t astrid_v4_select(lpv4i_t mask, lpv4f_t a, lpv4f_t b) {
+    return (lpv4f_t)(((lpv4i_t)a & mask) | ((lpv4i_t)b & ~mask));
+}
+
+/* Zero NaNs, denormals and signed zeros, keep normals and infinities */
+static inline lpv4f_t astrid_v4_sanitize(lpv4f_t v) {
+    lpv4i_t mag = (lpv4i_t)v & 0x7fffffff;
+    return (lpv4f_t)((lpv4i_t)v & ((mag >= 0x00800000) & (mag <= 0x7f800000)));
+}
+
+static inline float astrid_sanitize(float x) {
+    uint32_t bits, mag;
+    memcpy(&bits, &x, sizeof(bits));
+    mag = bits & 0x7fffffff;
+    if(mag < 0x00800000 || mag > 0x7f800000) return 0.f;
+    return x;
+}
+
+/* Flush denormal results to zero and treat denormal inputs as 
+ * zero on the calling thread. Filters and feedback paths that 
+ * decay toward silence otherwise fall into slow microcode. */
+void astrid_block_denormals_zero(void) {
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+    /* FTZ is bit 15 and DAZ bit 6 of MXCSR */
+    unsigned int csr;
+    __asm__ __volatile__("stmxcsr %0" : "=m"(csr));
+    csr |= (1 << 15) | (1 << 6);
+    __asm__ __volatile__("ldmxcsr %0" : : "m"(csr));
+#elif defined(__aarch64__)
+    /* FZ is bit 24 of FPCR and covers inputs too */
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr |= (1 << 24);
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#elif defined(__arm__) && defined(__ARM_FP)
+    uint32_t fpscr;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+    fpscr |= (1 << 24);
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+#endif
+}
+
+void astrid_block_sanitize(float * block, size_t nframes) {
+    size_t i = 0;
+
+    for(; i + ASTRID_BLOCK_LANES <= nframes; i += ASTRID_BLOCK_LANES) {
+        *(lpv4fu_t *)(block + i) = astrid_v4_sanitize(*(lpv4fu_t *)(block + i));
+    }
+
+    for(; i < nframes; i++) {
+        block[i] = astrid_sanitize(block[i]);
+    }
+}
+
+/* NaNs pass through, sanitize first */
+void astrid_block_clamp(float * block, size_t nframes, float low, float high) {
+    lpv4f_t v, lo = {low, low, low, low}, hi = {high, high, high, high};
+    size_t i = 0;
+
+    for(; i + ASTRID_BLOCK_LANES <= nframes; i += ASTRID_BLOCK_LANES) {
+        v = *(lpv4fu_t *)(block + i);
+        v = astrid_v4_select(v < lo, lo, v);
+        v = astrid_v4_select(v > hi, hi, v);
+        *(lpv4fu_t *)(block + i) = v;
+    }
+
+    for(; i < nframes; i++) {
+        if(block[i] < low) block[i] = low;
+        if(block[i] > high) block[i] = high;
+    }
+}
+
+/* Copy channel blocks into interleaved frames, dropping NaNs 
+ * and denormals on the way */
+void astrid_block_interleave(float ** channels_in, int channels, size_t nframes, lpfloat_t * out) {
+    lpv4f_t v;
+    size_t i;
+    int c, k;
+
+    for(c=0; c < channels; c++) {
+        for(i=0; i + ASTRID_BLOCK_LANES <= nframes; i += ASTRID_BLOCK_LANES) {
+            v = astrid_v4_sanitize(*(lpv4fu_t *)(channels_in[c] + i));
+            for(k=0; k < ASTRID_BLOCK_LANES; k++) {
+                out[(i + k) * channels + c] = (lpfloat_t)v[k];
+            }
+        }
+
+        for(; i < nframes; i++) {
+            out[i * channels + c] = (lpfloat_t)astrid_sanitize(channels_in[c][i]);
+        }
+    }
+}
+
 /* SHARED MEMORY
  * BUFFER TOOLS
  * ************/
@@ -606,7 +1111,7 @@ lpbuffer_t * lpsampler_create(char * name, double length_in_seconds, int channel
     }
 
     /* Aquire a lock on the semaphore */
-    if(sem_wait(sem) < 0) {
+    if(astrid_stats_sem_wait(sem) < 0) {
         syslog(LOG_ERR, "lpsampler_create failed to lock %s sem. Error: %s\n", path, strerror(errno));
         return NULL;
     }
@@ -665,7 +1170,7 @@ lpbuffer_t * lpsampler_aquire_and_map(char * name) {
     }
 
     /* Aquire a lock on the semaphore */
-    if(sem_wait(sem) < 0) {
+    if(astrid_stats_sem_wait(sem) < 0) {
         syslog(LOG_ERR, "lpsampler_aquire_and_map failed to decrementsem %s. Error: %s\n", path, strerror(errno));
         return NULL;
     }
@@ -712,7 +1217,7 @@ int lpsampler_aquire(char * name) {
     }
 
     /* Aquire a lock on the semaphore */
-    if(sem_wait(sem) < 0) {
+    if(astrid_stats_sem_wait(sem) < 0) {
         syslog(LOG_ERR, "lpsampler_aquire failed to decrementsem %s. Error: %s\n", path, strerror(errno));
         return -1;
     }
@@ -828,32 +1333,34 @@ int lpsampler_write_ringbuffer_block(
         int channels, 
         size_t blocksize_in_frames
     ) {
-    size_t insert_pos, i, boundry;
+    float * wrapped[channels];
+    size_t head;
     int c;
-    float * channelp;
-    float sample = 0;
     char path[PATH_MAX] = {0};
 
     lpsampler_get_path(name, path);
 
+    /* A block longer than the ring would write past its end */
+    if(buf->channels != channels || blocksize_in_frames > buf->length) {
+        astrid_log(LOG_ERR, "lpsampler_write_ringbuffer_block: %d channel block of %ld frames doesn't fit the %d channel ring of %ld frames\n", channels, blocksize_in_frames, buf->channels, buf->length);
+        errno = EINVAL;
+        return -1;
+    }
+
     /* Aquire a lock on the buffer */
     if(lpsampler_aquire(name) < 0) {
         syslog(LOG_ERR, "lpsampler_write_ringbuffer_block: Could not aquire ADC buffer shm for update\n");
         return -1;
     }
 
-    assert(buf->channels == channels);
-
-    boundry = buf->length * channels;
+    /* Copy the block up to the end of the ring, then the rest from the start */
+    head = buf->length - buf->pos;
+    if(head > blocksize_in_frames) head = blocksize_in_frames;
+    astrid_block_interleave(block, channels, head, buf->data + buf->pos * channels);
 
-    /* Copy the block */
-    for(c=0; c < channels; c++) {
-        channelp = block[c];
-        for(i=0; i < blocksize_in_frames; i++) {
-            insert_pos = ((buf->pos+i) * channels + c) % boundry;
-            sample = *channelp++;
-            buf->data[insert_pos] = lpfilternan(sample);
-        }
+    if(head < blocksize_in_frames) {
+        for(c=0; c < channels; c++) wrapped[c] = block[c] + head;
+        astrid_block_interleave(wrapped, channels, blocksize_in_frames - head, buf->data);
     }
 
     /* Increment the write position */
@@ -919,320 +1426,447 @@ int lpsampler_read_ringbuffer_block(
 }
 
 
-/* MIDI STATUS IPC
+/* MIDI & SERIAL STATUS IPC
  * GETTERS & SETTERS
  * ****************/
-int lpmidi_setcc(int device_id, int cc, int value) {
-    char * cc_path;
-    size_t path_length;
+static lpctltable_t * _Atomic astrid_ctltables[ASTRID_CTL_MAXDEVICES];
+static pthread_mutex_t astrid_ctltables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void * astrid_device_table_map(const char * name_format, int device_id, size_t size) {
+    /* Maps a per device table, creating it if needed. 
+     * A new segment comes up zeroed. */
+    char path[NAME_MAX] = {0};
+    void * table;
+    int fd;
+
+    snprintf(path, NAME_MAX, name_format, device_id);
+    if((fd = shm_open(path, O_CREAT | O_RDWR, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "astrid_device_table_map shm_open: (%d) %s\n", errno, strerror(errno));
+        return NULL;
+    }
+
+    if(ftruncate(fd, size) < 0) {
+        syslog(LOG_ERR, "astrid_device_table_map ftruncate: (%d) %s\n", errno, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(table == MAP_FAILED) {
+        syslog(LOG_ERR, "astrid_device_table_map mmap: (%d) %s\n", errno, strerror(errno));
+        return NULL;
+    }
+
+    return table;
+}
+
+lpctltable_t * lpctl_get_table(int device_id) {
+    /* Maps the device table on first use. Tables stay 
+     * mapped for the life of the process. */
+    lpctltable_t * table;
+
+    if(device_id < 0 || device_id >= ASTRID_CTL_MAXDEVICES) {
+        syslog(LOG_ERR, "lpctl_get_table: device id %d out of range\n", device_id);
+        return NULL;
+    }
+
+    if((table = atomic_load(&astrid_ctltables[device_id])) != NULL) return table;
 
-    path_length = snprintf(NULL, 0, ASTRID_MIDI_CCBASE_PATH, device_id, cc) + 1;
-    cc_path = (char *)calloc(1, path_length);
-    snprintf(cc_path, path_length,  ASTRID_MIDI_CCBASE_PATH, device_id, cc);
+    pthread_mutex_lock(&astrid_ctltables_lock);
+    if((table = atomic_load(&astrid_ctltables[device_id])) == NULL) {
+        /* every ctl in a new table reads 0, never set */
+        table = (lpctltable_t *)astrid_device_table_map(ASTRID_CTLTABLE_NAME, device_id, sizeof(lpctltable_t));
+        atomic_store(&astrid_ctltables[device_id], table);
+    }
+    pthread_mutex_unlock(&astrid_ctltables_lock);
+
+    return table;
+}
+
+static long long lpctl_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now); /* the scheduler clock */
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static double lpctl_time_to_seconds(long long t) {
+    return t * 1e-9;
+}
 
-    if(lpipc_setid(cc_path, value) < 0) {
+int lpmidi_setcc(int device_id, int cc, int value) {
+    lpctltable_t * table;
+
+    if(cc < 0 || cc >= ASTRID_CTL_NUMCCS || (table = lpctl_get_table(device_id)) == NULL) {
         syslog(LOG_ERR, "Could not store %d for MIDI CC %d from device %d\n", value, cc, device_id);
         return -1;
     }
 
-    free(cc_path);
+    atomic_store(&table->ccs[cc], value);
+    atomic_store(&table->cc_times[cc], lpctl_now());
 
     return 0;
 }
 
 int lpmidi_getcc(int device_id, int cc) {
-    char cc_path[50];
-    size_t path_length;
+    lpctltable_t * table;
 
-    path_length = snprintf(NULL, 0, ASTRID_MIDI_CCBASE_PATH, device_id, cc) + 1;
-    snprintf(cc_path, path_length,  ASTRID_MIDI_CCBASE_PATH, device_id, cc);
+    if(cc < 0 || cc >= ASTRID_CTL_NUMCCS || (table = lpctl_get_table(device_id)) == NULL) return -1;
 
-    return lpipc_getid(cc_path);
+    return atomic_load(&table->ccs[cc]);
 }
 
 int lpmidi_setnote(int device_id, int note, int velocity) {
-    char * note_path;
-    size_t path_length;
+    lpctltable_t * table;
 
-    path_length = snprintf(NULL, 0, ASTRID_MIDI_NOTEBASE_PATH, device_id, note) + 1;
-    note_path = (char *)calloc(1, path_length);
-    snprintf(note_path, path_length,  ASTRID_MIDI_NOTEBASE_PATH, device_id, note);
-
-    if(lpipc_setid(note_path, velocity) < 0) {
+    if(note < 0 || note >= ASTRID_CTL_NUMNOTES || (table = lpctl_get_table(device_id)) == NULL) {
         syslog(LOG_ERR, "Could not store velocity %d for MIDI note %d from device %d\n", velocity, note, device_id);
         return -1;
     }
 
-    free(note_path);
+    atomic_store(&table->notes[note], velocity);
+    atomic_store(&table->note_times[note], lpctl_now());
 
     return 0;
 }
 
 int lpmidi_getnote(int device_id, int note) {
-    char * note_path;
-    size_t path_length;
+    lpctltable_t * table;
 
-    path_length = snprintf(NULL, 0, ASTRID_MIDI_NOTEBASE_PATH, device_id, note) + 1;
-    note_path = (char *)calloc(1, path_length);
-    snprintf(note_path, path_length,  ASTRID_MIDI_NOTEBASE_PATH, device_id, note);
+    if(note < 0 || note >= ASTRID_CTL_NUMNOTES || (table = lpctl_get_table(device_id)) == NULL) return -1;
 
-    return lpipc_getid(note_path);
+    return atomic_load(&table->notes[note]);
 }
 
-
-/* SERIAL STATUS IPC
- * GETTERS & SETTERS
- * ****************/
 int lpserial_setctl(int device_id, int param_id, size_t value) {
-    char * ctl_path;
-    size_t path_length;
+    lpctltable_t * table;
 
-    path_length = snprintf(NULL, 0, ASTRID_SERIAL_CTLBASE_PATH, device_id, param_id) + 1;
-    ctl_path = (char *)calloc(1, path_length);
-    snprintf(ctl_path, path_length,  ASTRID_SERIAL_CTLBASE_PATH, device_id, param_id);
-
-    if(lpipc_setvalue(ctl_path, &value, sizeof(size_t)) < 0) {
-        syslog(LOG_ERR, "Could not store %ld for MIDI CC %d from device %d\n", value, param_id, device_id);
+    if(param_id < 0 || param_id >= ASTRID_CTL_NUMSERIAL || (table = lpctl_get_table(device_id)) == NULL) {
+        syslog(LOG_ERR, "Could not store %ld for serial ctl %d from device %d\n", value, param_id, device_id);
         return -1;
     }
 
-    free(ctl_path);
+    atomic_store(&table->serial[param_id], value);
+    atomic_store(&table->serial_times[param_id], lpctl_now());
 
     return 0;
 }
 
 int lpserial_getctl(int device_id, int ctl, lpfloat_t * value) {
-    char ctl_path[50];
-    size_t path_length;
-    size_t ctl_value = 0;
-    void * ctl_valuep = &ctl_value;
+    lpctltable_t * table;
 
-    path_length = snprintf(NULL, 0, ASTRID_SERIAL_CTLBASE_PATH, device_id, ctl) + 1;
-    snprintf(ctl_path, path_length,  ASTRID_SERIAL_CTLBASE_PATH, device_id, ctl);
+    if(ctl < 0 || ctl >= ASTRID_CTL_NUMSERIAL || (table = lpctl_get_table(device_id)) == NULL) return -1;
 
-    if(lpipc_getvalue(ctl_path, &ctl_valuep)) {
-        return -1;        
-    }
+    /* Ctls that were never set have no value */
+    if(atomic_load(&table->serial_times[ctl]) == 0) return -1;
 
-    *value = (lpfloat_t)ctl_value / (lpfloat_t)SIZE_MAX;
+    *value = (lpfloat_t)atomic_load(&table->serial[ctl]) / (lpfloat_t)SIZE_MAX;
 
     return 0;
 }
 
+double lpmidi_getcc_time(int device_id, int cc) {
+    lpctltable_t * table;
+    if(cc < 0 || cc >= ASTRID_CTL_NUMCCS || (table = lpctl_get_table(device_id)) == NULL) return 0;
+    return lpctl_time_to_seconds(atomic_load(&table->cc_times[cc]));
+}
+
+double lpmidi_getnote_time(int device_id, int note) {
+    lpctltable_t * table;
+    if(note < 0 || note >= ASTRID_CTL_NUMNOTES || (table = lpctl_get_table(device_id)) == NULL) return 0;
+    return lpctl_time_to_seconds(atomic_load(&table->note_times[note]));
+}
+
+double lpserial_getctl_time(int device_id, int ctl) {
+    lpctltable_t * table;
+    if(ctl < 0 || ctl >= ASTRID_CTL_NUMSERIAL || (table = lpctl_get_table(device_id)) == NULL) return 0;
+    return lpctl_time_to_seconds(atomic_load(&table->serial_times[ctl]));
+}
+
 
 /* MIDI trigger maps for noteon 
  * (and eventually cc triggers)
  * ***************************/
+static lpnotemap_t * _Atomic astrid_notemaps[ASTRID_CTL_MAXDEVICES];
 
-int lpmidi_add_msg_to_notemap(int device_id, int note, lpmsg_t msg) {
-    int fd, bytes_written;
-    size_t notemap_path_length;
-    char * notemap_path;
+static void lpnotemap_write_entry(lpnotemapentry_t * entry, lpmsg_t * msg) {
+    /* Callers hold the note lock. A NULL msg removes the entry. */
+    atomic_fetch_add(&entry->seq, 1);
+    if(msg != NULL) memcpy(&entry->msg, msg, sizeof(lpmsg_t));
+    atomic_store(&entry->active, msg != NULL);
+    atomic_fetch_add(&entry->seq, 1);
+}
 
-    notemap_path_length = snprintf(NULL, 0, ASTRID_MIDIMAP_NOTEBASE_PATH, device_id, note) + 1;
-    notemap_path = (char *)calloc(1, notemap_path_length);
-    snprintf(notemap_path, notemap_path_length, ASTRID_MIDIMAP_NOTEBASE_PATH, device_id, note);
+static int lpnotemap_read_entry(lpnotemapentry_t * entry, lpmsg_t * msg) {
+    /* Copies out an active entry, returns 0 if it's been removed 
+     * or -1 if a writer held it for ASTRID_NOTEMAP_READ_SPINS tries */
+    unsigned int seq;
+    int spins, active;
 
-    if((fd = open(notemap_path, O_RDWR | O_CREAT | O_APPEND, LPIPC_PERMS)) < 0) {
-        syslog(LOG_ERR, "Could not open file for appending. Error: %s\n", strerror(errno));
-        return -1;
+    for(spins=0; spins < ASTRID_NOTEMAP_READ_SPINS; spins++) {
+        if((seq = atomic_load(&entry->seq)) & 1) continue;
+        active = atomic_load(&entry->active);
+        if(active) memcpy(msg, &entry->msg, sizeof(lpmsg_t));
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load(&entry->seq) == seq) return active;
     }
 
-    if((bytes_written = write(fd, &msg, sizeof(lpmsg_t))) < 0) {
-        syslog(LOG_ERR, "Could not append msg to file. Error: %s\n", strerror(errno));
-        return -1;
+    return -1;
+}
+
+static int lpnotemap_lock(lpnotemap_t * notemap) {
+    int note, map_index, ret;
+    lpnotemapentry_t * entry;
+
+    if((ret = astrid_robust_mutex_lock(&notemap->lock, "notemap")) <= 0) return ret;
+
+    /* The last owner died mid write: drop the entries it left half done */
+    for(note=0; note < ASTRID_CTL_NUMNOTES; note++) {
+        for(map_index=0; map_index < ASTRID_NOTEMAP_MAXMSGS; map_index++) {
+            entry = &notemap->entries[note][map_index];
+            if(!(atomic_load(&entry->seq) & 1)) continue;
+            atomic_store(&entry->active, 0);
+            atomic_fetch_add(&entry->seq, 1);
+            syslog(LOG_WARNING, "notemap: removed entry %d for note %d left half written\n", map_index, note);
+        }
     }
 
-    if(bytes_written != sizeof(lpmsg_t)) {
-        syslog(LOG_ERR, "Wrote incorrect number of bytes to notemap. Expected %d, wrote %d\n", (int)sizeof(lpmsg_t), bytes_written);
+    return 0;
+}
+
+static void lpnotemap_unlock(lpnotemap_t * notemap) {
+    atomic_fetch_add(&notemap->generation, 1);
+    pthread_mutex_unlock(&notemap->lock);
+}
+
+static int lpnotemap_load(int device_id, lpnotemap_t * notemap) {
+    char path[PATH_MAX] = {0};
+    int fd, note, map_index;
+    lpmsg_t msg = {0};
+
+    snprintf(path, PATH_MAX, ASTRID_MIDIMAP_PATH, device_id);
+    if((fd = open(path, O_RDONLY)) < 0) {
+        if(errno == ENOENT) return 0;
+        syslog(LOG_ERR, "Could not open notemap file for loading. Error: %s\n", strerror(errno));
         return -1;
     }
 
+    while(read(fd, &note, sizeof(int)) == sizeof(int)
+        && read(fd, &map_index, sizeof(int)) == sizeof(int)
+        && read(fd, &msg, sizeof(lpmsg_t)) == sizeof(lpmsg_t)
+    ) {
+        if(note < 0 || note >= ASTRID_CTL_NUMNOTES || map_index < 0 || map_index >= ASTRID_NOTEMAP_MAXMSGS) continue;
+        lpnotemap_write_entry(&notemap->entries[note][map_index], &msg);
+        if(map_index >= atomic_load(&notemap->counts[note])) atomic_store(&notemap->counts[note], map_index+1);
+    }
+
     if(close(fd) < 0) {
-        syslog(LOG_ERR, "Could not close notemap file after writing. Error: %s\n", strerror(errno));
+        syslog(LOG_ERR, "Could not close notemap file after loading. Error: %s\n", strerror(errno));
         return -1;
     }
 
-    free(notemap_path);
-
     return 0;
 }
 
-int lpmidi_remove_msg_from_notemap(int device_id, int note, int index_to_remove) {
-    int fd, bytes_read, bytes_written, map_index;
-    struct stat statbuf;
-    size_t notemap_path_length, notemap_size, read_pos;
-    char * notemap_path;
-    lpmsg_t msg = {0};
-
-    notemap_path_length = snprintf(NULL, 0, ASTRID_MIDIMAP_NOTEBASE_PATH, device_id, note) + 1;
-    notemap_path = (char *)calloc(1, notemap_path_length);
-    snprintf(notemap_path, notemap_path_length, ASTRID_MIDIMAP_NOTEBASE_PATH, device_id, note);
+lpnotemap_t * lpmidi_get_notemap(int device_id) {
+    /* Maps the device notemap on first use, loading the 
+     * persisted copy if this is the first process to map it */
+    lpnotemap_t * notemap;
+    int expected = 0, waited = 0;
 
-    if((fd = open(notemap_path, O_RDWR)) < 0) {
-        syslog(LOG_ERR, "Could not open file for printing. Error: %s\n", strerror(errno));
-        return -1;
+    if(device_id < 0 || device_id >= ASTRID_CTL_MAXDEVICES) {
+        syslog(LOG_ERR, "lpmidi_get_notemap: device id %d out of range\n", device_id);
+        return NULL;
     }
 
-    if(fstat(fd, &statbuf) < 0) {
-        syslog(LOG_ERR, "Could not stat notemap file. Error: %s\n", strerror(errno));
-        return -1;
-    }
+    if((notemap = atomic_load(&astrid_notemaps[device_id])) != NULL) return notemap;
 
-    notemap_size = statbuf.st_size;
-    map_index = 0;
-    for(read_pos=0; read_pos < notemap_size; read_pos += sizeof(lpmsg_t)) {
-        if((bytes_read = read(fd, &msg, sizeof(lpmsg_t))) < 0) {
-            syslog(LOG_ERR, "Could not read msg from file during removal walk. Error: %s\n", strerror(errno));
-            return -1;
+    pthread_mutex_lock(&astrid_ctltables_lock);
+    if((notemap = atomic_load(&astrid_notemaps[device_id])) == NULL) {
+        notemap = (lpnotemap_t *)astrid_device_table_map(ASTRID_NOTEMAP_NAME, device_id, sizeof(lpnotemap_t));
+        if(notemap != NULL && atomic_compare_exchange_strong(&notemap->loaded, &expected, 1)) {
+            astrid_robust_mutex_init(&notemap->lock);
+            lpnotemap_load(device_id, notemap);
+            atomic_store(&notemap->saved, atomic_load(&notemap->generation));
+            atomic_store(&notemap->loaded, 2);
         }
 
-        if(map_index == index_to_remove) {
-            msg.type = LPMSG_EMPTY;
+        /* Another process is still setting it up */
+        while(notemap != NULL && atomic_load(&notemap->loaded) != 2 && waited++ < 1000) usleep(1000);
+        if(notemap != NULL && atomic_load(&notemap->loaded) != 2) {
+            syslog(LOG_WARNING, "lpmidi_get_notemap: notemap for device %d was never finished loading, using it anyway\n", device_id);
+        }
 
-            if(lseek(fd, read_pos, SEEK_SET) < 0) {
-                syslog(LOG_ERR, "Could not rewind midimap to remove msg from file. Error: %s\n", strerror(errno));
-                return -1;
-            }
+        atomic_store(&astrid_notemaps[device_id], notemap);
+    }
+    pthread_mutex_unlock(&astrid_ctltables_lock);
 
-            if((bytes_written = write(fd, &msg, sizeof(lpmsg_t))) < 0) {
-                syslog(LOG_ERR, "Could not remove msg from file. Error: %s\n", strerror(errno));
-                return -1;
-            }
-        }
+    return notemap;
+}
+
+int lpmidi_add_msg_to_notemap(int device_id, int note, lpmsg_t msg) {
+    lpnotemap_t * notemap;
+    int map_index, count;
 
-        map_index += 1;
+    if(note < 0 || note >= ASTRID_CTL_NUMNOTES || (notemap = lpmidi_get_notemap(device_id)) == NULL) {
+        syslog(LOG_ERR, "Could not add msg to notemap for note %d on device %d\n", note, device_id);
+        return -1;
     }
 
-    if(close(fd) < 0) {
-        syslog(LOG_ERR, "Could not close notemap file after msg removal. Error: %s\n", strerror(errno));
+    if(lpnotemap_lock(notemap) < 0) return -1;
+
+    /* Reuse the first removed entry */
+    count = atomic_load(&notemap->counts[note]);
+    for(map_index=0; map_index < count; map_index++) {
+        if(!atomic_load(&notemap->entries[note][map_index].active)) break;
+    }
+
+    if(map_index >= ASTRID_NOTEMAP_MAXMSGS) {
+        lpnotemap_unlock(notemap);
+        syslog(LOG_ERR, "Notemap for note %d on device %d is full\n", note, device_id);
         return -1;
     }
 
-    free(notemap_path);
+    lpnotemap_write_entry(&notemap->entries[note][map_index], &msg);
+    if(map_index >= count) atomic_store(&notemap->counts[note], map_index+1);
+
+    lpnotemap_unlock(notemap);
 
     return 0;
 }
 
-int lpmidi_print_notemap(int device_id, int note) {
-    int fd, bytes_read, map_index;
-    struct stat statbuf;
-    size_t notemap_path_length, notemap_size, read_pos;
-    char * notemap_path;
-    lpmsg_t msg = {0};
-
-    notemap_path_length = snprintf(NULL, 0, ASTRID_MIDIMAP_NOTEBASE_PATH, device_id, note) + 1;
-    notemap_path = (char *)calloc(1, notemap_path_length);
-    snprintf(notemap_path, notemap_path_length, ASTRID_MIDIMAP_NOTEBASE_PATH, device_id, note);
+int lpmidi_remove_msg_from_notemap(int device_id, int note, int index_to_remove) {
+    /* A negative index removes every msg mapped to the note */
+    lpnotemap_t * notemap;
+    int map_index, count;
 
-    if((fd = open(notemap_path, O_RDONLY)) < 0) {
-        syslog(LOG_ERR, "Could not open file for printing. Error: %s\n", strerror(errno));
+    if(note < 0 || note >= ASTRID_CTL_NUMNOTES || (notemap = lpmidi_get_notemap(device_id)) == NULL) {
+        syslog(LOG_ERR, "Could not remove msg from notemap for note %d on device %d\n", note, device_id);
         return -1;
     }
 
-    if(fstat(fd, &statbuf) < 0) {
-        syslog(LOG_ERR, "Could not stat notemap file. Error: %s\n", strerror(errno));
-        return -1;
+    if(lpnotemap_lock(notemap) < 0) return -1;
+
+    count = atomic_load(&notemap->counts[note]);
+    for(map_index=0; map_index < count; map_index++) {
+        if(index_to_remove >= 0 && map_index != index_to_remove) continue;
+        lpnotemap_write_entry(&notemap->entries[note][map_index], NULL);
     }
 
-    notemap_size = statbuf.st_size;
-    map_index = 0;
-    for(read_pos=0; read_pos < notemap_size; read_pos += sizeof(lpmsg_t)) {
-        if((bytes_read = read(fd, &msg, sizeof(lpmsg_t))) < 0) {
-            syslog(LOG_ERR, "Could not read msg from file. Error: %s\n", strerror(errno));
-            return -1;
-        }
+    /* Drop trailing removed entries so triggers have less to walk */
+    while(count > 0 && !atomic_load(&notemap->entries[note][count-1].active)) count -= 1;
+    atomic_store(&notemap->counts[note], count);
 
-        printf("\nmap_index: %d\n", map_index);
-        printf("bytes_read: %d, read_pos: %ld, notemap_size: %ld\n", bytes_read, read_pos, notemap_size);
-        printf("msg.type: %d msg.initiated: %f msg.instrument_name: %s\n", msg.type, msg.initiated, msg.instrument_name);
-        if(msg.type == LPMSG_EMPTY) {
-            printf("this message is empty!\n");
-        }
+    lpnotemap_unlock(notemap);
+
+    return 0;
+}
+
+int lpmidi_save_notemap(int device_id) {
+    /* Persists the notemap if it has changed since the last save */
+    char path[PATH_MAX] = {0};
+    char tmppath[PATH_MAX] = {0};
+    lpnotemap_t * notemap;
+    unsigned int generation;
+    int fd, note, map_index, count, active;
+    lpmsg_t msg = {0};
+
+    if((notemap = lpmidi_get_notemap(device_id)) == NULL) return -1;
+
+    generation = atomic_load(&notemap->generation);
+    if(generation == atomic_load(&notemap->saved)) return 0;
 
-        map_index += 1;
+    snprintf(path, PATH_MAX, ASTRID_MIDIMAP_PATH, device_id);
+    if(snprintf(tmppath, PATH_MAX, "%s.%d", path, (int)getpid()) >= PATH_MAX) {
+        syslog(LOG_ERR, "Notemap file path is too long to save. (%s)\n", path);
+        return -1;
     }
 
-    if(close(fd) < 0) {
-        syslog(LOG_ERR, "Could not close notemap file after reading. Error: %s\n", strerror(errno));
+    if((fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "Could not open notemap file for saving. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    for(note=0; note < ASTRID_CTL_NUMNOTES; note++) {
+        count = atomic_load(&notemap->counts[note]);
+        for(map_index=0; map_index < count; map_index++) {
+            if((active = lpnotemap_read_entry(&notemap->entries[note][map_index], &msg)) == 0) continue;
+            if(active < 0) {
+                /* Try again on the next save */
+                syslog(LOG_ERR, "Could not read notemap entry %d for note %d while saving\n", map_index, note);
+                close(fd);
+                unlink(tmppath);
+                return -1;
+            }
+            if(write(fd, &note, sizeof(int)) != sizeof(int)
+                || write(fd, &map_index, sizeof(int)) != sizeof(int)
+                || write(fd, &msg, sizeof(lpmsg_t)) != sizeof(lpmsg_t)
+            ) {
+                syslog(LOG_ERR, "Could not write notemap file. Error: %s\n", strerror(errno));
+                close(fd);
+                unlink(tmppath);
+                return -1;
+            }
+        }
+    }
+
+    if(close(fd) < 0 || rename(tmppath, path) < 0) {
+        syslog(LOG_ERR, "Could not save notemap file. Error: %s\n", strerror(errno));
+        unlink(tmppath);
         return -1;
     }
 
-    free(notemap_path);
+    atomic_store(&notemap->saved, generation);
 
     return 0;
 }
 
-int lpmidi_trigger_notemap(int device_id, int note) {
-    int fd, bytes_read;
-    struct stat statbuf;
-    size_t notemap_path_length, notemap_size, read_pos;
-    char * notemap_path;
-    double now = 0;
+int lpmidi_print_notemap(int device_id, int note) {
+    lpnotemap_t * notemap;
+    int map_index, count;
     lpmsg_t msg = {0};
 
-    notemap_path_length = snprintf(NULL, 0, ASTRID_MIDIMAP_NOTEBASE_PATH, device_id, note) + 1;
-    notemap_path = (char *)calloc(1, notemap_path_length);
-    snprintf(notemap_path, notemap_path_length, ASTRID_MIDIMAP_NOTEBASE_PATH, device_id, note);
+    if(note < 0 || note >= ASTRID_CTL_NUMNOTES || (notemap = lpmidi_get_notemap(device_id)) == NULL) return -1;
 
-    if(access(notemap_path, F_OK) < 0) {
-        syslog(LOG_DEBUG, "No notemap for %s\n", notemap_path);
-        return 0;
+    count = atomic_load(&notemap->counts[note]);
+    for(map_index=0; map_index < count; map_index++) {
+        printf("\nmap_index: %d\n", map_index);
+        if(lpnotemap_read_entry(&notemap->entries[note][map_index], &msg) <= 0) {
+            printf("this message is empty!\n");
+            continue;
+        }
+        printf("msg.type: %d msg.initiated: %f msg.instrument_name: %s\n", msg.type, msg.initiated, msg.instrument_name);
     }
 
-    if((fd = open(notemap_path, O_RDWR)) < 0) {
-        syslog(LOG_ERR, "Could not open notemap file for triggering. Error: %s\n", strerror(errno));
-        return -1;
-    }
+    return 0;
+}
 
-    if(fstat(fd, &statbuf) < 0) {
-        syslog(LOG_ERR, "Could not stat notemap file for triggering. Error: %s\n", strerror(errno));
-        return -1;
-    }
+int lpmidi_trigger_notemap(int device_id, int note) {
+    lpnotemap_t * notemap;
+    int map_index, count;
+    double now = 0;
+    lpmsg_t msg = {0};
 
-    notemap_size = statbuf.st_size;
-    for(read_pos=0; read_pos < notemap_size; read_pos += sizeof(lpmsg_t)) {
-        if((bytes_read = read(fd, &msg, sizeof(lpmsg_t))) < 0) {
-            syslog(LOG_ERR, "Could not read msg from file during notemap trigger walk. Error: %s\n", strerror(errno));
-            return -1;
-        }
+    if(note < 0 || note >= ASTRID_CTL_NUMNOTES || (notemap = lpmidi_get_notemap(device_id)) == NULL) return -1;
 
+    count = atomic_load(&notemap->counts[note]);
+    for(map_index=0; map_index < count; map_index++) {
+        if(lpnotemap_read_entry(&notemap->entries[note][map_index], &msg) <= 0) continue;
         if(msg.type == LPMSG_EMPTY) continue;
 
         if(lpscheduler_get_now_seconds(&now) < 0) {
-            syslog(LOG_ERR, "Could not get now seconds during notemap trigger. Error: %s\n", strerror(errno));
+            astrid_log(LOG_ERR, "Could not get now seconds during notemap trigger. Error: %s\n", strerror(errno));
             return -1;
         }
 
         msg.initiated = now;
 
-        syslog(LOG_INFO, "Sending message from lpmidi trigger notemap\ninitiated %f\nscheduled %f\ncompleted %f\nmax_processing_time %f\nonset_delay %ld\nvoice_id %ld\ncount %ld\ntype %d\nmsg %s\nname %s\n\n", 
-            msg.initiated,
-            msg.scheduled,
-            msg.completed,
-            msg.max_processing_time,
-            msg.onset_delay,
-            msg.voice_id, 
-            msg.count,
-            msg.type,
-            msg.msg,
-            msg.instrument_name
-        );
-
-        if(send_message(msg.instrument_name, msg) < 0) {
-            syslog(LOG_ERR, "Could not schedule msg for sending during notemap trigger. Error: %s\n", strerror(errno));
+        if(send_play_message(msg) < 0) {
+            astrid_log(LOG_ERR, "Could not schedule msg for sending during notemap trigger. Error: %s\n", strerror(errno));
             return -1;
         }
-        syslog(LOG_INFO, "Sent! lpmidi trigger notemap message\n");
-    }
-
-    if(close(fd) < 0) {
-        syslog(LOG_ERR, "Could not close notemap file after triggering. Error: %s\n", strerror(errno));
-        return -1;
     }
 
-    free(notemap_path);
-
     return 0;
 }
 
@@ -1430,7 +2064,7 @@ ssize_t lpcounter_read_and_increment(char * name) {
     }
 
     // Aquire a lock on the semaphore
-    if(sem_wait(sem) < 0) {
+    if(astrid_stats_sem_wait(sem) < 0) {
         syslog(LOG_ERR, "lpipc_getvalue failed to decrement sem %s. Error: %s\n", name, strerror(errno));
         return -1;
     }
@@ -1475,45 +2109,60 @@ ssize_t lpcounter_read_and_increment(char * name) {
 /* BUFFER
  * SERIALIZATION
  * *************/
-unsigned char * serialize_buffer(lpbuffer_t * buf, lpmsg_t * msg, size_t * strsize) {
+size_t serialize_buffer_size(size_t length, int channels) {
+    size_t strsize = 0;
+    strsize += sizeof(size_t);  /* audio size in bytes */
+    strsize += sizeof(size_t);  /* audio length in frames */
+    strsize += sizeof(int);     /* channels   */
+    strsize += sizeof(int);     /* samplerate */
+    strsize += sizeof(int);     /* is_looping */
+    strsize += sizeof(size_t);  /* onset      */
+    strsize += length * channels * sizeof(lpfloat_t); /* audio data */
+    strsize += sizeof(lpmsg_t); /* message */
+    return strsize;
+}
+
+/* Writes the buffer header and returns the offset 
+ * where the audio data begins */
+size_t serialize_buffer_header(unsigned char * str, size_t length, int channels, int samplerate, int is_looping, size_t onset) {
     size_t audiosize, offset;
-    unsigned char * str;
-
-    audiosize = buf->length * buf->channels * sizeof(lpfloat_t);
-
-    *strsize =  0;
-    *strsize += sizeof(size_t);  /* audio size in bytes */
-    *strsize += sizeof(size_t);  /* audio length in frames */
-    *strsize += sizeof(int);     /* channels   */
-    *strsize += sizeof(int);     /* samplerate */
-    *strsize += sizeof(int);     /* is_looping */
-    *strsize += sizeof(size_t);  /* onset      */
-    *strsize += audiosize;       /* audio data */
-    *strsize += sizeof(lpmsg_t); /* message */
-
-    /* initialize string buffer */
-    str = (unsigned char *)calloc(1, *strsize);
 
+    audiosize = length * channels * sizeof(lpfloat_t);
     offset = 0;
 
     memcpy(str + offset, &audiosize, sizeof(size_t));
     offset += sizeof(size_t);
 
-    memcpy(str + offset, &buf->length, sizeof(size_t));
+    memcpy(str + offset, &length, sizeof(size_t));
     offset += sizeof(size_t);
 
-    memcpy(str + offset, &buf->channels, sizeof(int));
+    memcpy(str + offset, &channels, sizeof(int));
     offset += sizeof(int);
 
-    memcpy(str + offset, &buf->samplerate, sizeof(int));
+    memcpy(str + offset, &samplerate, sizeof(int));
     offset += sizeof(int);
 
-    memcpy(str + offset, &buf->is_looping, sizeof(int));
+    memcpy(str + offset, &is_looping, sizeof(int));
     offset += sizeof(int);
 
-    memcpy(str + offset, &buf->onset, sizeof(size_t));
+    memcpy(str + offset, &onset, sizeof(size_t));
     offset += sizeof(size_t);
 
+    return offset;
+}
+
+unsigned char * serialize_buffer(lpbuffer_t * buf, lpmsg_t * msg, size_t * strsize) {
+    size_t audiosize, offset;
+    unsigned char * str;
+
+    audiosize = buf->length * buf->channels * sizeof(lpfloat_t);
+    *strsize = serialize_buffer_size(buf->length, buf->channels);
+
+    /* initialize string buffer */
+    str = (unsigned char *)calloc(1, *strsize);
+
+    offset = serialize_buffer_header(str, buf->length, buf->channels, buf->samplerate, buf->is_looping, buf->onset);
+
     memcpy(str + offset, buf->data, audiosize);
     offset += audiosize;
 
@@ -1540,7 +2189,7 @@ lpbuffer_t * deserialize_buffer(char * buffer_code, lpmsg_t * msg) {
     }
 
     /* Aquire a lock on the semaphore */
-    if(sem_wait(sem) < 0) {
+    if(astrid_stats_sem_wait(sem) < 0) {
         syslog(LOG_ERR, "deserialize_buffer: failed to decrementsem %s. Error: %s\n", buffer_code, strerror(errno));
         return NULL;
     }
@@ -1655,2375 +2304,5525 @@ lpmsg_t * create_instrument_message(char * instrument_name) {
     return msg;
 }
 
-int send_play_message(lpmsg_t msg) {
-    mqd_t mqd;
-    char qname[NAME_MAX] = {0};
-    struct mq_attr attr;
+/* Interned instrument names
+ *
+ * An append-only table in shared memory: names are 
+ * written before the count is bumped, so lookups 
+ * need no lock. Only inserts take the semaphore. */
+static lpnametable_t * astrid_names = NULL;
+static pthread_once_t astrid_names_once = PTHREAD_ONCE_INIT;
 
-    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
-    attr.mq_msgsize = sizeof(lpmsg_t);
-
-    snprintf(qname, NAME_MAX, "/%s-msgq", msg.instrument_name);
+static void astrid_names_map(void) {
+    lpnametable_t * names;
+    int fd;
 
-    if((mqd = mq_open(qname, O_CREAT | O_WRONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
-        syslog(LOG_ERR, "send_play_message mq_open: Error opening message queue. Error: %s\n", strerror(errno));
-        return -1;
+    if((fd = shm_open(ASTRID_NAMES_SHMNAME, O_CREAT | O_RDWR, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "astrid_names_map: Could not open name table. Error: (%d) %s\n", errno, strerror(errno));
+        return;
     }
 
-    if(mq_send(mqd, (char *)(&msg), sizeof(lpmsg_t), 0) < 0) {
-        syslog(LOG_ERR, "send_play_message mq_send: Error allocing during message write. Error: %s\n", strerror(errno));
-        return -1;
+    if(ftruncate(fd, sizeof(lpnametable_t)) < 0) {
+        syslog(LOG_ERR, "astrid_names_map: Could not size name table. Error: (%d) %s\n", errno, strerror(errno));
+        close(fd);
+        return;
     }
 
-    if(mq_close(mqd) == -1) {
-        syslog(LOG_ERR, "send_play_message close: Error closing play queue. Error: %s\n", strerror(errno));
-        return -1; 
+    names = (lpnametable_t *)mmap(NULL, sizeof(lpnametable_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(names == MAP_FAILED) {
+        syslog(LOG_ERR, "astrid_names_map: Could not map name table. Error: (%d) %s\n", errno, strerror(errno));
+        return;
     }
 
-    return 0;
+    astrid_names = names;
 }
 
-int send_serial_message(lpmsg_t msg) {
-    /* Relays a message to the serial listener thread for a 
-     * given instrument, which will write the translated payload
-     * to the tty... only used for special solenoid trigger & 
-     * motor speed messages now... also for shutdown messages
-     * FIXME ... & probably needs some decode/encode fixes after recent changes
-     */
-    mqd_t mqd;
-    char qname[NAME_MAX] = {0};
-    struct mq_attr attr;
+static int astrid_names_find(const char * name) {
+    int i, count;
 
-    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
-    attr.mq_msgsize = sizeof(lpmsg_t);
+    count = atomic_load(&astrid_names->count);
+    for(i=0; i < count; i++) {
+        if(strncmp(astrid_names->names[i], name, LPMAXNAME) == 0) return i;
+    }
 
-    snprintf(qname, NAME_MAX, "/%s-serial-msgq", msg.instrument_name);
+    return -1;
+}
 
-    if((mqd = mq_open(qname, O_CREAT | O_WRONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
-        syslog(LOG_ERR, "send_serial_message mq_open: Error opening message queue. Error: %s\n", strerror(errno));
-        return -1;
-    }
+int astrid_names_intern(const char * name) {
+    /* Returns the id of name, adding it if it's new, 
+     * or -1 if the table is unavailable or full. */
+    sem_t * lock;
+    int id, count;
+
+    pthread_once(&astrid_names_once, astrid_names_map);
+    if(astrid_names == NULL || name[0] == '\0') return -1;
+
+    if((id = astrid_names_find(name)) >= 0) return id;
 
-    if(mq_send(mqd, (char *)(&msg), sizeof(lpmsg_t), 0) < 0) {
-        syslog(LOG_ERR, "send_serial_message mq_send: Error allocing during message write. Error: %s\n", strerror(errno));
+    if((lock = sem_open(ASTRID_NAMES_LOCK, O_CREAT, LPIPC_PERMS, 1)) == SEM_FAILED) {
+        syslog(LOG_ERR, "astrid_names_intern: Could not open name table lock. Error: (%d) %s\n", errno, strerror(errno));
         return -1;
     }
 
-    if(mq_close(mqd) == -1) {
-        syslog(LOG_ERR, "send_serial_message close: Error closing play queue. Error: %s\n", strerror(errno));
-        return -1; 
+    sem_wait(lock);
+    if((id = astrid_names_find(name)) < 0) {
+        count = atomic_load(&astrid_names->count);
+        if(count < ASTRID_MAXNAMES) {
+            strncpy(astrid_names->names[count], name, LPMAXNAME-1);
+            atomic_store(&astrid_names->count, count + 1);
+            id = count;
+        }
     }
+    sem_post(lock);
+    sem_close(lock);
 
-    return 0;
+    return id;
 }
 
+const char * astrid_names_lookup(int id) {
+    pthread_once(&astrid_names_once, astrid_names_map);
+    if(astrid_names == NULL || id < 0 || id >= atomic_load(&astrid_names->count)) return NULL;
+    return astrid_names->names[id];
+}
+
+/* Compact wire format
+ *
+ *     magic u8
+ *     type, flags, voice_id, count     varints
+ *     fields u8                        which of the below are present
+ *     initiated ... max_processing_time  doubles, 8 bytes each
+ *     onset_delay, target_frame        varints
+ *     name id + 1                      varint, or 0 then a varint length and the bytes
+ *     payload size                     varint, then the bytes
+ *
+ * Anything that won't fit in less than sizeof(lpmsg_t) 
+ * is sent as a raw lpmsg_t instead, which readers tell 
+ * apart by its size. */
+static size_t astrid_wire_put_varint(unsigned char * out, uint64_t value) {
+    size_t size = 0;
 
-int send_message(char * qname, lpmsg_t msg) {
-    mqd_t mqd;
-    struct mq_attr attr;
+    do {
+        if(out != NULL) out[size] = (unsigned char)((value & 0x7f) | ((value > 0x7f) ? 0x80 : 0));
+        value >>= 7;
+        size += 1;
+    } while(value > 0);
 
-    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
-    attr.mq_msgsize = sizeof(lpmsg_t);
+    return size;
+}
 
-    syslog(LOG_DEBUG, "Sending message type %d on queue %s\n", msg.type, qname);
+static int astrid_wire_get_varint(const unsigned char ** p, const unsigned char * end, uint64_t * value) {
+    int shift = 0;
 
-    if((mqd = mq_open(qname, O_CREAT | O_WRONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
-        syslog(LOG_ERR, "send_message mq_open: Error opening message queue. Error: %s\n", strerror(errno));
-        return -1;
+    *value = 0;
+    while(*p < end && shift < 64) {
+        *value |= (uint64_t)(**p & 0x7f) << shift;
+        if(!(*(*p)++ & 0x80)) return 0;
+        shift += 7;
     }
 
-    if(mq_send(mqd, (char *)(&msg), sizeof(lpmsg_t), 0) < 0) {
-        syslog(LOG_ERR, "send_message mq_send: Error allocing during message write. Error: %s\n", strerror(errno));
-        return -1;
-    }
+    return -1;
+}
 
-    if(mq_close(mqd) == -1) {
-        syslog(LOG_ERR, "send_message close: Error closing message relay queue. Error: %s\n", strerror(errno));
-        return -1; 
+static size_t astrid_wire_put_double(unsigned char * out, double value) {
+    if(out != NULL) memcpy(out, &value, sizeof(double));
+    return sizeof(double);
+}
+
+static size_t astrid_wire_payload_size(lpmsg_t * msg) {
+    uint16_t size;
+    size_t len;
+
+    if(msg->flags & LPFLAG_IS_ENCODED_PARAM) {
+        memcpy(&size, msg->msg, sizeof(uint16_t));
+        return sizeof(uint16_t) + size;
+    }
+
+    /* Binary payloads are kept up to their last nonzero byte */
+    len = LPMAXMSG;
+    while(len > 0 && msg->msg[len-1] == 0) len--;
+    return len;
+}
+
+size_t astrid_wire_encode(lpmsg_t * msg, unsigned char * out) {
+    /* Writes the compact encoding of msg to out (or just 
+     * measures it when out is NULL). Returns the size, or 
+     * 0 when the message has to go out as a raw lpmsg_t. */
+    size_t pos = 0, payload_size, namelen;
+    unsigned char fields = 0;
+    int name_id;
+
+    payload_size = astrid_wire_payload_size(msg);
+    if(payload_size > ASTRID_WIRE_MAXSIZE - ASTRID_WIRE_MAXHEADER) return 0;
+
+    if(msg->initiated != 0) fields |= ASTRID_WIRE_INITIATED;
+    if(msg->scheduled != 0) fields |= ASTRID_WIRE_SCHEDULED;
+    if(msg->completed != 0) fields |= ASTRID_WIRE_COMPLETED;
+    if(msg->dispatched != 0) fields |= ASTRID_WIRE_DISPATCHED;
+    if(msg->max_processing_time != 0) fields |= ASTRID_WIRE_MAX_PROCESSING_TIME;
+    if(msg->onset_delay != 0) fields |= ASTRID_WIRE_ONSET_DELAY;
+    if(msg->target_frame != 0) fields |= ASTRID_WIRE_TARGET_FRAME;
+
+    if(out != NULL) out[pos] = ASTRID_WIRE_MAGIC;
+    pos += 1;
+    pos += astrid_wire_put_varint(out ? out+pos : NULL, msg->type);
+    pos += astrid_wire_put_varint(out ? out+pos : NULL, msg->flags);
+    pos += astrid_wire_put_varint(out ? out+pos : NULL, msg->voice_id);
+    pos += astrid_wire_put_varint(out ? out+pos : NULL, msg->count);
+
+    if(out != NULL) out[pos] = fields;
+    pos += 1;
+    if(fields & ASTRID_WIRE_INITIATED) pos += astrid_wire_put_double(out ? out+pos : NULL, msg->initiated);
+    if(fields & ASTRID_WIRE_SCHEDULED) pos += astrid_wire_put_double(out ? out+pos : NULL, msg->scheduled);
+    if(fields & ASTRID_WIRE_COMPLETED) pos += astrid_wire_put_double(out ? out+pos : NULL, msg->completed);
+    if(fields & ASTRID_WIRE_DISPATCHED) pos += astrid_wire_put_double(out ? out+pos : NULL, msg->dispatched);
+    if(fields & ASTRID_WIRE_MAX_PROCESSING_TIME) pos += astrid_wire_put_double(out ? out+pos : NULL, msg->max_processing_time);
+    if(fields & ASTRID_WIRE_ONSET_DELAY) pos += astrid_wire_put_varint(out ? out+pos : NULL, msg->onset_delay);
+    if(fields & ASTRID_WIRE_TARGET_FRAME) pos += astrid_wire_put_varint(out ? out+pos : NULL, msg->target_frame);
+
+    namelen = strnlen(msg->instrument_name, LPMAXNAME);
+    if((name_id = astrid_names_intern(msg->instrument_name)) >= 0) {
+        pos += astrid_wire_put_varint(out ? out+pos : NULL, (uint64_t)name_id + 1);
+    } else {
+        pos += astrid_wire_put_varint(out ? out+pos : NULL, 0);
+        pos += astrid_wire_put_varint(out ? out+pos : NULL, namelen);
+        if(out != NULL) memcpy(out+pos, msg->instrument_name, namelen);
+        pos += namelen;
     }
 
-    /*syslog(LOG_DEBUG, "Finished sending message type %d to %s\n", msg.type, msg.instrument_name);*/
+    pos += astrid_wire_put_varint(out ? out+pos : NULL, payload_size);
+    if(out != NULL) memcpy(out+pos, msg->msg, payload_size);
+    pos += payload_size;
+
+    return pos;
+}
 
+static int astrid_wire_get_double(const unsigned char ** p, const unsigned char * end, double * value) {
+    if(end - *p < (ptrdiff_t)sizeof(double)) return -1;
+    memcpy(value, *p, sizeof(double));
+    *p += sizeof(double);
     return 0;
 }
 
-mqd_t astrid_playq_open(const char * instrument_name) {
-    mqd_t mqd;
-    ssize_t qname_length;
-    char qname[LPMAXQNAME] = {0};
-    struct mq_attr attr;
+int astrid_wire_view(const unsigned char * buf, size_t size, lpmsgview_t * view) {
+    /* Decodes the fixed fields of an encoded message and points 
+     * the view at its name and payload without copying them. */
+    const unsigned char * p = buf, * end = buf + size;
+    uint64_t value, namelen;
+    unsigned char fields;
+
+    memset(view, 0, sizeof(lpmsgview_t));
+    if(size < 2 || *p++ != ASTRID_WIRE_MAGIC) return -1;
+
+    if(astrid_wire_get_varint(&p, end, &value) < 0) return -1;
+    view->type = (uint16_t)value;
+    if(astrid_wire_get_varint(&p, end, &value) < 0) return -1;
+    view->flags = (uint16_t)value;
+    if(astrid_wire_get_varint(&p, end, &value) < 0) return -1;
+    view->voice_id = (size_t)value;
+    if(astrid_wire_get_varint(&p, end, &value) < 0) return -1;
+    view->count = (size_t)value;
+
+    if(p >= end) return -1;
+    fields = *p++;
+    if((fields & ASTRID_WIRE_INITIATED) && astrid_wire_get_double(&p, end, &view->initiated) < 0) return -1;
+    if((fields & ASTRID_WIRE_SCHEDULED) && astrid_wire_get_double(&p, end, &view->scheduled) < 0) return -1;
+    if((fields & ASTRID_WIRE_COMPLETED) && astrid_wire_get_double(&p, end, &view->completed) < 0) return -1;
+    if((fields & ASTRID_WIRE_DISPATCHED) && astrid_wire_get_double(&p, end, &view->dispatched) < 0) return -1;
+    if((fields & ASTRID_WIRE_MAX_PROCESSING_TIME) && astrid_wire_get_double(&p, end, &view->max_processing_time) < 0) return -1;
+    if(fields & ASTRID_WIRE_ONSET_DELAY) {
+        if(astrid_wire_get_varint(&p, end, &value) < 0) return -1;
+        view->onset_delay = (size_t)value;
+    }
+    if(fields & ASTRID_WIRE_TARGET_FRAME) {
+        if(astrid_wire_get_varint(&p, end, &view->target_frame) < 0) return -1;
+    }
+
+    if(astrid_wire_get_varint(&p, end, &value) < 0) return -1;
+    if(value > 0) {
+        if((view->instrument_name = astrid_names_lookup((int)(value - 1))) == NULL) return -1;
+        view->namelen = strnlen(view->instrument_name, LPMAXNAME);
+    } else {
+        if(astrid_wire_get_varint(&p, end, &namelen) < 0 || namelen > LPMAXNAME || (uint64_t)(end - p) < namelen) return -1;
+        view->instrument_name = (const char *)p;
+        view->namelen = (size_t)namelen;
+        p += namelen;
+    }
 
-    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
-    attr.mq_msgsize = sizeof(lpmsg_t);
+    if(astrid_wire_get_varint(&p, end, &value) < 0 || value > LPMAXMSG || (uint64_t)(end - p) < value) return -1;
+    view->payload = p;
+    view->payload_size = (size_t)value;
 
-    qname_length = snprintf(NULL, 0, "%s-%s", LPPLAYQ, instrument_name) + 1;
-    qname_length = (LPMAXQNAME >= qname_length) ? LPMAXQNAME : qname_length;
-    snprintf(qname, qname_length, "%s-%s", LPPLAYQ, instrument_name);
+    return 0;
+}
 
-    syslog(LOG_DEBUG, "Opening playq %s\n", qname);
-    if((mqd = mq_open(qname, O_CREAT | O_RDONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
-        syslog(LOG_ERR, "astrid_playq_open mq_open: Error opening message queue. Error: %s\n", strerror(errno));
+int astrid_wire_decode(const unsigned char * buf, size_t size, lpmsg_t * msg) {
+    lpmsgview_t view;
+
+    /* Raw messages from older senders, or too big to encode */
+    if(size == sizeof(lpmsg_t)) {
+        memcpy(msg, buf, sizeof(lpmsg_t));
+        return 0;
+    }
+
+    if(astrid_wire_view(buf, size, &view) < 0) {
+        syslog(LOG_ERR, "astrid_wire_decode: Malformed message of %ld bytes\n", size);
         return -1;
     }
 
-    syslog(LOG_DEBUG, "Opened playq mqd:%d\n", mqd);
-    return mqd;
+    memset(msg, 0, sizeof(lpmsg_t));
+    msg->initiated = view.initiated;
+    msg->scheduled = view.scheduled;
+    msg->completed = view.completed;
+    msg->dispatched = view.dispatched;
+    msg->max_processing_time = view.max_processing_time;
+    msg->onset_delay = view.onset_delay;
+    msg->target_frame = view.target_frame;
+    msg->voice_id = view.voice_id;
+    msg->count = view.count;
+    msg->flags = view.flags;
+    msg->type = view.type;
+    memcpy(msg->msg, view.payload, view.payload_size);
+    memcpy(msg->instrument_name, view.instrument_name, (view.namelen < LPMAXNAME) ? view.namelen : LPMAXNAME-1);
+
+    return 0;
 }
 
-int astrid_playq_close(mqd_t mqd) {
-    if(mq_close(mqd) == -1) {
-        syslog(LOG_ERR, "astrid_playq_close close: Error closing play queue FIFO. Error: %s\n", strerror(errno));
-        return -1; 
+/* Typed params
+ *
+ * Update messages carry their params pre-parsed when 
+ * LPFLAG_IS_ENCODED_PARAM is set: msg holds a uint16_t 
+ * byte count followed by one record per param:
+ *
+ *     key length varint, key bytes, type u8, then
+ *     LPPARAM_INT32   zigzag varint
+ *     LPPARAM_DOUBLE  8 bytes
+ *     LPPARAM_STRING  varint length, bytes
+ *     LPPARAM_NONE    nothing (a bare key) */
+static int astrid_params_format_double(char * out, size_t size, double val) {
+    /* The shortest %g form that reads back as the same double */
+    int precision, len = 0;
+
+    for(precision=1; precision <= 17; precision++) {
+        len = snprintf(out, size, "%.*g", precision, val);
+        if(strtod(out, NULL) == val) break;
     }
 
-    return 0;
+    return len;
 }
 
-int astrid_playq_read(mqd_t mqd, lpmsg_t * msg) {
-    char * msgp;
-    ssize_t read_result;
-    unsigned int msg_priority;
+static size_t astrid_params_put(unsigned char * out, char * key, char * val) {
+    /* Values are only typed when they decode back to the same 
+     * text, so things like patterns with leading zeros or hex 
+     * strings reach the update callback untouched. */
+    char * end;
+    char canonical[LPMAXMSG];
+    long vali;
+    double vald;
+    size_t pos = 0, keylen, vallen;
+    uint32_t zigzag;
 
-    msgp = (char *)msg;
+    keylen = strlen(key);
+    pos += astrid_wire_put_varint(out ? out+pos : NULL, keylen);
+    if(out != NULL) memcpy(out+pos, key, keylen);
+    pos += keylen;
 
-    if((read_result = mq_receive(mqd, msgp, sizeof(lpmsg_t), &msg_priority)) < 0) {
-        syslog(LOG_ERR, "astrid_playq_read mq_receive: Error allocing during message read. Error: %s\n", strerror(errno));
-        return -1;
+    if(val == NULL) {
+        if(out != NULL) out[pos] = LPPARAM_NONE;
+        return pos + 1;
+    }
+
+    errno = 0;
+    vali = strtol(val, &end, 10);
+    if(errno == 0 && *end == '\0' && *val != '\0' && vali >= INT32_MIN && vali <= INT32_MAX
+    && snprintf(canonical, LPMAXMSG, "%ld", vali) > 0 && strcmp(canonical, val) == 0) {
+        if(out != NULL) out[pos] = LPPARAM_INT32;
+        pos += 1;
+        zigzag = ((uint32_t)vali << 1) ^ (uint32_t)((int32_t)vali >> 31);
+        return pos + astrid_wire_put_varint(out ? out+pos : NULL, zigzag);
+    }
+
+    errno = 0;
+    vald = strtod(val, &end);
+    if(errno == 0 && *end == '\0' && *val != '\0'
+    && astrid_params_format_double(canonical, LPMAXMSG, vald) > 0 && strcmp(canonical, val) == 0) {
+        if(out != NULL) out[pos] = LPPARAM_DOUBLE;
+        pos += 1;
+        return pos + astrid_wire_put_double(out ? out+pos : NULL, vald);
+    }
+
+    vallen = strlen(val);
+    if(out != NULL) out[pos] = LPPARAM_STRING;
+    pos += 1;
+    pos += astrid_wire_put_varint(out ? out+pos : NULL, vallen);
+    if(out != NULL) memcpy(out+pos, val, vallen);
+    return pos + vallen;
+}
+
+int astrid_params_encode(lpmsg_t * msg) {
+    /* Parses the `key=value key ...` text of msg once on the 
+     * sending side into typed params. Leaves the text alone 
+     * and returns -1 if the typed version wouldn't fit. */
+    char cmdline[LPMAXMSG] = {0};
+    unsigned char params[LPMAXMSG] = {0};
+    char * paramline, * keytoken, * valtoken;
+    char * cmdline_save, * paramline_save;
+    size_t size = sizeof(uint16_t), paramsize;
+    uint16_t size16;
+
+    if(msg->flags & LPFLAG_IS_ENCODED_PARAM) return 0;
+
+    memcpy(cmdline, msg->msg, LPMAXMSG-1);
+
+    paramline = strtok_r(cmdline, " ", &cmdline_save);
+    while(paramline != NULL) {
+        keytoken = strtok_r(paramline, "=", &paramline_save);
+        if(keytoken != NULL) {
+            valtoken = strtok_r(NULL, "=", &paramline_save);
+            paramsize = astrid_params_put(NULL, keytoken, valtoken);
+            if(size + paramsize > LPMAXMSG) return -1;
+            size += astrid_params_put(params + size, keytoken, valtoken);
+        }
+        paramline = strtok_r(NULL, " ", &cmdline_save);
     }
 
+    size16 = (uint16_t)(size - sizeof(uint16_t));
+    memcpy(params, &size16, sizeof(uint16_t));
+    memset(msg->msg, 0, LPMAXMSG);
+    memcpy(msg->msg, params, size);
+    msg->flags |= LPFLAG_IS_ENCODED_PARAM;
+
     return 0;
 }
 
-mqd_t astrid_msgq_open(char * qname) {
-    mqd_t mqd;
-    struct mq_attr attr;
+int astrid_params_next(const char * params, size_t * pos, lpmsgparam_t * param) {
+    /* Reads the param at pos (start from 0) in place and advances 
+     * past it. Returns 1 for a param, 0 at the end, -1 on bad input. */
+    const unsigned char * p, * end;
+    uint64_t value;
+    uint16_t size;
 
-    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
-    attr.mq_msgsize = sizeof(lpmsg_t);
+    memcpy(&size, params, sizeof(uint16_t));
+    if(size > LPMAXMSG - sizeof(uint16_t)) return -1;
 
-    syslog(LOG_DEBUG, "Opening msgq %s\n", qname);
-    if((mqd = mq_open(qname, O_CREAT | O_RDONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
-        syslog(LOG_ERR, "astrid_playq_open mq_open: Error opening message queue. Error: %s\n", strerror(errno));
-        return (mqd_t) -1;
+    p = (const unsigned char *)params + sizeof(uint16_t) + *pos;
+    end = (const unsigned char *)params + sizeof(uint16_t) + size;
+    if(p >= end) return 0;
+
+    memset(param, 0, sizeof(lpmsgparam_t));
+    if(astrid_wire_get_varint(&p, end, &value) < 0 || (uint64_t)(end - p) < value + 1) return -1;
+    param->key = (const char *)p;
+    param->keylen = (size_t)value;
+    p += value;
+    param->type = *p++;
+
+    switch(param->type) {
+        case LPPARAM_NONE:
+            break;
+
+        case LPPARAM_INT32:
+            if(astrid_wire_get_varint(&p, end, &value) < 0) return -1;
+            param->i = (int32_t)((uint32_t)(value >> 1) ^ -(uint32_t)(value & 1));
+            break;
+
+        case LPPARAM_DOUBLE:
+            if(astrid_wire_get_double(&p, end, &param->d) < 0) return -1;
+            break;
+
+        case LPPARAM_STRING:
+            if(astrid_wire_get_varint(&p, end, &value) < 0 || (uint64_t)(end - p) < value) return -1;
+            param->s = (const char *)p;
+            param->slen = (size_t)value;
+            p += value;
+            break;
+
+        default:
+            return -1;
     }
 
-    syslog(LOG_DEBUG, "Opened msgq mqd:%d\n", mqd);
-    return mqd;
+    *pos = (size_t)(p - ((const unsigned char *)params + sizeof(uint16_t)));
+    return 1;
 }
 
-int astrid_msgq_close(mqd_t mqd) {
-    if(mq_close(mqd) == -1) {
-        syslog(LOG_ERR, "astrid_msgq_close close: Error closing msg queue FIFO. Error: %s\n", strerror(errno));
-        return -1; 
+static int astrid_msgring_names(char * qname, char * shmname, char * doorbellpath) {
+    /* Queue names near NAME_MAX leave no room for the suffix */
+    if(snprintf(shmname, NAME_MAX, "%s-ring", qname) >= NAME_MAX
+    || snprintf(doorbellpath, PATH_MAX, ASTRID_MSGRING_DOORBELL_PATH, qname + (qname[0] == '/')) >= PATH_MAX) {
+        syslog(LOG_ERR, "astrid_msgring_names: Queue name %s is too long for a message ring\n", qname);
+        return -1;
     }
-
     return 0;
 }
 
-int astrid_msgq_read(mqd_t mqd, lpmsg_t * msg) {
-    char * msgp;
-    ssize_t read_result;
-    unsigned int msg_priority = 0;
-
-    syslog(LOG_DEBUG, "Reading from msgq mqd:%d\n", mqd);
-    syslog(LOG_DEBUG, "Reading from msg.instrument_name:%s\n", msg->instrument_name);
-    msgp = (char *)msg;
+static uint32_t astrid_msgrecord_size(lpmsg_t * msg, uint32_t * length) {
+    size_t size;
 
-    if((read_result = mq_receive(mqd, msgp, sizeof(lpmsg_t), &msg_priority)) < 0) {
-        syslog(LOG_ERR, "astrid_msgq_read mq_receive: Error reading message. (Got %ld bytes) Error: %s\n", read_result, strerror(errno));
-        return -1;
+    if((*length = (uint32_t)astrid_wire_encode(msg, NULL)) == 0) {
+        *length = sizeof(lpmsg_t);
     }
 
-    syslog(LOG_DEBUG, "msg.msg is now:%s\n", msg->msg);
-
-    return 0;
+    size = sizeof(lpmsgrecord_t) + *length;
+    size = (size + ASTRID_MSGRING_ALIGN - 1) & ~((size_t)ASTRID_MSGRING_ALIGN - 1);
+    return (uint32_t)size;
 }
 
-int astrid_get_playback_device_id() {
-    int device_id;
+static size_t astrid_msgring_reserve(lpmsgring_t * ring, size_t size) {
+    /* Gives up when the reader is gone, or hasn't made 
+     * room after ASTRID_MSGRING_FULL_TRIES waits */
+    size_t head, tail, pad;
+    lpmsgrecord_t * padding;
+    int tries = 0;
 
-    /* If the default device isn't set, then 
-     * set it to zero and return the ID */
-    if(access(ASTRID_DEVICEID_PATH, F_OK) < 0) {
-        if(lpipc_setid(ASTRID_DEVICEID_PATH, 0) < 0) {
-            syslog(LOG_ERR, "Could not set default device ID to 0. Error: (%d) %s\n", errno, strerror(errno));
-            return -1;
+    head = atomic_load(&ring->reserve);
+    while(1) {
+        /* A batch never wraps: pad out the end of the ring instead */
+        pad = ring->capacity - (head & (ring->capacity-1));
+        if(pad >= size) pad = 0;
+
+        tail = atomic_load(&ring->tail);
+        if(head + pad + size - tail > ring->capacity) {
+            if(!atomic_load(&ring->is_open) || tries++ >= ASTRID_MSGRING_FULL_TRIES) return (size_t)-1;
+            usleep((useconds_t)ASTRID_MSGRING_FULL_WAIT);
+            head = atomic_load(&ring->reserve);
+            continue;
         }
 
-        return 0;
+        if(atomic_compare_exchange_weak(&ring->reserve, &head, head + pad + size)) break;
     }
 
-    /* Otherwise look up the ID */
-    if((device_id = lpipc_getid(ASTRID_DEVICEID_PATH)) < 0) {
-        syslog(LOG_ERR, "Could not get current device ID. Error: (%d) %s\n", errno, strerror(errno));
-        return -1;
+    if(pad > 0) {
+        padding = (lpmsgrecord_t *)(ring->data + (head & (ring->capacity-1)));
+        padding->size = (uint32_t)pad;
+        atomic_store(&padding->flags, ASTRID_MSGRECORD_COMMITTED | ASTRID_MSGRECORD_PADDING);
     }
 
-    return device_id;
+    return head + pad;
 }
 
-/* TODO set these per-process and per-device */
-int astrid_get_capture_device_id() {
-    return astrid_get_playback_device_id();
-}
+/* Returns how many of the messages made it onto the ring, 
+ * which is short of count if the ring was closed or stayed full */
+static int astrid_msgring_write(lpmsgring_t * ring, int doorbell, lpmsg_t * msgs, int count) {
+    size_t pos, total;
+    uint32_t recsize, length;
+    lpmsgrecord_t * rec;
+    unsigned char * p;
+    int i, first;
+    char c = 1;
 
-int extract_int32_from_token(char * token, int32_t * val) {
-    char * end;
-    long result = 0;
+    first = 0;
+    while(first < count) {
+        /* Claim the largest run of messages that fits in a 
+         * quarter of the ring, so big batches can't starve it */
+        total = 0;
+        for(i=first; i < count; i++) {
+            recsize = astrid_msgrecord_size(&msgs[i], &length);
+            if(i > first && total + recsize > ring->capacity / 4) break;
+            total += recsize;
+        }
 
-    errno = 0;
-    result = strtol(token, &end, 0);
+        if((pos = astrid_msgring_reserve(ring, total)) == (size_t)-1) break;
 
-    if(errno != 0) return -1;
-    if(*end != '\0') return -1;
+        for(; first < i; first++) {
+            recsize = astrid_msgrecord_size(&msgs[first], &length);
+            rec = (lpmsgrecord_t *)(ring->data + (pos & (ring->capacity-1)));
+            rec->size = recsize;
+            rec->length = length;
 
-    if(result > INT_MAX) result = INT_MAX;
+            p = (unsigned char *)rec + sizeof(lpmsgrecord_t);
+            if(length == sizeof(lpmsg_t)) {
+                memcpy(p, &msgs[first], sizeof(lpmsg_t));
+            } else {
+                astrid_wire_encode(&msgs[first], p);
+            }
 
-    *val = (int32_t)result;
-    return 0;
+            atomic_store(&rec->flags, ASTRID_MSGRECORD_COMMITTED);
+            pos += recsize;
+        }
+    }
+
+    /* Ring the doorbell once for the whole batch if the reader sleeps. 
+     * A full FIFO means it has already been rung. */
+    if(first > 0 && atomic_exchange(&ring->waiting, 0)) {
+        if(write(doorbell, &c, 1) < 0 && errno != EAGAIN) {
+            syslog(LOG_ERR, "astrid_msgring_write: Could not ring the doorbell. Error: (%d) %s\n", errno, strerror(errno));
+        }
+    }
+
+    return first;
 }
 
-int extract_float_from_token(char * token, float * val) {
-    char * end;
-    float result = 0;
+/* Rings this process sends to, opened on first use. 
+ * The table lock only covers lookups: writers hold a 
+ * use count instead so a full ring can't stall other sends. */
+typedef struct lpmsgring_handle_t {
+    char name[NAME_MAX];
+    lpmsgring_t * ring;
+    int doorbell;
+    int users;
+} lpmsgring_handle_t;
 
-    errno = 0;
-    result = strtof(token, &end);
+static lpmsgring_handle_t astrid_msgring_handles[ASTRID_MSGRING_MAXHANDLES];
+static int astrid_msgring_numhandles = 0;
+static pthread_mutex_t astrid_msgring_handles_lock = PTHREAD_MUTEX_INITIALIZER;
 
-    if(errno != 0) return -1;
-    if(*end != '\0') return -1;
+static lpmsgring_handle_t * astrid_msgring_get_handle(char * qname) {
+    char shmname[NAME_MAX] = {0};
+    char doorbellpath[PATH_MAX] = {0};
+    lpmsgring_handle_t * handle = NULL;
+    lpmsgring_t * ring;
+    int i, fd, doorbell;
 
-    *val = result;
-    return 0;
-}
+    for(i=0; i < astrid_msgring_numhandles; i++) {
+        if(strncmp(astrid_msgring_handles[i].name, qname, NAME_MAX) == 0) {
+            handle = &astrid_msgring_handles[i];
+            break;
+        }
+    }
 
-int extract_floatlist_from_token(char * tokenlist, lpfloat_t * val, int size) {
-    char * end, * save, * token;
-    char tokenlist_copy[LPMAXMSG] = {0};
-    float result = 0;
-    int count = 0, i = 0;
+    if(handle != NULL && handle->ring != NULL) {
+        if(atomic_load(&handle->ring->is_open)) {
+            handle->users++;
+            return handle;
+        }
 
-    memcpy(tokenlist_copy, tokenlist, LPMAXMSG);
-    token = strtok_r(tokenlist_copy, ",", &save);
+        /* Still being written to: use the mq until the writers let go */
+        if(handle->users > 0) return NULL;
 
-    while(token != NULL) {
-        errno = 0;
-        result = strtof(token, &end);
+        /* The consumer went away: look for its replacement */
+        munmap(handle->ring, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE);
+        close(handle->doorbell);
+        handle->ring = NULL;
+    }
 
-        if(errno != 0) return -1;
-        if(*end != '\0') return -1;
-        val[count] = result;
+    if(astrid_msgring_names(qname, shmname, doorbellpath) < 0) return NULL;
+    if((fd = shm_open(shmname, O_RDWR, LPIPC_PERMS)) < 0) return NULL;
 
-        count += 1;
-        if(count >= size) break;
+    ring = (lpmsgring_t *)mmap(NULL, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ring == MAP_FAILED) return NULL;
 
-        token = strtok_r(NULL, ",", &save);
+    /* ENXIO here means nobody is reading: stick with the mq */
+    if(!atomic_load(&ring->is_open) || (doorbell = open(doorbellpath, O_WRONLY | O_NONBLOCK)) < 0) {
+        munmap(ring, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE);
+        return NULL;
     }
 
-    for(i=count; i < size; i++) {
-        val[i] = val[0];
+    if(handle == NULL) {
+        if(astrid_msgring_numhandles >= ASTRID_MSGRING_MAXHANDLES) {
+            munmap(ring, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE);
+            close(doorbell);
+            return NULL;
+        }
+        handle = &astrid_msgring_handles[astrid_msgring_numhandles++];
+        strncpy(handle->name, qname, NAME_MAX-1);
     }
 
-    return count;
+    handle->ring = ring;
+    handle->doorbell = doorbell;
+    handle->users = 1;
+    return handle;
 }
 
+static void astrid_msgring_handles_atfork_child(void) {
+    /* Only the forking thread survives: nobody else holds the 
+     * table lock or is mid-write in the child */
+    int i;
 
-int extract_patternbuf_from_token(char * token, unsigned char * patternbuf, size_t * pattern_length) {
-    size_t i;
+    pthread_mutex_init(&astrid_msgring_handles_lock, NULL);
+    for(i=0; i < astrid_msgring_numhandles; i++) {
+        astrid_msgring_handles[i].users = 0;
+    }
+}
 
-    *pattern_length = strlen(token);
-    if(*pattern_length > LPMAXPAT) *pattern_length = LPMAXPAT;
+static pthread_once_t astrid_msgring_atfork_once = PTHREAD_ONCE_INIT;
 
-    memset(patternbuf, 0, LPMAXPAT);
-    for(i=0; i < *pattern_length; i++) {
-        patternbuf[i] = (token[i] == '1');
+static void astrid_msgring_register_atfork(void) {
+    pthread_atfork(NULL, NULL, astrid_msgring_handles_atfork_child);
+}
+
+static int astrid_msgq_send(char * qname, lpmsg_t * msgs, int count) {
+    unsigned char wire[sizeof(lpmsg_t)];
+    mqd_t mqd;
+    struct mq_attr attr;
+    size_t size;
+    int i;
+
+    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
+    attr.mq_msgsize = sizeof(lpmsg_t);
+
+    if((mqd = mq_open(qname, O_CREAT | O_WRONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
+        syslog(LOG_ERR, "send_message mq_open: Error opening message queue. Error: %s\n", strerror(errno));
+        return -1;
     }
 
-    return 0;
-}
+    for(i=0; i < count; i++) {
+        /* Compact where it fits, a raw lpmsg_t otherwise */
+        if((size = astrid_wire_encode(&msgs[i], wire)) == 0) {
+            memcpy(wire, &msgs[i], sizeof(lpmsg_t));
+            size = sizeof(lpmsg_t);
+        }
+
+        if(mq_send(mqd, (char *)wire, size, 0) < 0) {
+            syslog(LOG_ERR, "send_message mq_send: Error allocing during message write. Error: %s\n", strerror(errno));
+            mq_close(mqd);
+            return -1;
+        }
+    }
+
+    if(mq_close(mqd) == -1) {
+        syslog(LOG_ERR, "send_message close: Error closing message relay queue. Error: %s\n", strerror(errno));
+        return -1; 
+    }
 
-int decode_update_message_param(lpmsg_t * msg, uint16_t * id, float * value) {
-    memcpy(id, msg->msg, sizeof(uint16_t));
-    memcpy(value, msg->msg + sizeof(uint16_t), sizeof(float));
     return 0;
 }
 
-/* FIXME these encode* functions can probably go away...? */
-int encode_update_message_param(lpmsg_t * msg) {
-    char *token, *save=NULL;
-    char param_copy[LPMAXMSG] = {0};
+int send_messages(char * qname, lpmsg_t * msgs, int count) {
+    /* Sends a batch of messages on the ring for qname if 
+     * its reader has one open, or else one by one on the mq. */
+    lpmsgring_handle_t * handle;
+    int sent;
 
-    int32_t vali32 = 0;
-    int16_t vali16 = 0;
-    float valf = 0.f;
+    if(count <= 0) return 0;
 
-    memcpy(param_copy, msg->msg, LPMAXMSG);
-    token = strtok_r(param_copy, " ", &save);
+    syslog(LOG_DEBUG, "Sending %d messages on queue %s\n", count, qname);
 
-    if(extract_int32_from_token(token, &vali32) < 0) {
-        return -1;
-    } 
+    pthread_once(&astrid_msgring_atfork_once, astrid_msgring_register_atfork);
 
-    syslog(LOG_DEBUG, "ENCODE UPDATE got ID %d\n", vali32);
-    if(vali32 > 32767) vali32 = 32767;
-    vali16 = (uint16_t)vali32;
-    memcpy(msg->msg, &vali16, sizeof(uint16_t));
+    pthread_mutex_lock(&astrid_msgring_handles_lock);
+    handle = astrid_msgring_get_handle(qname);
+    pthread_mutex_unlock(&astrid_msgring_handles_lock);
 
-    if(extract_float_from_token(token, &valf) == 0) {
-        return -1;
+    if(handle != NULL) {
+        /* May sleep on a full ring, so don't hold the table lock */
+        sent = astrid_msgring_write(handle->ring, handle->doorbell, msgs, count);
+
+        pthread_mutex_lock(&astrid_msgring_handles_lock);
+        handle->users--;
+        pthread_mutex_unlock(&astrid_msgring_handles_lock);
+
+        if(sent == count) return 0;
+
+        /* A closed or stuck ring: the rest go on the mq, which the reader also watches */
+        syslog(LOG_WARNING, "send_messages: The message ring for %s is closed or full, sending %d messages on the mq\n", qname, count - sent);
+        return astrid_msgq_send(qname, msgs + sent, count - sent);
     }
 
-    syslog(LOG_DEBUG, "ENCODE UPDATE got VALUE %f\n", valf);
-    memcpy(msg->msg + sizeof(uint16_t), &valf, sizeof(float));
-   
-    return 0;
+    return astrid_msgq_send(qname, msgs, count);
 }
 
-int encode_update_message_param_float(uint16_t id, char * valstr, lpmsg_t * msg) {
-    float val = 0;
-    if(extract_float_from_token(valstr, &val) < 0) {
-        syslog(LOG_ERR, "encode_update_message_param_float: Could not extract float from token '%s'\n", valstr);
-        return -1;
-    }
+int send_message(char * qname, lpmsg_t msg) {
+    return send_messages(qname, &msg, 1);
+}
+
+int send_play_messages(lpmsg_t * msgs, int count) {
+    /* Batches runs of messages bound for the same instrument */
+    char qname[NAME_MAX] = {0};
+    int first, i;
 
-    memset(msg->msg, 0, sizeof(LPMAXMSG));
-    memcpy(msg->msg, &id, sizeof(uint16_t));
-    memcpy(msg->msg + sizeof(uint16_t), &val, sizeof(float));
+    first = 0;
+    while(first < count) {
+        for(i=first+1; i < count; i++) {
+            if(strncmp(msgs[i].instrument_name, msgs[first].instrument_name, LPMAXNAME) != 0) break;
+        }
+
+        snprintf(qname, NAME_MAX, "/%s-msgq", msgs[first].instrument_name);
+        if(send_messages(qname, &msgs[first], i - first) < 0) {
+            syslog(LOG_ERR, "send_play_messages: Could not send messages to %s\n", msgs[first].instrument_name);
+            return -1;
+        }
+        first = i;
+    }
 
     return 0;
 }
 
-int encode_update_message_param_int32(uint16_t id, char * valstr, lpmsg_t * msg) {
-    int32_t val = 0;
-    int16_t val16 = 0;
-    if(extract_int32_from_token(valstr, &val) < 0) {
-        syslog(LOG_ERR, "encode_update_message_param_int32: Could not extract int32_t from token '%s'\n", valstr);
-        return -1;
-    }
+int send_play_message(lpmsg_t msg) {
+    return send_play_messages(&msg, 1);
+}
 
-    if(val > 32767) val = 32767;
-    val16 = (uint16_t)val;
-    memset(msg->msg, 0, sizeof(LPMAXMSG));
-    memcpy(msg->msg, &id, sizeof(uint16_t));
-    memcpy(msg->msg + sizeof(uint16_t), &val16, sizeof(uint16_t));
+int send_serial_message(lpmsg_t msg) {
+    /* Relays a message to the serial listener thread for a 
+     * given instrument, which will write the translated payload
+     * to the tty... only used for special solenoid trigger & 
+     * motor speed messages now... also for shutdown messages
+     * FIXME ... & probably needs some decode/encode fixes after recent changes
+     */
+    char qname[NAME_MAX] = {0};
 
-    return 0;
+    snprintf(qname, NAME_MAX, "/%s-serial-msgq", msg.instrument_name);
+    return send_messages(qname, &msg, 1);
 }
 
-// Takes the cmd on the instrument and runs each param through the 
-// instrument's param update callback.
-int process_param_updates(lpinstrument_t * instrument) {
-    char cmdline[LPMAXMSG] = {0};
-    char * paramline;
-    char * keytoken;
-    char * valtoken;
-    char * cmdline_save;
-    char * paramline_save;
+mqd_t astrid_playq_open(const char * instrument_name) {
+    mqd_t mqd;
+    ssize_t qname_length;
+    char qname[LPMAXQNAME] = {0};
+    struct mq_attr attr;
 
-    memcpy(cmdline, instrument->msg.msg, LPMAXMSG);
+    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
+    attr.mq_msgsize = sizeof(lpmsg_t);
 
-    paramline = strtok_r(cmdline, " ", &cmdline_save);
-    while(paramline != NULL) {
-        keytoken = strtok_r(paramline, "=", &paramline_save);
-        if(keytoken != NULL) {
-            valtoken = strtok_r(NULL, "=", &paramline_save);
-            if(valtoken != NULL) {
-                syslog(LOG_DEBUG, "UPDATE Key: %s, Value: %s\n", keytoken, valtoken);
-                // TODO think about handling large / special values, like buffers...
-                // payload could be the shm ID like render complete messages...?
-                if(instrument->update(instrument, keytoken, valtoken) < 0) {
-                    syslog(LOG_ERR, "process_param_updates: failed to pass param (%s=%s) to update callback.\n", keytoken, valtoken);
-                }
-            }
-        }
-        paramline = strtok_r(NULL, " ", &cmdline_save);
+    qname_length = snprintf(NULL, 0, "%s-%s", LPPLAYQ, instrument_name) + 1;
+    qname_length = (LPMAXQNAME >= qname_length) ? LPMAXQNAME : qname_length;
+    snprintf(qname, qname_length, "%s-%s", LPPLAYQ, instrument_name);
+
+    syslog(LOG_DEBUG, "Opening playq %s\n", qname);
+    if((mqd = mq_open(qname, O_CREAT | O_RDONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
+        syslog(LOG_ERR, "astrid_playq_open mq_open: Error opening message queue. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    syslog(LOG_DEBUG, "Opened playq mqd:%d\n", mqd);
+    return mqd;
+}
+
+int astrid_playq_close(mqd_t mqd) {
+    if(mq_close(mqd) == -1) {
+        syslog(LOG_ERR, "astrid_playq_close close: Error closing play queue FIFO. Error: %s\n", strerror(errno));
+        return -1; 
     }
+
     return 0;
 }
 
+int astrid_playq_read(mqd_t mqd, lpmsg_t * msg) {
+    char * msgp;
+    ssize_t read_result;
+    unsigned int msg_priority;
 
-int prepare_and_send_instrument_message(lpmsg_t * msg, char msgtype) {
-    int voice_id = 0;
+    msgp = (char *)msg;
 
-    /* Get the voice ID from the voice ID counter */
-    if((voice_id = lpcounter_read_and_increment("voiceid")) < 0) {
-        syslog(LOG_ERR, "Error getting voice ID: (%d) %s\n", errno, strerror(errno));
+    if((read_result = mq_receive(mqd, msgp, sizeof(lpmsg_t), &msg_priority)) < 0) {
+        syslog(LOG_ERR, "astrid_playq_read mq_receive: Error allocing during message read. Error: %s\n", strerror(errno));
         return -1;
     }
 
-    /* Initialize the count and set the voice_id */
-    msg->count = 0;
-    msg->voice_id = voice_id;
+    return 0;
+}
 
-    switch(msgtype) {
-        case PLAY_MESSAGE:
-            msg->type = LPMSG_PLAY;
-            break;
+mqd_t astrid_msgq_open(char * qname) {
+    mqd_t mqd;
+    struct mq_attr attr;
 
-        case TRIGGER_MESSAGE:
-            msg->type = LPMSG_TRIGGER;
-            break;
+    attr.mq_maxmsg = ASTRID_MQ_MAXMSG;
+    attr.mq_msgsize = sizeof(lpmsg_t);
 
-        case SERIAL_MESSAGE:
-            msg->type = LPMSG_SERIAL;
-            break;
+    syslog(LOG_DEBUG, "Opening msgq %s\n", qname);
+    if((mqd = mq_open(qname, O_CREAT | O_RDONLY, LPIPC_PERMS, &attr)) == (mqd_t) -1) {
+        syslog(LOG_ERR, "astrid_playq_open mq_open: Error opening message queue. Error: %s\n", strerror(errno));
+        return (mqd_t) -1;
+    }
 
-        case UPDATE_MESSAGE:
-            msg->type = LPMSG_UPDATE;
-            break;
+    syslog(LOG_DEBUG, "Opened msgq mqd:%d\n", mqd);
+    return mqd;
+}
 
-        case LOAD_MESSAGE:
-            msg->type = LPMSG_LOAD;
-            break;
+int astrid_msgq_close(mqd_t mqd) {
+    if(mq_close(mqd) == -1) {
+        syslog(LOG_ERR, "astrid_msgq_close close: Error closing msg queue FIFO. Error: %s\n", strerror(errno));
+        return -1; 
+    }
 
-        case SCHEDULE_MESSAGE:
-            msg->type = LPMSG_SCHEDULE;
-            break;
+    return 0;
+}
 
-        case SHUTDOWN_MESSAGE:
-            msg->type = LPMSG_SHUTDOWN;
-            break;
+int astrid_msgq_read(mqd_t mqd, lpmsg_t * msg) {
+    unsigned char wire[sizeof(lpmsg_t)];
+    ssize_t read_result;
+    unsigned int msg_priority = 0;
 
-        case SET_COUNTER_MESSAGE:
-            msg->type = LPMSG_SET_COUNTER;
-            break;
+    syslog(LOG_DEBUG, "Reading from msgq mqd:%d\n", mqd);
 
-        default:
-            syslog(LOG_CRIT, "Bad msgtype! %c\n", msgtype);
-            return -1;
+    if((read_result = mq_receive(mqd, (char *)wire, sizeof(lpmsg_t), &msg_priority)) < 0) {
+        syslog(LOG_ERR, "astrid_msgq_read mq_receive: Error reading message. (Got %ld bytes) Error: %s\n", read_result, strerror(errno));
+        return -1;
     }
 
-    if(send_play_message(*msg) < 0) {
-        syslog(LOG_ERR, "Could not send play message...\n");
+    if(astrid_wire_decode(wire, (size_t)read_result, msg) < 0) {
         return -1;
     }
 
-    // FIXME -- maybe set this elsewhere to let cleanup happen first?
-    //if(msg->type == LPMSG_SHUTDOWN) instrument->is_running = 0;
+    syslog(LOG_DEBUG, "msg.msg is now:%s\n", msg->msg);
 
     return 0;
 }
 
-int parse_message_from_args(int argc, int arg_offset, char * argv[], lpmsg_t * msg) {
-    int bytesread, a, i, length;
-    char msgtype;
-    char message_params[LPMAXMSG] = {0};
-    char instrument_name[LPMAXNAME] = {0};
-    size_t instrument_name_length;
-
-    instrument_name_length = 0;
-    msgtype = argv[arg_offset + 1][0];
-
-    /* Prepare the message param string */
-    bytesread = 0;
-    for(a=arg_offset+2; a < argc; a++) {
-        length = strlen(argv[a]);
-        if(a==arg_offset+2) {
-            instrument_name_length = (size_t)length;
-            memcpy(instrument_name, argv[a], instrument_name_length);
-            continue;
-        }
-
-        for(i=0; i < length; i++) {
-            message_params[bytesread] = argv[a][i];
-            bytesread++;
-        }
-        message_params[bytesread] = SPACE;
-        bytesread++;
-    }
+/* Closes a ring left behind by a reader that never called 
+ * astrid_msgchannel_close, so producers still holding it 
+ * drop their handle and look for the new one, then unlinks it */
+static void astrid_msgring_retire(char * shmname) {
+    lpmsgring_t * ring;
+    int fd;
 
-    /* Set up the message struct */
-    strncpy(msg->instrument_name, instrument_name, instrument_name_length);
-    strncpy(msg->msg, message_params, bytesread);
+    if((fd = shm_open(shmname, O_RDWR, LPIPC_PERMS)) < 0) return;
 
-    if(prepare_and_send_instrument_message(msg, msgtype) < 0) {
-        syslog(LOG_ERR, "Could not prepare message of type %c: (%d) %s\n", msgtype, errno, strerror(errno));
-        return -1;
+    ring = (lpmsgring_t *)mmap(NULL, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ring != MAP_FAILED) {
+        atomic_store(&ring->is_open, 0);
+        munmap(ring, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE);
     }
 
-    return 0;
+    shm_unlink(shmname);
 }
 
-int parse_message_from_cmdline(char * cmdline, size_t cmdlength, lpmsg_t * msg) {
-    int tokenlength;
-    char *token, *save=NULL;
-    char msgtype;
-    char cmd_copy[LPMAXMSG] = {0};
-
-    if(cmdline == NULL) return 0;
-
-    // strtok clobbers input
-    memcpy(cmd_copy, cmdline, cmdlength);
-
-    // Get the message type, and ignore everything else for now...
-    token = strtok_r(cmd_copy, " ", &save);
-    msgtype = token[0]; // msg types only use the first char
-    tokenlength = strlen(token);
+int astrid_msgchannel_open(lpmsgchannel_t * channel, char * qname) {
+    char shmname[NAME_MAX] = {0};
+    char doorbellpath[PATH_MAX] = {0};
+    int fd;
 
-    memset(msg->msg, 0, LPMAXMSG);
-    strncpy(msg->msg, cmdline + tokenlength, cmdlength - tokenlength);
+    memset(channel, 0, sizeof(lpmsgchannel_t));
+    strncpy(channel->name, qname, NAME_MAX-1);
+    channel->doorbell = -1;
 
-    if(prepare_and_send_instrument_message(msg, msgtype) < 0) {
-        syslog(LOG_ERR, "Could not prepare message of type %c: (%d) %s\n", msgtype, errno, strerror(errno));
+    if((channel->mqd = astrid_msgq_open(qname)) == (mqd_t) -1) {
         return -1;
     }
 
-    return 0;
-}
-
-int midi_triggerq_open() {
-    int qfd;
-
-    umask(0);
-    if(mkfifo(ASTRID_MIDI_TRIGGERQ_PATH, S_IRUSR | S_IWUSR | S_IWGRP) == -1 && errno != EEXIST) {
-        syslog(LOG_ERR, "midi_triggerq_open mkfifo: Error creating msg queue FIFO. Error: %s\n", strerror(errno));
+    /* Start from an empty ring even if a crashed reader left one behind */
+    if(astrid_msgring_names(qname, shmname, doorbellpath) < 0) {
+        astrid_msgq_close(channel->mqd);
+        channel->mqd = (mqd_t) -1;
+        channel->name[0] = 0;
         return -1;
     }
+    astrid_msgring_retire(shmname);
 
-    if((qfd = open(ASTRID_MIDI_TRIGGERQ_PATH, O_RDWR)) < 0) {
-        syslog(LOG_ERR, "midi_triggerq_open open: Error opening msg queue FIFO. Error: %s\n", strerror(errno));
+    if((fd = shm_open(shmname, O_CREAT | O_EXCL | O_RDWR, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "astrid_msgchannel_open: Could not create message ring %s. Error: (%d) %s\n", shmname, errno, strerror(errno));
         return -1;
-    };
+    }
 
-    return qfd;
-}
+    if(ftruncate(fd, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE) < 0) {
+        syslog(LOG_ERR, "astrid_msgchannel_open: Could not size message ring %s. Error: (%d) %s\n", shmname, errno, strerror(errno));
+        close(fd);
+        return -1;
+    }
 
-int midi_triggerq_schedule(int qfd, lpmidievent_t t) {
-    if(write(qfd, &t, sizeof(lpmidievent_t)) != sizeof(lpmidievent_t)) {
-        syslog(LOG_ERR, "midi_triggerq_schedule write: Could not write to q. Error: %s\n", strerror(errno));
+    channel->ring = (lpmsgring_t *)mmap(NULL, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(channel->ring == MAP_FAILED) {
+        syslog(LOG_ERR, "astrid_msgchannel_open: Could not map message ring %s. Error: (%d) %s\n", shmname, errno, strerror(errno));
+        channel->ring = NULL;
         return -1;
     }
 
-    return 0;
-}
+    umask(0);
+    if(mkfifo(doorbellpath, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) == -1 && errno != EEXIST) {
+        syslog(LOG_ERR, "astrid_msgchannel_open: Could not create doorbell %s. Error: (%d) %s\n", doorbellpath, errno, strerror(errno));
+        return -1;
+    }
 
-int midi_triggerq_close(int qfd) {
-    if(close(qfd) == -1) {
-        syslog(LOG_ERR, "midi_triggerq_close close: Error closing msg queue FIFO. Error: %s\n", strerror(errno));
-        return -1; 
+    /* Held open for reading and writing so it never reports EOF */
+    if((channel->doorbell = open(doorbellpath, O_RDWR | O_NONBLOCK)) < 0) {
+        syslog(LOG_ERR, "astrid_msgchannel_open: Could not open doorbell %s. Error: (%d) %s\n", doorbellpath, errno, strerror(errno));
+        return -1;
     }
 
+    /* The ring is zeroed by ftruncate, which leaves every record uncommitted */
+    channel->ring->capacity = ASTRID_MSGRING_SIZE;
+    atomic_store(&channel->ring->is_open, 1);
+
     return 0;
 }
 
+int astrid_msgchannel_pop(lpmsgchannel_t * channel, lpmsg_t * msg) {
+    /* Takes the next message off the ring without blocking.
+     * Returns 1 if there was one, 0 if the ring is empty. */
+    lpmsgring_t * ring = channel->ring;
+    lpmsgrecord_t * rec;
+    unsigned char * p;
+    unsigned int flags;
+    size_t tail;
+    uint32_t size;
 
-/* SCHEDULING
- * and MIXING
- * **********/
-int lpscheduler_get_now_seconds(double * now) {
-    clockid_t cid;
-    struct timespec ts;
+    if(ring == NULL) return 0;
 
-#if defined(__linux__)
-    cid = CLOCK_MONOTONIC_RAW;
-#else
-    cid = CLOCK_MONOTONIC;
-#endif
+    while(1) {
+        tail = atomic_load(&ring->tail);
+        rec = (lpmsgrecord_t *)(ring->data + (tail & (ring->capacity-1)));
+        if(!((flags = atomic_load(&rec->flags)) & ASTRID_MSGRECORD_COMMITTED)) return 0;
 
-    if(clock_gettime(cid, &ts) < 0) {
-        syslog(LOG_ERR, "scheduler_get_now_seconds: clock_gettime error: %s\n", strerror(errno));
-        return -1; 
-    }
+        size = rec->size;
+        if(!(flags & ASTRID_MSGRECORD_PADDING)) {
+            p = (unsigned char *)rec + sizeof(lpmsgrecord_t);
+            if(astrid_wire_decode(p, rec->length, msg) < 0) flags |= ASTRID_MSGRECORD_PADDING;
+        }
 
-    *now = ts.tv_sec + ts.tv_nsec * 1e-9;
+        memset(rec, 0, size);
+        atomic_store(&ring->tail, tail + size);
 
-    return 0;
+        if(!(flags & ASTRID_MSGRECORD_PADDING)) return 1;
+    }
 }
 
-void scheduler_get_now(struct timespec * now) {
-    clock_gettime(CLOCK_MONOTONIC_RAW, now);
-}
+int astrid_msgchannel_prepare_wait(lpmsgchannel_t * channel) {
+    /* Call before sleeping on the doorbell and the mq. Returns 1 
+     * (and stays awake) if a message landed in the meantime. */
+    lpmsgring_t * ring = channel->ring;
+    lpmsgrecord_t * rec;
 
-void scheduler_frames_to_timespec(
-    size_t frames, 
-    lpfloat_t samplerate, 
-    struct timespec * ts
-) {
-    size_t ns;
+    if(ring == NULL) return 0;
 
-    ts->tv_sec = (time_t)(frames / samplerate);
+    atomic_store(&ring->waiting, 1);
+    rec = (lpmsgrecord_t *)(ring->data + (atomic_load(&ring->tail) & (ring->capacity-1)));
+    if(atomic_load(&rec->flags) & ASTRID_MSGRECORD_COMMITTED) {
+        atomic_store(&ring->waiting, 0);
+        return 1;
+    }
 
-    ns = frames - (size_t)(ts->tv_sec * samplerate);
-    ts->tv_nsec = (size_t)(ns / samplerate);
+    return 0;
 }
 
-void scheduler_increment_timespec_by_ns(
-    struct timespec * ts, 
-    size_t ns
-) {
-    size_t seconds = 0;
-    while(ns >= 1000000000) {
-        ns -= 1000000000;
-        seconds += 1;
-    }
+void astrid_msgchannel_finish_wait(lpmsgchannel_t * channel) {
+    char bell[64];
 
-    ts->tv_sec += seconds;
-    ts->tv_nsec += ns;
+    if(channel->ring == NULL) return;
+    atomic_store(&channel->ring->waiting, 0);
+    while(read(channel->doorbell, bell, sizeof(bell)) > 0);
 }
 
-size_t scheduler_timespec_to_ticks(
-    lpscheduler_t * s, 
-    struct timespec * ts
-) {
-    size_t secs, nsecs, total_ns;     
+int astrid_msgchannel_read(lpmsgchannel_t * channel, lpmsg_t * msg) {
+    /* Blocks until a message arrives on either the ring or the mq */
+    struct pollfd fds[2];
 
-    /* Seconds and nanoseconds since init */
-    secs = ts->tv_sec - s->init->tv_sec;
-    nsecs = ts->tv_nsec - s->init->tv_nsec;
+    while(1) {
+        if(astrid_msgchannel_pop(channel, msg) > 0) return 0;
+        if(channel->ring == NULL) return astrid_msgq_read(channel->mqd, msg);
+        if(astrid_msgchannel_prepare_wait(channel)) continue;
 
-    /* Convert nanoseconds since init to number of 
-     * ticks since init.
-     *
-     * ticks advance on frame boundries as the scheduler 
-     * processes each frame of output.
-     *
-     * `tick_ns` is the number of nanoseconds 
-     * per frame at the current samplerate.
-     **/
-    total_ns = nsecs + (secs * 1000000000);
-    return total_ns / s->tick_ns;
-}
+        fds[0].fd = channel->doorbell;
+        fds[0].events = POLLIN;
+        fds[1].fd = (int)channel->mqd;
+        fds[1].events = POLLIN;
 
-int scheduler_onset_has_elapsed(lpscheduler_t * s, struct timespec * ts) {
-    printf(" s->now->tv_sec: %d\n", (int)s->now->tv_sec);
-    printf("     ts->tv_sec: %d\n", (int)ts->tv_sec);
-    printf("s->now->tv_nsec: %d\n", (int)s->now->tv_nsec);
-    printf("    ts->tv_nsec: %d\n", (int)ts->tv_nsec);
+        if(poll(fds, 2, -1) < 0 && errno != EINTR) {
+            syslog(LOG_ERR, "astrid_msgchannel_read poll: Error waiting for messages. Error: (%d) %s\n", errno, strerror(errno));
+            astrid_msgchannel_finish_wait(channel);
+            return -1;
+        }
 
-    return ((
-            s->now->tv_sec >= ts->tv_sec
-        ) || (
-            s->now->tv_sec == ts->tv_sec &&
-            s->now->tv_nsec >= ts->tv_nsec
-        )
-    ) ? 1 : 0;
-}
+        astrid_msgchannel_finish_wait(channel);
 
-void ll_display(lpevent_t * head) {
-    lpevent_t * current;
-    if(head) {
-        current = head;
-        while(current->next != NULL) {
-            syslog(LOG_DEBUG, "    e%ld onset: %ld pos: %ld length: %ld\n", current->id, current->onset, current->pos, current->buf->length);
-            current = (lpevent_t *)current->next;        
-        }
-        syslog(LOG_DEBUG, "    e%ld onset: %ld pos: %ld length: %ld\n", current->id, current->onset, current->pos, current->buf->length);
+        /* Ring messages go first, the mq is only read once it's empty */
+        if(astrid_msgchannel_pop(channel, msg) > 0) return 0;
+        if(fds[1].revents & POLLIN) return astrid_msgq_read(channel->mqd, msg);
     }
 }
 
-int ll_count(lpevent_t * head) {
-    lpevent_t * current;
-    int count;
+int astrid_msgchannel_close(lpmsgchannel_t * channel) {
+    char shmname[NAME_MAX] = {0};
+    char doorbellpath[PATH_MAX] = {0};
 
-    count = 0;
+    if(channel->name[0] == 0) return 0;
 
-    if(head) {
-        count = 1;
-        current = head;
-        while(current->next != NULL) {
-            current = (lpevent_t *)current->next;        
-            count += 1;
-        }
+    if(astrid_msgring_names(channel->name, shmname, doorbellpath) < 0) return -1;
+
+    if(channel->ring != NULL) {
+        atomic_store(&channel->ring->is_open, 0);
+        munmap(channel->ring, sizeof(lpmsgring_t) + ASTRID_MSGRING_SIZE);
+        shm_unlink(shmname);
+        channel->ring = NULL;
     }
 
-    return count;
-}
+    if(channel->doorbell >= 0) {
+        close(channel->doorbell);
+        unlink(doorbellpath);
+        channel->doorbell = -1;
+    }
 
-/* Add event to the tail of the waiting queue */
-static inline void start_waiting(lpscheduler_t * s, lpevent_t * e) {
-    lpevent_t * current;
+    if(channel->mqd != (mqd_t) -1) astrid_msgq_close(channel->mqd);
+    channel->name[0] = 0;
 
-    if(s->waiting_queue_head == NULL) {
-        s->waiting_queue_head = e;
-    } else {
-        current = s->waiting_queue_head;
-        while(current->next != NULL) {
-            current = (lpevent_t *)current->next;        
-        }
-        current->next = (void *)e;
-    }
-} 
+    return 0;
+}
 
-static inline void start_playing(lpscheduler_t * s, lpevent_t * e) {
-    lpevent_t * current;
-    lpevent_t * prev;
+int astrid_get_playback_device_id() {
+    int device_id;
 
-    syslog(LOG_INFO, "START playing event ID %ld\n", e->id);
+    /* If the default device isn't set, then 
+     * set it to zero and return the ID */
+    if(access(ASTRID_DEVICEID_PATH, F_OK) < 0) {
+        if(lpipc_setid(ASTRID_DEVICEID_PATH, 0) < 0) {
+            syslog(LOG_ERR, "Could not set default device ID to 0. Error: (%d) %s\n", errno, strerror(errno));
+            return -1;
+        }
 
-    /* Remove from the waiting queue */
-    if(s->waiting_queue_head == NULL) {
-        printf("Cannot move this event. There is nothing in the waiting queue!\n");
+        return 0;
     }
 
-    prev = NULL;
-    current = s->waiting_queue_head;
-    while(current != e && current->next != NULL) {
-        prev = current;
-        current = (lpevent_t *)current->next;
-    }
-    if(prev) {
-        prev->next = current->next;
-    } else {
-        s->waiting_queue_head = (lpevent_t *)current->next;
+    /* Otherwise look up the ID */
+    if((device_id = lpipc_getid(ASTRID_DEVICEID_PATH)) < 0) {
+        syslog(LOG_ERR, "Could not get current device ID. Error: (%d) %s\n", errno, strerror(errno));
+        return -1;
     }
 
-    current->next = NULL;
-
-    /* Add to the tail of the playing queue */
-    if(s->playing_stack_head == NULL) {
-        s->playing_stack_head = e;
-    } else {
-        current = s->playing_stack_head;
-        while(current->next != NULL) {
-            current = (lpevent_t *)current->next;
-        }
-        current->next = (void *)e;
-    }
+    return device_id;
 }
 
-static inline void stop_playing(lpscheduler_t * s, lpevent_t * e) {
-    lpevent_t * current;
-    lpevent_t * prev;
-
-    syslog(LOG_INFO, "STOP playing event ID %ld\n", e->id);
+/* TODO set these per-process and per-device */
+int astrid_get_capture_device_id() {
+    return astrid_get_playback_device_id();
+}
 
-    /* Remove from the playing stack */
-    if(s->playing_stack_head == NULL) {
-        syslog(LOG_CRIT, "Cannot move this event. There is nothing in the waiting queue!\n");
-        return;
-    }
+int extract_int32_from_token(char * token, int32_t * val) {
+    char * end;
+    long result = 0;
 
-    prev = NULL;
-    current = s->playing_stack_head;
-    while(current != e && current->next != NULL) {
-        prev = current;
-        current = (lpevent_t *)current->next;
-    }
+    errno = 0;
+    result = strtol(token, &end, 0);
 
-    if(prev) {
-        prev->next = current->next;
-    } else {
-        s->playing_stack_head = (lpevent_t *)current->next;
-    }
+    if(errno != 0) return -1;
+    if(*end != '\0') return -1;
 
-    current->next = NULL;
+    if(result > INT_MAX) result = INT_MAX;
 
-    /* Add to the tail of the garbage stack */
-    if(pthread_mutex_lock(&astrid_nursery_lock) != 0) {
-        syslog(LOG_ERR, "Error getting lock on nursery mutex\n");
-        return;
-    }
-    if(s->nursery_head == NULL) {
-        s->nursery_head = e;
-    } else {
-        current = s->nursery_head;
-        while(current->next != NULL) {
-            current = (lpevent_t *)current->next;
-        }
-        current->next = (void *)e;
-    }
-    if(pthread_mutex_unlock(&astrid_nursery_lock) != 0) {
-        syslog(LOG_ERR, "Error getting lock on nursery mutex\n");
-        return;
-    }
+    *val = (int32_t)result;
+    return 0;
 }
 
-lpscheduler_t * scheduler_create(int realtime, int channels, lpfloat_t samplerate) {
-    lpscheduler_t * s;
+int extract_float_from_token(char * token, float * val) {
+    char * end;
+    float result = 0;
 
-    s = (lpscheduler_t *)LPMemoryPool.alloc(1, sizeof(lpscheduler_t));
-    s->now = (struct timespec *)LPMemoryPool.alloc(1, sizeof(struct timespec));
+    errno = 0;
+    result = strtof(token, &end);
 
-    s->realtime = realtime;
+    if(errno != 0) return -1;
+    if(*end != '\0') return -1;
 
-    s->waiting_queue_head = NULL;
-    s->playing_stack_head = NULL;
-    s->nursery_head = NULL;
+    *val = result;
+    return 0;
+}
 
-    s->samplerate = samplerate;
-    s->channels = channels;
+int extract_floatlist_from_token(char * tokenlist, lpfloat_t * val, int size) {
+    char * end, * save, * token;
+    char tokenlist_copy[LPMAXMSG] = {0};
+    float result = 0;
+    int count = 0, i = 0;
 
-    s->tick_ns = (size_t)(samplerate / 1000000000.f);
+    memcpy(tokenlist_copy, tokenlist, LPMAXMSG);
+    token = strtok_r(tokenlist_copy, ",", &save);
 
-    if(realtime == 1) scheduler_get_now(s->now);
-    s->ticks = 0;
-    s->current_frame = (lpfloat_t *)LPMemoryPool.alloc(channels, sizeof(lpfloat_t));
+    while(token != NULL) {
+        errno = 0;
+        result = strtof(token, &end);
 
-    s->event_count = 0;
+        if(errno != 0) return -1;
+        if(*end != '\0') return -1;
+        val[count] = result;
 
-    return s;
-}
+        count += 1;
+        if(count >= size) break;
 
-/* look for events waiting to be scheduled */
-static inline void scheduler_update(lpscheduler_t * s) {
-    lpevent_t * current;
-    void * next;
-    if(s->waiting_queue_head != NULL) {
-        current = s->waiting_queue_head;
-        while(current->next != NULL) {
-            next = current->next;
-            if(s->ticks >= current->onset) {
-                start_playing(s, current);
-            }
-            current = (lpevent_t *)next;
-        }
-        if(s->ticks >= current->onset) {
-            start_playing(s, current);
-        }
+        token = strtok_r(NULL, ",", &save);
     }
 
-    /* look for events that have finished playing */
-    if(s->playing_stack_head != NULL) {
-        current = s->playing_stack_head;
-        while(current->next != NULL) {
-            next = current->next;
-            if(current->buf != NULL && current->pos >= current->buf->length-1) {
-                stop_playing(s, current);
-            }
-            current = (lpevent_t *)next;
-        }
-
-        if(current->buf != NULL && current->pos >= current->buf->length-1) {
-            stop_playing(s, current);
-        }
+    for(i=count; i < size; i++) {
+        val[i] = val[0];
     }
-}
 
-static inline void scheduler_mix_buffers(lpscheduler_t * s) {
-    lpevent_t * current;
-    lpfloat_t sample;
-    int bufc, c;
+    return count;
+}
 
-    if(s->playing_stack_head == NULL) {
-        for(c=0; c < s->channels; c++) {
-            s->current_frame[c] = 0.f;
-        }
-        return;
-    }
 
-    for(c=0; c < s->channels; c++) {
-        sample = 0.f;
+int extract_patternbuf_from_token(char * token, unsigned char * patternbuf, size_t * pattern_length) {
+    size_t i;
 
-        current = s->playing_stack_head;
-        while(current->next != NULL) {
-            if(current->buf != NULL && current->pos < current->buf->length) {
-                bufc = c % current->buf->channels;
-                sample += current->buf->data[current->pos * current->buf->channels + bufc];
-            }
-            current = (lpevent_t *)current->next;
-        }
+    *pattern_length = strlen(token);
+    if(*pattern_length > LPMAXPAT) *pattern_length = LPMAXPAT;
 
-        if(current->buf != NULL && current->pos < current->buf->length) {
-            bufc = c % current->buf->channels;
-            sample += current->buf->data[current->pos * current->buf->channels + bufc];
-        }
- 
-        s->current_frame[c] = lpfilternan(sample);
+    memset(patternbuf, 0, LPMAXPAT);
+    for(i=0; i < *pattern_length; i++) {
+        patternbuf[i] = (token[i] == '1');
     }
+
+    return 0;
 }
 
-static inline void scheduler_advance_buffers(lpscheduler_t * s) {
-    lpevent_t * current;
- 
-    /* loop over buffers and advance their positions */
-    if(s->playing_stack_head != NULL) {
-        current = s->playing_stack_head;
-        while(current->next != NULL) {
-            current->pos += 1;
-            current = (lpevent_t *)current->next;
-        }
-        current->pos += 1;
+// Typed params were parsed by the sender: hand them to the 
+// update callback straight from the message, no tokenizing.
+/* Writes the value of a typed param as the text it was 
+ * encoded from. Returns -1 for bare keys, which have none. */
+static int astrid_params_format_value(lpmsgparam_t * param, char * val, size_t size) {
+    switch(param->type) {
+        case LPPARAM_INT32:
+            return snprintf(val, size, "%d", param->i);
+
+        case LPPARAM_DOUBLE:
+            return astrid_params_format_double(val, size, param->d);
+
+        case LPPARAM_STRING:
+            return snprintf(val, size, "%.*s", (int)param->slen, param->s);
+
+        default:
+            return -1;
     }
 }
 
-void scheduler_debug(lpscheduler_t * s) {
-    if(s->waiting_queue_head) {
-        syslog(LOG_DEBUG, "%d waiting\n", ll_count(s->waiting_queue_head));
-        ll_display(s->waiting_queue_head);
-    } else {
-        syslog(LOG_DEBUG, "none waiting\n");
-    }
+int astrid_params_decode(const char * params, char * out, size_t size) {
+    /* Turns encoded params back into key=value text */
+    char val[LPMAXMSG] = {0};
+    lpmsgparam_t param;
+    size_t pos = 0, len = 0;
+    int ret;
 
-    if(s->playing_stack_head) {
-        syslog(LOG_DEBUG, "%d playing\n", ll_count(s->playing_stack_head));
-        ll_display(s->playing_stack_head);
-    } else {
-        syslog(LOG_DEBUG, "none playing\n");
+    out[0] = '\0';
+    while((ret = astrid_params_next(params, &pos, &param)) > 0 && len < size) {
+        if(astrid_params_format_value(&param, val, LPMAXMSG) < 0) {
+            len += (size_t)snprintf(out + len, size - len, "%s%.*s", len > 0 ? " " : "", (int)param.keylen, param.key);
+        } else {
+            len += (size_t)snprintf(out + len, size - len, "%s%.*s=%s", len > 0 ? " " : "", (int)param.keylen, param.key, val);
+        }
     }
 
-    if(s->nursery_head) {
-        syslog(LOG_DEBUG, "%d done\n\n", ll_count(s->nursery_head));
-        ll_display(s->nursery_head);
-    } else {
-        syslog(LOG_DEBUG, "none done\n");
-    }
+    if(ret < 0 || len >= size) return -1;
+    return 0;
 }
 
-void lpscheduler_tick(lpscheduler_t * s) {
-    //scheduler_debug(s);
+static int process_encoded_param_updates(lpinstrument_t * instrument) {
+    char key[LPMAXMSG] = {0};
+    char val[LPMAXMSG] = {0};
+    lpmsgparam_t param;
+    size_t pos = 0;
+    int ret;
 
-    /* Move buffers to proper lists */
-    scheduler_update(s);
+    while((ret = astrid_params_next(instrument->msg.msg, &pos, &param)) > 0) {
+        memcpy(key, param.key, param.keylen);
+        key[param.keylen] = '\0';
 
-    /* Mix currently playing buffers into s->current_frame */
-    scheduler_mix_buffers(s);
+        // bare keys have no value to update
+        if(astrid_params_format_value(&param, val, LPMAXMSG) < 0) continue;
 
-    /* Advance the position for all playing buffers */
-    scheduler_advance_buffers(s);
+        syslog(LOG_DEBUG, "UPDATE Key: %s, Value: %s\n", key, val);
+        if(instrument->update(instrument, key, val) < 0) {
+            syslog(LOG_ERR, "process_param_updates: failed to pass param (%s=%s) to update callback.\n", key, val);
+        }
+    }
 
-    /* Increment process ticks and update now timestamp */
-    s->ticks += 1;
-    if(s->realtime == 1) {
-        scheduler_get_now(s->now);
-    } else {
-        scheduler_increment_timespec_by_ns(s->now, s->tick_ns);
+    if(ret < 0) {
+        syslog(LOG_ERR, "process_param_updates: malformed encoded params\n");
+        return -1;
     }
+
+    return 0;
 }
 
-void scheduler_schedule_event(lpscheduler_t * s, lpbuffer_t * buf, size_t onset_delay) {
-    lpevent_t * e;
+// Takes the cmd on the instrument and runs each param through the 
+// instrument's param update callback.
+int process_param_updates(lpinstrument_t * instrument) {
+    char cmdline[LPMAXMSG] = {0};
+    char * paramline;
+    char * keytoken;
+    char * valtoken;
+    char * cmdline_save;
+    char * paramline_save;
 
-    /*
-    if(s->nursery_head != NULL) {
-        e = s->nursery_head;
-        s->nursery_head = (void *)e->next;
-        e->next = NULL; 
-    } else {
-        e = (lpevent_t *)LPMemoryPool.alloc(1, sizeof(lpevent_t));
-        s->event_count += 1;
-        e->id = s->event_count;
-        e->onset = 0;
-        e->callback_onset = 0;
+    if(instrument->msg.flags & LPFLAG_IS_ENCODED_PARAM) {
+        return process_encoded_param_updates(instrument);
     }
-    */
-    e = (lpevent_t *)LPMemoryPool.alloc(1, sizeof(lpevent_t));
-    s->event_count += 1;
-    e->id = s->event_count;
-    e->onset = 0;
-    e->callback_onset = 0;
-
-    e->buf = buf;
-    e->pos = 0;
-    e->onset = s->ticks + onset_delay;
 
-    syslog(LOG_INFO, "scheduling event ID %ld\n", e->id);
-    syslog(LOG_INFO, "scheduler got buffer with onset %ld\n", e->onset);
-    syslog(LOG_INFO, "scheduler got buffer value 10 %f\n", buf->data[10]);
+    memcpy(cmdline, instrument->msg.msg, LPMAXMSG);
 
-    start_waiting(s, e);
+    paramline = strtok_r(cmdline, " ", &cmdline_save);
+    while(paramline != NULL) {
+        keytoken = strtok_r(paramline, "=", &paramline_save);
+        if(keytoken != NULL) {
+            valtoken = strtok_r(NULL, "=", &paramline_save);
+            if(valtoken != NULL) {
+                syslog(LOG_DEBUG, "UPDATE Key: %s, Value: %s\n", keytoken, valtoken);
+                // TODO think about handling large / special values, like buffers...
+                // payload could be the shm ID like render complete messages...?
+                if(instrument->update(instrument, keytoken, valtoken) < 0) {
+                    syslog(LOG_ERR, "process_param_updates: failed to pass param (%s=%s) to update callback.\n", keytoken, valtoken);
+                }
+            }
+        }
+        paramline = strtok_r(NULL, " ", &cmdline_save);
+    }
+    return 0;
 }
 
-int scheduler_count_waiting(lpscheduler_t * s) {
-    return ll_count(s->waiting_queue_head);
-}
 
-int scheduler_count_playing(lpscheduler_t * s) {
-    return ll_count(s->playing_stack_head);
-}
+int prepare_and_send_instrument_message(lpmsg_t * msg, char msgtype) {
+    int voice_id = 0;
 
-int scheduler_count_done(lpscheduler_t * s) {
-    return ll_count(s->nursery_head);
-}
+    /* Get the voice ID from the voice ID counter */
+    if((voice_id = lpcounter_read_and_increment("voiceid")) < 0) {
+        syslog(LOG_ERR, "Error getting voice ID: (%d) %s\n", errno, strerror(errno));
+        return -1;
+    }
 
-int scheduler_is_playing(lpscheduler_t * s) {
-    int playing;
-    playing = 0;
-    if(scheduler_count_waiting(s) > 0) playing = 1;
-    if(scheduler_count_playing(s) > 0) playing = 1;
-    return playing;
-}
+    /* Initialize the count and set the voice_id */
+    msg->count = 0;
+    msg->voice_id = voice_id;
 
-void scheduler_destroy(lpscheduler_t * s) {
-    /* Loop over queues and free buffers, events */
-    lpevent_t * current;
-    lpevent_t * next;
+    switch(msgtype) {
+        case PLAY_MESSAGE:
+            msg->type = LPMSG_PLAY;
+            break;
 
-    if(s->waiting_queue_head != NULL) {
-        current = s->waiting_queue_head;
-        while(current->next != NULL) {
-            next = (lpevent_t *)current->next;
-            LPMemoryPool.free(current);
-            current = (lpevent_t *)next;        
-        }
-        LPMemoryPool.free(current);
-    }
+        case TRIGGER_MESSAGE:
+            msg->type = LPMSG_TRIGGER;
+            break;
 
-    if(s->playing_stack_head != NULL) {
-        current = s->playing_stack_head;
-        while(current->next != NULL) {
-            next = (lpevent_t *)current->next;
-            LPMemoryPool.free(current);
-            current = (lpevent_t *)next;        
-        }
-        LPMemoryPool.free(current);
-    }
+        case SERIAL_MESSAGE:
+            msg->type = LPMSG_SERIAL;
+            break;
 
-    if(s->nursery_head != NULL) {
-        current = s->nursery_head;
-        while(current->next != NULL) {
-            next = (lpevent_t *)current->next;
-            LPMemoryPool.free(current);
-            current = (lpevent_t *)next;        
-        }
-        LPMemoryPool.free(current);
-    }
-    LPMemoryPool.free(s->now);
-    LPMemoryPool.free(s->current_frame);
-    LPMemoryPool.free(s);
-}
+        case UPDATE_MESSAGE:
+            msg->type = LPMSG_UPDATE;
+            if(astrid_params_encode(msg) < 0) {
+                syslog(LOG_WARNING, "Could not encode update params, sending them as text\n");
+            }
+            break;
 
-int scheduler_cleanup_nursery(lpscheduler_t * s) {
-    /* Loop over nursery and free buffers */
-    lpevent_t * current;
-    lpevent_t * next;
+        case LOAD_MESSAGE:
+            msg->type = LPMSG_LOAD;
+            break;
 
-    if(s->nursery_head == NULL) return 0;
+        case SCHEDULE_MESSAGE:
+            msg->type = LPMSG_SCHEDULE;
+            break;
 
-    if(pthread_mutex_lock(&astrid_nursery_lock) != 0) {
-        syslog(LOG_ERR, "Error getting lock on nursery mutex\n");
-        return -1;
-    }
+        case SHUTDOWN_MESSAGE:
+            msg->type = LPMSG_SHUTDOWN;
+            break;
 
-    current = s->nursery_head;
-    while(current->next != NULL) {
-        next = (lpevent_t *)current->next;
-        syslog(LOG_INFO, "freeing event ID %ld\n", current->id);
-        LPBuffer.destroy(current->buf);
-        free(current);
-        current = next;        
-    }
+        case SET_COUNTER_MESSAGE:
+            msg->type = LPMSG_SET_COUNTER;
+            break;
 
-    if(current != NULL) {
-        syslog(LOG_INFO, "freeing event ID %ld\n", current->id);
-        LPBuffer.destroy(current->buf);
-        free(current);
-    }
+        case VOICE_MESSAGE:
+            msg->type = LPMSG_VOICE;
+            break;
 
-    s->nursery_head = NULL;
+        default:
+            syslog(LOG_CRIT, "Bad msgtype! %c\n", msgtype);
+            return -1;
+    }
 
-    if(pthread_mutex_unlock(&astrid_nursery_lock) != 0) {
-        syslog(LOG_ERR, "Error releasing lock on nursery mutex\n");
+    if(send_play_message(*msg) < 0) {
+        syslog(LOG_ERR, "Could not send play message...\n");
         return -1;
     }
 
-    //scheduler_debug(s);
+    // FIXME -- maybe set this elsewhere to let cleanup happen first?
+    //if(msg->type == LPMSG_SHUTDOWN) instrument->is_running = 0;
+
     return 0;
 }
 
-int astrid_instrument_jack_callback(jack_nframes_t nframes, void * arg) {
-    lpinstrument_t * instrument = (lpinstrument_t *)arg;
-    float * output_channels[instrument->channels];
-    float * input_channels[instrument->channels];
-    size_t i;
-    int c;
-
-    if(!instrument->is_running) return 0;
-
-    if(!instrument->has_been_initialized) {
-        syslog(LOG_DEBUG, "Seeding the random number generator from the audio callback. %s\n", instrument->name);
-        LPRand.preseed();
-        instrument->has_been_initialized = 1;
-        // TODO could run the before callback here maybe, 
-        // or is there a reason to have mainthread-before AND audiothread-before?
-    }
-
-    for(c=0; c < instrument->channels; c++) {
-        input_channels[c] = (float *)jack_port_get_buffer(instrument->inports[c], nframes);
-        output_channels[c] = (float *)jack_port_get_buffer(instrument->outports[c], nframes);
-        memset(output_channels[c], 0, nframes * sizeof(float));
-    }
+int parse_message_from_args(int argc, int arg_offset, char * argv[], lpmsg_t * msg) {
+    int bytesread, a, i, length;
+    char msgtype;
+    char message_params[LPMAXMSG] = {0};
+    char instrument_name[LPMAXNAME] = {0};
+    size_t instrument_name_length;
 
-    /* write the block into the adc ringbuffer */
-    if(lpsampler_write_ringbuffer_block(instrument->adcname, instrument->adcbuf, input_channels, instrument->channels, nframes) < 0) {
-        syslog(LOG_ERR, "Error writing into adc ringbuf\n");
-        return 0;
-    }
+    instrument_name_length = 0;
+    msgtype = argv[arg_offset + 1][0];
 
-    /* mix in async renders */
-    for(i=0; i < (size_t)nframes; i++) {
-        lpscheduler_tick(instrument->async_mixer);
-        for(c=0; c < instrument->channels; c++) {
-            output_channels[c][i] += instrument->async_mixer->current_frame[c];
+    /* Prepare the message param string */
+    bytesread = 0;
+    for(a=arg_offset+2; a < argc; a++) {
+        length = strlen(argv[a]);
+        if(a==arg_offset+2) {
+            instrument_name_length = (size_t)length;
+            memcpy(instrument_name, argv[a], instrument_name_length);
+            continue;
         }
-    }
 
-    if(instrument->stream != NULL) {
-        if(instrument->stream((size_t)nframes, input_channels, output_channels, (void *)instrument) < 0) {
-            return -1;
+        for(i=0; i < length; i++) {
+            message_params[bytesread] = argv[a][i];
+            bytesread++;
         }
+        message_params[bytesread] = SPACE;
+        bytesread++;
     }
 
-    /* clamp output */
-    for(c=0; c < instrument->channels; c++) {
-        for(i=0; i < (size_t)nframes; i++) {
-            output_channels[c][i] = fmax(-1.f, fmin(output_channels[c][i], 1.f));
-        }
-    }
+    /* Set up the message struct */
+    strncpy(msg->instrument_name, instrument_name, instrument_name_length);
+    strncpy(msg->msg, message_params, bytesread);
 
-    /* write the output block into the resampler ringbuffer */
-    if(lpsampler_write_ringbuffer_block(instrument->resamplername, instrument->resamplerbuf, output_channels, instrument->channels, nframes) < 0) {
-        syslog(LOG_ERR, "Error writing into adc ringbuf\n");
-        return 0;
+    if(prepare_and_send_instrument_message(msg, msgtype) < 0) {
+        syslog(LOG_ERR, "Could not prepare message of type %c: (%d) %s\n", msgtype, errno, strerror(errno));
+        return -1;
     }
 
     return 0;
 }
 
-/* instrument seq priority queue callbacks */
-static int msgpq_cmp_pri(double next, double curr) {
-    return (next > curr);
-}
-
-static double msgpq_get_pri(void * a) {
-    return ((lpmsgpq_node_t *)a)->timestamp;
-}
-
-static void msgpq_set_pri(void * a, double timestamp) {
-    ((lpmsgpq_node_t *)a)->timestamp = timestamp;
-}
+int parse_message_from_cmdline(char * cmdline, size_t cmdlength, lpmsg_t * msg) {
+    int tokenlength;
+    char *token, *save=NULL;
+    char msgtype;
+    char cmd_copy[LPMAXMSG] = {0};
 
-static size_t msgpq_get_pos(void * a) {
-    return ((lpmsgpq_node_t *)a)->pos;
-}
+    if(cmdline == NULL) return 0;
 
-static void msgpq_set_pos(void * a, size_t pos) {
-    ((lpmsgpq_node_t *)a)->pos = pos;
-}
+    // strtok clobbers input
+    memcpy(cmd_copy, cmdline, cmdlength);
 
-int instrument_seq_remove_nodes_by_voice_id(pqueue_t * msgpq, size_t voice_id) {
-    lpmsgpq_node_t * node;
-    lpmsg_t * msg;
-    void * d;
-    size_t i;
+    // Get the message type, and ignore everything else for now...
+    token = strtok_r(cmd_copy, " ", &save);
+    msgtype = token[0]; // msg types only use the first char
+    tokenlength = strlen(token);
 
-    for(i=0; i < msgpq->size; i++) {
-        d = msgpq->d[i];                
-        if(d == NULL) {
-            syslog(LOG_DEBUG, "STOP: d[%d] is NULL\n", (int)i);
-            continue;
-        }
+    memset(msg->msg, 0, LPMAXMSG);
+    strncpy(msg->msg, cmdline + tokenlength, cmdlength - tokenlength);
 
-        node = (lpmsgpq_node_t *)d;
-        msg = &node->msg;
-        if(msg->voice_id == voice_id) {
-            syslog(LOG_DEBUG, "STOP: removing node & freeing memory for voice id %ld\n", voice_id);
-            pqueue_remove(msgpq, d);
-        }
+    if(prepare_and_send_instrument_message(msg, msgtype) < 0) {
+        syslog(LOG_ERR, "Could not prepare message of type %c: (%d) %s\n", msgtype, errno, strerror(errno));
+        return -1;
     }
 
     return 0;
 }
 
-void * instrument_seq_pq(void * arg) {
-    lpinstrument_t * instrument = (lpinstrument_t *)arg;
-    lpmsg_t * msg;
-    lpmsgpq_node_t * node;
-    void * d;
-    double now;
+int midi_triggerq_open() {
+    int qfd;
 
-    now = 0;
-    syslog(LOG_DEBUG, ":::: INSTRUMENT SEQ PQ STARTING ::::\n");
+    umask(0);
+    if(mkfifo(ASTRID_MIDI_TRIGGERQ_PATH, S_IRUSR | S_IWUSR | S_IWGRP) == -1 && errno != EEXIST) {
+        syslog(LOG_ERR, "midi_triggerq_open mkfifo: Error creating msg queue FIFO. Error: %s\n", strerror(errno));
+        return -1;
+    }
 
-    d = NULL;
-    msg = NULL;
-    node = NULL;
+    if((qfd = open(ASTRID_MIDI_TRIGGERQ_PATH, O_RDWR)) < 0) {
+        syslog(LOG_ERR, "midi_triggerq_open open: Error opening msg queue FIFO. Error: %s\n", strerror(errno));
+        return -1;
+    };
 
-    while(instrument->is_running) {
-        /* peek into the queue */
-        d = pqueue_peek(instrument->msgpq);
+    return qfd;
+}
 
-        /* No messages have arrived */
-        if(d == NULL) {
-            usleep((useconds_t)500);
-            continue;
-        }
+int midi_triggerq_schedule(int qfd, lpmidievent_t t) {
+    if(write(qfd, &t, sizeof(lpmidievent_t)) != sizeof(lpmidievent_t)) {
+        syslog(LOG_ERR, "midi_triggerq_schedule write: Could not write to q. Error: %s\n", strerror(errno));
+        return -1;
+    }
 
-        /* There is a message! */
-        node = (lpmsgpq_node_t *)d;
-        msg = &node->msg;
+    return 0;
+}
 
-        if(msg->type == LPMSG_SHUTDOWN) {
-            break;
-        }
+int midi_triggerq_close(int qfd) {
+    if(close(qfd) == -1) {
+        syslog(LOG_ERR, "midi_triggerq_close close: Error closing msg queue FIFO. Error: %s\n", strerror(errno));
+        return -1; 
+    }
 
-        /* Get now */
-        if(lpscheduler_get_now_seconds(&now) < 0) {
-            syslog(LOG_CRIT, "Error getting now in message scheduler\n");
-            exit(1);
-        }
+    return 0;
+}
 
-        /* If msg timestamp is in the future, 
-         * sleep for a bit and then try again */
-        if(node->timestamp > now) {
-            usleep((useconds_t)500);
-            continue;
-        }
 
-        /* Send it along to the instrument message fifo */
-        if(send_play_message(*msg) < 0) {
-            syslog(LOG_ERR, "Error sending play message from message priority queue\n");
-            usleep((useconds_t)500);
-            continue;
-        }
+/* SCHEDULING
+ * and MIXING
+ * **********/
+int lpscheduler_get_now_seconds(double * now) {
+    clockid_t cid;
+    struct timespec ts;
 
-        /* And remove it from the pq */
-        if(pqueue_remove(instrument->msgpq, d) < 0) {
-            syslog(LOG_ERR, "pqueue_remove: problem removing message from the pq\n");
-            usleep((useconds_t)500);
-        }
+#if defined(__linux__)
+    cid = CLOCK_MONOTONIC_RAW;
+#else
+    cid = CLOCK_MONOTONIC;
+#endif
+
+    if(astrid_offline_clock != NULL) {
+        *now = astrid_offline_clock->start_seconds + (double)atomic_load(&astrid_offline_clock->frame) / astrid_offline_clock->samplerate;
+        return 0;
     }
 
-    syslog(LOG_INFO, "Message scheduler pq thread shutting down...\n");
+    if(clock_gettime(cid, &ts) < 0) {
+        syslog(LOG_ERR, "scheduler_get_now_seconds: clock_gettime error: %s\n", strerror(errno));
+        return -1; 
+    }
+
+    *now = ts.tv_sec + ts.tv_nsec * 1e-9;
+
     return 0;
 }
 
-int relay_message_to_seq(lpinstrument_t * instrument, lpmsg_t msg) {
-    lpmsgpq_node_t * d;
-    double seq_delay, now=0;
+void scheduler_get_now(struct timespec * now) {
+    clock_gettime(CLOCK_MONOTONIC_RAW, now);
+}
 
-    syslog(LOG_DEBUG, "SEQ PQ MSG: got a scheduled message to insert into the sequencer priority queue\n");
-    syslog(LOG_DEBUG, "SEQ PQ MSG: pqnode_index=%d\n", instrument->pqnode_index);
+void scheduler_frames_to_timespec(
+    size_t frames, 
+    lpfloat_t samplerate, 
+    struct timespec * ts
+) {
+    size_t ns;
 
-    d = &instrument->pqnodes[instrument->pqnode_index];
-    memcpy(&d->msg, &msg, sizeof(lpmsg_t));
-    instrument->pqnode_index += 1;
-    while(instrument->pqnode_index >= NUM_NODES) instrument->pqnode_index -= NUM_NODES;
+    ts->tv_sec = (time_t)(frames / samplerate);
 
-    if(lpscheduler_get_now_seconds(&now) < 0) {
-        syslog(LOG_CRIT, "SEQ PQ MSG: Error getting now in seq relay\n");
-        return -1;
+    ns = frames - (size_t)(ts->tv_sec * samplerate);
+    ts->tv_nsec = (size_t)(ns / samplerate);
+}
+
+void scheduler_increment_timespec_by_ns(
+    struct timespec * ts, 
+    size_t ns
+) {
+    size_t seconds = 0;
+    while(ns >= 1000000000) {
+        ns -= 1000000000;
+        seconds += 1;
     }
 
-    /* Hold on to the message as long as possible while still 
-     * trying to leave some time for processing before the target deadline */
-    seq_delay = msg.scheduled - (msg.max_processing_time * 2);
-    d->timestamp = msg.initiated + seq_delay;
+    ts->tv_sec += seconds;
+    ts->tv_nsec += ns;
+}
 
-    syslog(LOG_DEBUG, "d->timestamp=%f msg.scheduled=%f msg.initiated=%f\n",
-                    d->timestamp, msg.scheduled, msg.initiated);
+size_t scheduler_timespec_to_ticks(
+    lpscheduler_t * s, 
+    struct timespec * ts
+) {
+    size_t secs, nsecs, total_ns;     
 
-    // Remove the scheduled flag before relaying the message
-    d->msg.flags &= ~LPFLAG_IS_SCHEDULED;
+    /* Seconds and nanoseconds since init */
+    secs = ts->tv_sec - s->init->tv_sec;
+    nsecs = ts->tv_nsec - s->init->tv_nsec;
 
-    if(pqueue_insert(instrument->msgpq, (void *)d) < 0) {
-        syslog(LOG_ERR, "SEQ PQ MSG: Error while inserting message into pq during msgq loop: %s\n", strerror(errno));
-        return -1;
-    }
+    /* Convert nanoseconds since init to number of 
+     * ticks since init.
+     *
+     * ticks advance on frame boundries as the scheduler 
+     * processes each frame of output.
+     *
+     * `tick_ns` is the number of nanoseconds 
+     * per frame at the current samplerate.
+     **/
+    total_ns = nsecs + (secs * 1000000000);
+    return total_ns / s->tick_ns;
+}
 
-    return 0;
+int scheduler_onset_has_elapsed(lpscheduler_t * s, struct timespec * ts) {
+    printf(" s->now->tv_sec: %d\n", (int)s->now->tv_sec);
+    printf("     ts->tv_sec: %d\n", (int)ts->tv_sec);
+    printf("s->now->tv_nsec: %d\n", (int)s->now->tv_nsec);
+    printf("    ts->tv_nsec: %d\n", (int)ts->tv_nsec);
+
+    return ((
+            s->now->tv_sec >= ts->tv_sec
+        ) || (
+            s->now->tv_sec == ts->tv_sec &&
+            s->now->tv_nsec >= ts->tv_nsec
+        )
+    ) ? 1 : 0;
 }
 
-void * instrument_cleanup_thread(void * arg) {
-    lpinstrument_t * instrument = (lpinstrument_t *)arg;
-    /* free buffers that are done playing */
-    while(instrument->is_running) {
-        if(scheduler_cleanup_nursery(instrument->async_mixer) < 0) {
-            syslog(LOG_ERR, "%s cleanup thread: Could not cleanup nursery. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+void ll_display(lpevent_t * head) {
+    lpevent_t * current;
+    if(head) {
+        current = head;
+        while(current->next != NULL) {
+            syslog(LOG_DEBUG, "    e%ld onset: %ld pos: %ld length: %ld\n", current->id, current->onset, current->pos, current->buf->length);
+            current = (lpevent_t *)current->next;        
         }
-        usleep((useconds_t)10000);
+        syslog(LOG_DEBUG, "    e%ld onset: %ld pos: %ld length: %ld\n", current->id, current->onset, current->pos, current->buf->length);
     }
+}
 
-    if(scheduler_cleanup_nursery(instrument->async_mixer) < 0) {
-        syslog(LOG_ERR, "%s cleanup thread: Could not cleanup nursery. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+int ll_count(lpevent_t * head) {
+    lpevent_t * current;
+    int count;
+
+    count = 0;
+
+    if(head) {
+        count = 1;
+        current = head;
+        while(current->next != NULL) {
+            current = (lpevent_t *)current->next;        
+            count += 1;
+        }
     }
 
-    return NULL;
+    return count;
 }
 
-void * instrument_message_thread(void * arg) {
-    lpmsg_t bufmsg = {0}; // the message serialized along with the async buffer...
-    lpbuffer_t * buf; // async renders: FIXME, do renders in a thread if possible... or fork out early for the python interpreter maybe?
-    //double processing_time_so_far, onset_delay_in_seconds, now=0;
-    lpinstrument_t * instrument = (lpinstrument_t *)arg;
-    int is_scheduled = 0;
+/* Channel gains for the voice's current mix state. Even 
+ * channels take the left side of the balance, odd channels 
+ * the right, and mono instruments ignore pan. */
+static inline void scheduler_voice_gains(lpscheduler_t * s, lpevent_t * e, float * chgain) {
+    float level = e->mix.gain * e->mix.fade;
 
-    instrument->is_waiting = 1;
-    while(instrument->is_running) {
-        if(astrid_msgq_read(instrument->msgq, &instrument->msg) == (mqd_t) -1) {
-            syslog(LOG_ERR, "%s renderer: Could not read message from playq. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
-            usleep((useconds_t)10000);
-            return 0;
-        }
+    if(s->channels < 2) {
+        chgain[0] = chgain[1] = level;
+        return;
+    }
 
-        is_scheduled = ((instrument->msg.flags & LPFLAG_IS_SCHEDULED) == LPFLAG_IS_SCHEDULED);
-        syslog(LOG_DEBUG, "C MSG: name=%s\n", instrument->msg.instrument_name);
-        syslog(LOG_DEBUG, "C MSG: scheduled=%f\n", instrument->msg.scheduled);
-        syslog(LOG_DEBUG, "C MSG: voice_id=%d\n", (int)instrument->msg.voice_id);
-        syslog(LOG_DEBUG, "C MSG: type=%d\n", (int)instrument->msg.type);
-        syslog(LOG_DEBUG, "C MSG: flags=%d\n", (int)instrument->msg.flags);
-        syslog(LOG_DEBUG, "C MSG: is_scheduled=%d\n", is_scheduled);
+    chgain[0] = level * fminf(1.f, 2.f * (1.f - e->mix.pan));
+    chgain[1] = level * fminf(1.f, 2.f * e->mix.pan);
+}
 
-        // Handle shutdown early
-        if(instrument->msg.type == LPMSG_SHUTDOWN) {
-            syslog(LOG_DEBUG, "C MSG: shutdown\n");
-            instrument->is_running = 0;
+static inline float scheduler_voice_ramp(float value, float target, size_t * frames_left, size_t nframes) {
+    if(*frames_left <= nframes) {
+        *frames_left = 0;
+        return target;
+    }
 
-            // send the shutdown message to the seq thread and external relay
-            if(relay_message_to_seq(instrument, instrument->msg) < 0) {
-                syslog(LOG_ERR, "%s renderer: Could not read relay message to seq. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
-            }
-            if(instrument->ext_relay_enabled) {
-                if(send_message(instrument->external_relay_name, instrument->msg) < 0) {
-                    syslog(LOG_ERR, "Could not relay message\n");
-                }
-            }
+    value += (target - value) * ((float)nframes / (float)*frames_left);
+    *frames_left -= nframes;
+    return value;
+}
 
-            if(send_serial_message(instrument->msg) < 0) {
-                syslog(LOG_ERR, "Could not relay serial message\n");
-            }
+static inline void scheduler_voice_init(lpevent_t * e, size_t voice_id) {
+    e->voice_id = voice_id;
+    e->mix.gain = e->mix.gain_target = 1.f;
+    e->mix.pan = e->mix.pan_target = 0.5f;
+    e->mix.fade = e->mix.fade_target = 1.f;
+    e->mix.loop = (e->buf != NULL) ? e->buf->is_looping : 0;
+    e->mix.chgain[0] = e->mix.chgain[1] = 1.f;
+}
 
-            break;
-        }
+static void scheduler_voice_apply(lpevent_t * e, lpvoicecmd_t * cmd, int is_playing) {
+    if(cmd->flags & ASTRID_VOICE_SET_GAIN) {
+        e->mix.gain_target = cmd->gain;
+        e->mix.gain_frames = cmd->ramp_frames;
+        if(!is_playing || cmd->ramp_frames == 0) e->mix.gain = cmd->gain;
+    }
 
-        if(is_scheduled) {
-            // Scheduled messages get sent to the sequencer for handling later
-            syslog(LOG_DEBUG, "C IS SCHEDULED msg.scheduled %f\n", instrument->msg.scheduled);
-            if(relay_message_to_seq(instrument, instrument->msg) < 0) {
-                syslog(LOG_ERR, "%s renderer: Could not read relay message to seq. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
-            }
-            continue;
-        } else {
-            // All other messages get relayed externally, too, if the relay is enabled
-            if(instrument->ext_relay_enabled) {
-                syslog(LOG_DEBUG, "C MSG: relaying to ext\n");
-                if(send_message(instrument->external_relay_name, instrument->msg) < 0) {
-                    syslog(LOG_ERR, "Could not relay message\n");
-                }
-            }
-        }
+    if(cmd->flags & ASTRID_VOICE_SET_PAN) {
+        e->mix.pan_target = cmd->pan;
+        e->mix.pan_frames = cmd->ramp_frames;
+        if(!is_playing || cmd->ramp_frames == 0) e->mix.pan = cmd->pan;
+    }
 
-        // Now the fun stuff
-        switch(instrument->msg.type) {
-            case LPMSG_RENDER_COMPLETE:
-                /* FIXME do this in another thread? */
-                // Renders from the internal callback AND/OR external renderers (AKA python)
-                if((buf = deserialize_buffer(instrument->msg.msg, &bufmsg)) == NULL) {
-                    syslog(LOG_ERR, "DAC could not deserialize buffer. Error: (%d) %s\n", errno, strerror(errno));
-                    continue;
-                }
+    if(cmd->flags & ASTRID_VOICE_FADEIN) {
+        /* a voice that hasn't started fades in from silence */
+        if(!is_playing) e->mix.fade = 0.f;
+        e->mix.fade_target = 1.f;
+        e->mix.fade_frames = cmd->fade_frames;
+        e->mix.release = 0;
+    }
 
-                // tracking the render time is still useful... this might not be right place tho
-                /*
-                if(lpscheduler_get_now_seconds(&now) < 0) {
-                    syslog(LOG_ERR, "Could not get now seconds for loop retriggering\n");
-                    now = 0;
-                }
+    if(cmd->flags & ASTRID_VOICE_FADEOUT) {
+        e->mix.fade_target = 0.f;
+        e->mix.fade_frames = cmd->fade_frames;
+        e->mix.release = 1;
+    }
 
-                processing_time_so_far = now - instrument->msg.initiated;
-                onset_delay_in_seconds = instrument->msg.scheduled - processing_time_so_far;
-                if(onset_delay_in_seconds < 0) onset_delay_in_seconds = 0.f;
+    if(cmd->flags & ASTRID_VOICE_SET_LOOP) {
+        e->mix.loop = cmd->loop;
+    }
+}
 
-                instrument->msg.onset_delay = (size_t)(onset_delay_in_seconds * ASTRID_SAMPLERATE);
+static void scheduler_voice_dispatch(lpscheduler_t * s, lpvoicecmd_t * cmd) {
+    lpevent_t * current;
+    int matched = 0;
 
-                syslog(LOG_INFO, "msg.onset_delay %ld\n", instrument->msg.onset_delay);
-                */
+    /* A voice can be several events, a play that rendered more than one buffer */
+    for(current = s->playing_stack_head; current != NULL; current = (lpevent_t *)current->next) {
+        if(current->voice_id != cmd->voice_id) continue;
+        scheduler_voice_apply(current, cmd, 1);
+        matched += 1;
+    }
 
-                /* Schedule the buffer for playback */
-                syslog(LOG_INFO, "RENDER COMPLETE: scheduling buffer with value 10 %f\n", buf->data[10]);
-                scheduler_schedule_event(instrument->async_mixer, buf, 0);
-                //scheduler_debug(instrument->async_mixer);
-                break;
+    for(current = s->waiting_queue_head; current != NULL; current = (lpevent_t *)current->next) {
+        if(current->voice_id != cmd->voice_id) continue;
+        scheduler_voice_apply(current, cmd, 0);
+        scheduler_voice_gains(s, current, current->mix.chgain);
+        matched += 1;
+    }
 
-            case LPMSG_UPDATE:
-                syslog(LOG_DEBUG, "C MSG: update\n");
-                if(instrument->update == NULL) continue;
-                // decode each update param and call the callback with it
-                if(process_param_updates(instrument) < 0) {
-                    syslog(LOG_ERR, "Could not encode update messages...\n");
-                    continue;
-                }
-                //instrument->update(instrument);
-                break;
+    if(matched == 0) astrid_log(LOG_DEBUG, "No voice %ld in the mixer for voice command\n", cmd->voice_id);
+}
 
-            case LPMSG_PLAY:
-                syslog(LOG_DEBUG, "C MSG: play\n");
-                // Schedule a C callback render if there's a callback defined
-                // python renders will also be triggered at this point if we're 
-                // inside a python instrument because of the message relay
-                if(instrument->renderer != NULL) {
-                    syslog(LOG_DEBUG, "C MSG: rendering play...\n");
-                    /* FIXME do this in another thread */
-                    if(instrument->renderer(instrument) < 0) {
-                        syslog(LOG_ERR, "there was a problem rendering from the C instrument\n");
-                        continue;
-                    }
-                }
-                break;
+/* Called from the message thread */
+int scheduler_send_voice_command(lpscheduler_t * s, lpvoicecmd_t * cmd) {
+    lpvoicecmdqueue_t * q = &s->voicecmds;
+    size_t head, tail;
 
-            case LPMSG_SERIAL:
-                syslog(LOG_DEBUG, "C MSG: serial\n");
-                // serial messages get relayed from here to the special serial Q, 
-                // and then written out to the tty in the serial listener thread...
-                if(send_serial_message(instrument->msg) < 0) {
-                    syslog(LOG_ERR, "Could not send serial message...\n");
-                }
-                break;
+    head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if(head - tail >= ASTRID_VOICECMD_QUEUE_SIZE) {
+        syslog(LOG_ERR, "scheduler_send_voice_command: Voice command queue is full, dropping command for voice %ld\n", cmd->voice_id);
+        return -1;
+    }
 
-            case LPMSG_LOAD:
-                // it would be interesting to explore live reloading of C modules
-                // in the tradition of CLIVE, but at the moment only python handles these
-                syslog(LOG_DEBUG, "C MSG: load\n");
-                break;
+    q->cmds[head & (ASTRID_VOICECMD_QUEUE_SIZE-1)] = *cmd;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
 
-            case LPMSG_TRIGGER:
-                // maybe support raspberry pi GPIO pin toggling / triggers?
-                syslog(LOG_DEBUG, "C MSG: trigger\n");
-                if(instrument->trigger != NULL) instrument->trigger(instrument);
-                break;
+    return 0;
+}
 
-            case LPMSG_MIDI_FROM_DEVICE:
-                syslog(LOG_DEBUG, "C MSG: midi from device\n");
-                break;
+/* Called by the audio thread before the block is mixed: applies 
+ * pending voice commands, then moves every playing voice's mix 
+ * state across the block and sets up its per frame gain steps. */
+void scheduler_begin_block(lpscheduler_t * s, size_t nframes) {
+    lpvoicecmdqueue_t * q = &s->voicecmds;
+    lpevent_t * current;
+    size_t head, tail;
+    float end[2];
+    int c;
 
-            case LPMSG_MIDI_TO_DEVICE:
-                syslog(LOG_DEBUG, "C MSG: midi to device\n");
-                break;
+    tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&q->head, memory_order_acquire);
+    while(tail != head) {
+        scheduler_voice_dispatch(s, &q->cmds[tail & (ASTRID_VOICECMD_QUEUE_SIZE-1)]);
+        tail += 1;
+    }
+    atomic_store_explicit(&q->tail, tail, memory_order_release);
 
-            default:
-                // Garbage typed messages will shut 'er down
-                syslog(LOG_WARNING, "C MSG: got bad msg type %d\n", instrument->msg.type);
-                break;
+    if(nframes == 0) return;
+
+    for(current = s->playing_stack_head; current != NULL; current = (lpevent_t *)current->next) {
+        if(current->mix.release && current->mix.fade <= 0.f && current->mix.fade_frames == 0) {
+            current->mix.done = 1;
+        }
+
+        scheduler_voice_gains(s, current, current->mix.chgain);
+
+        current->mix.gain = scheduler_voice_ramp(current->mix.gain, current->mix.gain_target, &current->mix.gain_frames, nframes);
+        current->mix.pan = scheduler_voice_ramp(current->mix.pan, current->mix.pan_target, &current->mix.pan_frames, nframes);
+        current->mix.fade = scheduler_voice_ramp(current->mix.fade, current->mix.fade_target, &current->mix.fade_frames, nframes);
+
+        scheduler_voice_gains(s, current, end);
+        for(c=0; c < 2; c++) {
+            current->mix.chstep[c] = (end[c] - current->mix.chgain[c]) / (float)nframes;
         }
     }
+}
 
-    instrument->is_waiting = 0;
-    return 0;
+/* Add event to the tail of the waiting queue */
+static inline void start_waiting(lpscheduler_t * s, lpevent_t * e) {
+    lpevent_t * current;
+
+    if(s->waiting_queue_head == NULL) {
+        s->waiting_queue_head = e;
+    } else {
+        current = s->waiting_queue_head;
+        while(current->next != NULL) {
+            current = (lpevent_t *)current->next;        
+        }
+        current->next = (void *)e;
+    }
+} 
+
+static inline void start_playing(lpscheduler_t * s, lpevent_t * e) {
+    lpevent_t * current;
+    lpevent_t * prev;
+
+    astrid_log(LOG_DEBUG, "START playing event ID %ld\n", e->id);
+    if(astrid_stats_page != NULL) {
+        astrid_stats_gauge(&astrid_stats_page->active_voices, &astrid_stats_page->max_voices, 
+            atomic_load_explicit(&astrid_stats_page->active_voices, memory_order_relaxed) + 1);
+    }
+
+    /* Remove from the waiting queue */
+    if(s->waiting_queue_head == NULL) {
+        astrid_log(LOG_CRIT, "Cannot move this event. There is nothing in the waiting queue!\n");
+    }
+
+    prev = NULL;
+    current = s->waiting_queue_head;
+    while(current != e && current->next != NULL) {
+        prev = current;
+        current = (lpevent_t *)current->next;
+    }
+    if(prev) {
+        prev->next = current->next;
+    } else {
+        s->waiting_queue_head = (lpevent_t *)current->next;
+    }
+
+    current->next = NULL;
+
+    /* Voices starting mid-block hold their gain until the next block */
+    scheduler_voice_gains(s, e, e->mix.chgain);
+    e->mix.chstep[0] = e->mix.chstep[1] = 0.f;
+
+    /* Add to the tail of the playing queue */
+    if(s->playing_stack_head == NULL) {
+        s->playing_stack_head = e;
+    } else {
+        current = s->playing_stack_head;
+        while(current->next != NULL) {
+            current = (lpevent_t *)current->next;
+        }
+        current->next = (void *)e;
+    }
 }
 
-int astrid_instrument_seq_start(lpinstrument_t * instrument) {
-    int i;
+static inline void stop_playing(lpscheduler_t * s, lpevent_t * e) {
+    lpevent_t * current;
+    lpevent_t * prev;
 
-    /* Allocate the pq message nodes */
-    if((instrument->pqnodes = (lpmsgpq_node_t *)calloc(NUM_NODES, sizeof(lpmsgpq_node_t))) == NULL) {
-        syslog(LOG_ERR, "Could not initialize message priority queue nodes. Error: %s\n", strerror(errno));
-        return -1;
+    astrid_log(LOG_DEBUG, "STOP playing event ID %ld\n", e->id);
+    if(astrid_stats_page != NULL && atomic_load_explicit(&astrid_stats_page->active_voices, memory_order_relaxed) > 0) {
+        atomic_fetch_sub_explicit(&astrid_stats_page->active_voices, 1, memory_order_relaxed);
     }
-    memset(instrument->pqnodes, 0, NUM_NODES * sizeof(lpmsgpq_node_t));
 
-    for(i=0; i < NUM_NODES; i++) {
-        instrument->pqnodes[i].index = i;
+    /* Remove from the playing stack */
+    if(s->playing_stack_head == NULL) {
+        astrid_log(LOG_CRIT, "Cannot move this event. There is nothing in the waiting queue!\n");
+        return;
     }
 
-    /* Create the message priority queue */
-    if((instrument->msgpq = pqueue_init(NUM_NODES, msgpq_cmp_pri, msgpq_get_pri, msgpq_set_pri, msgpq_get_pos, msgpq_set_pos)) == NULL) {
-        syslog(LOG_ERR, "Could not initialize message priority queue. Error: %s\n", strerror(errno));
-        return -1;
+    prev = NULL;
+    current = s->playing_stack_head;
+    while(current != e && current->next != NULL) {
+        prev = current;
+        current = (lpevent_t *)current->next;
     }
 
-    /* Start message pq thread */
-    if(pthread_create(&instrument->message_scheduler_pq_thread, NULL, instrument_seq_pq, (void*)instrument) != 0) {
-        syslog(LOG_ERR, "Could not initialize message scheduler pq thread. Error: %s\n", strerror(errno));
-        return -1;
+    if(prev) {
+        prev->next = current->next;
+    } else {
+        s->playing_stack_head = (lpevent_t *)current->next;
     }
 
-    return 0;
+    current->next = NULL;
+
+    /* Add to the tail of the garbage stack */
+    if(pthread_mutex_lock(&astrid_nursery_lock) != 0) {
+        syslog(LOG_ERR, "Error getting lock on nursery mutex\n");
+        return;
+    }
+    if(s->nursery_head == NULL) {
+        s->nursery_head = e;
+    } else {
+        current = s->nursery_head;
+        while(current->next != NULL) {
+            current = (lpevent_t *)current->next;
+        }
+        current->next = (void *)e;
+    }
+    if(pthread_mutex_unlock(&astrid_nursery_lock) != 0) {
+        syslog(LOG_ERR, "Error getting lock on nursery mutex\n");
+        return;
+    }
 }
 
-#if 0
-// This was fun to write but...
-int encode_serial_msg(lpmsg_t * msg) {
-    char c=0, lastc=SPACE;
-    char token[100] = {0}; // 100 chars is prolly enough for single precision floats
-    int scan_pos=0, token_chars_read=0, token_count=0;
-    uint8_t type=0, id=0;
-    float value = 0.f;
-    lpserialmsg_t smsg;
+lpscheduler_t * scheduler_create(int realtime, int channels, lpfloat_t samplerate) {
+    lpscheduler_t * s;
 
-    syslog(LOG_DEBUG, "Encoding msg.msg `%s` for serial transmission!\n", msg->msg);
+    s = (lpscheduler_t *)LPMemoryPool.alloc(1, sizeof(lpscheduler_t));
+    s->now = (struct timespec *)LPMemoryPool.alloc(1, sizeof(struct timespec));
 
-    int num_tokens = 3;
-    int parse_order[3] = {
-        LPPARAM_STRING, // The message type
-        LPPARAM_INT,    // The id
-        LPPARAM_FLOAT   // The value
-    };
+    s->realtime = realtime;
 
-    c = msg->msg[scan_pos];
-    while(scan_pos < (int)LPMAXMSG && token_count < num_tokens) {
-        scan_pos += 1;
+    s->waiting_queue_head = NULL;
+    s->playing_stack_head = NULL;
+    s->nursery_head = NULL;
 
-        /* Prevent overflow on long-ass tokens */
-        if(token_chars_read >= 100) continue;
+    s->samplerate = samplerate;
+    s->channels = channels;
 
-        if((c == SPACE || c == '\0') && lastc != SPACE) {
-            token[token_chars_read] = '\0';
-            switch(parse_order[token_count]) {
-                case LPPARAM_STRING:
-                    // just look at the first char to determine the message type
-                    switch(token[0]) {
-                        case 'm':
-                            type = SMSG_MOTOR_SPEED;
-                            break;
+    s->tick_ns = (size_t)(samplerate / 1000000000.f);
 
-                        case 's':
-                            type = SMSG_SOLENOID_TRIGGER;
-                            break;
+    if(realtime == 1) scheduler_get_now(s->now);
+    s->ticks = 0;
+    s->current_frame = (lpfloat_t *)LPMemoryPool.alloc(channels, sizeof(lpfloat_t));
 
-                        default:
-                            type = SMSG_UNKNOWN;
-                            break;
-                    }
-                    break;
+    s->event_count = 0;
 
-                case LPPARAM_INT:
-                    id = atoi(token);
-                    break;
+    return s;
+}
 
-                case LPPARAM_FLOAT:
-                    value = atof(token);
-                    break;
+/* Events with a target frame start exactly on it, 
+ * the rest once the mixer reaches their onset tick */
+static inline int scheduler_event_is_due(lpscheduler_t * s, lpevent_t * e) {
+    if(e->target_frame > 0) return s->frame >= e->target_frame;
+    return s->ticks >= e->onset;
+}
 
-                default:
-                    break;
-            }
+static inline void scheduler_record_jitter(lpscheduler_t * s, lpevent_t * e) {
+    size_t late, max_late;
 
-            token_chars_read = 0;
-            token_count += 1;
-        } else if(c != SPACE) {
-            token[token_chars_read] = c;
-            token_chars_read += 1;
+    if(e->target_frame == 0) return;
+
+    atomic_fetch_add(&s->jitter.count, 1);
+    if(s->frame <= e->target_frame) return;
+
+    late = (size_t)(s->frame - e->target_frame);
+    atomic_fetch_add(&s->jitter.late, 1);
+    atomic_fetch_add(&s->jitter.total_late, late);
+    max_late = atomic_load(&s->jitter.max_late);
+    if(late > max_late) atomic_store(&s->jitter.max_late, late);
+}
+
+/* Streams wait for their safety lead before they start */
+static inline int scheduler_event_is_ready(lpevent_t * e) {
+    if(e->stream == NULL) return 1;
+    return atomic_load(&e->stream->done) || atomic_load(&e->stream->write_pos) >= e->stream->lead;
+}
+
+static inline void scheduler_update_playing(lpscheduler_t * s, lpevent_t * e) {
+    int done;
+
+    if(e->mix.done) {
+        stop_playing(s, e);
+        return;
+    }
+
+    if(e->stream != NULL) {
+        /* Read done before write_pos so a finished 
+         * stream is always drained to the last frame */
+        done = atomic_load(&e->stream->done);
+        e->stream_avail = atomic_load(&e->stream->write_pos);
+        if(done && e->pos >= e->stream_avail) {
+            stop_playing(s, e);
         }
+        return;
+    }
 
-        if(c == '\0') break;
-        lastc = c;
-        c = msg->msg[scan_pos];
+    if(e->buf != NULL && !e->mix.loop && e->pos >= e->buf->length-1) {
+        stop_playing(s, e);
     }
+}
 
-    smsg.type = type;
-    smsg.id = id;
-    smsg.value = value;
+static inline lpfloat_t scheduler_event_sample(lpevent_t * e, int c) {
+    lpstream_t * stream;
+
+    if(e->stream != NULL) {
+        stream = e->stream;
+        if(e->pos >= e->stream_avail) return 0.f;
+        return stream->data[(e->pos % stream->capacity) * stream->channels + (c % stream->channels)];
+    }
+
+    if(e->buf != NULL && e->pos < e->buf->length) {
+        return e->buf->data[e->pos * e->buf->channels + (c % e->buf->channels)];
+    }
+
+    return 0.f;
+}
+
+static inline void scheduler_advance_event(lpevent_t * e) {
+    e->mix.chgain[0] += e->mix.chstep[0];
+    e->mix.chgain[1] += e->mix.chstep[1];
+
+    if(e->stream != NULL) {
+        /* The writer has fallen behind: hold position and play silence */
+        if(e->pos >= e->stream_avail) {
+            if(!atomic_load(&e->stream->done)) atomic_fetch_add(&e->stream->underruns, 1);
+            return;
+        }
+        e->pos += 1;
+        atomic_store(&e->stream->read_pos, e->pos);
+        return;
+    }
+
+    e->pos += 1;
+    if(e->mix.loop && e->buf != NULL && e->pos >= e->buf->length) e->pos = 0;
+}
+
+static inline void scheduler_free_event(lpevent_t * e) {
+    size_t underruns;
+
+    if(e->stream != NULL) {
+        underruns = atomic_load(&e->stream->underruns);
+        if(underruns > 0) {
+            syslog(LOG_WARNING, "stream event ID %ld underran by %ld frames\n", e->id, underruns);
+        }
+        munmap(e->stream, e->stream_size);
+        return;
+    }
+
+    LPBuffer.destroy(e->buf);
+}
+
+/* look for events waiting to be scheduled */
+static inline void scheduler_update(lpscheduler_t * s) {
+    lpevent_t * current;
+    void * next;
+    if(s->waiting_queue_head != NULL) {
+        current = s->waiting_queue_head;
+        while(current->next != NULL) {
+            next = current->next;
+            if(scheduler_event_is_due(s, current) && scheduler_event_is_ready(current)) {
+                scheduler_record_jitter(s, current);
+                start_playing(s, current);
+            }
+            current = (lpevent_t *)next;
+        }
+        if(scheduler_event_is_due(s, current) && scheduler_event_is_ready(current)) {
+            scheduler_record_jitter(s, current);
+            start_playing(s, current);
+        }
+    }
+
+    /* look for events that have finished playing */
+    if(s->playing_stack_head != NULL) {
+        current = s->playing_stack_head;
+        while(current->next != NULL) {
+            next = current->next;
+            scheduler_update_playing(s, current);
+            current = (lpevent_t *)next;
+        }
+
+        scheduler_update_playing(s, current);
+    }
+}
+
+static inline void scheduler_mix_buffers(lpscheduler_t * s) {
+    lpevent_t * current;
+    lpfloat_t sample;
+    int c;
+
+    if(s->playing_stack_head == NULL) {
+        for(c=0; c < s->channels; c++) {
+            s->current_frame[c] = 0.f;
+        }
+        return;
+    }
+
+    for(c=0; c < s->channels; c++) {
+        sample = 0.f;
+
+        current = s->playing_stack_head;
+        while(current->next != NULL) {
+            sample += scheduler_event_sample(current, c) * current->mix.chgain[c & 1];
+            current = (lpevent_t *)current->next;
+        }
+
+        sample += scheduler_event_sample(current, c) * current->mix.chgain[c & 1];
+ 
+        /* NaNs are dropped from the whole output block in the callback */
+        s->current_frame[c] = sample;
+    }
+}
+
+static inline void scheduler_advance_buffers(lpscheduler_t * s) {
+    lpevent_t * current;
+ 
+    /* loop over buffers and advance their positions */
+    if(s->playing_stack_head != NULL) {
+        current = s->playing_stack_head;
+        while(current->next != NULL) {
+            scheduler_advance_event(current);
+            current = (lpevent_t *)current->next;
+        }
+        scheduler_advance_event(current);
+    }
+}
+
+void scheduler_debug(lpscheduler_t * s) {
+    if(s->waiting_queue_head) {
+        syslog(LOG_DEBUG, "%d waiting\n", ll_count(s->waiting_queue_head));
+        ll_display(s->waiting_queue_head);
+    } else {
+        syslog(LOG_DEBUG, "none waiting\n");
+    }
+
+    if(s->playing_stack_head) {
+        syslog(LOG_DEBUG, "%d playing\n", ll_count(s->playing_stack_head));
+        ll_display(s->playing_stack_head);
+    } else {
+        syslog(LOG_DEBUG, "none playing\n");
+    }
+
+    if(s->nursery_head) {
+        syslog(LOG_DEBUG, "%d done\n\n", ll_count(s->nursery_head));
+        ll_display(s->nursery_head);
+    } else {
+        syslog(LOG_DEBUG, "none done\n");
+    }
+}
+
+void lpscheduler_tick(lpscheduler_t * s) {
+    //scheduler_debug(s);
+
+    /* Move buffers to proper lists */
+    scheduler_update(s);
+
+    /* Mix currently playing buffers into s->current_frame */
+    scheduler_mix_buffers(s);
+
+    /* Advance the position for all playing buffers */
+    scheduler_advance_buffers(s);
+
+    /* Increment process ticks and update now timestamp */
+    s->ticks += 1;
+    s->frame += 1;
+    if(s->realtime == 1) {
+        scheduler_get_now(s->now);
+    } else {
+        scheduler_increment_timespec_by_ns(s->now, s->tick_ns);
+    }
+}
+
+void scheduler_schedule_event(lpscheduler_t * s, lpbuffer_t * buf, size_t onset_delay) {
+    lpevent_t * e;
+
+    /*
+    if(s->nursery_head != NULL) {
+        e = s->nursery_head;
+        s->nursery_head = (void *)e->next;
+        e->next = NULL; 
+    } else {
+        e = (lpevent_t *)LPMemoryPool.alloc(1, sizeof(lpevent_t));
+        s->event_count += 1;
+        e->id = s->event_count;
+        e->onset = 0;
+        e->callback_onset = 0;
+    }
+    */
+    e = (lpevent_t *)LPMemoryPool.alloc(1, sizeof(lpevent_t));
+    s->event_count += 1;
+    e->id = s->event_count;
+    e->onset = 0;
+    e->callback_onset = 0;
+
+    e->buf = buf;
+    e->pos = 0;
+    e->onset = s->ticks + onset_delay;
+    scheduler_voice_init(e, 0);
+
+    astrid_log(LOG_DEBUG, "scheduling event ID %ld with onset %ld\n", e->id, e->onset);
+
+    start_waiting(s, e);
+}
+
+/* Schedule a buffer to start at an absolute JACK frame. 
+ * Buffers that arrive after their target start right away 
+ * and count as late in the jitter stats. A target of 0 
+ * starts the buffer on the next tick. */
+void scheduler_schedule_event_at(lpscheduler_t * s, lpbuffer_t * buf, uint64_t target_frame, size_t voice_id) {
+    lpevent_t * e;
+
+    e = (lpevent_t *)LPMemoryPool.alloc(1, sizeof(lpevent_t));
+    s->event_count += 1;
+    e->id = s->event_count;
+    e->callback_onset = 0;
+
+    e->buf = buf;
+    e->pos = 0;
+    e->onset = 0;
+    e->target_frame = target_frame;
+    scheduler_voice_init(e, voice_id);
+
+    astrid_log(LOG_DEBUG, "scheduling event ID %ld at frame %ld\n", e->id, (size_t)target_frame);
+
+    start_waiting(s, e);
+}
+
+/* Called by the audio thread at the start of each cycle with 
+ * the cycle's JACK frame time and its monotonic timestamp */
+void scheduler_sync_clock(lpscheduler_t * s, uint32_t cycle_frame, double cycle_seconds) {
+    unsigned int seq;
+
+    /* JACK frame times wrap at 32 bits: extend them. 
+     * This is the only writer, so relaxed loads will do. */
+    if(atomic_load_explicit(&s->clock_seconds, memory_order_relaxed) == 0) {
+        s->frame = cycle_frame;
+    } else {
+        s->frame = atomic_load_explicit(&s->clock_frame, memory_order_relaxed) + (uint32_t)(cycle_frame - s->cycle_frame);
+    }
+    s->cycle_frame = cycle_frame;
+
+    seq = atomic_load_explicit(&s->clock_seq, memory_order_relaxed);
+    atomic_store_explicit(&s->clock_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&s->clock_frame, s->frame, memory_order_relaxed);
+    atomic_store_explicit(&s->clock_seconds, cycle_seconds, memory_order_relaxed);
+    atomic_store_explicit(&s->clock_seq, seq + 2, memory_order_release);
+}
+
+/* Converts a monotonic timestamp (see lpscheduler_get_now_seconds) 
+ * into a JACK frame. Returns 0 until the clock has been synced. */
+uint64_t scheduler_seconds_to_frame(lpscheduler_t * s, double seconds) {
+    unsigned int seq;
+    uint64_t frame;
+    double clock_seconds, offset;
+
+    do {
+        seq = atomic_load_explicit(&s->clock_seq, memory_order_acquire);
+        frame = atomic_load_explicit(&s->clock_frame, memory_order_relaxed);
+        clock_seconds = atomic_load_explicit(&s->clock_seconds, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while((seq & 1) || seq != atomic_load_explicit(&s->clock_seq, memory_order_relaxed));
+
+    if(clock_seconds == 0) return 0;
+
+    offset = (seconds - clock_seconds) * s->samplerate;
+    if(offset < 0 && (uint64_t)(-offset) >= frame) return 1;
+
+    return (uint64_t)((double)frame + offset + 0.5);
+}
+
+void scheduler_log_jitter(lpscheduler_t * s, const char * name) {
+    size_t count, late;
+
+    count = atomic_load(&s->jitter.count);
+    late = atomic_load(&s->jitter.late);
+
+    syslog(LOG_INFO, "%s placement jitter: events=%ld late=%ld mean_late=%f frames max_late=%ld frames\n", name, 
+        count, late, 
+        (late > 0) ? (double)atomic_load(&s->jitter.total_late) / late : 0.f,
+        atomic_load(&s->jitter.max_late)
+    );
+}
+
+void scheduler_schedule_stream(lpscheduler_t * s, lpstream_t * stream, size_t size, size_t onset_delay, size_t voice_id) {
+    lpevent_t * e;
+
+    e = (lpevent_t *)LPMemoryPool.alloc(1, sizeof(lpevent_t));
+    s->event_count += 1;
+    e->id = s->event_count;
+    e->callback_onset = 0;
+
+    e->buf = NULL;
+    e->stream = stream;
+    e->stream_size = size;
+    e->stream_avail = 0;
+    e->pos = 0;
+    e->onset = s->ticks + onset_delay;
+    scheduler_voice_init(e, voice_id);
+
+    astrid_log(LOG_DEBUG, "scheduling stream event ID %ld with onset %ld\n", e->id, e->onset);
+
+    start_waiting(s, e);
+}
+
+int scheduler_count_waiting(lpscheduler_t * s) {
+    return ll_count(s->waiting_queue_head);
+}
+
+int scheduler_count_playing(lpscheduler_t * s) {
+    return ll_count(s->playing_stack_head);
+}
+
+int scheduler_count_done(lpscheduler_t * s) {
+    return ll_count(s->nursery_head);
+}
+
+int scheduler_is_playing(lpscheduler_t * s) {
+    int playing;
+    playing = 0;
+    if(scheduler_count_waiting(s) > 0) playing = 1;
+    if(scheduler_count_playing(s) > 0) playing = 1;
+    return playing;
+}
+
+void scheduler_destroy(lpscheduler_t * s) {
+    /* Loop over queues and free buffers, events */
+    lpevent_t * current;
+    lpevent_t * next;
+
+    if(s->waiting_queue_head != NULL) {
+        current = s->waiting_queue_head;
+        while(current->next != NULL) {
+            next = (lpevent_t *)current->next;
+            LPMemoryPool.free(current);
+            current = (lpevent_t *)next;        
+        }
+        LPMemoryPool.free(current);
+    }
+
+    if(s->playing_stack_head != NULL) {
+        current = s->playing_stack_head;
+        while(current->next != NULL) {
+            next = (lpevent_t *)current->next;
+            LPMemoryPool.free(current);
+            current = (lpevent_t *)next;        
+        }
+        LPMemoryPool.free(current);
+    }
+
+    if(s->nursery_head != NULL) {
+        current = s->nursery_head;
+        while(current->next != NULL) {
+            next = (lpevent_t *)current->next;
+            LPMemoryPool.free(current);
+            current = (lpevent_t *)next;        
+        }
+        LPMemoryPool.free(current);
+    }
+    LPMemoryPool.free(s->now);
+    LPMemoryPool.free(s->current_frame);
+    LPMemoryPool.free(s);
+}
+
+int scheduler_cleanup_nursery(lpscheduler_t * s) {
+    /* Loop over nursery and free buffers */
+    lpevent_t * current;
+    lpevent_t * next;
+
+    if(s->nursery_head == NULL) return 0;
+
+    if(pthread_mutex_lock(&astrid_nursery_lock) != 0) {
+        syslog(LOG_ERR, "Error getting lock on nursery mutex\n");
+        return -1;
+    }
+
+    current = s->nursery_head;
+    while(current->next != NULL) {
+        next = (lpevent_t *)current->next;
+        astrid_log(LOG_DEBUG, "freeing event ID %ld\n", current->id);
+        scheduler_free_event(current);
+        free(current);
+        current = next;        
+    }
+
+    if(current != NULL) {
+        astrid_log(LOG_DEBUG, "freeing event ID %ld\n", current->id);
+        scheduler_free_event(current);
+        free(current);
+    }
+
+    s->nursery_head = NULL;
+
+    if(pthread_mutex_unlock(&astrid_nursery_lock) != 0) {
+        syslog(LOG_ERR, "Error releasing lock on nursery mutex\n");
+        return -1;
+    }
+
+    //scheduler_debug(s);
+    return 0;
+}
+
+/* Set on the threads that run audio blocks, which must not block on LMDB */
+static _Thread_local int astrid_thread_is_realtime = 0;
+
+static lpparamslot_t * astrid_paramcache_find(lpparamcache_t * cache, int param_index, int create) {
+    /* Open addressing with linear probing. Returns NULL when 
+     * the param isn't cached (and create is off) or the table is full. */
+    long long key, current;
+    size_t i, pos;
+
+    if(cache == NULL) return NULL;
+
+    key = (long long)param_index + 1;
+    pos = (size_t)(((uint32_t)param_index * 2654435761u) & (ASTRID_MAX_PARAMS-1));
+    for(i=0; i < ASTRID_MAX_PARAMS; i++) {
+        current = atomic_load(&cache->slots[pos].key);
+        if(current == key) return &cache->slots[pos];
+        if(current == 0) {
+            if(!create) return NULL;
+            if(atomic_compare_exchange_strong(&cache->slots[pos].key, &current, key)) return &cache->slots[pos];
+            if(current == key) return &cache->slots[pos];
+        }
+        pos = (pos + 1) & (ASTRID_MAX_PARAMS-1);
+    }
+
+    return NULL;
+}
+
+static lpparamcache_t * astrid_paramtables_enter(lpinstrument_t * instrument, int * table) {
+    /* Counts the caller in on the live table until it calls 
+     * astrid_paramtables_exit. Never blocks. */
+    lpparamtables_t * tables = instrument->paramtables;
+    int live;
+
+    if(tables == NULL) return NULL;
+
+    while(1) {
+        live = atomic_load(&tables->live);
+        atomic_fetch_add(&tables->readers[live], 1);
+        /* Swapped out before we were counted: try the new one */
+        if(atomic_load(&tables->live) == live) break;
+        atomic_fetch_sub(&tables->readers[live], 1);
+    }
+
+    *table = live;
+    return &tables->tables[live];
+}
+
+static void astrid_paramtables_exit(lpinstrument_t * instrument, int table) {
+    atomic_fetch_sub(&instrument->paramtables->readers[table], 1);
+}
+
+static void astrid_paramtables_drain(lpinstrument_t * instrument, int table) {
+    /* Waits for accesses that started before the table was 
+     * swapped out. A reader that died inside one would hold 
+     * the count forever, so give up after a while. */
+    struct timespec start, now, wait = {0, 100000};
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while(atomic_load(&instrument->paramtables->readers[table]) > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1000000000.0 > ASTRID_PARAM_DRAIN_TIMEOUT) {
+            syslog(LOG_WARNING, "%s param tables: %d readers still on the idle table, overwriting it anyway\n", instrument->name, atomic_load(&instrument->paramtables->readers[table]));
+            return;
+        }
+        nanosleep(&wait, NULL);
+    }
+}
+
+static void astrid_parammorph_retire(lpinstrument_t * instrument, lpparammorph_t * morph) {
+    /* Lock free push, safe from the audio thread */
+    morph->next = atomic_load(&instrument->parammorph_retired);
+    while(!atomic_compare_exchange_weak(&instrument->parammorph_retired, &morph->next, morph));
+}
+
+static void astrid_parammorph_free_retired(lpinstrument_t * instrument) {
+    lpparammorph_t * morph, * next;
+
+    morph = atomic_exchange(&instrument->parammorph_retired, NULL);
+    while(morph != NULL) {
+        next = morph->next;
+        free(morph);
+        morph = next;
+    }
+}
+
+static int astrid_paramslot_read(lpparamslot_t * slot, size_t offset, void * value, size_t size) {
+    /* Copies up to size bytes of the value from offset. 
+     * Returns the number of bytes copied, -1 if the slot 
+     * holds nothing yet, or -2 if a writer held it for more 
+     * than ASTRID_PARAM_READ_SPINS tries. Never blocks. */
+    unsigned int seq;
+    size_t copied;
+    int spins;
+
+    if(!atomic_load(&slot->loaded)) return -1;
+
+    for(spins=0; spins < ASTRID_PARAM_READ_SPINS; spins++) {
+        if((seq = atomic_load(&slot->seq)) & 1) continue;
+        copied = (offset < slot->size) ? slot->size - offset : 0;
+        if(copied > size) copied = size;
+        memcpy(value, slot->value + offset, copied);
+        atomic_thread_fence(memory_order_acquire);
+        if(atomic_load(&slot->seq) == seq) return (int)copied;
+    }
+
+    return -2;
+}
+
+static void astrid_paramslot_write(lpparamslot_t * slot, const void * value, size_t size, uint32_t type, int dirty) {
+    unsigned int seq;
+
+    /* Writers take the seqlock by making it odd */
+    seq = atomic_load(&slot->seq);
+    while((seq & 1) || !atomic_compare_exchange_weak(&slot->seq, &seq, seq + 1)) {
+        seq = atomic_load(&slot->seq);
+    }
+
+    memcpy(slot->value, value, size);
+    slot->size = (uint32_t)size;
+    if(type != LPPARAM_NONE) slot->type = type;
+
+    /* Marked loaded before release so a fill can't clobber it */
+    atomic_store(&slot->loaded, 1);
+    atomic_store(&slot->seq, seq + 2);
+
+    if(dirty) atomic_store(&slot->dirty, 1);
+}
+
+static void astrid_paramslot_fill(lpparamslot_t * slot, const void * value, size_t size) {
+    /* Like a clean write, but loses to any value set meanwhile */
+    unsigned int seq;
+
+    seq = atomic_load(&slot->seq);
+    while((seq & 1) || !atomic_compare_exchange_weak(&slot->seq, &seq, seq + 1)) {
+        seq = atomic_load(&slot->seq);
+    }
+
+    if(!atomic_load(&slot->loaded)) {
+        memcpy(slot->value, value, size);
+        slot->size = (uint32_t)size;
+        atomic_store(&slot->loaded, 1);
+    }
+    atomic_store(&slot->seq, seq + 2);
+}
+
+static void astrid_instrument_process_parammorph(lpinstrument_t * instrument, size_t nframes) {
+    /* Steps the snapshot interpolation once per block */
+    lpfloat_t values[ASTRID_PARAM_MAXSIZE / sizeof(lpfloat_t)];
+    lpparammorph_t * morph;
+    lpparammorphitem_t * item;
+    lpfloat_t pos;
+    size_t k;
+    int i, table;
+
+    /* A new morph replaces the running one right away */
+    if(atomic_load(&instrument->parammorph_pending) != NULL) {
+        if(instrument->parammorph != NULL) astrid_parammorph_retire(instrument, instrument->parammorph);
+        instrument->parammorph = atomic_exchange(&instrument->parammorph_pending, NULL);
+    }
+
+    if((morph = instrument->parammorph) == NULL) return;
+    if(astrid_paramtables_enter(instrument, &table) == NULL) return;
+
+    /* Another restore has swapped its table out since */
+    if(table != morph->table) {
+        astrid_paramtables_exit(instrument, table);
+        astrid_parammorph_retire(instrument, morph);
+        instrument->parammorph = NULL;
+        return;
+    }
+
+    morph->elapsed += nframes;
+    pos = (morph->elapsed >= morph->length) ? 1 : (lpfloat_t)morph->elapsed / morph->length;
+
+    for(i=0; i < morph->numitems; i++) {
+        item = &morph->items[i];
+        for(k=0; k < item->count; k++) {
+            values[k] = item->from[k] + (item->to[k] - item->from[k]) * pos;
+        }
+        /* Only the final values need to reach LMDB */
+        astrid_paramslot_write(item->slot, values, item->count * sizeof(lpfloat_t), LPPARAM_NONE, pos >= 1);
+    }
+
+    astrid_paramtables_exit(instrument, table);
+
+    if(pos >= 1) {
+        astrid_parammorph_retire(instrument, morph);
+        instrument->parammorph = NULL;
+    }
+}
+
+static void astrid_instrument_collect_midi_events(lpinstrument_t * instrument, jack_nframes_t cycle_frame, jack_nframes_t nframes) {
+    /* Moves the MIDI input due in this block to midi_events */
+    lpmidiinqueue_t * q = &instrument->midiin;
+    lpmidiinevent_t * event;
+    size_t head, tail;
+    int32_t offset;
+
+    instrument->num_midi_events = 0;
+
+    tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    while(tail != head && instrument->num_midi_events < ASTRID_MIDIIN_BLOCK_MAXEVENTS) {
+        event = &q->events[tail & (ASTRID_MIDIIN_QUEUE_SIZE-1)];
+
+        /* Delay by one period; frame times wrap, so the difference is signed */
+        offset = (int32_t)(event->frame + nframes - cycle_frame);
+        if(offset >= (int32_t)nframes) break; /* due in a later block */
+        if(offset < 0) offset = 0; /* late, play it right away */
+
+        instrument->midi_events[instrument->num_midi_events] = *event;
+        instrument->midi_events[instrument->num_midi_events].offset = (uint32_t)offset;
+        instrument->num_midi_events += 1;
+        tail += 1;
+    }
+
+    atomic_store_explicit(&q->tail, tail, memory_order_release);
+}
+
+/* REALTIME
+ * WORKER POOL
+ * ***********/
+
+static long astrid_futex(_Atomic uint32_t * word, int op, uint32_t value) {
+    return syscall(SYS_futex, (uint32_t *)word, op, value, NULL, NULL, 0);
+}
+
+static inline void astrid_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* (Re)size the job scratch blocks, only while no jobs are running */
+static int astrid_workers_reserve(lpworkerpool_t * pool, size_t maxframes) {
+    float * scratch;
+    size_t stride;
+    int j, c;
+
+    if(pool->scratch != NULL && maxframes <= pool->maxframes) return 0;
+
+    /* keep every channel on its own cache lines */
+    stride = (maxframes + 15) & ~(size_t)15;
+    if((scratch = (float *)aligned_alloc(64, stride * sizeof(float) * pool->channels * ASTRID_WORKER_MAXJOBS)) == NULL) {
+        syslog(LOG_ERR, "astrid_workers_reserve: Could not allocate scratch for %ld frames. (%d) %s\n", maxframes, errno, strerror(errno));
+        return -1;
+    }
+
+    free(pool->scratch);
+    pool->scratch = scratch;
+    pool->maxframes = maxframes;
+
+    for(j=0; j < ASTRID_WORKER_MAXJOBS; j++) {
+        for(c=0; c < pool->channels; c++) {
+            pool->jobs[j].output[c] = scratch + (j * pool->channels + c) * stride;
+        }
+    }
+
+    return 0;
+}
+
+/* Claim and run jobs from the current generation until none are left */
+static void astrid_workers_run(lpworkerpool_t * pool) {
+    lpworkerjob_t * job;
+    uint64_t claim, next, numjobs;
+    int c;
+
+    claim = atomic_load_explicit(&pool->claim, memory_order_acquire);
+    while(1) {
+        next = claim & 0xffff;
+        numjobs = (claim >> 16) & 0xffff;
+        if(next >= numjobs) return;
+
+        /* a failed CAS reloads the claim, maybe from a newer generation */
+        if(!atomic_compare_exchange_weak_explicit(&pool->claim, &claim, claim + 1, memory_order_acq_rel, memory_order_acquire)) continue;
+
+        job = &pool->jobs[next];
+        for(c=0; c < pool->channels; c++) {
+            memset(job->output[c], 0, pool->blocksize * sizeof(float));
+        }
+
+        if(job->run(pool->blocksize, pool->input, job->output, job->arg) < 0) {
+            atomic_store(&pool->failed, 1);
+        }
+
+        if(atomic_fetch_sub(&pool->pending, 1) == 1 && atomic_load(&pool->waiting)) {
+            astrid_futex(&pool->pending, FUTEX_WAKE_PRIVATE, 1);
+        }
+
+        claim = atomic_load_explicit(&pool->claim, memory_order_acquire);
+    }
+}
+
+static void * astrid_worker_thread(void * arg) {
+    lpworkerpool_t * pool = (lpworkerpool_t *)arg;
+    uint32_t wake;
+
+    astrid_block_denormals_zero();
+    astrid_thread_is_realtime = 1;
+
+    while(atomic_load(&pool->running)) {
+        wake = atomic_load(&pool->wake);
+        astrid_workers_run(pool);
+
+        /* returns at once if a generation started since the load */
+        astrid_futex(&pool->wake, FUTEX_WAIT_PRIVATE, wake);
+    }
+
+    return NULL;
+}
+
+lpworkerpool_t * astrid_workers_create(int numworkers, int channels, size_t maxframes, int priority) {
+    struct sched_param param = {0};
+    lpworkerpool_t * pool;
+    float ** outputs;
+    int i, ret;
+
+    if((pool = (lpworkerpool_t *)calloc(1, sizeof(lpworkerpool_t))) == NULL) {
+        syslog(LOG_ERR, "astrid_workers_create: Could not allocate worker pool. (%d) %s\n", errno, strerror(errno));
+        return NULL;
+    }
+
+    if((outputs = (float **)calloc(ASTRID_WORKER_MAXJOBS * channels, sizeof(float *))) == NULL) {
+        syslog(LOG_ERR, "astrid_workers_create: Could not allocate job outputs. (%d) %s\n", errno, strerror(errno));
+        free(pool);
+        return NULL;
+    }
+
+    pool->channels = channels;
+    for(i=0; i < ASTRID_WORKER_MAXJOBS; i++) {
+        pool->jobs[i].output = outputs + i * channels;
+    }
+
+    if(astrid_workers_reserve(pool, maxframes) < 0) {
+        free(outputs);
+        free(pool);
+        return NULL;
+    }
+
+    atomic_store(&pool->running, 1);
+
+    if(numworkers > ASTRID_WORKERS_MAX) numworkers = ASTRID_WORKERS_MAX;
+    for(i=0; i < numworkers; i++) {
+        if((ret = pthread_create(&pool->threads[i], NULL, astrid_worker_thread, (void *)pool)) != 0) {
+            syslog(LOG_ERR, "astrid_workers_create: Could not start worker %d, carrying on with %d. (%d) %s\n", i, i, ret, strerror(ret));
+            break;
+        }
+        pool->numworkers = i + 1;
+
+        if(priority > 0) {
+            param.sched_priority = priority;
+            if((ret = pthread_setschedparam(pool->threads[i], SCHED_FIFO, &param)) != 0) {
+                syslog(LOG_WARNING, "astrid_workers_create: Worker %d is running without realtime priority. (%d) %s\n", i, ret, strerror(ret));
+            }
+        }
+    }
+
+    syslog(LOG_DEBUG, "Started %d workers at priority %d\n", pool->numworkers, priority);
+
+    return pool;
+}
+
+int astrid_workers_destroy(lpworkerpool_t * pool) {
+    int i, ret;
+
+    if(pool == NULL) return 0;
+
+    atomic_store(&pool->running, 0);
+    atomic_fetch_add(&pool->wake, 1);
+    astrid_futex(&pool->wake, FUTEX_WAKE_PRIVATE, INT_MAX);
+
+    for(i=0; i < pool->numworkers; i++) {
+        if((ret = pthread_join(pool->threads[i], NULL)) != 0) {
+            syslog(LOG_ERR, "astrid_workers_destroy: Could not join worker %d. (%d) %s\n", i, ret, strerror(ret));
+        }
+    }
+
+    free(pool->jobs[0].output);
+    free(pool->scratch);
+    free(pool);
+
+    return 0;
+}
+
+/* Queue a job for the current block. Call it from the stream 
+ * callback: the job gets the block's inputs and a zeroed set 
+ * of outputs of its own, and may run on any worker, so it 
+ * should only touch the state it was handed in arg. */
+int astrid_instrument_submit(lpinstrument_t * instrument, int (*run)(size_t blocksize, float ** input, float ** output, void * arg), void * arg) {
+    lpworkerpool_t * pool = instrument->workers;
+
+    if(pool == NULL) {
+        astrid_log(LOG_ERR, "astrid_instrument_submit: %s has no worker pool\n", instrument->name);
+        return -1;
+    }
+
+    if(pool->numjobs >= ASTRID_WORKER_MAXJOBS) {
+        astrid_log(LOG_ERR, "astrid_instrument_submit: Too many jobs in this block (max %d)\n", ASTRID_WORKER_MAXJOBS);
+        return -1;
+    }
+
+    if(pool->blocksize > pool->maxframes) {
+        astrid_log(LOG_ERR, "astrid_instrument_submit: Block of %ld frames is bigger than the job scratch (%ld)\n", pool->blocksize, pool->maxframes);
+        return -1;
+    }
+
+    pool->jobs[pool->numjobs].run = run;
+    pool->jobs[pool->numjobs].arg = arg;
+    pool->numjobs += 1;
+
+    return 0;
+}
+
+/* Run the jobs submitted this block across the pool and mix 
+ * their outputs into output. The audio thread takes jobs too, 
+ * then spins briefly and sleeps on the futex for stragglers. 
+ * Called after the stream callback if it doesn't call it itself. */
+int astrid_instrument_join(lpinstrument_t * instrument, float ** output) {
+    lpworkerpool_t * pool = instrument->workers;
+    uint32_t pending;
+    int c, j, spins, towake;
+    size_t i;
+
+    if(pool == NULL || pool->numjobs == 0) return 0;
+
+    atomic_store(&pool->failed, 0);
+    atomic_store(&pool->waiting, 0);
+    atomic_store(&pool->pending, (uint32_t)pool->numjobs);
+
+    pool->generation += 1;
+    atomic_store_explicit(&pool->claim, ((uint64_t)pool->generation << 32) | ((uint64_t)pool->numjobs << 16), memory_order_release);
+
+    towake = (pool->numjobs - 1 < pool->numworkers) ? pool->numjobs - 1 : pool->numworkers;
+    if(towake > 0) {
+        atomic_fetch_add(&pool->wake, 1);
+        astrid_futex(&pool->wake, FUTEX_WAKE_PRIVATE, (uint32_t)towake);
+    }
+
+    astrid_workers_run(pool);
+
+    spins = 0;
+    while((pending = atomic_load(&pool->pending)) > 0) {
+        if(spins++ < ASTRID_WORKER_SPIN) {
+            astrid_cpu_relax();
+            continue;
+        }
+
+        atomic_store(&pool->waiting, 1);
+        if((pending = atomic_load(&pool->pending)) == 0) break;
+        astrid_futex(&pool->pending, FUTEX_WAIT_PRIVATE, pending);
+    }
+
+    /* mix in submission order */
+    for(j=0; j < pool->numjobs; j++) {
+        for(c=0; c < pool->channels; c++) {
+            for(i=0; i < pool->blocksize; i++) {
+                output[c][i] += pool->jobs[j].output[c][i];
+            }
+        }
+    }
+
+    pool->numjobs = 0;
+
+    return atomic_load(&pool->failed) ? -1 : 0;
+}
+
+static _Thread_local int astrid_block_denormals_are_zero = 0;
+
+/* Runs one block of the instrument: the JACK callback and the 
+ * headless driver both land here. cycle_frame and cycle_seconds 
+ * are the frame and monotonic time the block started on. */
+static int astrid_instrument_process_block(lpinstrument_t * instrument, jack_nframes_t nframes, jack_nframes_t cycle_frame, double cycle_seconds, float ** input_channels, float ** output_channels) {
+    struct timespec callback_start, callback_end;
+    size_t i;
+    int c;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &callback_start);
+
+    /* JACK may hand the callback to a new thread, so check every block */
+    if(!astrid_block_denormals_are_zero) {
+        astrid_block_denormals_zero();
+        astrid_block_denormals_are_zero = 1;
+        astrid_thread_is_realtime = 1;
+    }
+
+    /* Sync the mixer with the JACK clock for sample accurate placement */
+    if(cycle_seconds > 0) scheduler_sync_clock(instrument->async_mixer, cycle_frame, cycle_seconds);
+
+    if(!instrument->has_been_initialized) {
+        astrid_log(LOG_DEBUG, "Seeding the random number generator from the audio callback. %s\n", instrument->name);
+        LPRand.preseed();
+        instrument->has_been_initialized = 1;
+        // TODO could run the before callback here maybe, 
+        // or is there a reason to have mainthread-before AND audiothread-before?
+    }
+
+    /* ramp params toward a restored snapshot */
+    astrid_instrument_process_parammorph(instrument, (size_t)nframes);
+
+    /* MIDI input for the stream callback */
+    astrid_instrument_collect_midi_events(instrument, cycle_frame, nframes);
+
+    for(c=0; c < instrument->channels; c++) {
+        memset(output_channels[c], 0, nframes * sizeof(float));
+    }
+
+    /* write the block into the adc ringbuffer */
+    if(lpsampler_write_ringbuffer_block(instrument->adcname, instrument->adcbuf, input_channels, instrument->channels, nframes) < 0) {
+        astrid_log(LOG_ERR, "Error writing into adc ringbuf\n");
+        return 0;
+    }
+
+    /* mix in async renders */
+    scheduler_begin_block(instrument->async_mixer, (size_t)nframes);
+    for(i=0; i < (size_t)nframes; i++) {
+        lpscheduler_tick(instrument->async_mixer);
+        for(c=0; c < instrument->channels; c++) {
+            output_channels[c][i] += instrument->async_mixer->current_frame[c];
+        }
+    }
+
+    if(instrument->stream != NULL) {
+        if(instrument->workers != NULL) {
+            instrument->workers->numjobs = 0;
+            instrument->workers->blocksize = (size_t)nframes;
+            instrument->workers->input = input_channels;
+        }
+
+        if(instrument->stream((size_t)nframes, input_channels, output_channels, (void *)instrument) < 0) {
+            return -1;
+        }
+
+        /* finish any jobs the stream callback left for the pool */
+        if(astrid_instrument_join(instrument, output_channels) < 0) {
+            return -1;
+        }
+    }
+
+    /* drop NaNs and denormals, then clamp output */
+    for(c=0; c < instrument->channels; c++) {
+        astrid_block_sanitize(output_channels[c], (size_t)nframes);
+        astrid_block_clamp(output_channels[c], (size_t)nframes, -1.f, 1.f);
+    }
+
+    /* write the output block into the resampler ringbuffer */
+    if(lpsampler_write_ringbuffer_block(instrument->resamplername, instrument->resamplerbuf, output_channels, instrument->channels, nframes) < 0) {
+        astrid_log(LOG_ERR, "Error writing into adc ringbuf\n");
+        return 0;
+    }
+
+    if(astrid_stats_page != NULL) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &callback_end);
+        astrid_stats_hist_record(&astrid_stats_page->callback_ns, (size_t)((callback_end.tv_sec - callback_start.tv_sec) * 1000000000L + (callback_end.tv_nsec - callback_start.tv_nsec)));
+        atomic_fetch_add_explicit(&astrid_stats_page->callbacks, 1, memory_order_relaxed);
+        atomic_store_explicit(&astrid_stats_page->blocksize, (int)nframes, memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+int astrid_instrument_jack_callback(jack_nframes_t nframes, void * arg) {
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    float * output_channels[instrument->channels];
+    float * input_channels[instrument->channels];
+    jack_nframes_t cycle_frame;
+    jack_time_t since_cycle_start;
+    double now = 0, cycle_seconds = 0;
+    int c;
+
+    if(!instrument->is_running) return 0;
+
+    cycle_frame = jack_last_frame_time(instrument->jack_client);
+    if(lpscheduler_get_now_seconds(&now) == 0) {
+        since_cycle_start = jack_get_time() - jack_frames_to_time(instrument->jack_client, cycle_frame);
+        cycle_seconds = now - (int64_t)since_cycle_start * 0.000001;
+    }
+
+    for(c=0; c < instrument->channels; c++) {
+        input_channels[c] = (float *)jack_port_get_buffer(instrument->inports[c], nframes);
+        output_channels[c] = (float *)jack_port_get_buffer(instrument->outports[c], nframes);
+    }
+
+    return astrid_instrument_process_block(instrument, nframes, cycle_frame, cycle_seconds, input_channels, output_channels);
+}
+
+static int astrid_instrument_jack_xrun_callback(__attribute__((unused)) void * arg) {
+    if(astrid_stats_page != NULL) atomic_fetch_add_explicit(&astrid_stats_page->xruns, 1, memory_order_relaxed);
+    return 0;
+}
+
+/* JACK doesn't run the process callback while this runs, so the pool is idle */
+static int astrid_instrument_jack_buffer_size_callback(jack_nframes_t nframes, void * arg) {
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    if(instrument->workers == NULL) return 0;
+    return astrid_workers_reserve(instrument->workers, (size_t)nframes);
+}
+
+/* instrument seq priority queue callbacks */
+static int msgpq_cmp_pri(double next, double curr) {
+    return (next > curr);
+}
+
+static double msgpq_get_pri(void * a) {
+    return ((lpmsgpq_node_t *)a)->timestamp;
+}
+
+static void msgpq_set_pri(void * a, double timestamp) {
+    ((lpmsgpq_node_t *)a)->timestamp = timestamp;
+}
+
+static size_t msgpq_get_pos(void * a) {
+    return ((lpmsgpq_node_t *)a)->pos;
+}
+
+static void msgpq_set_pos(void * a, size_t pos) {
+    ((lpmsgpq_node_t *)a)->pos = pos;
+}
+
+int instrument_seq_remove_nodes_by_voice_id(pqueue_t * msgpq, size_t voice_id) {
+    lpmsgpq_node_t * node;
+    lpmsg_t * msg;
+    void * d;
+    size_t i;
+
+    for(i=0; i < msgpq->size; i++) {
+        d = msgpq->d[i];                
+        if(d == NULL) {
+            syslog(LOG_DEBUG, "STOP: d[%d] is NULL\n", (int)i);
+            continue;
+        }
+
+        node = (lpmsgpq_node_t *)d;
+        msg = &node->msg;
+        if(msg->voice_id == voice_id) {
+            syslog(LOG_DEBUG, "STOP: removing node & freeing memory for voice id %ld\n", voice_id);
+            pqueue_remove(msgpq, d);
+        }
+    }
+
+    return 0;
+}
+
+/* Sleep until the timeout (in seconds, or forever when negative) 
+ * passes or a new message is inserted into the pq */
+static int instrument_seq_wait(lpinstrument_t * instrument, double timeout) {
+    struct itimerspec its = {0};
+    struct pollfd fds[2];
+    uint64_t count;
+    int nfds = 1;
+
+    fds[0].fd = instrument->seq_wakefd;
+    fds[0].events = POLLIN;
+
+    if(timeout >= 0) {
+        its.it_value.tv_sec = (time_t)timeout;
+        its.it_value.tv_nsec = (long)((timeout - (double)its.it_value.tv_sec) * 1000000000);
+        /* an all-zero value would disarm the timer */
+        if(its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1;
+
+        if(timerfd_settime(instrument->seq_timerfd, 0, &its, NULL) < 0) {
+            syslog(LOG_ERR, "seq_wait: Could not arm timer. (%d) %s\n", errno, strerror(errno));
+            return -1;
+        }
+
+        fds[1].fd = instrument->seq_timerfd;
+        fds[1].events = POLLIN;
+        nfds = 2;
+    }
+
+    while(poll(fds, nfds, -1) < 0) {
+        if(errno != EINTR) {
+            syslog(LOG_ERR, "seq_wait: poll error. (%d) %s\n", errno, strerror(errno));
+            return -1;
+        }
+    }
+
+    if(fds[0].revents & POLLIN) {
+        if(read(instrument->seq_wakefd, &count, sizeof(uint64_t)) < 0) return -1;
+    }
+
+    if(nfds == 2 && (fds[1].revents & POLLIN)) {
+        if(read(instrument->seq_timerfd, &count, sizeof(uint64_t)) < 0) return -1;
+    }
+
+    return 0;
+}
+
+static void instrument_seq_wake(lpinstrument_t * instrument) {
+    if(eventfd_write(instrument->seq_wakefd, 1) < 0) {
+        syslog(LOG_ERR, "seq_wake: Could not signal the seq thread. (%d) %s\n", errno, strerror(errno));
+    }
+}
+
+void * instrument_seq_pq(void * arg) {
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    lpmsg_t * msg;
+    lpmsgpq_node_t * node;
+    void * d;
+    double now;
+
+    now = 0;
+    syslog(LOG_DEBUG, ":::: INSTRUMENT SEQ PQ STARTING ::::\n");
+
+    d = NULL;
+    msg = NULL;
+    node = NULL;
+
+    while(instrument->is_running) {
+        /* peek into the queue */
+        d = pqueue_peek(instrument->msgpq);
+
+        /* No messages have arrived: sleep until one does */
+        if(d == NULL) {
+            if(instrument_seq_wait(instrument, -1) < 0) usleep((useconds_t)500);
+            continue;
+        }
+
+        /* There is a message! */
+        node = (lpmsgpq_node_t *)d;
+        msg = &node->msg;
+
+        if(msg->type == LPMSG_SHUTDOWN) {
+            break;
+        }
+
+        /* Get now */
+        if(lpscheduler_get_now_seconds(&now) < 0) {
+            syslog(LOG_CRIT, "Error getting now in message scheduler\n");
+            exit(1);
+        }
+
+        /* If msg timestamp is in the future, sleep until 
+         * it is due or an earlier message is inserted */
+        if(node->timestamp > now) {
+            if(instrument_seq_wait(instrument, node->timestamp - now) < 0) usleep((useconds_t)500);
+            continue;
+        }
+
+        /* Send it along to the instrument message fifo */
+        msg->dispatched = now;
+        if(msg->initiated > 0 && msg->scheduled > 0) {
+            msg->target_frame = scheduler_seconds_to_frame(instrument->async_mixer, msg->initiated + msg->scheduled);
+        }
+        if(send_play_message(*msg) < 0) {
+            syslog(LOG_ERR, "Error sending play message from message priority queue\n");
+            usleep((useconds_t)500);
+            continue;
+        }
+
+        /* And remove it from the pq */
+        if(pqueue_remove(instrument->msgpq, d) < 0) {
+            syslog(LOG_ERR, "pqueue_remove: problem removing message from the pq\n");
+            usleep((useconds_t)500);
+        }
+    }
+
+    syslog(LOG_INFO, "Message scheduler pq thread shutting down...\n");
+    return 0;
+}
+
+void astrid_instrument_record_render_time(lpinstrument_t * instrument, double render_time) {
+    double sorted[ASTRID_RENDER_WINDOW];
+    double t;
+    int i, j, count;
+
+    instrument->render_times[instrument->render_times_index] = render_time;
+    instrument->render_times_index = (instrument->render_times_index + 1) % ASTRID_RENDER_WINDOW;
+    if(instrument->render_times_count < ASTRID_RENDER_WINDOW) instrument->render_times_count += 1;
+    count = instrument->render_times_count;
+
+    /* the window is small, so an insertion sort will do */
+    for(i=0; i < count; i++) {
+        t = instrument->render_times[i];
+        j = i;
+        while(j > 0 && sorted[j-1] > t) {
+            sorted[j] = sorted[j-1];
+            j--;
+        }
+        sorted[j] = t;
+    }
+
+    instrument->render_estimate = sorted[(int)((count-1) * ASTRID_RENDER_PERCENTILE)];
+}
+
+int relay_message_to_seq(lpinstrument_t * instrument, lpmsg_t msg) {
+    lpmsgpq_node_t * d;
+    double seq_delay, estimate, now=0;
+
+    syslog(LOG_DEBUG, "SEQ PQ MSG: got a scheduled message to insert into the sequencer priority queue\n");
+    syslog(LOG_DEBUG, "SEQ PQ MSG: pqnode_index=%d\n", instrument->pqnode_index);
+
+    d = &instrument->pqnodes[instrument->pqnode_index];
+    memcpy(&d->msg, &msg, sizeof(lpmsg_t));
+    instrument->pqnode_index += 1;
+    while(instrument->pqnode_index >= NUM_NODES) instrument->pqnode_index -= NUM_NODES;
+
+    if(lpscheduler_get_now_seconds(&now) < 0) {
+        syslog(LOG_CRIT, "SEQ PQ MSG: Error getting now in seq relay\n");
+        return -1;
+    }
+
+    /* Hold on to the message as long as possible while still 
+     * trying to leave some time for processing before the target deadline. 
+     * Once renders have been timed this uses their rolling percentile, 
+     * until then the estimate carried by the message. */
+    if(instrument->render_times_count > 0) {
+        estimate = instrument->render_estimate + ASTRID_RENDER_MARGIN;
+    } else {
+        estimate = msg.max_processing_time * 2;
+    }
+    seq_delay = msg.scheduled - estimate;
+    d->timestamp = msg.initiated + seq_delay;
+
+    syslog(LOG_DEBUG, "d->timestamp=%f msg.scheduled=%f msg.initiated=%f\n",
+                    d->timestamp, msg.scheduled, msg.initiated);
+
+    // Remove the scheduled flag before relaying the message
+    d->msg.flags &= ~LPFLAG_IS_SCHEDULED;
+
+    if(pqueue_insert(instrument->msgpq, (void *)d) < 0) {
+        syslog(LOG_ERR, "SEQ PQ MSG: Error while inserting message into pq during msgq loop: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* The new message may be due before the one the seq is sleeping on */
+    instrument_seq_wake(instrument);
+
+    return 0;
+}
+
+static void instrument_param_flusher_wake(lpinstrument_t * instrument) {
+    if(eventfd_write(instrument->param_flusher_wakefd, 1) < 0) {
+        syslog(LOG_ERR, "param_flusher_wake: Could not signal the param flusher thread. (%d) %s\n", errno, strerror(errno));
+    }
+}
+
+void * instrument_param_flusher_thread(void * arg) {
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    struct pollfd fds[1];
+    double interval;
+    uint64_t count;
+
+    fds[0].fd = instrument->param_flusher_wakefd;
+    fds[0].events = POLLIN;
+
+    while(instrument->is_running) {
+        interval = (instrument->param_flush_interval > 0) ? instrument->param_flush_interval : ASTRID_PARAM_FLUSH_INTERVAL;
+
+        /* Sleeps for the interval, or until stop wakes us */
+        if(poll(fds, 1, (int)(interval * 1000)) > 0 && (fds[0].revents & POLLIN)) {
+            if(read(instrument->param_flusher_wakefd, &count, sizeof(uint64_t)) < 0) {
+                syslog(LOG_ERR, "%s param flusher: Could not read wake eventfd. (%d) %s\n", instrument->name, errno, strerror(errno));
+            }
+        }
+
+        if(astrid_instrument_load_params(instrument) < 0) {
+            syslog(LOG_ERR, "%s param flusher: Could not load params\n", instrument->name);
+        }
+
+        if(astrid_instrument_flush_params(instrument) < 0) {
+            syslog(LOG_ERR, "%s param flusher: Could not flush params\n", instrument->name);
+        }
+
+        /* snapshot morphs the audio thread is done with */
+        astrid_parammorph_free_retired(instrument);
+
+        /* persist notemap changes for our MIDI device */
+        if(instrument->midi_device_id >= 0) lpmidi_save_notemap(instrument->midi_device_id);
+    }
+
+    return NULL;
+}
+
+void * instrument_cleanup_thread(void * arg) {
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    size_t placed, last_logged = 0;
+
+    /* free buffers that are done playing */
+    while(instrument->is_running) {
+        if(scheduler_cleanup_nursery(instrument->async_mixer) < 0) {
+            syslog(LOG_ERR, "%s cleanup thread: Could not cleanup nursery. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+        }
+
+        placed = atomic_load(&instrument->async_mixer->jitter.count);
+        if(placed - last_logged >= ASTRID_LATENCY_LOG_INTERVAL) {
+            scheduler_log_jitter(instrument->async_mixer, instrument->name);
+            last_logged = placed;
+        }
+
+        usleep((useconds_t)10000);
+    }
+
+    scheduler_log_jitter(instrument->async_mixer, instrument->name);
+
+    if(scheduler_cleanup_nursery(instrument->async_mixer) < 0) {
+        syslog(LOG_ERR, "%s cleanup thread: Could not cleanup nursery. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+    }
+
+    return NULL;
+}
+
+/* Sets up the headless driver from the environment, or 
+ * returns NULL when ASTRID_OFFLINE isn't set */
+static lpofflinedriver_t * astrid_offline_create(int channels) {
+    lpofflinedriver_t * driver;
+    char * env;
+    int c;
+
+    if((env = getenv(ASTRID_OFFLINE_ENV)) == NULL) return NULL;
+
+    driver = (lpofflinedriver_t *)LPMemoryPool.alloc(1, sizeof(lpofflinedriver_t));
+    memset(driver, 0, sizeof(lpofflinedriver_t));
+    snprintf(driver->outpath, PATH_MAX, "%s", env);
+
+    driver->samplerate = ASTRID_SAMPLERATE;
+    driver->blocksize = ASTRID_OFFLINE_BLOCKSIZE;
+    if((env = getenv(ASTRID_OFFLINE_SAMPLERATE_ENV)) != NULL && atoi(env) > 0) driver->samplerate = atoi(env);
+    if((env = getenv(ASTRID_OFFLINE_BLOCKSIZE_ENV)) != NULL && atoi(env) > 0) driver->blocksize = atoi(env);
+    if((env = getenv(ASTRID_OFFLINE_LENGTH_ENV)) != NULL) driver->length = atof(env);
+    if((env = getenv(ASTRID_OFFLINE_REALTIME_ENV)) != NULL) driver->realtime = atoi(env);
+    if((env = getenv(ASTRID_OFFLINE_SEED_ENV)) != NULL) {
+        driver->seed = atoi(env);
+        driver->has_seed = 1;
+    }
+
+    if((driver->clock = (lpofflineclock_t *)mmap(NULL, sizeof(lpofflineclock_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        syslog(LOG_ERR, "astrid_offline_create: Could not mmap the clock. (%d) %s\n", errno, strerror(errno));
+        LPMemoryPool.free(driver);
+        return NULL;
+    }
+    memset(driver->clock, 0, sizeof(lpofflineclock_t));
+    driver->clock->samplerate = driver->samplerate;
+
+    if((env = getenv(ASTRID_OFFLINE_REPLAY_ENV)) != NULL) {
+        if((driver->replay = fopen(env, "rb")) == NULL) {
+            syslog(LOG_ERR, "astrid_offline_create: Could not open message log %s. (%d) %s\n", env, errno, strerror(errno));
+        } else if(fread(&driver->next, sizeof(lpmsglogrecord_t), 1, driver->replay) == 1) {
+            driver->has_next = 1;
+            driver->replay_offset = driver->next.frame;
+        }
+    }
+
+    driver->inputs = (float **)LPMemoryPool.alloc(channels, sizeof(float *));
+    driver->outputs = (float **)LPMemoryPool.alloc(channels, sizeof(float *));
+    for(c=0; c < channels; c++) {
+        driver->inputs[c] = (float *)LPMemoryPool.alloc(driver->blocksize, sizeof(float));
+        driver->outputs[c] = (float *)LPMemoryPool.alloc(driver->blocksize, sizeof(float));
+    }
+
+    if(driver->outpath[0] != 0) {
+        driver->out = LPBuffer.create((size_t)driver->samplerate, channels, driver->samplerate);
+    }
+
+    return driver;
+}
+
+/* Seeds the calling thread from ASTRID_OFFLINE_SEED plus stream, 
+ * so each thread or render that draws numbers gets its own 
+ * repeatable sequence. Returns 0 when there's no seed to use. */
+int astrid_offline_seed(lpinstrument_t * instrument, size_t stream) {
+    if(instrument->offline == NULL || !instrument->offline->has_seed) return 0;
+    LPRand.seed(instrument->offline->seed + (int)stream);
+    return 1;
+}
+
+/* Sends every logged message due before until_frame to the instrument */
+static void astrid_offline_replay(lpinstrument_t * instrument, lpofflinedriver_t * driver, uint64_t until_frame) {
+    double now = 0;
+
+    while(driver->has_next && driver->next.frame - driver->replay_offset < until_frame) {
+        lpscheduler_get_now_seconds(&now);
+        driver->next.msg.initiated = now;
+        driver->next.msg.target_frame = 0;
+        driver->next.msg.flags |= LPFLAG_IS_REPLAYED;
+        snprintf(driver->next.msg.instrument_name, LPMAXNAME, "%s", instrument->name);
+
+        if(send_message(instrument->name, driver->next.msg) < 0) {
+            syslog(LOG_ERR, "%s offline driver: Could not replay message. (%d) %s\n", instrument->name, errno, strerror(errno));
+        } else {
+            atomic_fetch_add(&driver->delivered, 1);
+        }
+
+        driver->has_next = (fread(&driver->next, sizeof(lpmsglogrecord_t), 1, driver->replay) == 1);
+    }
+}
+
+/* Flat out, the clock only moves on once the message thread has 
+ * handled every replayed message and every render it kicked off 
+ * has come back, so renders land on the same frames each run. */
+static void astrid_offline_settle(lpinstrument_t * instrument, lpofflinedriver_t * driver) {
+    double start = 0, now = 0;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    start = ts.tv_sec + ts.tv_nsec * 1e-9;
+
+    while(instrument->is_running) {
+        if(atomic_load(&driver->replayed) >= atomic_load(&driver->delivered)
+            && atomic_load(&driver->read) == atomic_load(&driver->handled)
+            && atomic_load(&driver->plays) <= atomic_load(&driver->renders)
+        ) break;
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        now = ts.tv_sec + ts.tv_nsec * 1e-9;
+        if(now - start > ASTRID_OFFLINE_SETTLE_TIMEOUT) {
+            syslog(LOG_WARNING, "%s offline driver: gave up waiting on renders after %d seconds\n", instrument->name, ASTRID_OFFLINE_SETTLE_TIMEOUT);
+            atomic_store(&driver->renders, atomic_load(&driver->plays));
+            break;
+        }
+
+        usleep((useconds_t)100);
+    }
+
+    if(now > start) {
+        driver->settle_seconds += now - start;
+        if(now - start > driver->max_settle_seconds) driver->max_settle_seconds = now - start;
+    }
+}
+
+void * astrid_offline_driver_thread(void * arg) {
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    lpofflinedriver_t * driver = instrument->offline;
+    struct timespec deadline;
+    double cycle_seconds = 0;
+    uint64_t frame = 0;
+
+    /* LPRand keeps per thread state, so seed the thread that runs the callbacks */
+    astrid_offline_seed(instrument, 0);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while(instrument->is_running) {
+        astrid_offline_replay(instrument, driver, frame + driver->blocksize);
+
+        if(driver->realtime) {
+            lpscheduler_get_now_seconds(&cycle_seconds);
+        } else {
+            /* give the sequencer a look at the virtual clock, and let the pipeline catch up */
+            instrument_seq_wake(instrument);
+            astrid_offline_settle(instrument, driver);
+            cycle_seconds = driver->clock->start_seconds + (double)frame / driver->samplerate;
+        }
+
+        if(astrid_instrument_process_block(instrument, (jack_nframes_t)driver->blocksize, (jack_nframes_t)frame, cycle_seconds, driver->inputs, driver->outputs) < 0) {
+            syslog(LOG_ERR, "%s offline driver: process callback failed, stopping\n", instrument->name);
+            instrument->is_running = 0;
+            break;
+        }
+
+        if(driver->out != NULL) {
+            if(driver->outframes + driver->blocksize > driver->out->length) {
+                driver->out = LPBuffer.resize(driver->out, driver->out->length * 2);
+            }
+
+            astrid_block_interleave(driver->outputs, instrument->channels, (size_t)driver->blocksize, driver->out->data + driver->outframes * instrument->channels);
+            driver->outframes += driver->blocksize;
+        }
+
+        frame += driver->blocksize;
+        atomic_store(&driver->clock->frame, frame);
+        driver->blocks += 1;
+
+        if(driver->length > 0 && frame >= (uint64_t)(driver->length * driver->samplerate)) {
+            syslog(LOG_INFO, "%s offline driver: reached %f seconds, shutting down\n", instrument->name, driver->length);
+            instrument->is_running = 0;
+            break;
+        }
+
+        if(driver->realtime) {
+            deadline.tv_nsec += (long)((double)driver->blocksize / driver->samplerate * 1000000000);
+            while(deadline.tv_nsec >= 1000000000) {
+                deadline.tv_nsec -= 1000000000;
+                deadline.tv_sec += 1;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &deadline);
+    driver->wall_seconds = deadline.tv_sec + deadline.tv_nsec * 1e-9 - driver->clock->start_seconds;
+
+    return NULL;
+}
+
+/* Joins the driver, writes out the render and reports throughput */
+static int astrid_offline_finish(lpinstrument_t * instrument) {
+    lpofflinedriver_t * driver = instrument->offline;
+    double wall, rendered;
+    int c, ret;
+
+    if(driver == NULL) return 0;
+
+    if((ret = pthread_join(driver->thread, NULL)) != 0) {
+        syslog(LOG_ERR, "Error while attempting to join with offline driver thread. Ret: %d (%s)\n", ret, strerror(ret));
+    }
+
+    wall = driver->wall_seconds;
+    rendered = (double)atomic_load(&driver->clock->frame) / driver->samplerate;
+
+    fprintf(stderr, "%s offline: %ld blocks of %d frames, %f seconds rendered in %f seconds (%.2fx realtime), waited %f seconds on the pipeline (max %f per block)\n", 
+        instrument->name, driver->blocks, driver->blocksize, rendered, wall, 
+        (wall > 0) ? rendered / wall : 0.f, 
+        driver->settle_seconds, driver->max_settle_seconds
+    );
+
+    if(driver->out != NULL) {
+        driver->out = LPBuffer.resize(driver->out, driver->outframes);
+        LPSoundFile.write(driver->outpath, driver->out);
+        LPBuffer.destroy(driver->out);
+    }
+
+    if(driver->replay != NULL) fclose(driver->replay);
+
+    for(c=0; c < instrument->channels; c++) {
+        LPMemoryPool.free(driver->inputs[c]);
+        LPMemoryPool.free(driver->outputs[c]);
+    }
+    LPMemoryPool.free(driver->inputs);
+    LPMemoryPool.free(driver->outputs);
+
+    astrid_offline_clock = NULL;
+    munmap(driver->clock, sizeof(lpofflineclock_t));
+    LPMemoryPool.free(driver);
+    instrument->offline = NULL;
+
+    return 0;
+}
+
+/* Appends an incoming message to the message log */
+static void astrid_msglog_record(lpinstrument_t * instrument, lpmsg_t * msg) {
+    lpmsglogrecord_t record;
+    double now = 0;
+
+    if(instrument->msglog == NULL) return;
+    if(msg->type == LPMSG_RENDER_COMPLETE || msg->type == LPMSG_RENDER_STREAM) return;
+    if((msg->flags & LPFLAG_IS_REPLAYED) == LPFLAG_IS_REPLAYED) return;
+
+    lpscheduler_get_now_seconds(&now);
+    record.frame = scheduler_seconds_to_frame(instrument->async_mixer, now);
+    memcpy(&record.msg, msg, sizeof(lpmsg_t));
+
+    /* Log updates as the key=value text they were sent as, 
+     * so the log doesn't depend on the binary param encoding */
+    if((msg->flags & LPFLAG_IS_ENCODED_PARAM) == LPFLAG_IS_ENCODED_PARAM) {
+        if(astrid_params_decode(msg->msg, record.msg.msg, LPMAXMSG) < 0) {
+            syslog(LOG_ERR, "%s msglog: Could not decode update params, skipping the message\n", instrument->name);
+            return;
+        }
+        record.msg.flags &= ~LPFLAG_IS_ENCODED_PARAM;
+    }
+
+    /* stdio buffers the writes, the log is flushed when it's closed */
+    if(fwrite(&record, sizeof(lpmsglogrecord_t), 1, instrument->msglog) != 1) {
+        syslog(LOG_ERR, "%s msglog: Could not write message. (%d) %s\n", instrument->name, errno, strerror(errno));
+    }
+}
+
+/* Parses the key=value pairs of a voice message. Times are 
+ * in seconds: time ramps gain and pan, fadein and fadeout 
+ * set the fade length, and stop is a fadeout of the default 
+ * ramp time. */
+static int astrid_instrument_parse_voice_command(lpinstrument_t * instrument, char * params, lpvoicecmd_t * cmd) {
+    char cmdline[LPMAXMSG] = {0};
+    char * paramline, * keytoken, * valtoken;
+    char * cmdline_save = NULL, * paramline_save = NULL;
+    double ramp = ASTRID_VOICE_RAMP_DEFAULT;
+    int has_voice = 0;
+    float val_f = 0;
+    int32_t val_i32 = 0;
+
+    memset(cmd, 0, sizeof(lpvoicecmd_t));
+    cmd->fade_frames = (size_t)(ASTRID_VOICE_RAMP_DEFAULT * instrument->samplerate);
+    memcpy(cmdline, params, LPMAXMSG-1);
+
+    paramline = strtok_r(cmdline, " ", &cmdline_save);
+    while(paramline != NULL) {
+        keytoken = strtok_r(paramline, "=", &paramline_save);
+        valtoken = strtok_r(NULL, "=", &paramline_save);
+
+        if(keytoken != NULL && strcmp(keytoken, "stop") == 0) {
+            cmd->flags |= ASTRID_VOICE_FADEOUT;
+        } else if(keytoken == NULL || valtoken == NULL) {
+            /* skip it */
+        } else if(strcmp(keytoken, "voice") == 0) {
+            cmd->voice_id = (size_t)strtoull(valtoken, NULL, 10);
+            has_voice = 1;
+        } else if(strcmp(keytoken, "gain") == 0) {
+            extract_float_from_token(valtoken, &val_f);
+            cmd->gain = fmaxf(0.f, val_f);
+            cmd->flags |= ASTRID_VOICE_SET_GAIN;
+        } else if(strcmp(keytoken, "pan") == 0) {
+            extract_float_from_token(valtoken, &val_f);
+            cmd->pan = fmaxf(0.f, fminf(val_f, 1.f));
+            cmd->flags |= ASTRID_VOICE_SET_PAN;
+        } else if(strcmp(keytoken, "time") == 0) {
+            extract_float_from_token(valtoken, &val_f);
+            ramp = fmax(0, val_f);
+        } else if(strcmp(keytoken, "fadein") == 0) {
+            extract_float_from_token(valtoken, &val_f);
+            cmd->fade_frames = (size_t)(fmax(0, val_f) * instrument->samplerate);
+            cmd->flags |= ASTRID_VOICE_FADEIN;
+        } else if(strcmp(keytoken, "fadeout") == 0) {
+            extract_float_from_token(valtoken, &val_f);
+            cmd->fade_frames = (size_t)(fmax(0, val_f) * instrument->samplerate);
+            cmd->flags |= ASTRID_VOICE_FADEOUT;
+        } else if(strcmp(keytoken, "loop") == 0) {
+            extract_int32_from_token(valtoken, &val_i32);
+            cmd->loop = (val_i32 != 0);
+            cmd->flags |= ASTRID_VOICE_SET_LOOP;
+        }
+
+        paramline = strtok_r(NULL, " ", &cmdline_save);
+    }
+
+    if(!has_voice) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    cmd->ramp_frames = (size_t)(ramp * instrument->samplerate);
+
+    return 0;
+}
+
+void * instrument_message_thread(void * arg) {
+    lpmsg_t bufmsg = {0}; // the message serialized along with the async buffer...
+    lpvoicecmd_t voicecmd;
+    lpbuffer_t * buf; // async renders: FIXME, do renders in a thread if possible... or fork out early for the python interpreter maybe?
+    lpstream_t * stream; // streaming async renders
+    size_t stream_size = 0;
+    double now = 0;
+    uint64_t target_frame = 0;
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    int is_scheduled = 0, is_reading = 0;
+
+    instrument->is_waiting = 1;
+    while(instrument->is_running) {
+        /* back for the next message, so the last one has been handled */
+        if(instrument->offline != NULL && is_reading) atomic_fetch_add(&instrument->offline->handled, 1);
+        is_reading = 1;
+
+        if(astrid_msgchannel_read(&instrument->msgchannel, &instrument->msg) < 0) {
+            syslog(LOG_ERR, "%s renderer: Could not read message from playq. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+            usleep((useconds_t)10000);
+            return 0;
+        }
+
+        if(astrid_stats_page != NULL) {
+            atomic_fetch_add_explicit(&astrid_stats_page->messages, 1, memory_order_relaxed);
+        }
+
+        if(instrument->offline != NULL) {
+            /* pipeline progress for the headless driver (see astrid_offline_settle) */
+            if(instrument->msg.type == LPMSG_PLAY && (instrument->renderer != NULL || instrument->ext_relay_enabled)) {
+                atomic_fetch_add(&instrument->offline->plays, 1);
+            } else if(instrument->msg.type == LPMSG_RENDER_COMPLETE || instrument->msg.type == LPMSG_RENDER_STREAM) {
+                atomic_fetch_add(&instrument->offline->renders, 1);
+            }
+            atomic_fetch_add(&instrument->offline->read, 1);
+            if((instrument->msg.flags & LPFLAG_IS_REPLAYED) == LPFLAG_IS_REPLAYED) atomic_fetch_add(&instrument->offline->replayed, 1);
+        }
+
+        astrid_msglog_record(instrument, &instrument->msg);
+
+        if(astrid_stats_page != NULL && instrument->msgchannel.ring != NULL) {
+            astrid_stats_gauge(&astrid_stats_page->msgq_bytes, &astrid_stats_page->msgq_max_bytes, 
+                atomic_load(&instrument->msgchannel.ring->reserve) - atomic_load(&instrument->msgchannel.ring->tail));
+        }
+
+        is_scheduled = ((instrument->msg.flags & LPFLAG_IS_SCHEDULED) == LPFLAG_IS_SCHEDULED);
+        astrid_log(LOG_DEBUG, "C MSG: name=%s\n", instrument->msg.instrument_name);
+        astrid_log(LOG_DEBUG, "C MSG: scheduled=%f\n", instrument->msg.scheduled);
+        astrid_log(LOG_DEBUG, "C MSG: voice_id=%d\n", (int)instrument->msg.voice_id);
+        astrid_log(LOG_DEBUG, "C MSG: type=%d\n", (int)instrument->msg.type);
+        astrid_log(LOG_DEBUG, "C MSG: flags=%d\n", (int)instrument->msg.flags);
+        astrid_log(LOG_DEBUG, "C MSG: is_scheduled=%d\n", is_scheduled);
+
+        // Handle shutdown early
+        if(instrument->msg.type == LPMSG_SHUTDOWN) {
+            astrid_log(LOG_DEBUG, "C MSG: shutdown\n");
+            instrument->is_running = 0;
+
+            // send the shutdown message to the seq thread and external relay
+            if(relay_message_to_seq(instrument, instrument->msg) < 0) {
+                syslog(LOG_ERR, "%s renderer: Could not read relay message to seq. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+            }
+            if(instrument->ext_relay_enabled) {
+                if(send_message(instrument->external_relay_name, instrument->msg) < 0) {
+                    syslog(LOG_ERR, "Could not relay message\n");
+                }
+            }
+
+            if(send_serial_message(instrument->msg) < 0) {
+                syslog(LOG_ERR, "Could not relay serial message\n");
+            }
+
+            break;
+        }
+
+        if(is_scheduled) {
+            // Scheduled messages get sent to the sequencer for handling later
+            astrid_log(LOG_DEBUG, "C IS SCHEDULED msg.scheduled %f\n", instrument->msg.scheduled);
+            if(relay_message_to_seq(instrument, instrument->msg) < 0) {
+                syslog(LOG_ERR, "%s renderer: Could not read relay message to seq. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+            }
+            continue;
+        } else {
+            // All other messages get relayed externally, too, if the relay is enabled
+            if(instrument->ext_relay_enabled) {
+                astrid_log(LOG_DEBUG, "C MSG: relaying to ext\n");
+                if(send_message(instrument->external_relay_name, instrument->msg) < 0) {
+                    syslog(LOG_ERR, "Could not relay message\n");
+                }
+            }
+        }
+
+        // Now the fun stuff
+        switch(instrument->msg.type) {
+            case LPMSG_RENDER_COMPLETE:
+                /* FIXME do this in another thread? */
+                // Renders from the internal callback AND/OR external renderers (AKA python)
+                if((buf = deserialize_buffer(instrument->msg.msg, &bufmsg)) == NULL) {
+                    syslog(LOG_ERR, "DAC could not deserialize buffer. Error: (%d) %s\n", errno, strerror(errno));
+                    continue;
+                }
+
+                if(lpscheduler_get_now_seconds(&now) < 0) {
+                    syslog(LOG_ERR, "Could not get now seconds for render timing\n");
+                    now = 0;
+                }
+
+                /* Time renders the seq dispatched to refine its estimate */
+                if(now > 0 && bufmsg.dispatched > 0) {
+                    astrid_instrument_record_render_time(instrument, now - bufmsg.dispatched);
+                }
+
+                if(astrid_stats_page != NULL) {
+                    atomic_fetch_add_explicit(&astrid_stats_page->renders, 1, memory_order_relaxed);
+                    if(now > 0 && bufmsg.initiated > 0 && now > bufmsg.initiated) {
+                        astrid_stats_hist_record(&astrid_stats_page->render_usec, (size_t)((now - bufmsg.initiated) * 1000000));
+                    }
+                }
+
+                /* Schedule the buffer for playback at its target frame. 
+                 * Unscheduled renders just start on the next tick: their 
+                 * target would be in the past and only skew the jitter stats. */
+                target_frame = bufmsg.target_frame;
+                if(target_frame == 0 && bufmsg.initiated > 0 && bufmsg.scheduled > 0) {
+                    target_frame = scheduler_seconds_to_frame(instrument->async_mixer, bufmsg.initiated + bufmsg.scheduled);
+                }
+
+                scheduler_schedule_event_at(instrument->async_mixer, buf, target_frame, bufmsg.voice_id);
+                //scheduler_debug(instrument->async_mixer);
+                break;
+
+            case LPMSG_RENDER_STREAM:
+                if((stream = astrid_stream_attach(instrument->msg.msg, &stream_size)) == NULL) {
+                    syslog(LOG_ERR, "DAC could not attach render stream. Error: (%d) %s\n", errno, strerror(errno));
+                    continue;
+                }
+
+                /* Playback begins once the stream has buffered its safety lead */
+                scheduler_schedule_stream(instrument->async_mixer, stream, stream_size, 0, instrument->msg.voice_id);
+                break;
+
+            case LPMSG_VOICE:
+                if(astrid_instrument_parse_voice_command(instrument, instrument->msg.msg, &voicecmd) < 0) {
+                    syslog(LOG_ERR, "Could not parse voice message: %s\n", instrument->msg.msg);
+                    continue;
+                }
+
+                scheduler_send_voice_command(instrument->async_mixer, &voicecmd);
+                break;
+
+            case LPMSG_UPDATE:
+                astrid_log(LOG_DEBUG, "C MSG: update\n");
+                if(instrument->update == NULL) continue;
+                // decode each update param and call the callback with it
+                if(process_param_updates(instrument) < 0) {
+                    syslog(LOG_ERR, "Could not encode update messages...\n");
+                    continue;
+                }
+                //instrument->update(instrument);
+                break;
+
+            case LPMSG_PLAY:
+                astrid_log(LOG_DEBUG, "C MSG: play\n");
+                // Schedule a C callback render if there's a callback defined
+                // python renders will also be triggered at this point if we're 
+                // inside a python instrument because of the message relay
+                if(instrument->renderer != NULL) {
+                    astrid_log(LOG_DEBUG, "C MSG: rendering play...\n");
+                    astrid_offline_seed(instrument, instrument->msg.voice_id);
+                    /* FIXME do this in another thread */
+                    if(instrument->renderer(instrument) < 0) {
+                        syslog(LOG_ERR, "there was a problem rendering from the C instrument\n");
+                        continue;
+                    }
+                }
+                break;
+
+            case LPMSG_SERIAL:
+                astrid_log(LOG_DEBUG, "C MSG: serial\n");
+                // serial messages get relayed from here to the special serial Q, 
+                // and then written out to the tty in the serial listener thread...
+                if(send_serial_message(instrument->msg) < 0) {
+                    syslog(LOG_ERR, "Could not send serial message...\n");
+                }
+                break;
+
+            case LPMSG_LOAD:
+                // it would be interesting to explore live reloading of C modules
+                // in the tradition of CLIVE, but at the moment only python handles these
+                astrid_log(LOG_DEBUG, "C MSG: load\n");
+                break;
+
+            case LPMSG_TRIGGER:
+                // maybe support raspberry pi GPIO pin toggling / triggers?
+                astrid_log(LOG_DEBUG, "C MSG: trigger\n");
+                if(instrument->trigger != NULL) instrument->trigger(instrument);
+                break;
+
+            case LPMSG_MIDI_FROM_DEVICE:
+                astrid_log(LOG_DEBUG, "C MSG: midi from device\n");
+                break;
+
+            case LPMSG_MIDI_TO_DEVICE:
+                astrid_log(LOG_DEBUG, "C MSG: midi to device\n");
+                break;
+
+            default:
+                // Garbage typed messages will shut 'er down
+                syslog(LOG_WARNING, "C MSG: got bad msg type %d\n", instrument->msg.type);
+                break;
+        }
+    }
+
+    instrument->is_waiting = 0;
+    return 0;
+}
+
+int astrid_instrument_seq_start(lpinstrument_t * instrument) {
+    int i;
+
+    /* Allocate the pq message nodes */
+    if((instrument->pqnodes = (lpmsgpq_node_t *)calloc(NUM_NODES, sizeof(lpmsgpq_node_t))) == NULL) {
+        syslog(LOG_ERR, "Could not initialize message priority queue nodes. Error: %s\n", strerror(errno));
+        return -1;
+    }
+    memset(instrument->pqnodes, 0, NUM_NODES * sizeof(lpmsgpq_node_t));
+
+    for(i=0; i < NUM_NODES; i++) {
+        instrument->pqnodes[i].index = i;
+    }
+
+    /* The seq thread sleeps on these between messages */
+    if((instrument->seq_wakefd = eventfd(0, EFD_CLOEXEC)) < 0) {
+        syslog(LOG_ERR, "Could not create seq eventfd. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if((instrument->seq_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0) {
+        syslog(LOG_ERR, "Could not create seq timerfd. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* Create the message priority queue */
+    if((instrument->msgpq = pqueue_init(NUM_NODES, msgpq_cmp_pri, msgpq_get_pri, msgpq_set_pri, msgpq_get_pos, msgpq_set_pos)) == NULL) {
+        syslog(LOG_ERR, "Could not initialize message priority queue. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* Start message pq thread */
+    if(pthread_create(&instrument->message_scheduler_pq_thread, NULL, instrument_seq_pq, (void*)instrument) != 0) {
+        syslog(LOG_ERR, "Could not initialize message scheduler pq thread. Error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+#if 0
+// This was fun to write but...
+int encode_serial_msg(lpmsg_t * msg) {
+    char c=0, lastc=SPACE;
+    char token[100] = {0}; // 100 chars is prolly enough for single precision floats
+    int scan_pos=0, token_chars_read=0, token_count=0;
+    uint8_t type=0, id=0;
+    float value = 0.f;
+    lpserialmsg_t smsg;
+
+    astrid_log(LOG_DEBUG, "Encoding msg.msg `%s` for serial transmission!\n", msg->msg);
+
+    int num_tokens = 3;
+    int parse_order[3] = {
+        LPPARAM_STRING, // The message type
+        LPPARAM_INT,    // The id
+        LPPARAM_FLOAT   // The value
+    };
+
+    c = msg->msg[scan_pos];
+    while(scan_pos < (int)LPMAXMSG && token_count < num_tokens) {
+        scan_pos += 1;
+
+        /* Prevent overflow on long-ass tokens */
+        if(token_chars_read >= 100) continue;
+
+        if((c == SPACE || c == '\0') && lastc != SPACE) {
+            token[token_chars_read] = '\0';
+            switch(parse_order[token_count]) {
+                case LPPARAM_STRING:
+                    // just look at the first char to determine the message type
+                    switch(token[0]) {
+                        case 'm':
+                            type = SMSG_MOTOR_SPEED;
+                            break;
+
+                        case 's':
+                            type = SMSG_SOLENOID_TRIGGER;
+                            break;
+
+                        default:
+                            type = SMSG_UNKNOWN;
+                            break;
+                    }
+                    break;
+
+                case LPPARAM_INT:
+                    id = atoi(token);
+                    break;
+
+                case LPPARAM_FLOAT:
+                    value = atof(token);
+                    break;
+
+                default:
+                    break;
+            }
+
+            token_chars_read = 0;
+            token_count += 1;
+        } else if(c != SPACE) {
+            token[token_chars_read] = c;
+            token_chars_read += 1;
+        }
+
+        if(c == '\0') break;
+        lastc = c;
+        c = msg->msg[scan_pos];
+    }
+
+    smsg.type = type;
+    smsg.id = id;
+    smsg.value = value;
+
+    astrid_log(LOG_DEBUG, "PARSER constructed message: type=%d id=%d value=%f\n", type, id, value);
+
+    if(memset(&msg->msg, 0, LPMAXMSG) == NULL) {
+        syslog(LOG_ERR, "%s encode_serial_msg: memset failure. Error: (%d) %s\n", msg->instrument_name, errno, strerror(errno));
+        return -1;
+    }
+
+    if(memcpy(&msg->msg, &smsg, sizeof(lpserialmsg_t)) == NULL) {
+        syslog(LOG_ERR, "%s encode_serial_msg: memcpy failure. Error: (%d) %s\n", msg->instrument_name, errno, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+void log_byte_buffer(unsigned char * buf, size_t size) {
+    size_t i;
+    for(i=0; i < size; i++) {
+        if(buf[i] == '\n') {
+            astrid_log(LOG_DEBUG, "%ld: \\n\n", i);
+        } else if(buf[i] == '\r') {
+            astrid_log(LOG_DEBUG, "%ld: \\r\n", i);
+        } else if(buf[i] == '\t') {
+            astrid_log(LOG_DEBUG, "%ld: \\t\n", i);
+        } else if(isprint(buf[i])) {
+            astrid_log(LOG_DEBUG, "%ld: %c\n", i, buf[i]);
+        } else {
+            astrid_log(LOG_DEBUG, "%ld: \\x%02X\n", i, buf[i]);
+        }
+    }
+}
+
+static int serial_listener_relay(lpinstrument_t * instrument, int tty, lpmsg_t * msg) {
+    int bytes_written;
+
+    if(tty < 0) {
+        astrid_log(LOG_WARNING, "%s serial listener: the tty is gone, dropping a message for it\n", instrument->name);
+        return -1;
+    }
+
+    astrid_log(LOG_DEBUG, "Got a message to relay over serial! Writing it to the tty...\n");
+
+    // FIXME check write_fds here, and queue messages for writing later if 
+    // it's not possible to write (or just drop them I guess?)
+    bytes_written = write(tty, &msg->msg, sizeof(lpserialmsg_t));
+    if(bytes_written != sizeof(lpserialmsg_t)) {
+        syslog(LOG_ERR, "%s serial listener: unexpected number of bytes written to tty. (%d) Error: (%d) %s\n", instrument->name, bytes_written, errno, strerror(errno));
+        return -1;
+    }
+
+    astrid_log(LOG_DEBUG, "Wrote %d bytes to the tty...\n", bytes_written);
+    return 0;
+}
+
+static void serial_listener_parse(lpinstrument_t * instrument, unsigned char * buf, size_t * filled) {
+    /* Parses every complete frame in buf in one pass and shifts 
+     * any partial frame left to the front. Ctl updates are 
+     * coalesced so each ctl is published once per pass, and 
+     * messages for instruments are sent as one batch. */
+    static lpmsg_t msgs[ASTRID_SERIAL_MAXBATCH];
+    size_t ctlvalues[ASTRID_CTL_NUMSERIAL];
+    int ctlchanged[ASTRID_CTL_NUMSERIAL] = {0};
+    lpserialmsg_t header;
+    lpserialctl_t ctl;
+    size_t pos = 0, framesize, i;
+    int nummsgs = 0;
+
+    while(*filled - pos >= sizeof(lpserialmsg_t)) {
+        memcpy(&header, buf + pos, sizeof(lpserialmsg_t));
+        if(header.size > ASTRID_SERIAL_BUFSIZE - sizeof(lpserialmsg_t)) {
+            /* Can't be a real frame: drop what we have and resync on the next read */
+            syslog(LOG_ERR, "%s serial listener: bad frame size %u, dropping %ld bytes\n", instrument->name, header.size, *filled - pos);
+            pos = *filled;
+            break;
+        }
+
+        framesize = sizeof(lpserialmsg_t) + header.size;
+        if(*filled - pos < framesize) break;
+
+        if(header.type == LPMSG_DATA) {
+            /* Data frames carry ctl updates for the control table */
+            for(i=0; i + sizeof(lpserialctl_t) <= header.size; i += sizeof(lpserialctl_t)) {
+                memcpy(&ctl, buf + pos + sizeof(lpserialmsg_t) + i, sizeof(lpserialctl_t));
+                if(ctl.ctl >= ASTRID_CTL_NUMSERIAL) continue;
+                /* scale 0-UINT32_MAX to 0-SIZE_MAX like lpserial_getctl expects */
+                ctlvalues[ctl.ctl] = (size_t)ctl.value * (SIZE_MAX / UINT32_MAX);
+                ctlchanged[ctl.ctl] = 1;
+            }
+        } else {
+            if(nummsgs == ASTRID_SERIAL_MAXBATCH) {
+                if(send_play_messages(msgs, nummsgs) < 0) {
+                    syslog(LOG_ERR, "%s serial listener: Could not send %d messages from the tty\n", instrument->name, nummsgs);
+                }
+                nummsgs = 0;
+            }
+
+            memset(&msgs[nummsgs], 0, sizeof(lpmsg_t));
+            msgs[nummsgs].type = header.type;
+            memcpy(msgs[nummsgs].instrument_name, header.instrument_name, LPMAXNAME);
+            if(header.type == LPMSG_UPDATE) {
+                // Update messages have a fixed size ID/value payload
+                memcpy(msgs[nummsgs].msg, buf + pos + sizeof(lpserialmsg_t), (header.size < LPMAXMSG) ? header.size : LPMAXMSG);
+            }
+            nummsgs += 1;
+        }
+
+        pos += framesize;
+    }
+
+    for(i=0; i < ASTRID_CTL_NUMSERIAL; i++) {
+        if(ctlchanged[i]) lpserial_setctl(ASTRID_SERIAL_DEVICE_ID, (int)i, ctlvalues[i]);
+    }
+
+    if(nummsgs > 0 && send_play_messages(msgs, nummsgs) < 0) {
+        syslog(LOG_ERR, "%s serial listener: Could not send %d messages from the tty\n", instrument->name, nummsgs);
+    }
+
+    memmove(buf, buf + pos, *filled - pos);
+    *filled -= pos;
+}
+
+void * instrument_serial_listener_thread(void * arg) {
+    struct termios options;
+    struct epoll_event ev, events[3];
+    unsigned char * buf;
+    unsigned char c;
+    unsigned char ready = 'c';
+    lpmsg_t msg = {0};
+    int tty, epfd, numevents, bytes_written, bytes_read, i, tty_is_ready=0, tty_is_gone;
+    size_t filled = 0;
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+
+    if(!instrument->tty_is_enabled) {
+        syslog(LOG_INFO, "%s serial listener: no tty requested, shutting down here!\n", instrument->name);
+        return NULL;
+    }
+
+    // Open the tty 
+    // TODO support multiple ttys, duuuh
+    tty = open(instrument->tty_path, O_RDWR | O_NOCTTY);
+    if(tty < 0) {
+        syslog(LOG_ERR, "Problem connecting to TTY -- shutting down serial listener thread...\n");
+        return NULL;
+    }
+
+    tcgetattr(tty, &options);
+    //cfsetispeed(&options, B1000000);
+    //cfsetospeed(&options, B1000000);
+    cfmakeraw(&options);
+    tcsetattr(tty, TCSANOW, &options);
+
+    while(!tty_is_ready) {
+        // signal the tty we've connected
+        bytes_written = write(tty, &ready, 1);
+        if(bytes_written != 1) {
+            syslog(LOG_ERR, "%s serial listener: unexpected number of bytes written to tty. (%d) Error: (%d) %s\n", instrument->name, bytes_written, errno, strerror(errno));
+            close(tty);
+            return NULL;
+        }
+
+        bytes_read = read(tty, &c, 1);
+        syslog(LOG_DEBUG, "%s serial listener: got %d byte: %c. ready for messages.\n", instrument->name, bytes_read, c);
+        if(bytes_read < 0) {
+            syslog(LOG_ERR, "%s serial listener: Could not read header from the tty. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+            close(tty);
+            return NULL;
+        } 
+        if(c == 'c') {
+            syslog(LOG_DEBUG, "%s serial listener: got ready byte %c\n", instrument->name, c);
+            tty_is_ready = 1;
+        }
+    }
+
+    // From here on the tty is drained in big non-blocking reads
+    if(fcntl(tty, F_SETFL, fcntl(tty, F_GETFL) | O_NONBLOCK) < 0) {
+        syslog(LOG_ERR, "%s serial listener: Could not make the tty non-blocking. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+        close(tty);
+        return NULL;
+    }
+
+    if((buf = (unsigned char *)malloc(ASTRID_SERIAL_BUFSIZE)) == NULL) {
+        syslog(LOG_ERR, "%s serial listener: Could not allocate read buffer. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+        close(tty);
+        return NULL;
+    }
+
+    if((epfd = epoll_create1(0)) < 0) {
+        syslog(LOG_ERR, "%s serial listener: epoll_create1. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+        free(buf);
+        close(tty);
+        return NULL;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = tty;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tty, &ev);
+    ev.data.fd = (int)instrument->serialchannel.mqd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, (int)instrument->serialchannel.mqd, &ev);
+    ev.data.fd = instrument->serialchannel.doorbell;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, instrument->serialchannel.doorbell, &ev);
+
+    while(instrument->is_running) {
+        // Relay anything batched on the serial ring before sleeping
+        while(astrid_msgchannel_pop(&instrument->serialchannel, &msg) > 0) {
+            if(msg.type == LPMSG_SHUTDOWN) goto shutdown_serial_listener;
+            serial_listener_relay(instrument, tty, &msg);
+        }
+
+        if(astrid_msgchannel_prepare_wait(&instrument->serialchannel)) continue;
+
+        // Wait forever until something is ready for reading
+        numevents = epoll_wait(epfd, events, 3, -1);
+        astrid_msgchannel_finish_wait(&instrument->serialchannel);
+        if(numevents < 0) {
+            if(errno == EINTR) continue;
+            syslog(LOG_ERR, "%s serial listener: epoll_wait. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+            usleep((useconds_t)10000);
+            continue;
+        }
+
+        for(i=0; i < numevents; i++) {
+            if(tty >= 0 && events[i].data.fd == tty) {
+                // read everything the tty has for us, then parse it all at once
+                tty_is_gone = (events[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+                while(filled < ASTRID_SERIAL_BUFSIZE && (bytes_read = read(tty, buf + filled, ASTRID_SERIAL_BUFSIZE - filled)) > 0) {
+                    filled += bytes_read;
+                }
+
+                if(filled < ASTRID_SERIAL_BUFSIZE) {
+                    if(bytes_read == 0 || (bytes_read < 0 && errno == EIO)) {
+                        tty_is_gone = 1;
+                    } else if(bytes_read < 0 && errno != EAGAIN) {
+                        syslog(LOG_ERR, "%s serial listener: Could not read from the tty. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+                    }
+                }
+
+                serial_listener_parse(instrument, buf, &filled);
+
+                // An unplugged device stays readable forever, so stop watching it
+                if(tty_is_gone) {
+                    syslog(LOG_ERR, "%s serial listener: lost the tty %s, serial input is off until the instrument restarts\n", instrument->name, instrument->tty_path);
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, tty, NULL);
+                    close(tty);
+                    tty = -1;
+                    filled = 0;
+                }
+
+            } else if(events[i].data.fd == (int)instrument->serialchannel.mqd) {
+                // if there's a message on the queue, write it to the tty
+                if(astrid_msgq_read(instrument->serialchannel.mqd, &msg) == (mqd_t) -1) {
+                    syslog(LOG_ERR, "%s serial listener: Could not read message from the q. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
+                    continue;
+                }
+
+                if(msg.type == LPMSG_SHUTDOWN) goto shutdown_serial_listener;
+
+                serial_listener_relay(instrument, tty, &msg);
+            }
+        }
+    }
+
+shutdown_serial_listener:
+    syslog(LOG_INFO, "%s serial listener: shutting down here!\n", instrument->name);
+    close(epfd);
+    free(buf);
+    if(tty >= 0) close(tty);
+
+    return 0;
+}
+
+static void instrument_midi_listener_push(lpinstrument_t * instrument, jack_nframes_t frame, unsigned char type, unsigned char channel, unsigned char id, unsigned char value) {
+    lpmidiinqueue_t * q = &instrument->midiin;
+    lpmidiinevent_t * event;
+    size_t head, tail;
+
+    head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if(head - tail >= ASTRID_MIDIIN_QUEUE_SIZE) {
+        syslog(LOG_WARNING, "%s midi listener: MIDI input queue is full, dropping event\n", instrument->name);
+        return;
+    }
+
+    event = &q->events[head & (ASTRID_MIDIIN_QUEUE_SIZE-1)];
+    event->frame = frame;
+    event->offset = 0;
+    event->type = type;
+    event->channel = channel;
+    event->id = id;
+    event->value = value;
+
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+void * instrument_midi_listener_thread(void * arg) {
+    snd_seq_t * seq_handle;
+    snd_seq_event_t * event;
+    jack_nframes_t frame;
+    int ret, port;
+
+    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+
+    syslog(LOG_DEBUG, "%s MIDI listener thread starting for device ID %d\n", instrument->name, instrument->midi_device_id);
+
+    if((ret = snd_seq_open(&seq_handle, "default", SND_SEQ_OPEN_INPUT, 0)) < 0) {
+        syslog(LOG_ERR, "%s midi listener: Could not open ALSA seq. Error: (%d) %s\n", instrument->name, ret, snd_strerror(ret));
+        return 0;
+    }
+
+    snd_seq_set_client_name(seq_handle, "astrid_midi_listener");
+
+    if((port = snd_seq_create_simple_port(seq_handle, "input", 
+                    SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE, 
+                    SND_SEQ_PORT_TYPE_APPLICATION)) < 0) {
+        syslog(LOG_ERR, "%s midi listener: Could not create ALSA port. Error: (%d) %s\n", instrument->name, port, snd_strerror(port));
+        snd_seq_close(seq_handle);
+        return 0;
+    }
+
+    if((ret = snd_seq_connect_from(seq_handle, port, instrument->midi_device_id, 0)) < 0) {
+        syslog(LOG_ERR, "%s midi listener: Could not connect to ALSA port. Error: (%d) %s\n", instrument->name, ret, snd_strerror(ret));
+        snd_seq_close(seq_handle);
+        return 0;
+    }
+
+    while(instrument->is_running) {
+        snd_seq_event_input(seq_handle, &event);
+
+        /* Stamp the arrival before doing anything else */
+        frame = jack_frame_time(instrument->jack_client);
+
+        switch(event->type) {
+            case SND_SEQ_EVENT_NOTEON:
+                instrument_midi_listener_push(instrument, frame, NOTE_ON, event->data.note.channel, event->data.note.note, event->data.note.velocity);
+                lpmidi_setnote(instrument->midi_device_id, event->data.note.note, event->data.note.velocity);
+                /* Notemaps are triggered once per device by midistatus, not here */
+                lpmidi_relay_to_instrument(instrument->name, NOTE_ON, event->data.note.note, event->data.note.velocity);
+                break;
+            case SND_SEQ_EVENT_NOTEOFF:
+                instrument_midi_listener_push(instrument, frame, NOTE_OFF, event->data.note.channel, event->data.note.note, event->data.note.velocity);
+                lpmidi_setnote(instrument->midi_device_id, event->data.note.note, 0);
+                lpmidi_relay_to_instrument(instrument->name, NOTE_OFF, event->data.note.note, event->data.note.velocity);
+                break;
+            case SND_SEQ_EVENT_CONTROLLER:
+                instrument_midi_listener_push(instrument, frame, CONTROL_CHANGE, event->data.control.channel, event->data.control.param, event->data.control.value);
+                lpmidi_setcc(instrument->midi_device_id, event->data.control.param, event->data.control.value);
+                lpmidi_relay_to_instrument(instrument->name, CONTROL_CHANGE, event->data.control.param, event->data.control.value);
+                break;
+            default:
+                break;
+        }
+    }
+
+    snd_seq_close(seq_handle);
+    return 0;
+}
+
+static int astrid_instrument_jack_open(lpinstrument_t * instrument, int * blocksize) {
+    jack_status_t jack_status;
+    jack_options_t jack_options = JackNullOption;
+
+    /* Set up JACK */
+    instrument->inports = (jack_port_t **)calloc(instrument->channels, sizeof(jack_port_t *));
+    instrument->outports = (jack_port_t **)calloc(instrument->channels, sizeof(jack_port_t *));
+    instrument->jack_client = jack_client_open(instrument->name, jack_options, &jack_status, NULL);
+
+    syslog(LOG_DEBUG, "JACK STATUS %d\n", (int)jack_status);
+
+    if(instrument->jack_client == NULL) {
+        syslog(LOG_ERR, "%s Could not open jack client. Client is NULL: %s\n", instrument->name, strerror(errno));
+        if((jack_status & JackServerFailed) == JackServerFailed) {
+            syslog(LOG_ERR, "%s Could not open jack client. Jack server failed with status %2.0x\n", instrument->name, jack_status);
+        } else {
+            syslog(LOG_ERR, "%s Could not open jack client. Unknown error: %s\n", instrument->name, strerror(errno));
+        }
+        return -1;
+    }
+
+    if((jack_status & JackServerStarted) == JackServerStarted) {
+        syslog(LOG_INFO, "Jack server started!\n");
+    }
+
+    /* Get the samplerate from JACK */
+    /* FIXME could use the JACK D-Bus API here to let instruments change the samplerate? */
+    instrument->samplerate = (lpfloat_t)jack_get_sample_rate(instrument->jack_client);
+    *blocksize = (int)jack_get_buffer_size(instrument->jack_client);
+
+    return 0;
+}
+
+static int astrid_instrument_jack_activate(lpinstrument_t * instrument) {
+    const char ** ports;
+    char outport_name[50];
+    char inport_name[50];
+    int c = 0;
+
+    /* Set the main jack callback which always runs: maybe there is an analysis-only use to support too? */
+    jack_set_process_callback(instrument->jack_client, astrid_instrument_jack_callback, (void *)instrument);
+    jack_set_xrun_callback(instrument->jack_client, astrid_instrument_jack_xrun_callback, (void *)instrument);
+    jack_set_buffer_size_callback(instrument->jack_client, astrid_instrument_jack_buffer_size_callback, (void *)instrument);
+    for(c=0; c < instrument->channels; c++) {
+        snprintf(outport_name, sizeof(outport_name), "out%d", c);
+        instrument->outports[c] = jack_port_register(instrument->jack_client, outport_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+
+        snprintf(inport_name, sizeof(inport_name), "in%d", c);
+        instrument->inports[c] = jack_port_register(instrument->jack_client, inport_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+    }
+
+    /* Request some ports from jack */
+    for(c=0; c < instrument->channels; c++) {
+        if(instrument->outports[c] == NULL) {
+            syslog(LOG_ERR, "No more JACK output ports available, shutting down...\n");
+            return -1;
+        }
+
+        if(instrument->inports[c] == NULL) {
+            syslog(LOG_ERR, "No more JACK input ports available, shutting down...\n");
+            return -1;
+        }
+    }
+
+    /* activate the jack client */
+    if(jack_activate(instrument->jack_client) != 0) {
+        syslog(LOG_ERR, "%s Could not activate JACK client, shutting down...\n", instrument->name);
+        return -1;
+    }
+
+    /* connect the jack ports FIXME would be nice to optionally do routing in the instrument callback */
+    if((ports = jack_get_ports(instrument->jack_client, NULL, NULL, JackPortIsPhysical|JackPortIsOutput)) == NULL) {
+		syslog(LOG_CRIT, "Cannot find any physical capture ports");
+        return -1;
+	}
+
+    for(c=0; c < instrument->channels; c++) {
+        if(jack_connect(instrument->jack_client, ports[c], jack_port_name(instrument->inports[c]))) {
+            syslog(LOG_NOTICE, "Could not connect input port %d. (There probably aren't enough available inputs on this device.)\n", c);
+        }
+    }
+	free(ports);
+	
+	if((ports = jack_get_ports(instrument->jack_client, NULL, NULL, JackPortIsPhysical|JackPortIsInput)) == NULL) {
+		syslog(LOG_CRIT, "Cannot find any physical playback ports");
+        return -1;
+	}
+
+    for(c=0; c < instrument->channels; c++) {
+        if(jack_connect(instrument->jack_client, jack_port_name(instrument->outports[c]), ports[c])) {
+            syslog(LOG_NOTICE, "Could not connect output port %d. (There probably aren't enough available outputs on this device.)\n", c);
+        }
+    }
+	free(ports);
+
+    return 0;
+}
+
+lpinstrument_t * astrid_instrument_start(
+    char * name, 
+    int channels, 
+    int ext_relay_enabled,
+    double adc_length,
+    double resampler_length,
+    void * ctx,
+    char * tty,
+    char * midi_device_name,
+    int (*stream)(size_t blocksize, float ** input, float ** output, void * instrument),
+    int (*renderer)(void * instrument),
+    int (*update)(void * instrument, char * key, char * val),
+    int (*trigger)(void * instrument)
+) {
+    lpinstrument_t * instrument;
+    struct sigaction shutdown_action;
+    char * msglog_path, * numworkers_env;
+    int numworkers = 0, priority = 0;
+    int blocksize = 0;
+
+    instrument = (lpinstrument_t *)LPMemoryPool.alloc(1, sizeof(lpinstrument_t));
+    memset(instrument, 0, sizeof(lpinstrument_t));
+
+    setlogmask(LOG_UPTO(LOG_ERR));
+    openlog(name, LOG_PID, LOG_USER);
+    astrid_log_start(NULL);
+    syslog(LOG_DEBUG, "starting %s instrument...\n", name);
+
+    instrument->name = name;
+    instrument->channels = channels;
+    instrument->context = ctx;
+
+    instrument->stream = stream;
+    instrument->renderer = renderer;
+    instrument->update = update;
+    instrument->trigger = trigger;
+    instrument->ext_relay_enabled = ext_relay_enabled;
+    instrument->is_ready = 1;
+
+    instrument->midi_device_id = -1;
+    if(midi_device_name != NULL) {
+        instrument->midi_device_id = lpmidi_get_device_id_by_name(midi_device_name);
+        syslog(LOG_DEBUG, "Set MIDI device ID (%d) for %s\n", instrument->midi_device_id, midi_device_name);
+    }
+
+    /* Seed the random number generator */
+    LPRand.preseed();
+
+    /* Set shutdown signal handlers */
+    shutdown_action.sa_handler = handle_instrument_shutdown;
+    sigemptyset(&shutdown_action.sa_mask);
+    shutdown_action.sa_flags = SA_RESTART; /* Prevent open, read, write etc from EINTR */
+    astrid_instrument_is_running = &instrument->is_running;
+
+    if(sigaction(SIGINT, &shutdown_action, NULL) == -1) {
+        syslog(LOG_ERR, "%s Could not init SIGINT signal handler. Error: %s\n", name, strerror(errno));
+        exit(1);
+    }
+
+    if(sigaction(SIGTERM, &shutdown_action, NULL) == -1) {
+        syslog(LOG_ERR, "%s Could not init SIGTERM signal handler. Error: %s\n", name, strerror(errno));
+        exit(1);
+    }
+
+    // Set the message q names
+    snprintf(instrument->qname, NAME_MAX, "/%s-msgq", instrument->name);
+    snprintf(instrument->serial_message_q_name, NAME_MAX, "/%s-serial-msgq", instrument->name);
+
+    // Set the tty path
+    if(tty != NULL) {
+        snprintf(instrument->tty_path, NAME_MAX, "%s", tty);
+        instrument->tty_is_enabled = 1;
+    }
+
+    if(instrument->ext_relay_enabled) {
+        snprintf(instrument->external_relay_name, NAME_MAX, "/%s-extrelay-msgq", instrument->name);
+    } 
+
+    // set up the voice counter and the buffer counter
+    if(lpcounter_create("voiceid") < 0) {
+        syslog(LOG_ERR, "%s Could not create voiceid counter. Error: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    if(lpcounter_create("bufferid") < 0) {
+        syslog(LOG_ERR, "%s Could not create bufferid counter. Error: %s\n", name, strerror(errno));
+        exit(1);
+    }
+
+    /* Open the LMDB session */
+    astrid_instrument_session_open(instrument);
+
+    /* Run headless instead of on JACK if ASTRID_OFFLINE is set */
+    if((instrument->offline = astrid_offline_create(channels)) != NULL) {
+        instrument->samplerate = instrument->offline->samplerate;
+        blocksize = instrument->offline->blocksize;
+    } else if(astrid_instrument_jack_open(instrument, &blocksize) < 0) {
+        goto astrid_instrument_shutdown_with_error;
+    }
+
+    /* Record incoming messages for replay if asked */
+    if((msglog_path = getenv(ASTRID_MSGLOG_ENV)) != NULL && (instrument->msglog = fopen(msglog_path, "wb")) == NULL) {
+        syslog(LOG_ERR, "%s Could not open message log %s. Error: %s\n", name, msglog_path, strerror(errno));
+    }
+
+    /* Publish stats for astrid-stats */
+    if(astrid_stats_open(instrument->name, instrument->channels, (int)instrument->samplerate, blocksize) == NULL) {
+        syslog(LOG_WARNING, "%s Could not open stats page, carrying on without it\n", name);
+    }
+
+    /* Create the internal ringbuffer for sampling from the adc */
+    snprintf(instrument->adcname, PATH_MAX, "%s-adc", instrument->name);
+    if((instrument->adcbuf = lpsampler_create(instrument->adcname, adc_length, instrument->channels, instrument->samplerate)) == NULL) {
+        syslog(LOG_INFO, "Could not create instrument ADC buffer\n");
+        goto astrid_instrument_shutdown_with_error;
+    }
+
+    /* Create the internal ringbuffer for resampling */
+    snprintf(instrument->resamplername, PATH_MAX, "%s-resampler", instrument->name);
+    if((instrument->resamplerbuf = lpsampler_create(instrument->resamplername, resampler_length, instrument->channels, instrument->samplerate)) == NULL) {
+        syslog(LOG_INFO, "Could not create instrument resampler buffer\n");
+        goto astrid_instrument_shutdown_with_error;
+    }
+
+    /* init scheduler */
+    instrument->async_mixer = scheduler_create(1, instrument->channels, instrument->samplerate);
+
+    /* Spawn the worker pool for stream callbacks, one thread per spare core by default */
+    if(instrument->stream != NULL) {
+        numworkers = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+        if((numworkers_env = getenv(ASTRID_WORKERS_ENV)) != NULL) numworkers = atoi(numworkers_env);
+        if(numworkers < 0) numworkers = 0;
+    }
+    if(instrument->jack_client != NULL) {
+        /* JACK reports -1 when it isn't running realtime, so fall back to our own priority */
+        priority = jack_client_real_time_priority(instrument->jack_client);
+        if(priority <= 0) priority = ASTRID_WORKER_PRIORITY;
+    }
+    if((instrument->workers = astrid_workers_create(numworkers, instrument->channels, (size_t)blocksize, priority)) == NULL) {
+        goto astrid_instrument_shutdown_with_error;
+    }
+
+    /* Start the JACK callback */
+    if(instrument->offline == NULL && astrid_instrument_jack_activate(instrument) < 0) {
+        goto astrid_instrument_shutdown_with_error;
+    }
+
+    /* Register that everything is running and ready */
+    instrument->is_running = 1;
+    syslog(LOG_INFO, "%s is running...\n", name);
+
+    /* Open the message queue */
+    if(astrid_msgchannel_open(&instrument->msgchannel, instrument->qname) < 0) {
+        syslog(LOG_CRIT, "Could not open msgq for instrument %s. Error: %s\n", instrument->name, strerror(errno));
+        return NULL;
+    }
+    syslog(LOG_DEBUG, "Opened message queue for %s with fd %d\n", instrument->name, instrument->msgchannel.mqd);
+
+    if(astrid_msgchannel_open(&instrument->serialchannel, instrument->serial_message_q_name) < 0) {
+        syslog(LOG_CRIT, "Could not open serial msgq for instrument %s. Error: %s\n", instrument->name, strerror(errno));
+        return NULL;
+    }
+    syslog(LOG_DEBUG, "Opened serial message queue for %s with fd %d\n", instrument->name, instrument->serialchannel.mqd);
+
+    if(instrument->ext_relay_enabled) {
+        if(astrid_msgchannel_open(&instrument->exmsgchannel, instrument->external_relay_name) < 0) {
+            syslog(LOG_CRIT, "Could not open external message relay for instrument %s. Error: %s\n", instrument->name, strerror(errno));
+            return NULL;
+        }
+        syslog(LOG_DEBUG, "Opened message relay queue for %s with fd %d\n", instrument->name, instrument->exmsgchannel.mqd);
+    }
+
+    /* Prepare the message structs */ 
+    init_instrument_message(&instrument->msg, instrument->name);
+    init_instrument_message(&instrument->cmd, instrument->name);
+
+    /* Start the sequencer thread */
+    if(astrid_instrument_seq_start(instrument) < 0) {
+        syslog(LOG_CRIT, "Could not start message sequence threads for instrument %s. Error: %s\n", instrument->name, strerror(errno));
+        return NULL;
+    }
+
+    /* Start listening for messages in the message feed thread */
+    if(pthread_create(&instrument->message_feed_thread, NULL, instrument_message_thread, (void*)instrument) != 0) {
+        syslog(LOG_ERR, "Could not initialize instrument message thread. Error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    /* Start listening for MIDI messages in the midi listener thread */
+    // TODO support multiple devices
+    if(instrument->offline != NULL && instrument->midi_device_id >= 0) {
+        syslog(LOG_WARNING, "%s MIDI input is not available when running offline\n", instrument->name);
+        instrument->midi_device_id = -1;
+    }
+
+    if(instrument->midi_device_id >= 0) {
+        syslog(LOG_DEBUG, "We're gonna listen for some MIDI over here in %s-land!\n", instrument->name);
+        if(pthread_create(&instrument->midi_listener_thread, NULL, instrument_midi_listener_thread, (void*)instrument) != 0) {
+            syslog(LOG_ERR, "Could not initialize instrument midi listener thread. Error: %s\n", strerror(errno));
+            return NULL;
+        }
+    }
+
+    /* start the param flusher thread */
+    if(pthread_create(&instrument->param_flusher_thread, NULL, instrument_param_flusher_thread, (void*)instrument) != 0) {
+        syslog(LOG_ERR, "Could not initialize instrument param flusher thread. Error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    /* start the cleanup thread */
+    if(pthread_create(&instrument->cleanup_thread, NULL, instrument_cleanup_thread, (void*)instrument) != 0) {
+        syslog(LOG_ERR, "Could not initialize instrument cleanup thread. Error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    /* start the serial listener thread */
+    // TODO support multiple devices -- maybe just register them in the session?
+    if(pthread_create(&instrument->serial_listener_thread, NULL, instrument_serial_listener_thread, (void*)instrument) != 0) {
+        syslog(LOG_ERR, "Could not initialize serial listener thread. Error: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    /* start the headless driver last, once there is somewhere to replay messages to */
+    if(instrument->offline != NULL) {
+        /* this thread forks the python render processes, which seed per render */
+        if(astrid_offline_seed(instrument, 0)) instrument->has_been_initialized = 1;
+
+        lpscheduler_get_now_seconds(&instrument->offline->clock->start_seconds);
+        if(!instrument->offline->realtime) astrid_offline_clock = instrument->offline->clock;
+
+        if(pthread_create(&instrument->offline->thread, NULL, astrid_offline_driver_thread, (void*)instrument) != 0) {
+            syslog(LOG_ERR, "Could not initialize offline driver thread. Error: %s\n", strerror(errno));
+            return NULL;
+        }
+    }
+
+    /* setup linenoise repl, headless runs have no use for it */
+    if(instrument->offline == NULL) linenoiseHistoryLoad("history.txt"); // FIXME this goes in the instrument config dir / or share?
+
+    return instrument;
+
+astrid_instrument_shutdown_with_error:
+    instrument->is_running = 0;
+    if(instrument->jack_client != NULL) jack_client_close(instrument->jack_client);
+    astrid_workers_destroy(instrument->workers);
+    astrid_log_stop();
+    closelog();
+    return NULL;
+}
+
+int astrid_instrument_stop(lpinstrument_t * instrument) {
+    int c, ret, headless = (instrument->offline != NULL);
+
+    syslog(LOG_INFO, "%s instrument shutting down and cleaning up...\n", instrument->name);
+    syslog(LOG_INFO, "Sending shutdown message to threads and queues...\n");
+    if(instrument->is_waiting) {
+        instrument->msg.type = LPMSG_SHUTDOWN;
+        if(send_play_message(instrument->msg) < 0) {
+            fprintf(stderr, "astrid instrument message thread cleanup: Could not send shutdown message...\n");
+        }
+    }
+
+    syslog(LOG_DEBUG, "Joining with message thread...\n");
+    if((ret = pthread_join(instrument->message_feed_thread, NULL)) != 0) {
+        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
+        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
+        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
+        syslog(LOG_ERR, "Error while attempting to join with message feed thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
+    }
+
+    syslog(LOG_DEBUG, "Joining with message scheduler pq thread...\n");
+    instrument_seq_wake(instrument);
+    if((ret = pthread_join(instrument->message_scheduler_pq_thread, NULL)) != 0) {
+        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
+        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
+        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
+        syslog(LOG_ERR, "Error while attempting to join with message scheduler pq thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
+    }
+
+    syslog(LOG_DEBUG, "Joining with cleanup thread...\n");
+    if((ret = pthread_join(instrument->cleanup_thread, NULL)) != 0) {
+        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
+        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
+        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
+        syslog(LOG_ERR, "Error while attempting to join with cleanup thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
+    }
+
+    syslog(LOG_DEBUG, "Joining with param flusher thread...\n");
+    instrument_param_flusher_wake(instrument);
+    if((ret = pthread_join(instrument->param_flusher_thread, NULL)) != 0) {
+        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
+        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
+        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
+        syslog(LOG_ERR, "Error while attempting to join with param flusher thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
+    }
+
+    if(instrument->midi_device_id >= 0) {
+        syslog(LOG_DEBUG, "Joining with midi listener thread...\n");
+        if((ret = pthread_join(instrument->midi_listener_thread, NULL)) != 0) {
+            if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
+            if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
+            if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
+            syslog(LOG_ERR, "Error while attempting to join with midi listener thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
+        }
+    }
+
+    syslog(LOG_DEBUG, "Joining with serial listener thread...\n");
+    if((ret = pthread_join(instrument->serial_listener_thread, NULL)) != 0) {
+        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
+        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
+        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
+        syslog(LOG_ERR, "Error while attempting to join with serial listener thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
+    }
+
+    if(instrument->offline != NULL) {
+        syslog(LOG_DEBUG, "Joining with offline driver thread...\n");
+        astrid_offline_finish(instrument);
+    }
+
+    syslog(LOG_DEBUG, "Closing instrument message queue...\n");
+    astrid_msgchannel_close(&instrument->msgchannel);
+
+    syslog(LOG_DEBUG, "Closing serial message queue...\n");
+    astrid_msgchannel_close(&instrument->serialchannel);
+
+    syslog(LOG_DEBUG, "Closing external message queue...\n");
+    astrid_msgchannel_close(&instrument->exmsgchannel);
+
+    if(instrument->jack_client != NULL) {
+        syslog(LOG_DEBUG, "Stopping JACK...\n");
+        for(c=0; c < instrument->channels; c++) {
+            jack_port_unregister(instrument->jack_client, instrument->outports[c]);
+            jack_port_unregister(instrument->jack_client, instrument->inports[c]);
+        }
+
+        jack_client_close(instrument->jack_client);
+    }
+
+    /* the audio thread is gone, so the workers are idle */
+    astrid_workers_destroy(instrument->workers);
+
+    if(instrument->msglog != NULL) fclose(instrument->msglog);
+
+    /* everything that logs through the rings has stopped by now */
+    astrid_log_stop();
+    astrid_stats_close(astrid_stats_page);
+
+    /* and the jack i/o buffers */
+    free(instrument->inports);
+    free(instrument->outports);
+
+    syslog(LOG_DEBUG, "Closing lmdb session...\n");
+    astrid_instrument_session_close(instrument);
+
+    /* save the history FIXME save the path on the instrument */
+    if(!headless) linenoiseHistorySave("history.txt");
 
-    syslog(LOG_DEBUG, "PARSER constructed message: type=%d id=%d value=%f\n", type, id, value);
+    if(instrument->async_mixer != NULL) scheduler_destroy(instrument->async_mixer);
 
-    if(memset(&msg->msg, 0, LPMAXMSG) == NULL) {
-        syslog(LOG_ERR, "%s encode_serial_msg: memset failure. Error: (%d) %s\n", msg->instrument_name, errno, strerror(errno));
+    syslog(LOG_DEBUG, "Cleaning up adc ringbuf...\n");
+    if(lpsampler_destroy(instrument->adcname) < 0) {
+        syslog(LOG_ERR, "Error while removing adc ringbuf, dang! Other cleanup is done tho.\n");
+        closelog();
         return -1;
     }
 
-    if(memcpy(&msg->msg, &smsg, sizeof(lpserialmsg_t)) == NULL) {
-        syslog(LOG_ERR, "%s encode_serial_msg: memcpy failure. Error: (%d) %s\n", msg->instrument_name, errno, strerror(errno));
+    syslog(LOG_DEBUG, "Cleaning up resampler ringbuf...\n");
+    if(lpsampler_destroy(instrument->resamplername) < 0) {
+        syslog(LOG_ERR, "Error while removing resampler ringbuf, dang! Other cleanup is done tho.\n");
+        closelog();
         return -1;
     }
 
+    /* cleanup the pq memory */
+    pqueue_free(instrument->msgpq);
+    free(instrument->pqnodes);
+    close(instrument->seq_wakefd);
+    close(instrument->seq_timerfd);
+
+    /* poof! */
+    free(instrument);
+
+    syslog(LOG_DEBUG, "All done, see ya later!\n");
+    closelog();
     return 0;
 }
-#endif
 
-void log_byte_buffer(unsigned char * buf, size_t size) {
-    size_t i;
-    for(i=0; i < size; i++) {
-        if(buf[i] == '\n') {
-            syslog(LOG_DEBUG, "%ld: \\n\n", i);
-        } else if(buf[i] == '\r') {
-            syslog(LOG_DEBUG, "%ld: \\r\n", i);
-        } else if(buf[i] == '\t') {
-            syslog(LOG_DEBUG, "%ld: \\t\n", i);
-        } else if(isprint(buf[i])) {
-            syslog(LOG_DEBUG, "%ld: %c\n", i, buf[i]);
-        } else {
-            syslog(LOG_DEBUG, "%ld: \\x%02X\n", i, buf[i]);
-        }
-    }
-}
+int astrid_instrument_get_or_create_datadir(const char * name, char * dbpath) {
+    int ret;
+    char astrid_data_path[PATH_MAX];
+    char xdg_data_home[PATH_MAX];
+    char * user_home;
+    char * _xdg_data_home = getenv("XDG_DATA_HOME");
+    char * default_data_dir = ".local/share";
+    char * instrument_subdir = "astrid_instruments";
 
-void * instrument_serial_listener_thread(void * arg) {
-    struct termios options;
-    unsigned char serialmsgbuf[sizeof(lpserialmsg_t)] = {0};
-    lpserialmsg_t header = {0};
-    unsigned char * payload;
-    unsigned char c;
-    unsigned char ready = 'c';
-    lpmsg_t msg = {0};
-    fd_set read_fds;
-    int tty, biggest_fd, bytes_written, bytes_read, tty_is_ready=0;
-    size_t bytes_in_buf=0;
-    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    if(_xdg_data_home == NULL) {
+        user_home = getenv("HOME");
+        ret = snprintf(xdg_data_home, PATH_MAX, "%s/%s", user_home, default_data_dir);
+        if(ret < 0) {
+            syslog(LOG_ERR, "astrid data path (%s) snprintf: (%d) %s\n", default_data_dir, errno, strerror(errno));
+            return -1;
+        }
 
-    if(!instrument->tty_is_enabled) {
-        syslog(LOG_INFO, "%s serial listener: no tty requested, shutting down here!\n", instrument->name);
-        return NULL;
+    } else {
+        snprintf(xdg_data_home, PATH_MAX, "%s", _xdg_data_home);
     }
 
-    // Open the tty 
-    // TODO support multiple ttys, duuuh
-    tty = open(instrument->tty_path, O_RDWR | O_NOCTTY);
-    if(tty < 0) {
-        syslog(LOG_ERR, "Problem connecting to TTY -- shutting down serial listener thread...\n");
-        return NULL;
+    if(access(xdg_data_home, F_OK) != 0) {
+        /* create the xdg data home dir */
+        if(mkdir(xdg_data_home, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0) {
+            syslog(LOG_ERR, "session data path (%s) mkdir: (%d) %s\n", xdg_data_home, errno, strerror(errno));
+            return -1;
+        }
     }
 
-    tcgetattr(tty, &options);
-    //cfsetispeed(&options, B1000000);
-    //cfsetospeed(&options, B1000000);
-    cfmakeraw(&options);
-    tcsetattr(tty, TCSANOW, &options);
-
-    while(!tty_is_ready) {
-        // signal the tty we've connected
-        bytes_written = write(tty, &ready, 1);
-        if(bytes_written != 1) {
-            syslog(LOG_ERR, "%s serial listener: unexpected number of bytes written to tty. (%d) Error: (%d) %s\n", instrument->name, bytes_written, errno, strerror(errno));
-            return NULL;
-        }
+    ret = snprintf(astrid_data_path, PATH_MAX, "%s/%s", xdg_data_home, instrument_subdir);
+    if(ret < 0) {
+        syslog(LOG_ERR, "astrid data path (%s) snprintf: (%d) %s\n", astrid_data_path, errno, strerror(errno));
+        return -1;
+    }
 
-        bytes_read = read(tty, &c, 1);
-        syslog(LOG_DEBUG, "%s serial listener: got %d byte: %c. ready for messages.\n", instrument->name, bytes_read, c);
-        if(bytes_read < 0) {
-            syslog(LOG_ERR, "%s serial listener: Could not read header from the tty. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
-            return NULL;
-        } 
-        if(c == 'c') {
-            syslog(LOG_DEBUG, "%s serial listener: got ready byte %c\n", instrument->name, c);
-            tty_is_ready = 1;
+    if(access(astrid_data_path, F_OK) != 0) {
+        /* create the astrid data path */
+        if(mkdir(astrid_data_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0) {
+            syslog(LOG_ERR, "astrid data path (%s) mkdir: (%d) %s\n", astrid_data_path, errno, strerror(errno));
+            return -1;
         }
     }
 
-    while(instrument->is_running) {
-        // FIXME before calling select, check the session for new / removed ttys and close 
-        // or open their handles for reading/writing, setting them each in the fds collections.
-        // Also keep an array of tty_is_ready[1024] mapped fd=readyval since select only works 
-        // with max 1024 file descriptors anyway. And adapt the biggest fd calc on each loop...
-        
-        FD_ZERO(&read_fds);
-        FD_SET(instrument->serialmsgq, &read_fds);
-        FD_SET(tty, &read_fds);
-
-        // nfds should be the biggest fd + 1 ...
-        biggest_fd = (tty > instrument->serialmsgq ? tty : instrument->serialmsgq) + 1;
+    ret = snprintf(dbpath, PATH_MAX, "%s/%s", astrid_data_path, name);
+    if(ret < 0) {
+        syslog(LOG_ERR, "astrid data path (%s) snprintf: (%d) %s\n", astrid_data_path, errno, strerror(errno));
+        return -1;
+    }
 
-        // Wait forever until something is ready for reading or writing
-        if(select(biggest_fd, &read_fds, NULL, NULL, NULL) < 0) {
-            syslog(LOG_ERR, "%s serial listener: select. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
-            usleep((useconds_t)10000);
-            continue;
+    if(access(dbpath, F_OK) != 0) {
+        /* create the data dir */
+        if(mkdir(dbpath, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0) {
+            syslog(LOG_ERR, "session data path (%s) mkdir: (%d) %s\n", dbpath, errno, strerror(errno));
+            return -1;
         }
+    }
 
-        // read some bytes from the tty if there are some
-        if(FD_ISSET(tty, &read_fds)) {
-            // Read the header
-            bytes_in_buf = 0;
-            while(bytes_in_buf < sizeof(lpserialmsg_t)) {
-                bytes_read = read(tty, serialmsgbuf+bytes_in_buf, sizeof(lpserialmsg_t)-bytes_in_buf);
-                //syslog(LOG_ERR, "%s serial listener: got header bytes %d\n", instrument->name, bytes_read);
-                //log_byte_buffer(serialmsgbuf, sizeof(lpserialmsg_t));
-                if(bytes_read < 0) {
-                    syslog(LOG_ERR, "%s serial listener: Could not read header from the tty. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
-                    goto handle_serial_message_events;
-                } 
-                bytes_in_buf += bytes_read; 
-            }
-
-            memcpy(&header, serialmsgbuf, sizeof(lpserialmsg_t));
-            if(header.size > 0) {
-                payload = (unsigned char *)malloc(header.size);
-                bytes_in_buf = 0;
-                while(bytes_in_buf < header.size) {
-                    bytes_read = read(tty, payload+bytes_in_buf, header.size-bytes_in_buf);
-                    //syslog(LOG_ERR, "%s serial listener: got payload bytes %d\n", instrument->name, bytes_read);
-                    //log_byte_buffer(payload, header.size);
-
-                    if(bytes_read < 0) {
-                        syslog(LOG_ERR, "%s serial listener: Could not read payload from the tty. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
-                        free(payload);
-                        goto handle_serial_message_events;
-                    } 
-                    bytes_in_buf += bytes_read;
-                }
-            }
-
-            // parse and handle the msg:
-            // write the payload into the session, and the payload ID into the msg_t
-            // Convert the message to msg_t update
-            memset(&msg, 0, sizeof(lpmsg_t));
-            msg.type = header.type;
-            memcpy(msg.instrument_name, header.instrument_name, LPMAXNAME);
-
-            if(header.size > 0 && header.type == LPMSG_UPDATE) {
-                // Update messages have a fixed size ID/value payload
-                memcpy(msg.msg, payload, header.size);
-                free(payload);
-            } else if(header.size > 0 && header.type == LPMSG_DATA) {
-                // Data messages get their payloads stored in shared memory (with a wrapper, probably?)
-                free(payload);
-            }
-            // Send it on the instrument msg queue
-            send_play_message(msg);
-
-            // when we're done reading the message, clear the buffer & header
-            memset(&serialmsgbuf, 0, sizeof(serialmsgbuf));
-            memset(&header, 0, sizeof(lpserialmsg_t));
-            bytes_in_buf = 0;
-        }
-
-handle_serial_message_events:
-        // Handle messages on the serial queue if there are any
-        if(FD_ISSET(instrument->serialmsgq, &read_fds)) {
-            // if there's a message on the queue, write it to the tty
-            if(astrid_msgq_read(instrument->serialmsgq, &msg) == (mqd_t) -1) {
-                syslog(LOG_ERR, "%s serial listener: Could not read message from the q. Error: (%d) %s\n", instrument->name, errno, strerror(errno));
-                usleep((useconds_t)10000);
-                continue;
-            }
-
-            if(msg.type == LPMSG_SHUTDOWN) break;
-
-            syslog(LOG_DEBUG, "Got a message to relay over serial! Writing it to the tty...\n");
+    return 0;
+}
 
-            // FIXME check write_fds here, and queue messages for writing later if 
-            // it's not possible to write (or just drop them I guess?)
-            bytes_written = write(tty, &msg.msg, sizeof(lpserialmsg_t));
-            if(bytes_written != sizeof(lpserialmsg_t)) {
-                syslog(LOG_ERR, "%s serial listener: unexpected number of bytes written to tty. (%d) Error: (%d) %s\n", instrument->name, bytes_written, errno, strerror(errno));
-                usleep((useconds_t)10000);
-                continue;
-            }
+int astrid_instrument_session_open(lpinstrument_t * instrument) {
+    char cachename[NAME_MAX] = {0};
+    int rc, fd;
 
-            syslog(LOG_DEBUG, "Wrote %d bytes to the tty...\n", bytes_written);
-        }
+    if(astrid_instrument_get_or_create_datadir(instrument->name, instrument->datapath) < 0) {
+        syslog(LOG_ERR, "session data path (%s) mkdir: (%d) %s\n", instrument->datapath, errno, strerror(errno));
+        return -1;
     }
 
-    syslog(LOG_INFO, "%s serial listener: shutting down here!\n", instrument->name);
-    close(tty);
+    /* create the environment */
+	rc = mdb_env_create(&instrument->dbenv);
+    if(rc != MDB_SUCCESS) {
+		syslog(LOG_ERR, "mdb_env_create: (%d) %s\n", rc, mdb_strerror(rc));
+        return -1;
+    }
 
-    return 0;
-}
+    /* open it at the db directory */
+	rc = mdb_env_open(instrument->dbenv, instrument->datapath, 0, 0664);
+    if(rc != MDB_SUCCESS) {
+        syslog(LOG_ERR, "mdb_env_open: (%d) %s\n", rc, mdb_strerror(rc));
+        return -1;
+    }
 
-void * instrument_midi_listener_thread(void * arg) {
-    snd_seq_t * seq_handle;
-    snd_seq_event_t * event;
-    int ret, port;
+    /* begin a new read transaction */
+	rc = mdb_txn_begin(instrument->dbenv, NULL, MDB_RDONLY, &instrument->dbtxn_read);
+    if(rc != MDB_SUCCESS) {
+        syslog(LOG_ERR, "mdb_txn_begin: read (%d) %s\n", rc, mdb_strerror(rc));
+        return -1;
+    }
 
-    lpinstrument_t * instrument = (lpinstrument_t *)arg;
+    /* open the database inside the read transaction */
+	rc = mdb_dbi_open(instrument->dbtxn_read, NULL, 0, &instrument->dbi);
+    if(rc != MDB_SUCCESS) {
+        syslog(LOG_ERR, "mdb_dbi_open: read (%d) %s\n", rc, mdb_strerror(rc));
+        return -1;
+    }
 
-    syslog(LOG_DEBUG, "%s MIDI listener thread starting for device ID %d\n", instrument->name, instrument->midi_device_id);
+    /* begin a new read/write transaction */
+	rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &instrument->dbtxn_write);
+    if(rc != MDB_SUCCESS) {
+        syslog(LOG_ERR, "mdb_txn_begin: (%d) %s\n", rc, mdb_strerror(rc));
+        return -1;
+    }
 
-    if((ret = snd_seq_open(&seq_handle, "default", SND_SEQ_OPEN_INPUT, 0)) < 0) {
-        syslog(LOG_ERR, "%s midi listener: Could not open ALSA seq. Error: (%d) %s\n", instrument->name, ret, snd_strerror(ret));
-        return 0;
+    /* open the database inside the write transaction */
+	rc = mdb_dbi_open(instrument->dbtxn_write, NULL, 0, &instrument->dbi);
+    if(rc != MDB_SUCCESS) {
+        syslog(LOG_ERR, "mdb_dbi_open: read (%d) %s\n", rc, mdb_strerror(rc));
+        return -1;
     }
 
-    snd_seq_set_client_name(seq_handle, "astrid_midi_listener");
+    /* finalize the transactions */
+	mdb_txn_reset(instrument->dbtxn_read);
+	mdb_txn_commit(instrument->dbtxn_write);
 
-    if((port = snd_seq_create_simple_port(seq_handle, "input", 
-                    SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE, 
-                    SND_SEQ_PORT_TYPE_APPLICATION)) < 0) {
-        syslog(LOG_ERR, "%s midi listener: Could not create ALSA port. Error: (%d) %s\n", instrument->name, port, snd_strerror(port));
-        snd_seq_close(seq_handle);
-        return 0;
+    /* map a fresh param cache: LMDB is the source of truth at startup */
+    snprintf(cachename, NAME_MAX, ASTRID_PARAMCACHE_NAME, instrument->name);
+    shm_unlink(cachename);
+    if((fd = shm_open(cachename, O_CREAT | O_RDWR, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "param cache shm_open: (%d) %s\n", errno, strerror(errno));
+        return -1;
     }
 
-    if((ret = snd_seq_connect_from(seq_handle, port, instrument->midi_device_id, 0)) < 0) {
-        syslog(LOG_ERR, "%s midi listener: Could not connect to ALSA port. Error: (%d) %s\n", instrument->name, ret, snd_strerror(ret));
-        snd_seq_close(seq_handle);
-        return 0;
+    if(ftruncate(fd, sizeof(lpparamtables_t)) < 0) {
+        syslog(LOG_ERR, "param cache ftruncate: (%d) %s\n", errno, strerror(errno));
+        close(fd);
+        return -1;
     }
 
-    while(instrument->is_running) {
-        snd_seq_event_input(seq_handle, &event);
-        switch(event->type) {
-            case SND_SEQ_EVENT_NOTEON:
-                lpmidi_relay_to_instrument(instrument->name, NOTE_ON, event->data.note.note, event->data.note.velocity);
-                break;
-            case SND_SEQ_EVENT_NOTEOFF:
-                lpmidi_relay_to_instrument(instrument->name, NOTE_OFF, event->data.note.note, event->data.note.velocity);
-                break;
-            case SND_SEQ_EVENT_CONTROLLER:
-                lpmidi_relay_to_instrument(instrument->name, CONTROL_CHANGE, event->data.control.param, event->data.control.value);
-                break;
-            default:
-                break;
-        }
+    instrument->paramtables = (lpparamtables_t *)mmap(NULL, sizeof(lpparamtables_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(instrument->paramtables == MAP_FAILED) {
+        syslog(LOG_ERR, "param cache mmap: (%d) %s\n", errno, strerror(errno));
+        instrument->paramtables = NULL;
+        return -1;
     }
 
-    snd_seq_close(seq_handle);
-    return 0;
-}
-
-lpinstrument_t * astrid_instrument_start(
-    char * name, 
-    int channels, 
-    int ext_relay_enabled,
-    double adc_length,
-    double resampler_length,
-    void * ctx,
-    char * tty,
-    char * midi_device_name,
-    int (*stream)(size_t blocksize, float ** input, float ** output, void * instrument),
-    int (*renderer)(void * instrument),
-    int (*update)(void * instrument, char * key, char * val),
-    int (*trigger)(void * instrument)
-) {
-    lpinstrument_t * instrument;
-    struct sigaction shutdown_action;
-    jack_status_t jack_status;
-    jack_options_t jack_options = JackNullOption;
-    const char ** ports;
-    char outport_name[50];
-    char inport_name[50];
-    int c = 0;
+    instrument->paramtables->owner = getpid();
+    if((rc = astrid_robust_mutex_init(&instrument->paramtables->lock)) != 0) {
+        syslog(LOG_ERR, "param cache lock init: (%d) %s\n", rc, strerror(rc));
+        munmap(instrument->paramtables, sizeof(lpparamtables_t));
+        instrument->paramtables = NULL;
+        return -1;
+    }
 
-    instrument = (lpinstrument_t *)LPMemoryPool.alloc(1, sizeof(lpinstrument_t));
-    memset(instrument, 0, sizeof(lpinstrument_t));
+    instrument->param_flush_interval = ASTRID_PARAM_FLUSH_INTERVAL;
+    if((instrument->param_flusher_wakefd = eventfd(0, EFD_CLOEXEC)) < 0) {
+        syslog(LOG_ERR, "Could not create param flusher eventfd. Error: %s\n", strerror(errno));
+        return -1;
+    }
 
-    setlogmask(LOG_UPTO(LOG_ERR));
-    openlog(name, LOG_PID, LOG_USER);
-    syslog(LOG_DEBUG, "starting %s instrument...\n", name);
+	return 0;
+}
 
-    instrument->name = name;
-    instrument->channels = channels;
-    instrument->context = ctx;
+int astrid_instrument_session_close(lpinstrument_t * instrument) {
+    char cachename[NAME_MAX] = {0};
 
-    instrument->stream = stream;
-    instrument->renderer = renderer;
-    instrument->update = update;
-    instrument->trigger = trigger;
-    instrument->ext_relay_enabled = ext_relay_enabled;
-    instrument->is_ready = 1;
+    /* the audio thread is gone by now */
+    free(atomic_exchange(&instrument->parammorph_pending, NULL));
+    astrid_parammorph_free_retired(instrument);
+    free(instrument->parammorph);
+    instrument->parammorph = NULL;
 
-    instrument->midi_device_id = -1;
-    if(midi_device_name != NULL) {
-        instrument->midi_device_id = lpmidi_get_device_id_by_name(midi_device_name);
-        syslog(LOG_DEBUG, "Set MIDI device ID (%d) for %s\n", instrument->midi_device_id, midi_device_name);
+    if(instrument->paramtables != NULL) {
+        syslog(LOG_DEBUG, "Flushing param cache...\n");
+        astrid_instrument_flush_params(instrument);
+        pthread_mutex_destroy(&instrument->paramtables->lock);
+        munmap(instrument->paramtables, sizeof(lpparamtables_t));
+        instrument->paramtables = NULL;
+        snprintf(cachename, NAME_MAX, ASTRID_PARAMCACHE_NAME, instrument->name);
+        shm_unlink(cachename);
+        close(instrument->param_flusher_wakefd);
     }
 
-    /* Seed the random number generator */
-    LPRand.preseed();
+    syslog(LOG_DEBUG, "Closing LMDB session...\n");
+    mdb_txn_abort(instrument->dbtxn_read);
+	mdb_dbi_close(instrument->dbenv, instrument->dbi);
+	mdb_env_close(instrument->dbenv);
+    syslog(LOG_DEBUG, "Done cleaning up LMDB...\n");
+    return 0;
+}
 
-    /* Set shutdown signal handlers */
-    shutdown_action.sa_handler = handle_instrument_shutdown;
-    sigemptyset(&shutdown_action.sa_mask);
-    shutdown_action.sa_flags = SA_RESTART; /* Prevent open, read, write etc from EINTR */
-    astrid_instrument_is_running = &instrument->is_running;
+int send_render_to_mixer(lpinstrument_t * instrument, lpbuffer_t * buf) {
+    lpbufferslot_t slot;
+    size_t audiosize, offset;
 
-    if(sigaction(SIGINT, &shutdown_action, NULL) == -1) {
-        syslog(LOG_ERR, "%s Could not init SIGINT signal handler. Error: %s\n", name, strerror(errno));
-        exit(1);
-    }
+    astrid_log(LOG_DEBUG, "SEND RENDER serializing buffer of %ld frames\n", buf->length);
 
-    if(sigaction(SIGTERM, &shutdown_action, NULL) == -1) {
-        syslog(LOG_ERR, "%s Could not init SIGTERM signal handler. Error: %s\n", name, strerror(errno));
-        exit(1);
+    if(astrid_instrument_reserve_bufstr(instrument->name, serialize_buffer_size(buf->length, buf->channels), &slot) < 0) {
+        return -1;
     }
 
-    // Set the message q names
-    snprintf(instrument->qname, NAME_MAX, "/%s-msgq", instrument->name);
-    snprintf(instrument->serial_message_q_name, NAME_MAX, "/%s-serial-msgq", instrument->name);
+    /* serialize straight into the shared memory segment */
+    audiosize = buf->length * buf->channels * sizeof(lpfloat_t);
+    offset = serialize_buffer_header(slot.data, buf->length, buf->channels, buf->samplerate, buf->is_looping, buf->onset);
+    memcpy(slot.data + offset, buf->data, audiosize);
+    offset += audiosize;
+    memcpy(slot.data + offset, &instrument->msg, sizeof(lpmsg_t));
 
-    // Set the tty path
-    if(tty != NULL) {
-        snprintf(instrument->tty_path, NAME_MAX, "%s", tty);
-        instrument->tty_is_enabled = 1;
+    if(astrid_instrument_commit_bufstr(instrument->name, &slot) < 0) {
+        return -1;
     }
 
-    if(instrument->ext_relay_enabled) {
-        snprintf(instrument->external_relay_name, NAME_MAX, "/%s-extrelay-msgq", instrument->name);
-    } 
+    return 0;
+}
 
-    // set up the voice counter and the buffer counter
-    if(lpcounter_create("voiceid") < 0) {
-        syslog(LOG_ERR, "%s Could not create voiceid counter. Error: %s\n", name, strerror(errno));
-        exit(1);
+/* Creates and maps a new shared memory segment keyed by the instrument name */
+static int astrid_bufferslot_map(char * instrument_name, size_t size, lpbufferslot_t * slot) {
+    ssize_t buffer_id = 0;
+
+    memset(slot, 0, sizeof(lpbufferslot_t));
+    slot->size = size;
+
+    if((buffer_id = lpcounter_read_and_increment("bufferid")) < 0) {
+        syslog(LOG_ERR, "Could not get bufferid. (%d) %s\n", errno, strerror(errno));
+        return -1;
     }
-    if(lpcounter_create("bufferid") < 0) {
-        syslog(LOG_ERR, "%s Could not create bufferid counter. Error: %s\n", name, strerror(errno));
-        exit(1);
+
+    // generate the buffer code using the instrument name as the prefix
+    if(lpencode_with_prefix(instrument_name, buffer_id, slot->buffer_code) < 0) {
+        syslog(LOG_ERR, "Could not encode bufstr key. (%d) %s\n", errno, strerror(errno));
+        return -1;
     }
 
-    /* Open the LMDB session */
-    astrid_instrument_session_open(instrument);
+    /* Create the POSIX shared memory segment */
+    if((slot->shmfd = shm_open(slot->buffer_code, O_CREAT | O_RDWR, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "reserve_bufstr: Could not create shared memory segment. (%s) %s\n", slot->buffer_code, strerror(errno));
+        return -1;
+    }
 
-    /* Set up JACK */
-    instrument->inports = (jack_port_t **)calloc(channels, sizeof(jack_port_t *));
-    instrument->outports = (jack_port_t **)calloc(channels, sizeof(jack_port_t *));
-    instrument->jack_client = jack_client_open(name, jack_options, &jack_status, NULL);
+    if(ftruncate(slot->shmfd, size) < 0) {
+        syslog(LOG_ERR, "reserve_bufstr: Could not truncate shared memory segment to size %ld. (%s) %s\n", size, slot->buffer_code, strerror(errno));
+        return -1;
+    }
 
-    syslog(LOG_DEBUG, "JACK STATUS %d\n", (int)jack_status);
+    /* Attach the shared memory to the pointer */
+    if((slot->data = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, slot->shmfd, 0)) == MAP_FAILED) {
+        syslog(LOG_ERR, "reserve_bufstr: Could not mmap shared memory segment to size %ld. (%s) %s\n", size, slot->buffer_code, strerror(errno));
+        slot->data = NULL;
+        return -1;
+    }
 
-    if(instrument->jack_client == NULL) {
-        syslog(LOG_ERR, "%s Could not open jack client. Client is NULL: %s\n", name, strerror(errno));
-        if((jack_status & JackServerFailed) == JackServerFailed) {
-            syslog(LOG_ERR, "%s Could not open jack client. Jack server failed with status %2.0x\n", name, jack_status);
-        } else {
-            syslog(LOG_ERR, "%s Could not open jack client. Unknown error: %s\n", name, strerror(errno));
-        }
-        goto astrid_instrument_shutdown_with_error;
+    return 0;
+}
+
+int astrid_instrument_reserve_bufstr(char * instrument_name, size_t size, lpbufferslot_t * slot) {
+    if(astrid_bufferslot_map(instrument_name, size, slot) < 0) {
+        return -1;
     }
 
-    if((jack_status & JackServerStarted) == JackServerStarted) {
-        syslog(LOG_INFO, "Jack server started!\n");
+    /* Create the POSIX semaphore and initialize it to 1 */
+    if((slot->sem = sem_open(slot->buffer_code, O_CREAT | O_EXCL, LPIPC_PERMS, 1)) == NULL) {
+        syslog(LOG_ERR, "reserve_bufstr: failed to create semaphore %s. Error: %s\n", slot->buffer_code, strerror(errno));
+        return -1;
     }
 
-    /* Get the samplerate from JACK */
-    /* FIXME could use the JACK D-Bus API here to let instruments change the samplerate? */
-    instrument->samplerate = (lpfloat_t)jack_get_sample_rate(instrument->jack_client);
+    return 0;
+}
 
-    /* Create the internal ringbuffer for sampling from the adc */
-    snprintf(instrument->adcname, PATH_MAX, "%s-adc", instrument->name);
-    if((instrument->adcbuf = lpsampler_create(instrument->adcname, adc_length, instrument->channels, instrument->samplerate)) == NULL) {
-        syslog(LOG_INFO, "Could not create instrument ADC buffer\n");
-        goto astrid_instrument_shutdown_with_error;
+int astrid_instrument_commit_bufstr(char * instrument_name, lpbufferslot_t * slot) {
+    lpmsg_t msg = {0};
+
+    // Send the render complete message
+    memcpy(msg.instrument_name, instrument_name, strlen(instrument_name));
+    memcpy(msg.msg, slot->buffer_code, strlen(slot->buffer_code));
+    msg.type = LPMSG_RENDER_COMPLETE;
+    if(send_play_message(msg) < 0) {
+        syslog(LOG_ERR, "Could not send render complete message. (%d) %s\n", errno, strerror(errno));
+        return 1;
     }
 
-    /* Create the internal ringbuffer for resampling */
-    snprintf(instrument->resamplername, PATH_MAX, "%s-resampler", instrument->name);
-    if((instrument->resamplerbuf = lpsampler_create(instrument->resamplername, resampler_length, instrument->channels, instrument->samplerate)) == NULL) {
-        syslog(LOG_INFO, "Could not create instrument resampler buffer\n");
-        goto astrid_instrument_shutdown_with_error;
+    // unmap the memory...
+    munmap(slot->data, slot->size);
+    slot->data = NULL;
+
+    if(sem_close(slot->sem) < 0) {
+        syslog(LOG_ERR, "commit_bufstr sem_close Could not close semaphore\n");
+        return -1;
     }
 
-    /* init scheduler */
-    instrument->async_mixer = scheduler_create(1, instrument->channels, instrument->samplerate);
+    close(slot->shmfd);
 
-    /* Set the main jack callback which always runs: maybe there is an analysis-only use to support too? */
-    jack_set_process_callback(instrument->jack_client, astrid_instrument_jack_callback, (void *)instrument);
-    for(c=0; c < channels; c++) {
-        snprintf(outport_name, sizeof(outport_name), "out%d", c);
-        instrument->outports[c] = jack_port_register(instrument->jack_client, outport_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+    return 0;
+}
 
-        snprintf(inport_name, sizeof(inport_name), "in%d", c);
-        instrument->inports[c] = jack_port_register(instrument->jack_client, inport_name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+int astrid_instrument_publish_bufstr(char * instrument_name, unsigned char * bufstr, size_t size) {
+    lpbufferslot_t slot;
+
+    if(astrid_instrument_reserve_bufstr(instrument_name, size, &slot) < 0) {
+        return -1;
     }
 
-    /* Request some ports from jack */
-    for(c=0; c < channels; c++) {
-        if(instrument->outports[c] == NULL) {
-            syslog(LOG_ERR, "No more JACK output ports available, shutting down...\n");
-            goto astrid_instrument_shutdown_with_error;
-        }
+    /* Write the bufstr into the shared memory segment */
+    memcpy(slot.data, (void *)bufstr, size);
 
-        if(instrument->inports[c] == NULL) {
-            syslog(LOG_ERR, "No more JACK input ports available, shutting down...\n");
-            goto astrid_instrument_shutdown_with_error;
-        }
-    }
+    return astrid_instrument_commit_bufstr(instrument_name, &slot);
+}
 
-    /* activate the jack client */
-    if(jack_activate(instrument->jack_client) != 0) {
-        syslog(LOG_ERR, "%s Could not activate JACK client, shutting down...\n", name);
-        goto astrid_instrument_shutdown_with_error;
+/* RENDER
+ * STREAMS
+ * *******/
+int astrid_instrument_stream_open(char * instrument_name, int channels, int samplerate, size_t capacity, size_t lead, lpbufferslot_t * slot) {
+    lpstream_t * stream;
+    lpmsg_t msg = {0};
+
+    assert(capacity > 0);
+
+    if(astrid_bufferslot_map(instrument_name, sizeof(lpstream_t) + capacity * channels * sizeof(lpfloat_t), slot) < 0) {
+        return -1;
     }
 
-    /* connect the jack ports FIXME would be nice to optionally do routing in the instrument callback */
-    if((ports = jack_get_ports(instrument->jack_client, NULL, NULL, JackPortIsPhysical|JackPortIsOutput)) == NULL) {
-		syslog(LOG_CRIT, "Cannot find any physical capture ports");
-        goto astrid_instrument_shutdown_with_error;
-	}
+    /* ftruncate zero fills the segment, so the positions start at 0 */
+    stream = (lpstream_t *)slot->data;
+    stream->capacity = capacity;
+    stream->lead = (lead > capacity) ? capacity : lead;
+    stream->channels = channels;
+    stream->samplerate = samplerate;
 
-    for(c=0; c < instrument->channels; c++) {
-        if(jack_connect(instrument->jack_client, ports[c], jack_port_name(instrument->inports[c]))) {
-            syslog(LOG_NOTICE, "Could not connect input port %d. (There probably aren't enough available inputs on this device.)\n", c);
-        }
+    memcpy(msg.instrument_name, instrument_name, strlen(instrument_name));
+    memcpy(msg.msg, slot->buffer_code, strlen(slot->buffer_code));
+    msg.type = LPMSG_RENDER_STREAM;
+    if(send_play_message(msg) < 0) {
+        syslog(LOG_ERR, "Could not send render stream message. (%d) %s\n", errno, strerror(errno));
+        astrid_instrument_stream_close(slot);
+        return -1;
     }
-	free(ports);
-	
-	if((ports = jack_get_ports(instrument->jack_client, NULL, NULL, JackPortIsPhysical|JackPortIsInput)) == NULL) {
-		syslog(LOG_CRIT, "Cannot find any physical playback ports");
-        goto astrid_instrument_shutdown_with_error;
-	}
 
-    for(c=0; c < instrument->channels; c++) {
-        if(jack_connect(instrument->jack_client, jack_port_name(instrument->outports[c]), ports[c])) {
-            syslog(LOG_NOTICE, "Could not connect output port %d. (There probably aren't enough available outputs on this device.)\n", c);
+    return 0;
+}
+
+/* Waits for room in the ring and returns the number of free frames, 
+ * or -1 if the reader has not made progress within the timeout */
+ssize_t astrid_stream_wait(lpstream_t * stream, double timeout) {
+    struct timespec ts = {0, 1000000};
+    size_t space, read_pos, last_read_pos;
+    double waited = 0;
+
+    last_read_pos = atomic_load(&stream->read_pos);
+    for(;;) {
+        read_pos = atomic_load(&stream->read_pos);
+        space = stream->capacity - (atomic_load(&stream->write_pos) - read_pos);
+        if(space > 0) return (ssize_t)space;
+
+        if(read_pos != last_read_pos) {
+            last_read_pos = read_pos;
+            waited = 0;
         }
+
+        if(waited >= timeout) return -1;
+
+        nanosleep(&ts, NULL);
+        waited += 0.001;
     }
-	free(ports);
+}
 
-    /* Register that everything is running and ready */
-    instrument->is_running = 1;
-    syslog(LOG_INFO, "%s is running...\n", name);
+/* Publish frames already written past write_pos */
+void astrid_stream_commit(lpstream_t * stream, size_t frames) {
+    atomic_fetch_add(&stream->write_pos, frames);
+}
 
-    /* Open the message queue */
-    if((instrument->msgq = astrid_msgq_open(instrument->qname)) == (mqd_t) -1) {
-        syslog(LOG_CRIT, "Could not open msgq for instrument %s. Error: %s\n", instrument->name, strerror(errno));
+int astrid_instrument_stream_close(lpbufferslot_t * slot) {
+    lpstream_t * stream = (lpstream_t *)slot->data;
+
+    atomic_store(&stream->done, 1);
+
+    munmap(slot->data, slot->size);
+    slot->data = NULL;
+    close(slot->shmfd);
+
+    return 0;
+}
+
+lpstream_t * astrid_stream_attach(char * stream_code, size_t * size) {
+    struct stat statbuf;
+    lpstream_t * stream;
+    int fd;
+
+    if((fd = shm_open(stream_code, O_RDWR, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "stream_attach: Could not open shared memory segment. (%s) %s\n", stream_code, strerror(errno));
         return NULL;
     }
-    syslog(LOG_DEBUG, "Opened message queue for %s with fd %d\n", instrument->name, instrument->msgq);
 
-    if((instrument->serialmsgq = astrid_msgq_open(instrument->serial_message_q_name)) == (mqd_t) -1) {
-        syslog(LOG_CRIT, "Could not open serial msgq for instrument %s. Error: %s\n", instrument->name, strerror(errno));
+    if(fstat(fd, &statbuf) < 0) {
+        syslog(LOG_ERR, "stream_attach: Could not stat shm. Error: %s\n", strerror(errno));
+        close(fd);
         return NULL;
     }
-    syslog(LOG_DEBUG, "Opened serial message queue for %s with fd %d\n", instrument->name, instrument->serialmsgq);
 
-    if(instrument->ext_relay_enabled) {
-        if((instrument->exmsgq = astrid_msgq_open(instrument->external_relay_name)) == (mqd_t) -1) {
-            syslog(LOG_CRIT, "Could not open external message relay for instrument %s. Error: %s\n", instrument->name, strerror(errno));
-            return NULL;
-        }
-        syslog(LOG_DEBUG, "Opened message relay queue for %s with fd %d\n", instrument->name, instrument->exmsgq);
+    if((stream = (lpstream_t *)mmap(NULL, statbuf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        syslog(LOG_ERR, "stream_attach: Could not mmap shared memory segment to size %ld. (%s) %s\n", statbuf.st_size, stream_code, strerror(errno));
+        close(fd);
+        return NULL;
     }
 
-    /* Prepare the message structs */ 
-    init_instrument_message(&instrument->msg, instrument->name);
-    init_instrument_message(&instrument->cmd, instrument->name);
+    close(fd);
 
-    /* Start the sequencer thread */
-    if(astrid_instrument_seq_start(instrument) < 0) {
-        syslog(LOG_CRIT, "Could not start message sequence threads for instrument %s. Error: %s\n", instrument->name, strerror(errno));
-        return NULL;
+    /* Both ends hold a mapping now, so the name can go */
+    if(shm_unlink(stream_code) < 0) {
+        syslog(LOG_ERR, "stream_attach: Could not unlink shm. Error: %s\n", strerror(errno));
     }
 
-    /* Start listening for messages in the message feed thread */
-    if(pthread_create(&instrument->message_feed_thread, NULL, instrument_message_thread, (void*)instrument) != 0) {
-        syslog(LOG_ERR, "Could not initialize instrument message thread. Error: %s\n", strerror(errno));
+    *size = (size_t)statbuf.st_size;
+
+    return stream;
+}
+
+/* RENDER
+ * QUEUE
+ * *****/
+lprenderq_t * astrid_renderq_create(void) {
+    lprenderq_t * q;
+    int err;
+
+    if((q = (lprenderq_t *)mmap(NULL, sizeof(lprenderq_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        syslog(LOG_ERR, "renderq_create: Could not mmap render queue. (%d) %s\n", errno, strerror(errno));
         return NULL;
     }
 
-    /* Start listening for MIDI messages in the midi listener thread */
-    // TODO support multiple devices
-    if(instrument->midi_device_id >= 0) {
-        syslog(LOG_DEBUG, "We're gonna listen for some MIDI over here in %s-land!\n", instrument->name);
-        if(pthread_create(&instrument->midi_listener_thread, NULL, instrument_midi_listener_thread, (void*)instrument) != 0) {
-            syslog(LOG_ERR, "Could not initialize instrument midi listener thread. Error: %s\n", strerror(errno));
-            return NULL;
-        }
-    }
+    memset(q, 0, sizeof(lprenderq_t));
 
-    /* start the cleanup thread */
-    if(pthread_create(&instrument->cleanup_thread, NULL, instrument_cleanup_thread, (void*)instrument) != 0) {
-        syslog(LOG_ERR, "Could not initialize instrument cleanup thread. Error: %s\n", strerror(errno));
+    if((err = astrid_robust_mutex_init(&q->lock)) != 0) {
+        syslog(LOG_ERR, "renderq_create: Could not init render queue lock. (%d) %s\n", err, strerror(err));
+        munmap(q, sizeof(lprenderq_t));
         return NULL;
     }
 
-    /* start the serial listener thread */
-    // TODO support multiple devices -- maybe just register them in the session?
-    if(pthread_create(&instrument->serial_listener_thread, NULL, instrument_serial_listener_thread, (void*)instrument) != 0) {
-        syslog(LOG_ERR, "Could not initialize serial listener thread. Error: %s\n", strerror(errno));
+    if(sem_init(&q->items, 1, 0) < 0
+    || sem_init(&q->spaces, 1, ASTRID_RENDERQ_SIZE) < 0) {
+        syslog(LOG_ERR, "renderq_create: Could not init render queue semaphores. (%d) %s\n", errno, strerror(errno));
+        pthread_mutex_destroy(&q->lock);
+        munmap(q, sizeof(lprenderq_t));
         return NULL;
     }
 
-    /* setup linenoise repl */
-    linenoiseHistoryLoad("history.txt"); // FIXME this goes in the instrument config dir / or share?
+    return q;
+}
+
+/* Returns 1 if the message was queued and 0 if the ring was 
+ * full after all, which can happen if a renderer died between 
+ * its semaphore wait and taking the lock. */
+static int astrid_renderq_put(lprenderq_t * q, lpmsg_t * msg) {
+    lprenderq_slot_t * slot;
+    int depth;
+
+    if(astrid_robust_mutex_lock(&q->lock, "renderq_push") < 0) return -1;
+
+    if(q->head - q->tail >= ASTRID_RENDERQ_SIZE) {
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+    }
+
+    slot = &q->slots[q->head % ASTRID_RENDERQ_SIZE];
+    memcpy(&slot->msg, msg, sizeof(lpmsg_t));
+    if(lpscheduler_get_now_seconds(&slot->pushed) < 0) slot->pushed = 0;
+    q->head += 1;
+
+    pthread_mutex_unlock(&q->lock);
+    sem_post(&q->items);
+
+    if(astrid_stats_page != NULL && sem_getvalue(&q->items, &depth) == 0 && depth >= 0) {
+        astrid_stats_gauge(&astrid_stats_page->renderq_depth, &astrid_stats_page->renderq_max_depth, (size_t)depth);
+    }
+
+    return 1;
+}
+
+int astrid_renderq_push(lprenderq_t * q, lpmsg_t * msg) {
+    int ret;
+
+    /* Never block the message loop: if every slot is 
+     * still waiting for a renderer the pool is too far 
+     * behind for this render to be useful anyway */
+    if(sem_trywait(&q->spaces) < 0 || (ret = astrid_renderq_put(q, msg)) == 0) {
+        syslog(LOG_ERR, "renderq_push: render queue is full, dropping message.\n");
+        return -1;
+    }
+
+    return (ret < 0) ? -1 : 0;
+}
 
-    return instrument;
+/* Waits for a free slot instead of dropping the message, 
+ * for messages the renderers must see, like shutdown. */
+int astrid_renderq_push_wait(lprenderq_t * q, lpmsg_t * msg) {
+    int ret;
 
-astrid_instrument_shutdown_with_error:
-    instrument->is_running = 0;
-    jack_client_close(instrument->jack_client);
-    closelog();
-    return NULL;
+    while(1) {
+        while(sem_wait(&q->spaces) < 0) {
+            if(errno != EINTR) {
+                syslog(LOG_ERR, "renderq_push_wait: Could not wait for render queue space. (%d) %s\n", errno, strerror(errno));
+                return -1;
+            }
+        }
+
+        if((ret = astrid_renderq_put(q, msg)) != 0) return (ret < 0) ? -1 : 0;
+    }
 }
 
-int astrid_instrument_stop(lpinstrument_t * instrument) {
-    int c, ret;
+int astrid_renderq_pop(lprenderq_t * q, lpmsg_t * msg, double * wait) {
+    lprenderq_slot_t * slot;
+    double now = 0, pushed;
+    int count;
 
-    syslog(LOG_INFO, "%s instrument shutting down and cleaning up...\n", instrument->name);
-    syslog(LOG_INFO, "Sending shutdown message to threads and queues...\n");
-    if(instrument->is_waiting) {
-        instrument->msg.type = LPMSG_SHUTDOWN;
-        if(send_play_message(instrument->msg) < 0) {
-            fprintf(stderr, "astrid instrument message thread cleanup: Could not send shutdown message...\n");
+    while(1) {
+        while(sem_wait(&q->items) < 0) {
+            if(errno != EINTR) {
+                syslog(LOG_ERR, "renderq_pop: Could not wait for render queue items. (%d) %s\n", errno, strerror(errno));
+                return -1;
+            }
         }
-    }
 
-    syslog(LOG_DEBUG, "Joining with message thread...\n");
-    if((ret = pthread_join(instrument->message_feed_thread, NULL)) != 0) {
-        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
-        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
-        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
-        syslog(LOG_ERR, "Error while attempting to join with message feed thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
-    }
+        if(astrid_robust_mutex_lock(&q->lock, "renderq_pop") < 0) return -1;
 
-    syslog(LOG_DEBUG, "Joining with message scheduler pq thread...\n");
-    if((ret = pthread_join(instrument->message_scheduler_pq_thread, NULL)) != 0) {
-        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
-        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
-        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
-        syslog(LOG_ERR, "Error while attempting to join with message scheduler pq thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
-    }
+        /* A spare wakeup: the ring is empty after all */
+        if(q->head == q->tail) {
+            pthread_mutex_unlock(&q->lock);
+            continue;
+        }
 
-    syslog(LOG_DEBUG, "Joining with cleanup thread...\n");
-    if((ret = pthread_join(instrument->cleanup_thread, NULL)) != 0) {
-        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
-        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
-        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
-        syslog(LOG_ERR, "Error while attempting to join with cleanup thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
-    }
+        slot = &q->slots[q->tail % ASTRID_RENDERQ_SIZE];
+        memcpy(msg, &slot->msg, sizeof(lpmsg_t));
+        pushed = slot->pushed;
+        q->tail += 1;
+
+        /* If a renderer died after taking an item but before 
+         * taking the lock, the item count is one short of the 
+         * ring and the oldest message would never be woken for. 
+         * Spare wakeups are harmless, so top it back up. */
+        if(sem_getvalue(&q->items, &count) == 0 && count >= 0 && (size_t)count < q->head - q->tail) {
+            sem_post(&q->items);
+        }
 
-    if(instrument->midi_device_id >= 0) {
-        syslog(LOG_DEBUG, "Joining with midi listener thread...\n");
-        if((ret = pthread_join(instrument->midi_listener_thread, NULL)) != 0) {
-            if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
-            if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
-            if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
-            syslog(LOG_ERR, "Error while attempting to join with midi listener thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
+        /* Same for a renderer that died holding a free slot */
+        if(sem_getvalue(&q->spaces, &count) == 0 && count >= 0 && (size_t)count + 1 < ASTRID_RENDERQ_SIZE - (q->head - q->tail)) {
+            sem_post(&q->spaces);
         }
+
+        pthread_mutex_unlock(&q->lock);
+        break;
     }
 
-    syslog(LOG_DEBUG, "Joining with serial listener thread...\n");
-    if((ret = pthread_join(instrument->serial_listener_thread, NULL)) != 0) {
-        if(ret == EINVAL) syslog(LOG_ERR, "EINVAL\n");
-        if(ret == EDEADLK) syslog(LOG_ERR, "DEADLOCK\n");
-        if(ret == ESRCH) syslog(LOG_ERR, "ESRCH\n");
-        syslog(LOG_ERR, "Error while attempting to join with serial listener thread. Ret: %d Errno: %d (%s)\n", ret, errno, strerror(ret));
+    sem_post(&q->spaces);
+
+    if(lpscheduler_get_now_seconds(&now) < 0 || pushed == 0) {
+        *wait = 0;
+    } else {
+        *wait = now - pushed;
+        astrid_latency_record(&q->wait, *wait);
     }
 
-    syslog(LOG_DEBUG, "Closing instrument message queue...\n");
-    if(instrument->msgq != (mqd_t) -1) astrid_msgq_close(instrument->msgq);
+    return 0;
+}
 
-    syslog(LOG_DEBUG, "Closing serial message queue...\n");
-    if(instrument->serialmsgq != (mqd_t) -1) astrid_msgq_close(instrument->serialmsgq);
+/* Returns the number of latencies recorded so far */
+size_t astrid_latency_record(lplatencyhist_t * h, double seconds) {
+    size_t usec, max_usec;
+    int bucket = 0;
 
-    syslog(LOG_DEBUG, "Closing external message queue...\n");
-    if(instrument->exmsgq != (mqd_t) -1) astrid_msgq_close(instrument->exmsgq);
+    usec = (seconds > 0) ? (size_t)(seconds * 1000000) : 0;
+    while(bucket < ASTRID_LATENCY_BUCKETS-1 && usec >= ((size_t)1 << bucket)) bucket++;
 
-    syslog(LOG_DEBUG, "Stopping JACK...\n");
-    for(c=0; c < instrument->channels; c++) {
-        jack_port_unregister(instrument->jack_client, instrument->outports[c]);
-        jack_port_unregister(instrument->jack_client, instrument->inports[c]);
+    atomic_fetch_add(&h->buckets[bucket], 1);
+
+    max_usec = atomic_load(&h->max_usec);
+    while(usec > max_usec) {
+        if(atomic_compare_exchange_weak(&h->max_usec, &max_usec, usec)) break;
     }
 
-    jack_client_close(instrument->jack_client);
+    return atomic_fetch_add(&h->count, 1) + 1;
+}
 
-    /* and the jack i/o buffers */
-    free(instrument->inports);
-    free(instrument->outports);
+/* Upper bound in seconds of the bucket holding the given percentile (0-1) */
+double astrid_latency_percentile(lplatencyhist_t * h, double percentile) {
+    size_t count, target, seen = 0;
+    int i;
 
-    syslog(LOG_DEBUG, "Closing lmdb session...\n");
-    astrid_instrument_session_close(instrument);
+    count = atomic_load(&h->count);
+    if(count == 0) return 0;
 
-    /* save the history FIXME save the path on the instrument */
-    linenoiseHistorySave("history.txt");
+    target = (size_t)(count * percentile);
+    for(i=0; i < ASTRID_LATENCY_BUCKETS-1; i++) {
+        seen += atomic_load(&h->buckets[i]);
+        if(seen > target) return ((size_t)1 << i) * 0.000001;
+    }
 
-    if(instrument->async_mixer != NULL) scheduler_destroy(instrument->async_mixer);
+    return atomic_load(&h->max_usec) * 0.000001;
+}
 
-    syslog(LOG_DEBUG, "Cleaning up adc ringbuf...\n");
-    if(lpsampler_destroy(instrument->adcname) < 0) {
-        syslog(LOG_ERR, "Error while removing adc ringbuf, dang! Other cleanup is done tho.\n");
-        closelog();
-        return -1;
-    }
+void astrid_renderq_log_stats(lprenderq_t * q, const char * name) {
+    syslog(LOG_INFO, "%s render queue wait: count=%ld p50<%fs p95<%fs p99<%fs max=%fs\n", name, 
+        atomic_load(&q->wait.count),
+        astrid_latency_percentile(&q->wait, 0.5),
+        astrid_latency_percentile(&q->wait, 0.95),
+        astrid_latency_percentile(&q->wait, 0.99),
+        atomic_load(&q->wait.max_usec) * 0.000001
+    );
 
-    syslog(LOG_DEBUG, "Cleaning up resampler ringbuf...\n");
-    if(lpsampler_destroy(instrument->resamplername) < 0) {
-        syslog(LOG_ERR, "Error while removing resampler ringbuf, dang! Other cleanup is done tho.\n");
-        closelog();
+    syslog(LOG_INFO, "%s render time: count=%ld p50<%fs p95<%fs p99<%fs max=%fs\n", name, 
+        atomic_load(&q->render.count),
+        astrid_latency_percentile(&q->render, 0.5),
+        astrid_latency_percentile(&q->render, 0.95),
+        astrid_latency_percentile(&q->render, 0.99),
+        atomic_load(&q->render.max_usec) * 0.000001
+    );
+}
+
+int astrid_renderq_destroy(lprenderq_t * q) {
+    pthread_mutex_destroy(&q->lock);
+    sem_destroy(&q->items);
+    sem_destroy(&q->spaces);
+
+    if(munmap(q, sizeof(lprenderq_t)) < 0) {
+        syslog(LOG_ERR, "renderq_destroy: Could not munmap render queue. (%d) %s\n", errno, strerror(errno));
         return -1;
     }
 
-    /* cleanup the pq memory */
-    pqueue_free(instrument->msgpq);
-    free(instrument->pqnodes);
+    return 0;
+}
 
-    /* poof! */
-    free(instrument);
+static size_t astrid_stats_hist_bucket(size_t value) {
+    size_t shift;
+    int msb;
 
-    syslog(LOG_DEBUG, "All done, see ya later!\n");
-    closelog();
-    return 0;
+    if(value < ((size_t)1 << ASTRID_STATS_SUBBITS)) return value;
+
+    msb = 63 - __builtin_clzll((unsigned long long)value);
+    if(msb >= ASTRID_STATS_MAXBITS) return ASTRID_STATS_NUMBUCKETS-1;
+
+    shift = (size_t)(msb - ASTRID_STATS_SUBBITS);
+    return ((shift + 1) << ASTRID_STATS_SUBBITS) + ((value >> shift) - ((size_t)1 << ASTRID_STATS_SUBBITS));
 }
 
-int astrid_instrument_get_or_create_datadir(const char * name, char * dbpath) {
-    int ret;
-    char astrid_data_path[PATH_MAX];
-    char xdg_data_home[PATH_MAX];
-    char * user_home;
-    char * _xdg_data_home = getenv("XDG_DATA_HOME");
-    char * default_data_dir = ".local/share";
-    char * instrument_subdir = "astrid_instruments";
+/* The biggest value that lands in a bucket */
+static size_t astrid_stats_hist_bucket_max(size_t bucket) {
+    size_t shift, sub;
 
-    if(_xdg_data_home == NULL) {
-        user_home = getenv("HOME");
-        ret = snprintf(xdg_data_home, PATH_MAX, "%s/%s", user_home, default_data_dir);
-        if(ret < 0) {
-            syslog(LOG_ERR, "astrid data path (%s) snprintf: (%d) %s\n", default_data_dir, errno, strerror(errno));
-            return -1;
-        }
+    if(bucket < ((size_t)1 << ASTRID_STATS_SUBBITS)) return bucket;
 
-    } else {
-        memcpy(xdg_data_home, _xdg_data_home, PATH_MAX);
-    }
+    shift = (bucket >> ASTRID_STATS_SUBBITS) - 1;
+    sub = bucket & (((size_t)1 << ASTRID_STATS_SUBBITS) - 1);
+    return ((((size_t)1 << ASTRID_STATS_SUBBITS) + sub + 1) << shift) - 1;
+}
 
-    if(access(xdg_data_home, F_OK) != 0) {
-        /* create the xdg data home dir */
-        if(mkdir(xdg_data_home, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0) {
-            syslog(LOG_ERR, "session data path (%s) mkdir: (%d) %s\n", xdg_data_home, errno, strerror(errno));
-            return -1;
-        }
-    }
+void astrid_stats_hist_record(lpstatshist_t * h, size_t value) {
+    size_t max;
 
-    ret = snprintf(astrid_data_path, PATH_MAX, "%s/%s", xdg_data_home, instrument_subdir);
-    if(ret < 0) {
-        syslog(LOG_ERR, "astrid data path (%s) snprintf: (%d) %s\n", astrid_data_path, errno, strerror(errno));
-        return -1;
-    }
+    atomic_fetch_add_explicit(&h->buckets[astrid_stats_hist_bucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
 
-    if(access(astrid_data_path, F_OK) != 0) {
-        /* create the astrid data path */
-        if(mkdir(astrid_data_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0) {
-            syslog(LOG_ERR, "astrid data path (%s) mkdir: (%d) %s\n", astrid_data_path, errno, strerror(errno));
-            return -1;
-        }
+    max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while(value > max) {
+        if(atomic_compare_exchange_weak_explicit(&h->max, &max, value, memory_order_relaxed, memory_order_relaxed)) break;
     }
 
-    ret = snprintf(dbpath, PATH_MAX, "%s/%s", astrid_data_path, name);
-    if(ret < 0) {
-        syslog(LOG_ERR, "astrid data path (%s) snprintf: (%d) %s\n", astrid_data_path, errno, strerror(errno));
-        return -1;
-    }
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+}
 
-    if(access(dbpath, F_OK) != 0) {
-        /* create the data dir */
-        if(mkdir(dbpath, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0) {
-            syslog(LOG_ERR, "session data path (%s) mkdir: (%d) %s\n", dbpath, errno, strerror(errno));
-            return -1;
-        }
+/* Upper bound of the bucket holding the given percentile (0-1), 
+ * never more than the biggest value recorded */
+size_t astrid_stats_hist_percentile(lpstatshist_t * h, double percentile) {
+    size_t count, target, seen = 0, max, i;
+
+    count = atomic_load_explicit(&h->count, memory_order_relaxed);
+    max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    if(count == 0) return 0;
+
+    target = (size_t)(count * percentile);
+    for(i=0; i < ASTRID_STATS_NUMBUCKETS; i++) {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if(seen > target) return (astrid_stats_hist_bucket_max(i) < max) ? astrid_stats_hist_bucket_max(i) : max;
     }
 
-    return 0;
+    return max;
 }
 
-int astrid_instrument_session_open(lpinstrument_t * instrument) {
-    int rc;
+/* Sets a gauge and keeps its high water mark */
+void astrid_stats_gauge(atomic_size_t * gauge, atomic_size_t * max, size_t value) {
+    size_t current;
 
-    if(astrid_instrument_get_or_create_datadir(instrument->name, instrument->datapath) < 0) {
-        syslog(LOG_ERR, "session data path (%s) mkdir: (%d) %s\n", instrument->datapath, errno, strerror(errno));
-        return -1;
-    }
+    atomic_store_explicit(gauge, value, memory_order_relaxed);
+    if(max == NULL) return;
 
-    /* create the environment */
-	rc = mdb_env_create(&instrument->dbenv);
-    if(rc != MDB_SUCCESS) {
-		syslog(LOG_ERR, "mdb_env_create: (%d) %s\n", rc, mdb_strerror(rc));
-        return -1;
+    current = atomic_load_explicit(max, memory_order_relaxed);
+    while(value > current) {
+        if(atomic_compare_exchange_weak_explicit(max, &current, value, memory_order_relaxed, memory_order_relaxed)) break;
     }
+}
 
-    /* open it at the db directory */
-	rc = mdb_env_open(instrument->dbenv, instrument->datapath, 0, 0664);
-    if(rc != MDB_SUCCESS) {
-        syslog(LOG_ERR, "mdb_env_open: (%d) %s\n", rc, mdb_strerror(rc));
-        return -1;
-    }
+/* Creates the stats page for this process. Hooks around astrid 
+ * (the JACK callback, the mixer, the message thread, lock waits) 
+ * record into it from then on. */
+lpstats_t * astrid_stats_open(const char * name, int channels, int samplerate, int blocksize) {
+    char shmname[NAME_MAX] = {0};
+    lpstats_t * stats;
+    int fd;
 
-    /* begin a new read transaction */
-	rc = mdb_txn_begin(instrument->dbenv, NULL, MDB_RDONLY, &instrument->dbtxn_read);
-    if(rc != MDB_SUCCESS) {
-        syslog(LOG_ERR, "mdb_txn_begin: read (%d) %s\n", rc, mdb_strerror(rc));
-        return -1;
-    }
+    snprintf(shmname, NAME_MAX, ASTRID_STATS_NAME, name);
 
-    /* open the database inside the read transaction */
-	rc = mdb_dbi_open(instrument->dbtxn_read, NULL, 0, &instrument->dbi);
-    if(rc != MDB_SUCCESS) {
-        syslog(LOG_ERR, "mdb_dbi_open: read (%d) %s\n", rc, mdb_strerror(rc));
-        return -1;
+    if((fd = shm_open(shmname, O_CREAT | O_RDWR, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "astrid_stats_open: Could not create stats page %s. (%d) %s\n", shmname, errno, strerror(errno));
+        return NULL;
     }
 
-    /* begin a new read/write transaction */
-	rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &instrument->dbtxn_write);
-    if(rc != MDB_SUCCESS) {
-        syslog(LOG_ERR, "mdb_txn_begin: (%d) %s\n", rc, mdb_strerror(rc));
-        return -1;
+    if(ftruncate(fd, sizeof(lpstats_t)) < 0) {
+        syslog(LOG_ERR, "astrid_stats_open: Could not size stats page %s. (%d) %s\n", shmname, errno, strerror(errno));
+        close(fd);
+        return NULL;
     }
 
-    /* open the database inside the write transaction */
-	rc = mdb_dbi_open(instrument->dbtxn_write, NULL, 0, &instrument->dbi);
-    if(rc != MDB_SUCCESS) {
-        syslog(LOG_ERR, "mdb_dbi_open: read (%d) %s\n", rc, mdb_strerror(rc));
-        return -1;
+    if((stats = (lpstats_t *)mmap(NULL, sizeof(lpstats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        syslog(LOG_ERR, "astrid_stats_open: Could not mmap stats page %s. (%d) %s\n", shmname, errno, strerror(errno));
+        close(fd);
+        return NULL;
     }
+    close(fd);
 
-    /* finalize the transactions */
-	mdb_txn_reset(instrument->dbtxn_read);
-	mdb_txn_commit(instrument->dbtxn_write);
+    /* A page left behind by a crashed run starts over */
+    memset(stats, 0, sizeof(lpstats_t));
+    stats->pid = getpid();
+    strncpy(stats->name, name, LPMAXNAME-1);
+    stats->channels = channels;
+    atomic_store(&stats->samplerate, samplerate);
+    atomic_store(&stats->blocksize, blocksize);
+    if(lpscheduler_get_now_seconds(&stats->started) < 0) stats->started = 0;
+    atomic_thread_fence(memory_order_release);
+    stats->magic = ASTRID_STATS_MAGIC;
 
-	return 0;
+    astrid_stats_page = stats;
+    return stats;
 }
 
-int astrid_instrument_session_close(lpinstrument_t * instrument) {
-    syslog(LOG_DEBUG, "Closing LMDB session...\n");
-    mdb_txn_abort(instrument->dbtxn_read);
-	mdb_dbi_close(instrument->dbenv, instrument->dbi);
-	mdb_env_close(instrument->dbenv);
-    syslog(LOG_DEBUG, "Done cleaning up LMDB...\n");
-    return 0;
-}
+int astrid_stats_close(lpstats_t * stats) {
+    char shmname[NAME_MAX] = {0};
 
-int send_render_to_mixer(lpinstrument_t * instrument, lpbuffer_t * buf) {
-    unsigned char * bufstr;
-    size_t strsize = 0;
+    if(stats == NULL) return 0;
+    if(astrid_stats_page == stats) astrid_stats_page = NULL;
 
-    syslog(LOG_INFO, "SEND RENDER serializing buffer with value 10 %f\n", buf->data[10]);
+    snprintf(shmname, NAME_MAX, ASTRID_STATS_NAME, stats->name);
+    stats->magic = 0;
 
-    if((bufstr = serialize_buffer(buf, &instrument->msg, &strsize)) == NULL) {
+    if(munmap(stats, sizeof(lpstats_t)) < 0) {
+        syslog(LOG_ERR, "astrid_stats_close: Could not munmap stats page. (%d) %s\n", errno, strerror(errno));
         return -1;
     }
 
-    if(astrid_instrument_publish_bufstr(instrument->name, bufstr, strsize) < 0) {
+    if(shm_unlink(shmname) < 0) {
+        syslog(LOG_ERR, "astrid_stats_close: Could not unlink stats page %s. (%d) %s\n", shmname, errno, strerror(errno));
         return -1;
     }
 
-    free(bufstr);
-
     return 0;
 }
 
-int astrid_instrument_publish_bufstr(char * instrument_name, unsigned char * bufstr, size_t size) {
-    int shmfd;
-    void * shmaddr;
-    sem_t * sem;
-    char buffer_code[LPKEY_MAXLENGTH] = {0};
-    ssize_t buffer_id = 0;
-    lpmsg_t msg = {0};
+/* Maps another process's stats page read-only. Returns NULL if 
+ * it isn't a stats page or its instrument is no longer running. */
+lpstats_t * astrid_stats_attach(const char * shmname) {
+    lpstats_t * stats;
+    struct stat st;
+    int fd;
 
-    if((buffer_id = lpcounter_read_and_increment("bufferid")) < 0) {
-        syslog(LOG_ERR, "Could not get bufferid. (%d) %s\n", errno, strerror(errno));
-        return -1;
+    if((fd = shm_open(shmname, O_RDONLY, 0)) < 0) return NULL;
+
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(lpstats_t)) {
+        close(fd);
+        return NULL;
     }
 
-    // generate the buffer code using the instrument name as the prefix
-    if(lpencode_with_prefix(instrument_name, buffer_id, buffer_code) < 0) {
-        syslog(LOG_ERR, "Could not encode bufstr key. (%d) %s\n", errno, strerror(errno));
-        return -1;
+    if((stats = (lpstats_t *)mmap(NULL, sizeof(lpstats_t), PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    if(stats->magic != ASTRID_STATS_MAGIC || (kill(stats->pid, 0) < 0 && errno == ESRCH)) {
+        munmap(stats, sizeof(lpstats_t));
+        return NULL;
     }
 
-    // write the bufstr to shared memory at the key location
-    /* Create the POSIX semaphore and initialize it to 1 */
-    if((sem = sem_open(buffer_code, O_CREAT | O_EXCL, LPIPC_PERMS, 1)) == NULL) {
-        syslog(LOG_ERR, "publish_bufstr: failed to create semaphore %s. Error: %s\n", buffer_code, strerror(errno));
+    return stats;
+}
+
+int astrid_stats_detach(lpstats_t * stats) {
+    if(munmap(stats, sizeof(lpstats_t)) < 0) {
+        syslog(LOG_ERR, "astrid_stats_detach: Could not munmap stats page. (%d) %s\n", errno, strerror(errno));
         return -1;
     }
 
-    /* Create the POSIX shared memory segment */
-    if((shmfd = shm_open(buffer_code, O_CREAT | O_RDWR, LPIPC_PERMS)) < 0) {
-        syslog(LOG_ERR, "publish_bufstr: Could not create shared memory segment. (%s) %s\n", buffer_code, strerror(errno));
-        return -1;
+    return 0;
+}
+
+/* Watch an instrument script for changes.
+ *
+ * Editors often save by writing a new file and renaming 
+ * it over the old one, so this watches the directory and 
+ * matches events against the script's filename. 
+ * Inotify descriptors share their event queue when inherited, 
+ * so every process that reloads needs its own watch. */
+int astrid_instrument_watch(const char * path) {
+    char dirname[PATH_MAX] = {0};
+    char * sep;
+    int fd;
+
+    strncpy(dirname, path, PATH_MAX-1);
+    if((sep = strrchr(dirname, '/')) == NULL) {
+        dirname[0] = '.';
+        dirname[1] = 0;
+    } else if(sep == dirname) {
+        dirname[1] = 0;
+    } else {
+        *sep = 0;
     }
 
-    if(ftruncate(shmfd, size) < 0) {
-        syslog(LOG_ERR, "publish_bufstr: Could not truncate shared memory segment to size %ld. (%s) %s\n", size, buffer_code, strerror(errno));
+    if((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        syslog(LOG_ERR, "instrument_watch: Could not init inotify. (%d) %s\n", errno, strerror(errno));
         return -1;
     }
 
-    /* Attach the shared memory to the pointer */
-    if((shmaddr = (void*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0)) == MAP_FAILED) {
-        syslog(LOG_ERR, "lpipc_buffer_aquire Could not mmap shared memory segment to size %ld. (%s) %s\n", size, buffer_code, strerror(errno));
+    if(inotify_add_watch(fd, dirname, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        syslog(LOG_ERR, "instrument_watch: Could not watch %s. (%d) %s\n", dirname, errno, strerror(errno));
+        close(fd);
         return -1;
     }
 
-    /* Write the bufstr into the shared memory segment */
-    memcpy(shmaddr, (void *)bufstr, size);
+    return fd;
+}
 
-    // Send the render complete message
-    memcpy(msg.instrument_name, instrument_name, strlen(instrument_name));
-    memcpy(msg.msg, buffer_code, strlen(buffer_code));
-    msg.type = LPMSG_RENDER_COMPLETE;
-    if(send_play_message(msg) < 0) {
-        syslog(LOG_ERR, "Could not send render complete message. (%d) %s\n", errno, strerror(errno));
-        return 1;
-    }
+/* Drains pending events and returns 1 if the script changed */
+int astrid_instrument_watch_changed(int fd, const char * path) {
+    char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event * event;
+    const char * filename;
+    ssize_t len;
+    char * e;
+    int changed = 0;
 
-    // unmap the memory...
-    munmap(shmaddr, size);
+    filename = strrchr(path, '/');
+    filename = (filename == NULL) ? path : filename + 1;
 
-    if(sem_close(sem) < 0) {
-        syslog(LOG_ERR, "publish_bufstr sem_close Could not close semaphore\n");
-        return -1;
+    while((len = read(fd, events, sizeof(events))) > 0) {
+        for(e = events; e < events + len; e += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)e;
+            if(event->len > 0 && strcmp(event->name, filename) == 0) changed = 1;
+        }
     }
 
-    close(shmfd);
+    if(len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        syslog(LOG_ERR, "instrument_watch_changed: Could not read inotify events. (%d) %s\n", errno, strerror(errno));
+        return -1;
+    }
 
-    return 0;
+    return changed;
 }
 
 int astrid_instrument_process_command_tick(lpinstrument_t * instrument) {
@@ -4130,369 +7929,581 @@ lpparamset_t astrid_instrument_create_paramset(char * paramset_defs) {
     return paramset;
 }
 
-int astrid_instrument_save_param_session_snapshot(lpinstrument_t * instrument, int num_params, int snapshot_id) {
-    int shmfd;
-    sem_t * sem;
-    void * shm_base;
-    size_t shm_size = 0;
-    size_t offset = 0;
+static lpparamsnapshot_t * astrid_param_snapshot_map(lpinstrument_t * instrument, int snapshot_id, int create, sem_t ** sem) {
+    /* Maps a snapshot segment and opens the semaphore guarding it */
+    lpparamsnapshot_t * snapshot;
+    struct stat statbuf;
     char path[PATH_MAX] = {0};
+    int shmfd;
 
-    // Generate the path for the shared memory and semaphore
     snprintf(path, PATH_MAX, "%s-%s-%d", ASTRID_SESSION_SNAPSHOT_NAME, instrument->name, snapshot_id);
 
-    // Create and initialize the semaphore
-    if((sem = sem_open(path, O_CREAT, LPIPC_PERMS, 1)) == SEM_FAILED) {
-        syslog(LOG_ERR, "Could not create semaphore. (%s) %s\n", path, strerror(errno));
-        return -1;
+    if((*sem = (create) ? sem_open(path, O_CREAT, LPIPC_PERMS, 1) : sem_open(path, 0)) == SEM_FAILED) {
+        syslog(LOG_ERR, "Could not open snapshot semaphore. (%s) %s\n", path, strerror(errno));
+        return NULL;
     }
 
-    // Calculate the required size for shared memory
-    for(int i = 0; i < num_params; i++) {
-        MDB_val key, data;
-        key.mv_size = sizeof(int);
-        key.mv_data = &i;
-
-        int rc = mdb_txn_renew(instrument->dbtxn_read);
-        if(rc == 0 && mdb_get(instrument->dbtxn_read, instrument->dbi, &key, &data) == 0) {
-            shm_size += sizeof(int) + sizeof(size_t) + data.mv_size;
-        }
-        mdb_txn_reset(instrument->dbtxn_read);
+    if((shmfd = shm_open(path, (create) ? O_CREAT | O_RDWR : O_RDWR, LPIPC_PERMS)) < 0) {
+        syslog(LOG_ERR, "Could not open snapshot shared memory segment. (%s) %s\n", path, strerror(errno));
+        sem_close(*sem);
+        return NULL;
     }
 
-    // Create and truncate the shared memory segment
-    if((shmfd = shm_open(path, O_CREAT | O_RDWR, LPIPC_PERMS)) < 0) {
-        syslog(LOG_ERR, "Could not create shared memory segment. (%s) %s\n", path, strerror(errno));
-        sem_close(sem);
-        sem_unlink(path);
-        return -1;
+    if(create && ftruncate(shmfd, sizeof(lpparamsnapshot_t)) < 0) {
+        syslog(LOG_ERR, "Could not truncate snapshot shared memory segment. (%s) %s\n", path, strerror(errno));
+        close(shmfd);
+        sem_close(*sem);
+        return NULL;
     }
 
-    if(ftruncate(shmfd, shm_size) < 0) {
-        syslog(LOG_ERR, "Could not truncate shared memory segment to size %ld. (%s) %s\n", shm_size, path, strerror(errno));
+    if(fstat(shmfd, &statbuf) < 0 || (size_t)statbuf.st_size != sizeof(lpparamsnapshot_t)) {
+        syslog(LOG_ERR, "Snapshot shared memory segment is not a param snapshot. (%s)\n", path);
         close(shmfd);
-        sem_close(sem);
-        sem_unlink(path);
-        return -1;
+        sem_close(*sem);
+        return NULL;
     }
 
-    if((shm_base = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0)) == MAP_FAILED) {
-        syslog(LOG_ERR, "Could not mmap shared memory segment. (%s) %s\n", path, strerror(errno));
-        close(shmfd);
-        sem_close(sem);
-        sem_unlink(path);
-        return -1;
+    snapshot = (lpparamsnapshot_t *)mmap(NULL, sizeof(lpparamsnapshot_t), PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+    close(shmfd);
+    if(snapshot == MAP_FAILED) {
+        syslog(LOG_ERR, "Could not mmap snapshot shared memory segment. (%s) %s\n", path, strerror(errno));
+        sem_close(*sem);
+        return NULL;
     }
 
-    // Lock the semaphore
-    sem_wait(sem);
+    return snapshot;
+}
 
-    // Write data to shared memory
-    for(int i = 0; i < num_params; i++) {
-        MDB_val key, data;
-        key.mv_size = sizeof(int);
-        key.mv_data = &i;
+static void astrid_param_snapshot_unmap(lpparamsnapshot_t * snapshot, sem_t * sem) {
+    sem_post(sem);
+    munmap(snapshot, sizeof(lpparamsnapshot_t));
+    sem_close(sem);
+}
 
-        int rc = mdb_txn_renew(instrument->dbtxn_read);
-        if (rc == 0 && mdb_get(instrument->dbtxn_read, instrument->dbi, &key, &data) == 0) {
-            memcpy((char *)shm_base + offset, &i, sizeof(int));
-            offset += sizeof(int);
-            size_t data_size = data.mv_size;
-            memcpy((char *)shm_base + offset, &data_size, sizeof(size_t));
-            offset += sizeof(size_t);
-            memcpy((char *)shm_base + offset, data.mv_data, data_size);
-            offset += data_size;
-        }
-        mdb_txn_reset(instrument->dbtxn_read);
-    }
+static int astrid_param_snapshot_overflow_put(lpparamsnapshot_t * snapshot, int param_index, const void * value, size_t size) {
+    /* Appends a param to the overflow area, or returns -1 if it's full */
+    lpparamoverflow_t record;
+    size_t length = (sizeof(lpparamoverflow_t) + size + 7) & ~(size_t)7;
 
-    // Unlock the semaphore
-    sem_post(sem);
+    if(length > ASTRID_PARAM_SNAPSHOT_OVERFLOW - snapshot->overflow_used) return -1;
 
-    // Clean up
-    munmap(shm_base, shm_size);
-    close(shmfd);
-    sem_close(sem);
+    record.param_index = param_index;
+    record.size = (uint32_t)size;
+    memcpy(snapshot->overflow + snapshot->overflow_used, &record, sizeof(lpparamoverflow_t));
+    memcpy(snapshot->overflow + snapshot->overflow_used + sizeof(lpparamoverflow_t), value, size);
+    snapshot->overflow_used += length;
 
     return 0;
 }
 
-int astrid_instrument_restore_param_session_snapshot(lpinstrument_t * instrument, int snapshot_id) {
-    int shmfd;
-    sem_t * sem;
-    void * shm_base;
-    size_t offset = 0;
-    char path[PATH_MAX] = {0};
+static int astrid_param_snapshot_overflow_restore(lpinstrument_t * instrument, lpparamsnapshot_t * snapshot) {
+    /* Writes the overflow params back to LMDB in one transaction */
+    lpparamoverflow_t record;
+    MDB_txn * txn;
+    MDB_val key, data;
+    size_t pos = 0;
+    int rc, count = 0;
 
-    // Generate the path for the shared memory and semaphore
-    snprintf(path, PATH_MAX, "%s-%s-%d", ASTRID_SESSION_SNAPSHOT_NAME, instrument->name, snapshot_id);
+    if(snapshot->overflow_used == 0) return 0;
 
-    // Open the semaphore
-    if((sem = sem_open(path, 0)) == SEM_FAILED) {
-        syslog(LOG_ERR, "Could not open semaphore. (%s) %s\n", path, strerror(errno));
+    if((rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &txn)) != MDB_SUCCESS) {
+        syslog(LOG_ERR, "astrid_param_snapshot_overflow_restore mdb_txn_begin: (%d) %s\n", rc, mdb_strerror(rc));
         return -1;
     }
 
-    // Open the shared memory segment
-    if((shmfd = shm_open(path, O_RDWR, LPIPC_PERMS)) < 0) {
-        syslog(LOG_ERR, "Could not open shared memory segment. (%s) %s\n", path, strerror(errno));
-        sem_close(sem);
-        return -1;
+    while(pos + sizeof(lpparamoverflow_t) <= snapshot->overflow_used) {
+        memcpy(&record, snapshot->overflow + pos, sizeof(lpparamoverflow_t));
+        if(record.size > snapshot->overflow_used - pos - sizeof(lpparamoverflow_t)) break;
+
+        key.mv_size = sizeof(int);
+        key.mv_data = (void *)(&record.param_index);
+        data.mv_size = record.size;
+        data.mv_data = (void *)(snapshot->overflow + pos + sizeof(lpparamoverflow_t));
+        if((rc = mdb_put(txn, instrument->dbi, &key, &data, 0)) != MDB_SUCCESS) {
+            syslog(LOG_ERR, "astrid_param_snapshot_overflow_restore mdb_put: (%d) %s\n", rc, mdb_strerror(rc));
+            mdb_txn_abort(txn);
+            return -1;
+        }
+
+        pos += (sizeof(lpparamoverflow_t) + record.size + 7) & ~(size_t)7;
+        count += 1;
     }
 
-    // Get the size of the shared memory segment
-    struct stat shm_stat;
-    if(fstat(shmfd, &shm_stat) < 0) {
-        syslog(LOG_ERR, "Could not get shared memory segment size. (%s) %s\n", path, strerror(errno));
-        close(shmfd);
-        sem_close(sem);
+    if((rc = mdb_txn_commit(txn)) != MDB_SUCCESS) {
+        syslog(LOG_ERR, "astrid_param_snapshot_overflow_restore mdb_txn_commit: (%d) %s\n", rc, mdb_strerror(rc));
         return -1;
     }
-    size_t shm_size = shm_stat.st_size;
 
-    if((shm_base = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0)) == MAP_FAILED) {
-        syslog(LOG_ERR, "Could not mmap shared memory segment. (%s) %s\n", path, strerror(errno));
-        close(shmfd);
-        sem_close(sem);
+    return count;
+}
+
+int astrid_instrument_save_param_session_snapshot(lpinstrument_t * instrument, int num_params, int snapshot_id) {
+    /* Copies the whole live param table in one pass. Params 
+     * still only in LMDB are filled in after, so num_params 
+     * is no longer needed and is ignored. */
+    unsigned char value[ASTRID_PARAM_MAXSIZE];
+    lpparamsnapshot_t * snapshot;
+    lpparamcache_t * params;
+    lpparamslot_t * slot, * dest;
+    MDB_txn * txn;
+    MDB_cursor * cursor;
+    MDB_val key, data;
+    sem_t * sem;
+    long long slotkey;
+    int i, rc, size, param_index, table;
+
+    (void)num_params;
+
+    if((snapshot = astrid_param_snapshot_map(instrument, snapshot_id, 1, &sem)) == NULL) return -1;
+
+    sem_wait(sem);
+    memset(&snapshot->table, 0, sizeof(lpparamcache_t));
+    snapshot->overflow_used = 0;
+
+    /* Slots keep their positions, so the probe chains carry over */
+    if((params = astrid_paramtables_enter(instrument, &table)) == NULL) {
+        astrid_param_snapshot_unmap(snapshot, sem);
         return -1;
     }
 
-    // Lock the semaphore
-    sem_wait(sem);
+    for(i=0; i < ASTRID_MAX_PARAMS; i++) {
+        slot = &params->slots[i];
+        if((slotkey = atomic_load(&slot->key)) == 0) continue;
+        if((size = astrid_paramslot_read(slot, 0, value, ASTRID_PARAM_MAXSIZE)) < 0) continue;
 
-    // Read data from shared memory
-    while(offset < shm_size) {
-        int param_index;
-        size_t data_size;
-        void *data;
-
-        memcpy(&param_index, (char *)shm_base + offset, sizeof(int));
-        offset += sizeof(int);
-        memcpy(&data_size, (char *)shm_base + offset, sizeof(size_t));
-        offset += sizeof(size_t);
-
-        data = malloc(data_size);
-        if(!data) {
-            syslog(LOG_ERR, "Failed to allocate memory for parameter data.");
-            sem_post(sem);
-            munmap(shm_base, shm_size);
-            close(shmfd);
-            sem_close(sem);
-            return -1;
-        }
+        dest = &snapshot->table.slots[i];
+        atomic_store(&dest->key, slotkey);
+        astrid_paramslot_write(dest, value, (size_t)size, slot->type, 0);
+    }
+    astrid_paramtables_exit(instrument, table);
 
-        memcpy(data, (char *)shm_base + offset, data_size);
-        offset += data_size;
+    if((rc = mdb_txn_begin(instrument->dbenv, NULL, MDB_RDONLY, &txn)) != MDB_SUCCESS) {
+        syslog(LOG_ERR, "astrid_instrument_save_param_session_snapshot mdb_txn_begin: (%d) %s\n", rc, mdb_strerror(rc));
+    } else {
+        if((rc = mdb_cursor_open(txn, instrument->dbi, &cursor)) == MDB_SUCCESS) {
+            while(mdb_cursor_get(cursor, &key, &data, MDB_NEXT) == MDB_SUCCESS) {
+                if(key.mv_size != sizeof(int)) continue;
+                memcpy(&param_index, key.mv_data, sizeof(int));
+
+                dest = (data.mv_size <= ASTRID_PARAM_MAXSIZE) ? astrid_paramcache_find(&snapshot->table, param_index, 1) : NULL;
+                if(dest != NULL) {
+                    if(!atomic_load(&dest->loaded)) astrid_paramslot_write(dest, data.mv_data, data.mv_size, LPPARAM_NONE, 0);
+                    continue;
+                }
 
-        MDB_val key, mdb_data;
-        key.mv_size = sizeof(int);
-        key.mv_data = &param_index;
-        mdb_data.mv_size = data_size;
-        mdb_data.mv_data = data;
-
-        int rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &instrument->dbtxn_write);
-        if(rc) {
-            syslog(LOG_ERR, "Failed to begin transaction: (%d) %s", rc, mdb_strerror(rc));
-            free(data);
-            sem_post(sem);
-            munmap(shm_base, shm_size);
-            close(shmfd);
-            sem_close(sem);
-            return -1;
+                /* Too big for a slot, or the table is full */
+                if(astrid_param_snapshot_overflow_put(snapshot, param_index, data.mv_data, data.mv_size) < 0) {
+                    syslog(LOG_WARNING, "%s snapshot %d: No room for param %d (%ld bytes), leaving it out\n", instrument->name, snapshot_id, param_index, data.mv_size);
+                }
+            }
+            mdb_cursor_close(cursor);
         }
+        mdb_txn_abort(txn);
+    }
 
-        rc = mdb_put(instrument->dbtxn_write, instrument->dbi, &key, &mdb_data, 0);
-        if(rc) {
-            syslog(LOG_ERR, "Failed to put parameter data: (%d) %s", rc, mdb_strerror(rc));
-            free(data);
-            mdb_txn_abort(instrument->dbtxn_write);
-            sem_post(sem);
-            munmap(shm_base, shm_size);
-            close(shmfd);
-            sem_close(sem);
+    astrid_param_snapshot_unmap(snapshot, sem);
+
+    return 0;
+}
+
+int astrid_instrument_interpolate_param_session_snapshots(lpinstrument_t * instrument, int from_snapshot_id, int to_snapshot_id, double seconds) {
+    /* Fills the idle param table from the `to` snapshot and swaps 
+     * it in. If seconds > 0, the float params are then ramped over 
+     * from the `from` snapshot (or the live table if from_snapshot_id 
+     * is negative) by the audio thread. Other processes can't hand 
+     * it a morph, so from there the swap is always immediate. */
+    lpparamtables_t * tables = instrument->paramtables;
+    lpparamsnapshot_t * to, * from_snapshot = NULL;
+    lpparamcache_t * live, * next, * from;
+    lpparammorph_t * morph;
+    lpparammorphitem_t * item;
+    lpparamslot_t * slot, * src;
+    sem_t * to_sem, * from_sem = NULL;
+    long long slotkey;
+    int i, idle, numitems = 0;
+
+    if(tables == NULL) return -1;
+    if(getpid() != tables->owner) seconds = 0;
+
+    /* One restore at a time, from any process */
+    if(astrid_robust_mutex_lock(&tables->lock, "interpolate_param_session_snapshots") < 0) return -1;
+
+    /* Nothing else swaps tables while we hold the lock */
+    idle = 1 - atomic_load(&tables->live);
+    live = &tables->tables[1 - idle];
+    next = &tables->tables[idle];
+
+    if((to = astrid_param_snapshot_map(instrument, to_snapshot_id, 0, &to_sem)) == NULL) {
+        pthread_mutex_unlock(&tables->lock);
+        return -1;
+    }
+
+    /* Readers still on the idle table from before the last swap */
+    astrid_paramtables_drain(instrument, idle);
+
+    /* Held until the overflow params are back in LMDB */
+    sem_wait(to_sem);
+    memcpy(next, &to->table, sizeof(lpparamcache_t));
+
+    /* The flusher will write the restored values back to LMDB */
+    for(i=0; i < ASTRID_MAX_PARAMS; i++) {
+        if(atomic_load(&next->slots[i].loaded)) atomic_store(&next->slots[i].dirty, 1);
+    }
+
+    from = live;
+    if(seconds > 0 && from_snapshot_id == to_snapshot_id) {
+        from = &to->table;
+    } else if(seconds > 0 && from_snapshot_id >= 0) {
+        if((from_snapshot = astrid_param_snapshot_map(instrument, from_snapshot_id, 0, &from_sem)) == NULL) {
+            astrid_param_snapshot_unmap(to, to_sem);
+            pthread_mutex_unlock(&tables->lock);
             return -1;
         }
+        sem_wait(from_sem);
+        from = &from_snapshot->table;
+    }
 
-        rc = mdb_txn_commit(instrument->dbtxn_write);
-        if(rc) {
-            syslog(LOG_ERR, "Failed to commit transaction: (%d) %s", rc, mdb_strerror(rc));
-            free(data);
-            sem_post(sem);
-            munmap(shm_base, shm_size);
-            close(shmfd);
-            sem_close(sem);
-            return -1;
+    if(seconds > 0) {
+        for(i=0; i < ASTRID_MAX_PARAMS; i++) {
+            if(next->slots[i].type == LPPARAM_FLOAT || next->slots[i].type == LPPARAM_FLOATLIST) numitems += 1;
         }
+    }
 
-        free(data);
+    if((morph = calloc(1, sizeof(lpparammorph_t) + sizeof(lpparammorphitem_t) * numitems)) == NULL) {
+        syslog(LOG_ERR, "astrid_instrument_interpolate_param_session_snapshots calloc: (%d) %s\n", errno, strerror(errno));
+        if(from_snapshot != NULL) astrid_param_snapshot_unmap(from_snapshot, from_sem);
+        astrid_param_snapshot_unmap(to, to_sem);
+        pthread_mutex_unlock(&tables->lock);
+        return -1;
     }
 
-    // Unlock the semaphore
-    sem_post(sem);
+    morph->table = idle;
+    morph->length = (size_t)(seconds * instrument->samplerate);
 
-    // Clean up
-    munmap(shm_base, shm_size);
-    close(shmfd);
-    sem_close(sem);
+    for(i=0; i < ASTRID_MAX_PARAMS && numitems > 0; i++) {
+        slot = &next->slots[i];
+        if(slot->type != LPPARAM_FLOAT && slot->type != LPPARAM_FLOATLIST) continue;
+        if((slotkey = atomic_load(&slot->key)) == 0) continue;
+        if((src = astrid_paramcache_find(from, (int)(slotkey - 1), 0)) == NULL) continue;
+        /* Values that were only ever loaded from LMDB are untyped */
+        if((src->type != slot->type && src->type != LPPARAM_NONE) || src->size != slot->size) continue;
+
+        item = &morph->items[morph->numitems];
+        item->slot = slot;
+        item->count = slot->size / sizeof(lpfloat_t);
+        if(astrid_paramslot_read(src, 0, item->from, sizeof(item->from)) < 0) continue;
+        if(astrid_paramslot_read(slot, 0, item->to, sizeof(item->to)) < 0) continue;
+
+        /* Start from where the ramp starts so nothing jumps at the swap */
+        astrid_paramslot_write(slot, item->from, slot->size, LPPARAM_NONE, 1);
+        morph->numitems += 1;
+    }
+
+    if(from_snapshot != NULL) astrid_param_snapshot_unmap(from_snapshot, from_sem);
+
+    /* Anything not in the snapshot reloads from LMDB after the swap */
+    if(astrid_instrument_flush_params(instrument) < 0) {
+        syslog(LOG_ERR, "astrid_instrument_interpolate_param_session_snapshots: Could not flush params\n");
+    }
+
+    /* After the flush, so a live value can't write over the snapshot's */
+    if(astrid_param_snapshot_overflow_restore(instrument, to) < 0) {
+        syslog(LOG_ERR, "astrid_instrument_interpolate_param_session_snapshots: Could not restore the overflow params\n");
+    }
+    astrid_param_snapshot_unmap(to, to_sem);
+
+    atomic_store(&tables->live, idle);
+
+    syslog(LOG_DEBUG, "%s restored snapshot %d, ramping %d params over %f seconds\n", instrument->name, to_snapshot_id, morph->numitems, seconds);
+
+    /* An empty morph still replaces (and so stops) a running one */
+    free(atomic_exchange(&instrument->parammorph_pending, morph));
+
+    pthread_mutex_unlock(&tables->lock);
 
     return 0;
 }
 
+int astrid_instrument_restore_param_session_snapshot(lpinstrument_t * instrument, int snapshot_id) {
+    return astrid_instrument_interpolate_param_session_snapshots(instrument, -1, snapshot_id, 0);
+}
 
-int32_t astrid_instrument_get_param_int32(lpinstrument_t * instrument, int param_index, int32_t default_value) {
-    int rc, param_exists=0;
+static int astrid_param_db_get(lpinstrument_t * instrument, int param_index, size_t offset, void * value, size_t size, size_t * stored_size) {
+    /* Copies up to size bytes of the stored value from offset 
+     * and reports the full stored size. */
+    MDB_txn * txn;
     MDB_val key, data;
-    int32_t param = default_value;
+    size_t copied;
+    int rc;
 
     key.mv_size = sizeof(int);
     key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(int32_t);
 
-	rc = mdb_txn_renew(instrument->dbtxn_read);
-    rc = mdb_get(instrument->dbtxn_read, instrument->dbi, &key, &data);
-    if(rc == 0) {
-        param = *((int32_t *)data.mv_data);
-        param_exists = 1;
+    /* A private read txn: misses can come from any thread */
+    if((rc = mdb_txn_begin(instrument->dbenv, NULL, MDB_RDONLY, &txn)) != MDB_SUCCESS) {
+        syslog(LOG_WARNING, "astrid_param_db_get mdb_txn_begin: (%d) %s\n", rc, mdb_strerror(rc));
+        return -1;
     }
-    mdb_txn_reset(instrument->dbtxn_read);
 
-    if(!param_exists) astrid_instrument_set_param_int32(instrument, param_index, param);
+    if((rc = mdb_get(txn, instrument->dbi, &key, &data)) == MDB_SUCCESS) {
+        copied = (offset < data.mv_size) ? data.mv_size - offset : 0;
+        if(copied > size) copied = size;
+        memcpy(value, (unsigned char *)data.mv_data + offset, copied);
+        *stored_size = data.mv_size;
+    }
+    mdb_txn_abort(txn);
 
-    return param;
+    return (rc == MDB_SUCCESS) ? 0 : -1;
 }
 
-void astrid_instrument_set_param_int32(lpinstrument_t * instrument, int param_index, int32_t value) {
+static void astrid_param_db_put(lpinstrument_t * instrument, int param_index, const void * value, size_t size) {
+    MDB_txn * txn;
+    MDB_val key, data;
     int rc;
-	MDB_val key, data;
 
     key.mv_size = sizeof(int);
     key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(int32_t);
-    data.mv_data = (void *)(&value);
+    data.mv_size = size;
+    data.mv_data = (void *)value;
 
-	rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &instrument->dbtxn_write);
-    rc = mdb_put(instrument->dbtxn_write, instrument->dbi, &key, &data, 0);
-    rc = mdb_txn_commit(instrument->dbtxn_write);
-    if(rc) {
-        syslog(LOG_WARNING, "astrid_instrument_get_param_int32 mdb_txn_commit: (%d) %s\n", rc, mdb_strerror(rc));
+    if((rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &txn)) != MDB_SUCCESS) {
+        syslog(LOG_WARNING, "astrid_param_db_put mdb_txn_begin: (%d) %s\n", rc, mdb_strerror(rc));
+        return;
+    }
+
+    mdb_put(txn, instrument->dbi, &key, &data, 0);
+    if((rc = mdb_txn_commit(txn)) != MDB_SUCCESS) {
+        syslog(LOG_WARNING, "astrid_param_db_put mdb_txn_commit: (%d) %s\n", rc, mdb_strerror(rc));
     }
 }
 
+static int astrid_paramcache_get(lpinstrument_t * instrument, lpparamcache_t * params, int param_index, uint32_t type, size_t offset, void * value, size_t size) {
+    unsigned char stored[ASTRID_PARAM_MAXSIZE];
+    lpparamslot_t * slot;
+    size_t stored_size = 0, cached_size;
+    int copied;
 
-lpfloat_t astrid_instrument_get_param_float(lpinstrument_t * instrument, int param_index, lpfloat_t default_value) {
-    int rc, param_exists=0;
-    MDB_val key, data;
-    lpfloat_t param = default_value;
+    /* Reads through to LMDB still get the whole size */
+    cached_size = (size > ASTRID_PARAM_MAXSIZE) ? ASTRID_PARAM_MAXSIZE : size;
 
-    key.mv_size = sizeof(int);
-    key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(lpfloat_t);
+    slot = astrid_paramcache_find(params, param_index, 0);
+    if(slot != NULL && (copied = astrid_paramslot_read(slot, offset, stored, cached_size)) != -1) {
+        if(copied < 0) return -2;
+        memcpy(value, stored, (size_t)copied);
+        return 0;
+    }
 
-	rc = mdb_txn_renew(instrument->dbtxn_read);
-    rc = mdb_get(instrument->dbtxn_read, instrument->dbi, &key, &data);
-    if(rc == 0) {
-        param = *((lpfloat_t *)data.mv_data);
-        param_exists = 1;
+    if(astrid_thread_is_realtime) {
+        /* Claim the slot so the flusher thread loads it */
+        if(slot == NULL) astrid_paramcache_find(params, param_index, 1);
+        return -2;
     }
-    mdb_txn_reset(instrument->dbtxn_read);
 
-    if(!param_exists) astrid_instrument_set_param_float(instrument, param_index, param);
+    if(astrid_param_db_get(instrument, param_index, 0, stored, ASTRID_PARAM_MAXSIZE, &stored_size) < 0) return -1;
 
-    return param;
+    if(stored_size > ASTRID_PARAM_MAXSIZE) {
+        /* Too big for the cache: read through */
+        return astrid_param_db_get(instrument, param_index, offset, value, size, &stored_size);
+    }
+
+    if(slot == NULL) slot = astrid_paramcache_find(params, param_index, 1);
+    if(slot == NULL) {
+        /* No room left in the cache */
+        if(offset < stored_size) memcpy(value, stored + offset, (stored_size - offset < size) ? stored_size - offset : size);
+        return 0;
+    }
+
+    astrid_paramslot_fill(slot, stored, stored_size);
+    if(type != LPPARAM_NONE) slot->type = type;
+    if((copied = astrid_paramslot_read(slot, offset, stored, cached_size)) < 0) return -2;
+    memcpy(value, stored, (size_t)copied);
+    return 0;
 }
 
-void astrid_instrument_set_param_float(lpinstrument_t * instrument, int param_index, lpfloat_t value) {
-    int rc;
-	MDB_val key, data;
+static int astrid_instrument_get_param(lpinstrument_t * instrument, int param_index, uint32_t type, size_t offset, void * value, size_t size) {
+    /* Fills value from the cache, loading the param from LMDB 
+     * on the first read. Returns -1 if it isn't in the session, 
+     * or -2 if it can't be read right now: the caller should 
+     * use its default without storing it. Value is only 
+     * touched on success. */
+    lpparamcache_t * params;
+    int table, ret;
 
-    key.mv_size = sizeof(int);
-    key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(lpfloat_t);
-    data.mv_data = (void *)(&value);
+    if((params = astrid_paramtables_enter(instrument, &table)) == NULL) return -2;
+    ret = astrid_paramcache_get(instrument, params, param_index, type, offset, value, size);
+    astrid_paramtables_exit(instrument, table);
 
-	rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &instrument->dbtxn_write);
-    rc = mdb_put(instrument->dbtxn_write, instrument->dbi, &key, &data, 0);
-    rc = mdb_txn_commit(instrument->dbtxn_write);
-    if(rc) {
-        syslog(LOG_WARNING, "astrid_instrument_set_param_float mdb_txn_commit: (%d) %s\n", rc, mdb_strerror(rc));
+    return ret;
+}
+
+int astrid_instrument_load_params(lpinstrument_t * instrument) {
+    /* Fills the slots the audio thread missed on from LMDB */
+    lpparamcache_t * params;
+    lpparamslot_t * slot;
+    MDB_txn * txn = NULL;
+    MDB_val key, data;
+    int i, rc, table, param_index, count = 0;
+
+    if((params = astrid_paramtables_enter(instrument, &table)) == NULL) return 0;
+
+    for(i=0; i < ASTRID_MAX_PARAMS; i++) {
+        slot = &params->slots[i];
+        if(atomic_load(&slot->key) == 0 || atomic_load(&slot->loaded)) continue;
+
+        if(txn == NULL && (rc = mdb_txn_begin(instrument->dbenv, NULL, MDB_RDONLY, &txn)) != MDB_SUCCESS) {
+            syslog(LOG_ERR, "astrid_instrument_load_params mdb_txn_begin: (%d) %s\n", rc, mdb_strerror(rc));
+            astrid_paramtables_exit(instrument, table);
+            return -1;
+        }
+
+        param_index = (int)(atomic_load(&slot->key) - 1);
+        key.mv_size = sizeof(int);
+        key.mv_data = (void *)(&param_index);
+
+        /* Params too big for the cache stay at their defaults on the audio thread */
+        if(mdb_get(txn, instrument->dbi, &key, &data) != MDB_SUCCESS || data.mv_size > ASTRID_PARAM_MAXSIZE) continue;
+        astrid_paramslot_fill(slot, data.mv_data, data.mv_size);
+        count += 1;
     }
+
+    if(txn != NULL) mdb_txn_abort(txn);
+    astrid_paramtables_exit(instrument, table);
+    return count;
 }
 
-void astrid_instrument_set_param_patternbuf(lpinstrument_t * instrument, int param_index, lppatternbuf_t * patternbuf) {
-    int rc;
-	MDB_val key, data;
+static void astrid_instrument_set_param(lpinstrument_t * instrument, int param_index, uint32_t type, const void * value, size_t size) {
+    lpparamcache_t * params;
+    lpparamslot_t * slot = NULL;
+    int table;
 
-    key.mv_size = sizeof(int);
-    key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(lppatternbuf_t);
-    data.mv_data = (void *)patternbuf;
+    if((params = astrid_paramtables_enter(instrument, &table)) != NULL) {
+        if(size <= ASTRID_PARAM_MAXSIZE) slot = astrid_paramcache_find(params, param_index, 1);
+        if(slot != NULL) astrid_paramslot_write(slot, value, size, type, 1);
+        astrid_paramtables_exit(instrument, table);
+    }
 
-	rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &instrument->dbtxn_write);
-    rc = mdb_put(instrument->dbtxn_write, instrument->dbi, &key, &data, 0);
-    rc = mdb_txn_commit(instrument->dbtxn_write);
-    if(rc) {
-        syslog(LOG_WARNING, "astrid_instrument_set_param_patternbuf mdb_txn_commit: (%d) %s\n", rc, mdb_strerror(rc));
+    if(slot == NULL && astrid_thread_is_realtime) {
+        /* No LMDB transactions on the audio thread: the write is lost */
+        astrid_log(LOG_ERR, "%s: dropped a %ld byte write to param %d from a realtime thread (cache full or param too big)\n", instrument->name, size, param_index);
+        return;
     }
+
+    if(slot == NULL) astrid_param_db_put(instrument, param_index, value, size);
 }
 
-lppatternbuf_t astrid_instrument_get_param_patternbuf(lpinstrument_t * instrument, int param_index) {
-    int rc, param_exists=0;
+int astrid_instrument_flush_params(lpinstrument_t * instrument) {
+    /* Writes every dirty param to LMDB in a single transaction */
+    unsigned char value[ASTRID_PARAM_MAXSIZE];
+    int flushed[ASTRID_MAX_PARAMS];
+    lpparamcache_t * params;
+    lpparamslot_t * slot;
+    MDB_txn * txn = NULL;
     MDB_val key, data;
-    lppatternbuf_t patternbuf = {1,{1}};
+    int i, rc, size, table, param_index, count = 0;
 
-    key.mv_size = sizeof(int);
-    key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(lppatternbuf_t);
+    if((params = astrid_paramtables_enter(instrument, &table)) == NULL) return 0;
+
+    for(i=0; i < ASTRID_MAX_PARAMS; i++) {
+        slot = &params->slots[i];
+        if(atomic_load(&slot->key) == 0 || !atomic_load(&slot->dirty)) continue;
+
+        if(txn == NULL && (rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &txn)) != MDB_SUCCESS) {
+            syslog(LOG_ERR, "astrid_instrument_flush_params mdb_txn_begin: (%d) %s\n", rc, mdb_strerror(rc));
+            astrid_paramtables_exit(instrument, table);
+            return -1;
+        }
+
+        /* Clear first so a write racing the flush marks it again */
+        atomic_store(&slot->dirty, 0);
+        param_index = (int)(atomic_load(&slot->key) - 1);
+
+        if((size = astrid_paramslot_read(slot, 0, value, ASTRID_PARAM_MAXSIZE)) < 0) {
+            atomic_store(&slot->dirty, 1);
+            continue;
+        }
+
+        key.mv_size = sizeof(int);
+        key.mv_data = (void *)(&param_index);
+        data.mv_size = (size_t)size;
+        data.mv_data = (void *)value;
 
-	rc = mdb_txn_renew(instrument->dbtxn_read);
-    rc = mdb_get(instrument->dbtxn_read, instrument->dbi, &key, &data);
-    if(rc == 0) {
-        patternbuf = *((lppatternbuf_t *)data.mv_data);
-        param_exists = 1;
+        if((rc = mdb_put(txn, instrument->dbi, &key, &data, 0)) != MDB_SUCCESS) {
+            syslog(LOG_ERR, "astrid_instrument_flush_params mdb_put: (%d) %s\n", rc, mdb_strerror(rc));
+            atomic_store(&slot->dirty, 1);
+            continue;
+        }
+        flushed[count++] = i;
+    }
+
+    if(txn == NULL) {
+        astrid_paramtables_exit(instrument, table);
+        return 0;
     }
-    mdb_txn_reset(instrument->dbtxn_read);
 
-    if(!param_exists) astrid_instrument_set_param_patternbuf(instrument, param_index, &patternbuf);
+    if((rc = mdb_txn_commit(txn)) != MDB_SUCCESS) {
+        syslog(LOG_ERR, "astrid_instrument_flush_params mdb_txn_commit: (%d) %s\n", rc, mdb_strerror(rc));
+        /* Nothing reached LMDB: try them all again next time */
+        for(i=0; i < count; i++) atomic_store(&params->slots[flushed[i]].dirty, 1);
+        astrid_paramtables_exit(instrument, table);
+        return -1;
+    }
 
-    return patternbuf;
+    astrid_paramtables_exit(instrument, table);
+
+    syslog(LOG_DEBUG, "%s flushed %d params\n", instrument->name, count);
+    return count;
 }
 
+int32_t astrid_instrument_get_param_int32(lpinstrument_t * instrument, int param_index, int32_t default_value) {
+    int32_t param = default_value;
 
-void astrid_instrument_set_param_float_list(lpinstrument_t * instrument, int param_index, lpfloat_t * value, size_t size) {
-    int rc;
-	MDB_val key, data;
+    if(astrid_instrument_get_param(instrument, param_index, LPPARAM_INT32, 0, &param, sizeof(int32_t)) == -1) {
+        astrid_instrument_set_param_int32(instrument, param_index, default_value);
+    }
 
-    key.mv_size = sizeof(int);
-    key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(lpfloat_t) * size;
-    data.mv_data = (void *)value;
+    return param;
+}
 
-	rc = mdb_txn_begin(instrument->dbenv, NULL, 0, &instrument->dbtxn_write);
-    rc = mdb_put(instrument->dbtxn_write, instrument->dbi, &key, &data, 0);
-    rc = mdb_txn_commit(instrument->dbtxn_write);
-    if(rc) {
-        syslog(LOG_WARNING, "astrid_instrument_get_param_float_list mdb_txn_commit: (%d) %s\n", rc, mdb_strerror(rc));
+void astrid_instrument_set_param_int32(lpinstrument_t * instrument, int param_index, int32_t value) {
+    astrid_instrument_set_param(instrument, param_index, LPPARAM_INT32, &value, sizeof(int32_t));
+}
+
+lpfloat_t astrid_instrument_get_param_float(lpinstrument_t * instrument, int param_index, lpfloat_t default_value) {
+    lpfloat_t param = default_value;
+
+    if(astrid_instrument_get_param(instrument, param_index, LPPARAM_FLOAT, 0, &param, sizeof(lpfloat_t)) == -1) {
+        astrid_instrument_set_param_float(instrument, param_index, default_value);
     }
+
+    return param;
 }
 
-void astrid_instrument_get_param_float_list(lpinstrument_t * instrument, int param_index, size_t size, lpfloat_t * list) {
-    int rc, param_exists=0;
-    MDB_val key, data;
+void astrid_instrument_set_param_float(lpinstrument_t * instrument, int param_index, lpfloat_t value) {
+    astrid_instrument_set_param(instrument, param_index, LPPARAM_FLOAT, &value, sizeof(lpfloat_t));
+}
 
-    key.mv_size = sizeof(int);
-    key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(lpfloat_t) * size;
+void astrid_instrument_set_param_patternbuf(lpinstrument_t * instrument, int param_index, lppatternbuf_t * patternbuf) {
+    astrid_instrument_set_param(instrument, param_index, LPPARAM_PATTERNBUF, patternbuf, sizeof(lppatternbuf_t));
+}
+
+lppatternbuf_t astrid_instrument_get_param_patternbuf(lpinstrument_t * instrument, int param_index) {
+    lppatternbuf_t patternbuf = {1,{1}};
 
-	rc = mdb_txn_renew(instrument->dbtxn_read);
-    rc = mdb_get(instrument->dbtxn_read, instrument->dbi, &key, &data);
-    if(rc == 0) {
-        memcpy(list, data.mv_data, data.mv_size);
-        param_exists = 1;
+    if(astrid_instrument_get_param(instrument, param_index, LPPARAM_PATTERNBUF, 0, &patternbuf, sizeof(lppatternbuf_t)) == -1) {
+        astrid_instrument_set_param_patternbuf(instrument, param_index, &patternbuf);
     }
 
-    if(!param_exists) astrid_instrument_set_param_float_list(instrument, param_index, list, size);
+    return patternbuf;
+}
+
+void astrid_instrument_set_param_float_list(lpinstrument_t * instrument, int param_index, lpfloat_t * value, size_t size) {
+    astrid_instrument_set_param(instrument, param_index, LPPARAM_FLOATLIST, value, sizeof(lpfloat_t) * size);
+}
 
-    mdb_txn_reset(instrument->dbtxn_read);
+void astrid_instrument_get_param_float_list(lpinstrument_t * instrument, int param_index, size_t size, lpfloat_t * list) {
+    if(astrid_instrument_get_param(instrument, param_index, LPPARAM_FLOATLIST, 0, list, sizeof(lpfloat_t) * size) == -1) {
+        astrid_instrument_set_param_float_list(instrument, param_index, list, size);
+    }
 }
 
 lpfloat_t astrid_instrument_get_param_float_list_item(
@@ -4502,28 +8513,12 @@ lpfloat_t astrid_instrument_get_param_float_list_item(
     int item_index, 
     lpfloat_t default_value
 ) {
-    int rc;
-    MDB_val key, data;
-    lpfloat_t * param_list = NULL;
     lpfloat_t param = default_value;
 
     assert((size_t)item_index < size);
 
-    key.mv_size = sizeof(int);
-    key.mv_data = (void *)(&param_index);
-    data.mv_size = sizeof(lpfloat_t) * size;
-
-    rc = mdb_txn_renew(instrument->dbtxn_read);
-    rc = mdb_get(instrument->dbtxn_read, instrument->dbi, &key, &data);
-    if(rc == 0) {
-        param_list = (lpfloat_t *)data.mv_data;
-    }
-
-    if(param_list != NULL) {
-        param = param_list[item_index];
-    }
-
-    mdb_txn_reset(instrument->dbtxn_read);
+    /* Only the one item is copied out of the cache */
+    astrid_instrument_get_param(instrument, param_index, LPPARAM_FLOATLIST, sizeof(lpfloat_t) * item_index, &param, sizeof(lpfloat_t));
 
     return param;
 }
@@ -8,9 +8,19 @@
 #include <mqueue.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
 #include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <string.h>
 #include <sys/ipc.h>
@@ -43,6 +53,81 @@
 
 #define ASTRID_MQ_MAXMSG 10
 
+#define ASTRID_MSGRING_SIZE (1 << 18) /* bytes per message ring, a power of two */
+#define ASTRID_MSGRING_ALIGN 16
+#define ASTRID_MSGRING_MAXHANDLES 64  /* rings a process can send to */
+#define ASTRID_MSGRING_FULL_WAIT 100  /* usecs a producer sleeps on a full ring */
+#define ASTRID_MSGRING_FULL_TRIES 10000 /* sleeps on a full ring before falling back to the mq */
+#define ASTRID_MSGRECORD_COMMITTED 1
+#define ASTRID_MSGRECORD_PADDING 2
+
+#define ASTRID_WIRE_MAGIC 0xA5
+#define ASTRID_WIRE_MAXSIZE (sizeof(lpmsg_t) - 1) /* bigger messages go out raw */
+#define ASTRID_WIRE_MAXHEADER 128 /* fixed fields and name, encoded */
+#define ASTRID_WIRE_INITIATED (1 << 0)
+#define ASTRID_WIRE_SCHEDULED (1 << 1)
+#define ASTRID_WIRE_COMPLETED (1 << 2)
+#define ASTRID_WIRE_DISPATCHED (1 << 3)
+#define ASTRID_WIRE_MAX_PROCESSING_TIME (1 << 4)
+#define ASTRID_WIRE_ONSET_DELAY (1 << 5)
+#define ASTRID_WIRE_TARGET_FRAME (1 << 6)
+
+#define ASTRID_MAXNAMES 256 /* interned instrument names */
+#define ASTRID_NAMES_SHMNAME "/astrid-names"
+#define ASTRID_NAMES_LOCK "/astrid-names-lock"
+
+#define ASTRID_LOG_RINGSIZE 128 /* records per thread ring, a power of two */
+#define ASTRID_LOG_MAXTHREADS 32 /* live threads that can log through a ring */
+#define ASTRID_LOG_MAXARGS 10
+#define ASTRID_LOG_STRSIZE 128 /* bytes for the string args of a record */
+#define ASTRID_LOG_MAXLINE 1024
+#define ASTRID_LOG_DRAIN_INTERVAL 20000 /* usecs between drains */
+
+/* Calls to astrid_log above this level compile away. Matches 
+ * the syslog mask the instruments run with by default. */
+#ifndef ASTRID_LOG_LEVEL
+#define ASTRID_LOG_LEVEL LOG_ERR
+#endif
+
+#define ASTRID_RENDERQ_SIZE 256
+#define ASTRID_LATENCY_BUCKETS 24
+#define ASTRID_LATENCY_LOG_INTERVAL 100
+
+#define ASTRID_STATS_NAME "/astrid-stats-%s"
+#define ASTRID_STATS_SHMDIR "/dev/shm" /* where the stats pages show up */
+#define ASTRID_STATS_MAGIC 0x61737473
+#define ASTRID_STATS_SUBBITS 4  /* 16 sub-buckets per power of two, about 6% error */
+#define ASTRID_STATS_MAXBITS 44 /* bigger values land in the last bucket */
+#define ASTRID_STATS_NUMBUCKETS ((ASTRID_STATS_MAXBITS - ASTRID_STATS_SUBBITS + 1) << ASTRID_STATS_SUBBITS)
+
+#define ASTRID_OFFLINE_ENV "ASTRID_OFFLINE" /* set to a WAV path (or empty) to run without JACK */
+#define ASTRID_OFFLINE_REALTIME_ENV "ASTRID_OFFLINE_REALTIME" /* 1 paces blocks to the wall clock */
+#define ASTRID_OFFLINE_SAMPLERATE_ENV "ASTRID_OFFLINE_SAMPLERATE"
+#define ASTRID_OFFLINE_BLOCKSIZE_ENV "ASTRID_OFFLINE_BLOCKSIZE"
+#define ASTRID_OFFLINE_LENGTH_ENV "ASTRID_OFFLINE_LENGTH" /* seconds to run before shutting down */
+#define ASTRID_OFFLINE_REPLAY_ENV "ASTRID_OFFLINE_REPLAY" /* message log to replay */
+#define ASTRID_OFFLINE_SEED_ENV "ASTRID_OFFLINE_SEED"
+#define ASTRID_OFFLINE_BLOCKSIZE 256
+#define ASTRID_OFFLINE_SETTLE_TIMEOUT 5 /* seconds a flat out block waits on the pipeline */
+#define ASTRID_MSGLOG_ENV "ASTRID_MSGLOG" /* records incoming messages to this path */
+
+#define ASTRID_BLOCK_LANES 4 /* floats per vector in the block kernels */
+
+#define ASTRID_WORKERS_ENV "ASTRID_WORKERS" /* worker threads, 0 runs every job on the audio thread */
+#define ASTRID_WORKERS_MAX 64
+#define ASTRID_WORKER_MAXJOBS 64 /* jobs per block */
+#define ASTRID_WORKER_PRIORITY 70 /* SCHED_FIFO priority when JACK isn't realtime */
+#define ASTRID_WORKER_SPIN 4096 /* polls before the join sleeps on the futex */
+
+#define ASTRID_RENDER_WINDOW 64    /* recent render times kept per instrument */
+#define ASTRID_RENDER_PERCENTILE 0.95
+#define ASTRID_RENDER_MARGIN 0.02  /* extra seconds of headroom for dispatch */
+
+#define ASTRID_STREAM_LENGTH 10   /* ring capacity in seconds */
+#define ASTRID_STREAM_CHUNK 4096  /* frames published at a time */
+#define ASTRID_STREAM_LEAD 0.05   /* default safety lead in seconds */
+#define ASTRID_STREAM_TIMEOUT 5   /* seconds a writer waits on a stalled reader */
+
 /* queue paths */
 #define LPPLAYQ "/astridq"
 #define ASTRID_MSGQ_PATH "/astrid-msgq"
@@ -50,18 +135,43 @@
 
 #define ASTRID_SESSIONDB_PATH "/tmp/astrid_session.db"
 #define ASTRID_MIDI_TRIGGERQ_PATH "/tmp/astrid-miditriggerq"
-#define ASTRID_MIDI_CCBASE_PATH "/tmp/astrid-mididevice%d-cc%d"
-#define ASTRID_MIDI_NOTEBASE_PATH "/tmp/astrid-mididevice%d-note%d"
-#define ASTRID_MIDIMAP_NOTEBASE_PATH "/tmp/astrid-midimap-device%d-note%d"
+#define ASTRID_MSGRING_DOORBELL_PATH "/tmp/astrid-%s-doorbell"
+#define ASTRID_MIDIMAP_PATH "/tmp/astrid-midimap-device%d"
 #define ASTRID_IPC_IDBASE_PATH "/tmp/astrid-idfile-%s"
 
-#define ASTRID_SERIAL_CTLBASE_PATH "/tmp/astrid-serialdevice%d-ctl%d"
+#define ASTRID_CTLTABLE_NAME "/astrid-ctl-device%d"
+#define ASTRID_CTL_MAXDEVICES 256 /* MIDI device ids are ALSA client ids */
+#define ASTRID_CTL_NUMCCS 128
+#define ASTRID_CTL_NUMNOTES 128
+#define ASTRID_CTL_NUMSERIAL 128
+#define ASTRID_SERIAL_DEVICE_ID 0 /* ctl table for the instrument tty */
+#define ASTRID_SERIAL_BUFSIZE (1<<16) /* tty read buffer */
+#define ASTRID_SERIAL_MAXBATCH 64 /* messages sent per batch from the tty */
+#define ASTRID_NOTEMAP_NAME "/astrid-notemap-device%d"
+#define ASTRID_NOTEMAP_MAXMSGS 16 /* mapped messages per note */
+#define ASTRID_NOTEMAP_READ_SPINS 1000 /* seqlock retries before an entry read gives up */
+#define ASTRID_MIDIIN_QUEUE_SIZE 1024 /* MIDI input events in flight, a power of two */
+#define ASTRID_MIDIIN_BLOCK_MAXEVENTS 256 /* MIDI input events delivered per block */
+
+#define ASTRID_VOICECMD_QUEUE_SIZE 256 /* voice mix commands in flight, a power of two */
+#define ASTRID_VOICE_RAMP_DEFAULT 0.01 /* seconds, when a voice message doesn't give a time */
+#define ASTRID_VOICE_SET_GAIN (1 << 0)
+#define ASTRID_VOICE_SET_PAN (1 << 1)
+#define ASTRID_VOICE_FADEIN (1 << 2)
+#define ASTRID_VOICE_FADEOUT (1 << 3) /* and stop once silent */
+#define ASTRID_VOICE_SET_LOOP (1 << 4)
 
 #define ASTRID_SESSION_SNAPSHOT_NAME "/astrid-session-snapshot"
 
 #define LPKEY_MAXLENGTH 4096
 #define ASTRID_MAX_CMDLINE 4096
-#define ASTRID_MAX_PARAMS 4096
+#define ASTRID_MAX_PARAMS 4096 /* slots in the param cache, a power of two */
+#define ASTRID_PARAM_MAXSIZE 512 /* bigger values skip the cache */
+#define ASTRID_PARAM_FLUSH_INTERVAL 0.5 /* default seconds between LMDB flushes */
+#define ASTRID_PARAM_READ_SPINS 1000 /* seqlock retries before a read gives up */
+#define ASTRID_PARAM_SNAPSHOT_OVERFLOW (1 << 20) /* bytes a snapshot keeps for params that don't fit its table */
+#define ASTRID_PARAM_DRAIN_TIMEOUT 1.0 /* seconds a restore waits for readers of the idle table */
+#define ASTRID_PARAMCACHE_NAME "/astrid-%s-params"
 
 #ifndef NOTE_ON
 #define NOTE_ON 144
@@ -105,6 +215,359 @@ typedef struct lpmidievent_t {
     char channel;
 } lpmidievent_t;
 
+/* Timestamped MIDI input.
+ *
+ * The instrument MIDI listener stamps each event with the 
+ * JACK frame it arrived on and pushes it to a single producer, 
+ * single consumer queue. Before the stream callback runs, the 
+ * JACK callback moves the events due in the current block 
+ * to `midi_events` on the instrument, in arrival order. 
+ * Events are due one period after they arrive, which keeps 
+ * their spacing intact instead of bunching them up at the 
+ * start of the block. */
+typedef struct lpmidiinevent_t {
+    jack_nframes_t frame; /* JACK frame time of arrival */
+    uint32_t offset;      /* frame within the block it is delivered in */
+    unsigned char type;   /* NOTE_ON, NOTE_OFF or CONTROL_CHANGE */
+    unsigned char channel;
+    unsigned char id;     /* note or cc number */
+    unsigned char value;  /* velocity or cc value */
+} lpmidiinevent_t;
+
+typedef struct lpmidiinqueue_t {
+    atomic_size_t head; /* written by the MIDI listener */
+    atomic_size_t tail; /* written by the JACK callback */
+    lpmidiinevent_t events[ASTRID_MIDIIN_QUEUE_SIZE];
+} lpmidiinqueue_t;
+
+/* Realtime logging.
+ *
+ * Each thread that calls astrid_log claims its own 
+ * single producer ring on first use (and gives it back 
+ * when it exits) and writes binary 
+ * records into it: the format string pointer (format 
+ * strings must be literals) and its args, with strings 
+ * copied into the record. Nothing allocates, locks or 
+ * formats on the logging thread. A drain thread formats 
+ * the records and hands them to syslog. Records are dropped 
+ * and counted when a ring is full. */
+typedef union lplogarg_t {
+    long long i;
+    double f;
+    void * p;
+    size_t s; /* offset into strs */
+} lplogarg_t;
+
+typedef struct lplogrecord_t {
+    struct timespec time;
+    const char * fmt;
+    int level;
+    int numargs;
+    size_t strsize;
+    lplogarg_t args[ASTRID_LOG_MAXARGS];
+    char strs[ASTRID_LOG_STRSIZE];
+} lplogrecord_t;
+
+typedef struct lplogring_t {
+    atomic_int in_use; /* claimed by a live thread */
+    atomic_size_t head; /* written by the logging thread */
+    atomic_size_t tail; /* written by the drain thread */
+    atomic_size_t dropped;
+    lplogrecord_t records[ASTRID_LOG_RINGSIZE];
+} lplogring_t;
+
+#define astrid_log(level, ...) do { \
+    if((level) <= ASTRID_LOG_LEVEL) astrid_log_write((level), __VA_ARGS__); \
+} while(0)
+
+/* Batched message channels.
+ *
+ * Each instrument message q has a shared memory ring
+ * of variable length records next to it. Producers claim
+ * room for a whole batch of messages with a single CAS on
+ * `reserve`, copy in the wire encoding of each message
+ * and then commit the records one by one. The (single)
+ * consumer frees records by zeroing them and advancing `tail`,
+ * so unclaimed space always reads as uncommitted.
+ *
+ * A consumer about to sleep sets `waiting` and producers
+ * ring its doorbell FIFO only then, once per batch. The mq
+ * is still read alongside the ring for older clients. */
+typedef struct lpmsgrecord_t {
+    atomic_uint flags;
+    uint32_t size;     /* of the whole record, padded to ASTRID_MSGRING_ALIGN */
+    uint32_t length;   /* of the wire encoded message that follows */
+    uint32_t reserved;
+} lpmsgrecord_t;
+
+typedef struct lpmsgring_t {
+    atomic_size_t reserve;
+    atomic_size_t tail;
+    atomic_int waiting;
+    atomic_int is_open;
+    size_t capacity; /* in bytes, a power of two */
+    unsigned char data[];
+} lpmsgring_t;
+
+typedef struct lpmsgchannel_t {
+    char name[NAME_MAX];
+    mqd_t mqd;
+    lpmsgring_t * ring;
+    int doorbell;
+} lpmsgchannel_t;
+
+/* Compact wire format for lpmsg_t (see astrid_wire_encode)
+ *
+ * A view points into the encoded buffer for the name and 
+ * payload, so readers that only need a few fields never 
+ * copy the whole struct. */
+typedef struct lpmsgview_t {
+    double initiated;
+    double scheduled;
+    double completed;
+    double dispatched;
+    double max_processing_time;
+    size_t onset_delay;
+    uint64_t target_frame;
+    size_t voice_id;
+    size_t count;
+    uint16_t flags;
+    uint16_t type;
+    const char * instrument_name; /* not null terminated */
+    size_t namelen;
+    const unsigned char * payload;
+    size_t payload_size;
+} lpmsgview_t;
+
+/* A typed update param, read in place from the msg payload */
+typedef struct lpmsgparam_t {
+    const char * key; /* not null terminated */
+    size_t keylen;
+    int type; /* LPPARAM_NONE, LPPARAM_INT32, LPPARAM_DOUBLE or LPPARAM_STRING */
+    int32_t i;
+    double d;
+    const char * s;
+    size_t slen;
+} lpmsgparam_t;
+
+/* Instrument names shared by every astrid process, 
+ * so messages can carry a small id instead of the name */
+typedef struct lpnametable_t {
+    atomic_int count;
+    char names[ASTRID_MAXNAMES][LPMAXNAME];
+} lpnametable_t;
+
+/* Control surface state
+ *
+ * One shared memory table per device holds the last value 
+ * of every MIDI CC and note and every serial ctl, with the 
+ * time it was set in nanoseconds on the scheduler clock 
+ * (0 if it never was). Each process maps a device table 
+ * once and reads after that are plain atomic loads. */
+typedef struct lpctltable_t {
+    atomic_int ccs[ASTRID_CTL_NUMCCS];
+    atomic_int notes[ASTRID_CTL_NUMNOTES];
+    atomic_size_t serial[ASTRID_CTL_NUMSERIAL];
+    atomic_llong cc_times[ASTRID_CTL_NUMCCS];
+    atomic_llong note_times[ASTRID_CTL_NUMNOTES];
+    atomic_llong serial_times[ASTRID_CTL_NUMSERIAL];
+} lpctltable_t;
+
+/* Serial ctl updates.
+ *
+ * The payload of an LPMSG_DATA frame from the tty is an 
+ * array of these, and each one is published to the serial 
+ * ctls of the ASTRID_SERIAL_DEVICE_ID control table. Values 
+ * are scaled to the full range of uint32_t. */
+typedef struct lpserialctl_t {
+    uint32_t ctl;
+    uint32_t value;
+} lpserialctl_t;
+
+/* MIDI note maps
+ *
+ * The messages mapped to each note of a device live in a 
+ * shared memory table, so triggering a note only copies 
+ * messages out of memory. Readers never lock: each entry 
+ * has a seqlock and a removed entry just goes inactive, 
+ * which keeps the map indexes stable. Writers take a robust 
+ * process shared mutex. Changes bump `generation` and the 
+ * table is persisted to ASTRID_MIDIMAP_PATH whenever it 
+ * has moved past `saved`, and loaded from it when the 
+ * table is first created. 
+ *
+ * Notes are triggered once per device by the midistatus 
+ * listener (astrid/python/midistatus.py) or the triggernotemap 
+ * tool, never by instrument MIDI listeners: several instruments 
+ * can listen to the same device. */
+typedef struct lpnotemapentry_t {
+    atomic_uint seq;
+    atomic_int active;
+    lpmsg_t msg;
+} lpnotemapentry_t;
+
+typedef struct lpnotemap_t {
+    atomic_int loaded; /* 0 new, 1 loading, 2 ready */
+    atomic_uint generation;
+    atomic_uint saved;
+    pthread_mutex_t lock; /* taken by add and remove */
+    atomic_int counts[ASTRID_CTL_NUMNOTES]; /* entries in use, active or not */
+    lpnotemapentry_t entries[ASTRID_CTL_NUMNOTES][ASTRID_NOTEMAP_MAXMSGS];
+} lpnotemap_t;
+
+/* Param cache
+ *
+ * Session params live in a shared memory hash table in 
+ * front of LMDB, keyed by param index. Reads are plain 
+ * copies under a per slot seqlock, writes mark the slot 
+ * dirty and a background thread flushes every dirty slot 
+ * to LMDB in one transaction. Slots are claimed by a CAS 
+ * on `key` and never released while the instrument runs. 
+ *
+ * The audio thread never touches LMDB: a miss there returns 
+ * the default and leaves the slot claimed but unloaded for 
+ * the flusher thread to fill in. 
+ *
+ * There are two tables mapped side by side: restoring a 
+ * snapshot fills the idle one and swaps it in by storing 
+ * its index. Session snapshots are plain copies of a table 
+ * in their own shared memory segment. */
+typedef struct lpparamslot_t {
+    atomic_llong key;  /* param index + 1, or 0 while the slot is free */
+    atomic_uint seq;   /* odd while a writer is updating the value */
+    atomic_int loaded; /* the value has been read from LMDB or set */
+    atomic_int dirty;  /* changed since the last flush */
+    uint32_t size;
+    uint32_t type;     /* LPParamTypes, LPPARAM_NONE if unknown */
+    unsigned char value[ASTRID_PARAM_MAXSIZE];
+} lpparamslot_t;
+
+typedef struct lpparamcache_t {
+    lpparamslot_t slots[ASTRID_MAX_PARAMS];
+} lpparamcache_t;
+
+/* Both tables and the index of the live one share a segment, 
+ * so a swap is seen by every process. Each access counts 
+ * itself in on the live table, and a restore only overwrites 
+ * the idle table once the count for it has drained. */
+typedef struct lpparamtables_t {
+    atomic_int live;
+    atomic_int readers[2];
+    pthread_mutex_t lock; /* serializes restores */
+    pid_t owner; /* the process running the audio thread, and so the ramps */
+    lpparamcache_t tables[2];
+} lpparamtables_t;
+
+/* A session snapshot is a copy of a param table followed 
+ * by an overflow area for the params that didn't make it 
+ * into the table: values bigger than a slot, or params that 
+ * found it full. They are packed one after another, each 
+ * behind an lpparamoverflow_t and padded to 8 bytes, and 
+ * written back to LMDB on restore. A param that doesn't fit 
+ * in the overflow area either is logged and left out. */
+typedef struct lpparamoverflow_t {
+    int param_index;
+    uint32_t size; /* of the value following the record */
+} lpparamoverflow_t;
+
+typedef struct lpparamsnapshot_t {
+    lpparamcache_t table;
+    size_t overflow_used; /* in bytes */
+    unsigned char overflow[ASTRID_PARAM_SNAPSHOT_OVERFLOW];
+} lpparamsnapshot_t;
+
+/* Snapshot interpolation.
+ *
+ * Float and float list params present in both snapshots 
+ * are ramped from one to the other by the audio thread, 
+ * once per block. The other params switch immediately. 
+ * Morphs are handed to the audio thread through `pending` 
+ * and pushed onto the `retired` list to be freed by the 
+ * param flusher thread. A morph only writes to the table 
+ * it was made for, and is dropped once that table is idle. */
+typedef struct lpparammorphitem_t {
+    lpparamslot_t * slot;
+    size_t count;
+    lpfloat_t from[ASTRID_PARAM_MAXSIZE / sizeof(lpfloat_t)];
+    lpfloat_t to[ASTRID_PARAM_MAXSIZE / sizeof(lpfloat_t)];
+} lpparammorphitem_t;
+
+typedef struct lpparammorph_t {
+    struct lpparammorph_t * next; /* on the retired list */
+    int table; /* the one holding the item slots */
+    size_t length; /* in frames */
+    size_t elapsed;
+    int numitems;
+    lpparammorphitem_t items[];
+} lpparammorph_t;
+
+/* Streaming renders.
+ *
+ * A ring of interleaved frames in shared memory, written 
+ * chunk by chunk by a renderer while the mixer plays it back. 
+ * Playback begins once `lead` frames have been written (or the 
+ * writer is done) and the mixer outputs silence and counts an 
+ * underrun for every frame the writer falls behind by. */
+typedef struct lpstream_t {
+    size_t capacity; /* in frames */
+    size_t lead;     /* in frames */
+    int channels;
+    int samplerate;
+    atomic_size_t write_pos;
+    atomic_size_t read_pos;
+    atomic_size_t underruns;
+    atomic_int done;
+    lpfloat_t data[];
+} lpstream_t;
+
+/* Mix controls for a playing voice, sent with an LPMSG_VOICE 
+ * message: `m <instrument> voice=<id> gain=0.5 pan=0.2 time=2` 
+ * ramps gain and pan over two seconds, and fadein, fadeout, 
+ * stop and loop take effect the same way. Ramp lengths are 
+ * in frames here. */
+typedef struct lpvoicecmd_t {
+    size_t voice_id;
+    int flags; /* ASTRID_VOICE_* */
+    float gain;
+    float pan;
+    int loop;
+    size_t ramp_frames; /* for gain and pan */
+    size_t fade_frames;
+} lpvoicecmd_t;
+
+/* Single producer (the message thread), single consumer 
+ * (the mixer at the start of each block) */
+typedef struct lpvoicecmdqueue_t {
+    atomic_size_t head;
+    atomic_size_t tail;
+    lpvoicecmd_t cmds[ASTRID_VOICECMD_QUEUE_SIZE];
+} lpvoicecmdqueue_t;
+
+/* Per voice mix state, owned by the audio thread.
+ *
+ * Gain, pan and the fade envelope move toward their targets 
+ * at block rate: scheduler_begin_block works out the channel 
+ * gains at the start and end of the block and the mixer 
+ * steps between them every frame. Pan is a balance law, so 
+ * the centre is unity on both sides and a voice nobody has 
+ * touched mixes exactly as it was rendered. */
+typedef struct lpvoicemix_t {
+    float gain;
+    float gain_target;
+    size_t gain_frames; /* left on the ramp */
+    float pan; /* 0 is left, 1 is right */
+    float pan_target;
+    size_t pan_frames;
+    float fade;
+    float fade_target;
+    size_t fade_frames;
+    int release; /* stop once the fade reaches zero */
+    int loop;
+    int done;
+    float chgain[2]; /* even and odd channels at the current frame */
+    float chstep[2];
+} lpvoicemix_t;
+
 /* These events are what is stored in the 
  * scheduler's linked lists where it tracks 
  * which buffers are queued, playing, and 
@@ -112,7 +575,13 @@ typedef struct lpmidievent_t {
  * */
 typedef struct lpevent_t {
     size_t id;
+    size_t voice_id;
+    lpvoicemix_t mix;
     lpbuffer_t * buf;
+    uint64_t target_frame; /* when set, start at this JACK frame instead of onset */
+    lpstream_t * stream; /* streams are played in place of buf */
+    size_t stream_size;
+    size_t stream_avail;
     size_t pos;
     size_t onset;
     void * next;
@@ -122,6 +591,14 @@ typedef struct lpevent_t {
     int callback_fired;
 } lpevent_t;
 
+/* Placement error of events scheduled at a target frame */
+typedef struct lpjitterstats_t {
+    atomic_size_t count;      /* events placed */
+    atomic_size_t late;       /* events that started after their target */
+    atomic_size_t total_late; /* in frames */
+    atomic_size_t max_late;   /* in frames */
+} lpjitterstats_t;
+
 typedef struct lpscheduler_t {
     lpfloat_t * current_frame;
     int channels;
@@ -137,8 +614,133 @@ typedef struct lpscheduler_t {
     lpevent_t * waiting_queue_head;
     lpevent_t * playing_stack_head;
     lpevent_t * nursery_head;
+
+    /* JACK clock: the absolute frame of the current tick, 
+     * and the frame and monotonic time at the start of the 
+     * current cycle for converting timestamps into frames. 
+     * The audio thread writes the reference under clock_seq, 
+     * and the reference fields are atomic so readers on other 
+     * threads never see a torn value. */
+    uint64_t frame;
+    uint32_t cycle_frame;
+    atomic_uint clock_seq;
+    _Atomic uint64_t clock_frame;
+    _Atomic double clock_seconds;
+
+    lpjitterstats_t jitter;
+
+    lpvoicecmdqueue_t voicecmds;
 } lpscheduler_t;
 
+/* Message logs are a flat file of these, written by the 
+ * message thread when ASTRID_MSGLOG is set. The frame is 
+ * the mixer frame the message arrived on. */
+typedef struct lpmsglogrecord_t {
+    uint64_t frame;
+    lpmsg_t msg;
+} lpmsglogrecord_t;
+
+/* Headless driver.
+ *
+ * Stands in for JACK when ASTRID_OFFLINE is set: a clock 
+ * thread runs the same process callback on silent inputs, 
+ * either paced to the wall clock or as fast as it can go, 
+ * and the output is written to a WAV when the instrument 
+ * stops. Running flat out the clock is virtual, so 
+ * lpscheduler_get_now_seconds follows the frame count, and 
+ * before each block the driver waits for replayed messages 
+ * and their renders to land. A replayed log renders the 
+ * same way on every run. The clock lives in a shared 
+ * mapping so render processes forked from the instrument 
+ * read the same frame. */
+typedef struct lpofflineclock_t {
+    double start_seconds; /* monotonic time of frame 0 */
+    int samplerate;
+    _Atomic uint64_t frame;
+} lpofflineclock_t;
+
+typedef struct lpofflinedriver_t {
+    pthread_t thread;
+    int realtime;
+    int samplerate;
+    int blocksize;
+    double length; /* 0 runs until the instrument stops */
+    char outpath[PATH_MAX];
+    lpofflineclock_t * clock;
+    int has_seed; /* ASTRID_OFFLINE_SEED was set */
+    int seed;
+
+    FILE * replay;
+    lpmsglogrecord_t next;
+    int has_next;
+    uint64_t replay_offset; /* frame of the first record */
+
+    /* pipeline progress, see astrid_offline_settle */
+    atomic_size_t delivered;
+    atomic_size_t replayed;
+    atomic_size_t read;
+    atomic_size_t handled;
+    atomic_size_t plays;
+    atomic_size_t renders;
+
+    float ** inputs;
+    float ** outputs;
+    lpbuffer_t * out;
+    size_t outframes;
+
+    size_t blocks;
+    double wall_seconds;
+    double settle_seconds;
+    double max_settle_seconds;
+} lpofflinedriver_t;
+
+/* Block kernels work on four floats at a time with the 
+ * compiler's generic vectors, which lower to SSE or NEON 
+ * where they're available. Loads and stores go through the 
+ * unaligned type, since JACK doesn't promise alignment. */
+typedef float lpv4f_t __attribute__((vector_size(16)));
+typedef int32_t lpv4i_t __attribute__((vector_size(16)));
+typedef float lpv4fu_t __attribute__((vector_size(16), aligned(4), may_alias));
+
+/* Work submitted by a stream callback, see lpworkerpool_t */
+typedef struct lpworkerjob_t {
+    int (*run)(size_t blocksize, float ** input, float ** output, void * arg);
+    void * arg;
+    float ** output; /* private to the job, zeroed before it runs */
+} lpworkerjob_t;
+
+/* Realtime worker pool.
+ *
+ * Threads are spawned with the instrument at the JACK 
+ * priority and sleep on a futex between blocks. A stream 
+ * callback submits independent jobs (voice groups, sub-graphs) 
+ * during the block and astrid_instrument_join runs them: the 
+ * claim word packs the generation, the job count and the next 
+ * job index, so workers and the audio thread take jobs with a 
+ * CAS and never hold a lock. Each job renders into its own 
+ * scratch block and the join sums them in submission order, 
+ * so the mix doesn't depend on which thread ran what. */
+typedef struct lpworkerpool_t {
+    int numworkers;
+    pthread_t threads[ASTRID_WORKERS_MAX];
+    _Atomic uint32_t wake;     /* futex: bumped to start a generation */
+    _Atomic uint64_t claim;    /* generation:32 numjobs:16 next:16 */
+    _Atomic uint32_t pending;  /* futex: jobs not yet finished */
+    _Atomic uint32_t waiting;  /* the join is asleep on pending */
+    _Atomic int failed;
+    _Atomic int running;
+
+    uint32_t generation;
+    int numjobs;
+    lpworkerjob_t jobs[ASTRID_WORKER_MAXJOBS];
+
+    int channels;
+    size_t blocksize; /* frames in the current block */
+    size_t maxframes; /* scratch capacity per channel */
+    float ** input;
+    float * scratch;
+} lpworkerpool_t;
+
 typedef struct lpinstrument_t {
     char * name;
     int channels;
@@ -162,6 +764,15 @@ typedef struct lpinstrument_t {
     // the XDG config dir where LMDB sessions live
     char datapath[PATH_MAX]; 
 
+    // Cached session params, flushed to LMDB every 
+    // param_flush_interval seconds
+    lpparamtables_t * paramtables; // both tables, mapped
+    double param_flush_interval;
+    int param_flusher_wakefd; // eventfd: signalled to flush early or stop
+    lpparammorph_t * _Atomic parammorph_pending;
+    lpparammorph_t * _Atomic parammorph_retired;
+    lpparammorph_t * parammorph; // owned by the audio thread
+
     // The adc ringbuf name
     char adcname[PATH_MAX];
     lpbuffer_t * adcbuf; // mmaped pointer to adcbuf
@@ -173,14 +784,19 @@ typedef struct lpinstrument_t {
     char external_relay_name[NAME_MAX]; // just python, really 
     char serial_message_q_name[NAME_MAX]; 
     int ext_relay_enabled;
-    mqd_t msgq;
-    mqd_t exmsgq;
-    mqd_t serialmsgq;
+    lpmsgchannel_t msgchannel;
+    lpmsgchannel_t exmsgchannel;
+    lpmsgchannel_t serialchannel;
     lpmsg_t msg;
     lpmsg_t cmd;
 
     int midi_device_id;
 
+    // MIDI input for the stream callback, see lpmidiinevent_t
+    lpmidiinqueue_t midiin;
+    lpmidiinevent_t midi_events[ASTRID_MIDIIN_BLOCK_MAXEVENTS];
+    int num_midi_events;
+
     int tty_is_enabled;
     char tty_path[NAME_MAX]; 
 
@@ -188,6 +804,15 @@ typedef struct lpinstrument_t {
     pqueue_t * msgpq;
     lpmsgpq_node_t * pqnodes;
     int pqnode_index;
+    int seq_wakefd;  // eventfd: signalled when a message is inserted
+    int seq_timerfd; // timerfd: armed for the timestamp of the head
+
+    // Rolling window of render times, from dispatch to 
+    // arrival at the mixer, and its running percentile
+    double render_times[ASTRID_RENDER_WINDOW];
+    int render_times_index;
+    int render_times_count;
+    double render_estimate;
 
     // Thread refs
     pthread_t cleanup_thread;
@@ -195,6 +820,7 @@ typedef struct lpinstrument_t {
     pthread_t serial_listener_thread;
     pthread_t midi_listener_thread;
     pthread_t message_scheduler_pq_thread;
+    pthread_t param_flusher_thread;
     lpscheduler_t * async_mixer;
     lpbuffer_t * lastbuf;
 
@@ -203,6 +829,15 @@ typedef struct lpinstrument_t {
     jack_port_t ** outports;
     jack_client_t * jack_client;
 
+    // Headless driver when JACK is not in use
+    lpofflinedriver_t * offline;
+
+    // Incoming message log
+    FILE * msglog;
+
+    // Parallel jobs for the stream callback
+    lpworkerpool_t * workers;
+
     // Optional local context struct for callbacks
     void * context;
 
@@ -229,6 +864,13 @@ typedef struct lpparamset_t {
 } lpparamset_t;
 
 void scheduler_schedule_event(lpscheduler_t * s, lpbuffer_t * buf, size_t delay);
+void scheduler_schedule_stream(lpscheduler_t * s, lpstream_t * stream, size_t size, size_t delay, size_t voice_id);
+void scheduler_schedule_event_at(lpscheduler_t * s, lpbuffer_t * buf, uint64_t target_frame, size_t voice_id);
+int scheduler_send_voice_command(lpscheduler_t * s, lpvoicecmd_t * cmd);
+void scheduler_begin_block(lpscheduler_t * s, size_t nframes);
+void scheduler_sync_clock(lpscheduler_t * s, uint32_t cycle_frame, double cycle_seconds);
+uint64_t scheduler_seconds_to_frame(lpscheduler_t * s, double seconds);
+void scheduler_log_jitter(lpscheduler_t * s, const char * name);
 void lpscheduler_tick(lpscheduler_t * s);
 lpscheduler_t * scheduler_create(int, int, lpfloat_t);
 void scheduler_destroy(lpscheduler_t * s);
@@ -272,8 +914,103 @@ typedef struct lpastridctx_t {
     int is_looping;
 } lpastridctx_t;
 
+/* A shared memory slot for a rendered buffer.
+ *
+ * Renderers reserve a slot sized for the serialized 
+ * buffer, write the header, audio and message into it 
+ * directly, then commit it to hand it off to the mixer. */
+typedef struct lpbufferslot_t {
+    char buffer_code[LPKEY_MAXLENGTH];
+    int shmfd;
+    sem_t * sem;
+    unsigned char * data;
+    size_t size;
+} lpbufferslot_t;
+
+/* Latency histogram with power of two buckets: 
+ * bucket N counts latencies below 2^N microseconds, 
+ * and the last bucket holds everything slower. */
+typedef struct lplatencyhist_t {
+    atomic_size_t count;
+    atomic_size_t max_usec;
+    atomic_size_t buckets[ASTRID_LATENCY_BUCKETS];
+} lplatencyhist_t;
+
+typedef struct lprenderq_slot_t {
+    double pushed;
+    lpmsg_t msg;
+} lprenderq_slot_t;
+
+/* Render queue for the python renderer pool.
+ *
+ * A ring of play messages in an anonymous shared mapping. 
+ * It is created before the render processes are forked, so 
+ * every process shares the same ring and the same latency 
+ * histograms. The semaphores are process-shared. 
+ *
+ * The lock is a robust mutex so a renderer that dies holding 
+ * it doesn't wedge the pool. head and tail only ever count up 
+ * and each is moved with a single store, so the ring is 
+ * consistent wherever its owner died. The semaphores are only 
+ * wakeups: the counts are checked again under the lock. */
+typedef struct lprenderq_t {
+    pthread_mutex_t lock;
+    sem_t items;
+    sem_t spaces;
+    size_t head;
+    size_t tail;
+    lplatencyhist_t wait;   /* queued until a renderer picks it up */
+    lplatencyhist_t render; /* picked up until published */
+    lprenderq_slot_t slots[ASTRID_RENDERQ_SIZE];
+} lprenderq_t;
+
+/* Log-linear histogram, in the style of HdrHistogram: 
+ * values below 2^ASTRID_STATS_SUBBITS each get a bucket, 
+ * and every power of two above that is split into 
+ * 2^ASTRID_STATS_SUBBITS linear sub-buckets. */
+typedef struct lpstatshist_t {
+    atomic_size_t count;
+    atomic_size_t sum;
+    atomic_size_t max;
+    atomic_size_t buckets[ASTRID_STATS_NUMBUCKETS];
+} lpstatshist_t;
+
+/* Instrument stats page.
+ *
+ * Each running instrument keeps one of these in a shared 
+ * memory segment named after it (see ASTRID_STATS_NAME) so 
+ * astrid-stats can sample it from outside. Every field is 
+ * written with relaxed atomics from whichever thread owns 
+ * the event, and read without any locking. */
+typedef struct lpstats_t {
+    uint32_t magic;
+    pid_t pid;
+    char name[LPMAXNAME];
+    double started; /* monotonic seconds */
+    int channels;
+    atomic_int samplerate;
+    atomic_int blocksize;
+
+    atomic_size_t callbacks;
+    atomic_size_t xruns;
+    atomic_size_t active_voices;
+    atomic_size_t max_voices;
+    atomic_size_t messages;
+    atomic_size_t renders;
+    atomic_size_t msgq_bytes;    /* message ring bytes in use after the last read */
+    atomic_size_t msgq_max_bytes;
+    atomic_size_t renderq_depth;
+    atomic_size_t renderq_max_depth;
+
+    lpstatshist_t callback_ns;  /* JACK callback durations */
+    lpstatshist_t render_usec;  /* play message initiated until its render arrives */
+    lpstatshist_t sem_wait_ns;  /* waits on shared memory locks */
+} lpstats_t;
 
 
+
+size_t serialize_buffer_size(size_t length, int channels);
+size_t serialize_buffer_header(unsigned char * str, size_t length, int channels, int samplerate, int is_looping, size_t onset);
 unsigned char * serialize_buffer(lpbuffer_t * buf, lpmsg_t * msg, size_t * strsize); 
 lpbuffer_t * deserialize_buffer(char * buffer_code, lpmsg_t * msg); 
 
@@ -282,13 +1019,12 @@ int parse_message_from_cmdline(char * cmdline, size_t cmdlength, lpmsg_t * msg);
 
 ssize_t astrid_get_voice_id();
 
-int decode_update_message_param(lpmsg_t * msg, uint16_t * id, float * value);
-int encode_update_message_param(lpmsg_t * msg);
-
 int init_instrument_message(lpmsg_t * msg, char * instrument_name);
 int send_message(char * qname, lpmsg_t msg);
 int send_play_message(lpmsg_t msg);
 int send_serial_message(lpmsg_t msg);
+int send_messages(char * qname, lpmsg_t * msgs, int count);
+int send_play_messages(lpmsg_t * msgs, int count);
 int get_play_message(char * instrument_name, lpmsg_t * msg);
 
 mqd_t astrid_playq_open(const char * instrument_name);
@@ -299,19 +1035,41 @@ mqd_t astrid_msgq_open(char * qname);
 int astrid_msgq_close(mqd_t mqd);
 int astrid_msgq_read(mqd_t mqd, lpmsg_t * msg);
 
+int astrid_names_intern(const char * name);
+const char * astrid_names_lookup(int id);
+
+size_t astrid_wire_encode(lpmsg_t * msg, unsigned char * out);
+int astrid_wire_view(const unsigned char * buf, size_t size, lpmsgview_t * view);
+int astrid_wire_decode(const unsigned char * buf, size_t size, lpmsg_t * msg);
+
+int astrid_params_encode(lpmsg_t * msg);
+int astrid_params_next(const char * params, size_t * pos, lpmsgparam_t * param);
+int astrid_params_decode(const char * params, char * out, size_t size);
+int process_param_updates(lpinstrument_t * instrument);
+
+int astrid_msgchannel_open(lpmsgchannel_t * channel, char * qname);
+int astrid_msgchannel_pop(lpmsgchannel_t * channel, lpmsg_t * msg);
+int astrid_msgchannel_prepare_wait(lpmsgchannel_t * channel);
+void astrid_msgchannel_finish_wait(lpmsgchannel_t * channel);
+int astrid_msgchannel_read(lpmsgchannel_t * channel, lpmsg_t * msg);
+int astrid_msgchannel_close(lpmsgchannel_t * channel);
+
 
 /* TODO add POSIX message queues for these too */
 int midi_triggerq_open();
 int midi_triggerq_schedule(int qfd, lpmidievent_t t);
 int midi_triggerq_close(int qfd);
 
+lpctltable_t * lpctl_get_table(int device_id);
 int lpmidi_setcc(int device_id, int cc, int value);
 int lpmidi_getcc(int device_id, int cc);
 int lpmidi_setnote(int device_id, int note, int velocity);
 int lpmidi_getnote(int device_id, int note);
 
+lpnotemap_t * lpmidi_get_notemap(int device_id);
 int lpmidi_add_msg_to_notemap(int device_id, int note, lpmsg_t msg);
 int lpmidi_remove_msg_from_notemap(int device_id, int note, int index);
+int lpmidi_save_notemap(int device_id);
 int lpmidi_print_notemap(int device_id, int note);
 int lpmidi_trigger_notemap(int device_id, int note);
 int lpmidi_relay_to_instrument(char * instrument_name, unsigned char mtype, unsigned char mid, unsigned char mval);
@@ -320,6 +1078,9 @@ int lpmidi_get_device_id_by_name(const char * device_name);
 
 int lpserial_setctl(int device_id, int param_id, size_t value);
 int lpserial_getctl(int device_id, int ctl, lpfloat_t * value);
+double lpmidi_getcc_time(int device_id, int cc);
+double lpmidi_getnote_time(int device_id, int note);
+double lpserial_getctl_time(int device_id, int ctl);
 
 int astrid_get_playback_device_id();
 int astrid_get_capture_device_id();
@@ -345,6 +1106,18 @@ int lpipc_destroyvalue(char * id_path);
 
 void lptimeit_since(struct timespec * start);
 
+void astrid_block_denormals_zero(void);
+void astrid_block_sanitize(float * block, size_t nframes);
+void astrid_block_clamp(float * block, size_t nframes, float low, float high);
+void astrid_block_interleave(float ** channels_in, int channels, size_t nframes, lpfloat_t * out);
+
+void astrid_log_write(int level, const char * fmt, ...) __attribute__((format(printf, 2, 3)));
+int astrid_log_start(FILE * out);
+int astrid_log_stop(void);
+
+int astrid_robust_mutex_init(pthread_mutex_t * lock);
+int astrid_robust_mutex_lock(pthread_mutex_t * lock, const char * name); /* 1 if it was recovered from a dead owner */
+
 lpinstrument_t * astrid_instrument_start(
         char * name, 
         int channels, 
@@ -362,7 +1135,14 @@ lpinstrument_t * astrid_instrument_start(
 
 int astrid_instrument_stop(lpinstrument_t * instrument);
 
+lpworkerpool_t * astrid_workers_create(int numworkers, int channels, size_t maxframes, int priority);
+int astrid_workers_destroy(lpworkerpool_t * pool);
+int astrid_instrument_submit(lpinstrument_t * instrument, int (*run)(size_t blocksize, float ** input, float ** output, void * arg), void * arg);
+int astrid_instrument_join(lpinstrument_t * instrument, float ** output);
+
 lpparamset_t astrid_instrument_create_paramset(char * paramset_defs);
+int astrid_instrument_flush_params(lpinstrument_t * instrument);
+int astrid_instrument_load_params(lpinstrument_t * instrument);
 int32_t astrid_instrument_get_param_int32(lpinstrument_t * instrument, int param_index, int32_t default_value);
 void astrid_instrument_set_param_int32(lpinstrument_t * instrument, int param_index, int32_t value);
 void astrid_instrument_set_param_patternbuf(lpinstrument_t * instrument, int param_index, lppatternbuf_t * patternbuf);
@@ -375,13 +1155,44 @@ lpfloat_t astrid_instrument_get_param_float_list_item(lpinstrument_t * instrumen
 
 int astrid_instrument_restore_param_session_snapshot(lpinstrument_t * instrument, int snapshot_id);
 int astrid_instrument_save_param_session_snapshot(lpinstrument_t * instrument, int num_params, int snapshot_id);
+int astrid_instrument_interpolate_param_session_snapshots(lpinstrument_t * instrument, int from_snapshot_id, int to_snapshot_id, double seconds);
 
 int astrid_instrument_tick(lpinstrument_t * instrument);
+int astrid_offline_seed(lpinstrument_t * instrument, size_t stream);
 int astrid_instrument_session_open(lpinstrument_t * instrument);
 int astrid_instrument_session_close(lpinstrument_t * instrument);
+int astrid_instrument_reserve_bufstr(char * instrument_name, size_t size, lpbufferslot_t * slot);
+int astrid_instrument_commit_bufstr(char * instrument_name, lpbufferslot_t * slot);
 int astrid_instrument_publish_bufstr(char * instrument_name, unsigned char * bufstr, size_t size);
+
+int astrid_instrument_stream_open(char * instrument_name, int channels, int samplerate, size_t capacity, size_t lead, lpbufferslot_t * slot);
+ssize_t astrid_stream_wait(lpstream_t * stream, double timeout);
+void astrid_stream_commit(lpstream_t * stream, size_t frames);
+int astrid_instrument_stream_close(lpbufferslot_t * slot);
+lpstream_t * astrid_stream_attach(char * stream_code, size_t * size);
+
+lprenderq_t * astrid_renderq_create(void);
+int astrid_renderq_push(lprenderq_t * q, lpmsg_t * msg);
+int astrid_renderq_push_wait(lprenderq_t * q, lpmsg_t * msg);
+int astrid_renderq_pop(lprenderq_t * q, lpmsg_t * msg, double * wait);
+size_t astrid_latency_record(lplatencyhist_t * h, double seconds);
+double astrid_latency_percentile(lplatencyhist_t * h, double percentile);
+void astrid_renderq_log_stats(lprenderq_t * q, const char * name);
+
+lpstats_t * astrid_stats_open(const char * name, int channels, int samplerate, int blocksize);
+int astrid_stats_close(lpstats_t * stats);
+lpstats_t * astrid_stats_attach(const char * shmname);
+int astrid_stats_detach(lpstats_t * stats);
+void astrid_stats_hist_record(lpstatshist_t * h, size_t value);
+size_t astrid_stats_hist_percentile(lpstatshist_t * h, double percentile);
+void astrid_stats_gauge(atomic_size_t * gauge, atomic_size_t * max, size_t value);
+int astrid_renderq_destroy(lprenderq_t * q);
+
+int astrid_instrument_watch(const char * path);
+int astrid_instrument_watch_changed(int fd, const char * path);
 int send_render_to_mixer(lpinstrument_t * instrument, lpbuffer_t * buf);
 int relay_message_to_seq(lpinstrument_t * instrument, lpmsg_t msg);
+void astrid_instrument_record_render_time(lpinstrument_t * instrument, double render_time);
 
 int extract_int32_from_token(char * token, int32_t * val);
 int extract_float_from_token(char * token, float * val);
@@ -4,7 +4,7 @@ int main(int argc, char * argv[]) {
     int device_id, note, map_index;
 
     if(argc != 4) {
-        fprintf(stderr, "Usage: %s <device_id:int> <note:int> <map_index:int> (argc: %d)\n", argv[0], argc);
+        fprintf(stderr, "Usage: %s <device_id:int> <note:int> <map_index:int, -1 for all> (argc: %d)\n", argv[0], argc);
         return 1;
     }
 
@@ -17,6 +17,11 @@ int main(int argc, char * argv[]) {
         return 1;
     }
 
+    if(lpmidi_save_notemap(device_id) < 0) {
+        fprintf(stderr, "Could not save notemap\n");
+        return 1;
+    }
+
     if(lpmidi_print_notemap(device_id, note) < 0) {
         fprintf(stderr, "Could not print notemap\n");
         return 1;
@@ -0,0 +1,158 @@
+#include <dirent.h>
+#include "astrid.h"
+
+#define STATS_PREFIX "astrid-stats-"
+
+static double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static void print_hist_json(const char * name, lpstatshist_t * h, int last) {
+    size_t count, i;
+
+    count = atomic_load(&h->count);
+    printf("      \"%s\": {\"count\": %ld, \"mean\": %.2f, \"max\": %ld", name,
+        count,
+        (count > 0) ? (double)atomic_load(&h->sum) / count : 0.f,
+        atomic_load(&h->max)
+    );
+
+    for(i=0; i < sizeof(percentiles) / sizeof(double); i++) {
+        printf(", \"p%g\": %ld", percentiles[i] * 100, astrid_stats_hist_percentile(h, percentiles[i]));
+    }
+    printf("}%s\n", last ? "" : ",");
+}
+
+static void print_hist(const char * name, const char * unit, lpstatshist_t * h) {
+    size_t count, i;
+
+    count = atomic_load(&h->count);
+    printf("  %-12s n=%-10ld mean=%.1f%s", name, count, (count > 0) ? (double)atomic_load(&h->sum) / count : 0.f, unit);
+    for(i=0; i < sizeof(percentiles) / sizeof(double); i++) {
+        printf(" p%g=%ld%s", percentiles[i] * 100, astrid_stats_hist_percentile(h, percentiles[i]), unit);
+    }
+    printf(" max=%ld%s\n", atomic_load(&h->max), unit);
+}
+
+static void print_stats_json(lpstats_t * stats, double uptime, int last) {
+    printf("    {\n");
+    printf("      \"name\": \"%s\",\n", stats->name);
+    printf("      \"pid\": %d,\n", (int)stats->pid);
+    printf("      \"uptime\": %.3f,\n", uptime);
+    printf("      \"channels\": %d,\n", stats->channels);
+    printf("      \"samplerate\": %d,\n", atomic_load(&stats->samplerate));
+    printf("      \"blocksize\": %d,\n", atomic_load(&stats->blocksize));
+    printf("      \"callbacks\": %ld,\n", atomic_load(&stats->callbacks));
+    printf("      \"xruns\": %ld,\n", atomic_load(&stats->xruns));
+    printf("      \"active_voices\": %ld,\n", atomic_load(&stats->active_voices));
+    printf("      \"max_voices\": %ld,\n", atomic_load(&stats->max_voices));
+    printf("      \"messages\": %ld,\n", atomic_load(&stats->messages));
+    printf("      \"renders\": %ld,\n", atomic_load(&stats->renders));
+    printf("      \"msgq_bytes\": %ld,\n", atomic_load(&stats->msgq_bytes));
+    printf("      \"msgq_max_bytes\": %ld,\n", atomic_load(&stats->msgq_max_bytes));
+    printf("      \"renderq_depth\": %ld,\n", atomic_load(&stats->renderq_depth));
+    printf("      \"renderq_max_depth\": %ld,\n", atomic_load(&stats->renderq_max_depth));
+    print_hist_json("callback_ns", &stats->callback_ns, 0);
+    print_hist_json("render_usec", &stats->render_usec, 0);
+    print_hist_json("sem_wait_ns", &stats->sem_wait_ns, 1);
+    printf("    }%s\n", last ? "" : ",");
+}
+
+static void print_stats(lpstats_t * stats, double uptime) {
+    int samplerate, blocksize;
+    double budget_ns = 0;
+
+    samplerate = atomic_load(&stats->samplerate);
+    blocksize = atomic_load(&stats->blocksize);
+    if(samplerate > 0) budget_ns = (double)blocksize / samplerate * 1000000000;
+
+    printf("%s (pid %d) up %.1fs, %d channels, %d frames @ %dhz\n", stats->name, (int)stats->pid, uptime, stats->channels, blocksize, samplerate);
+    printf("  callbacks=%ld xruns=%ld voices=%ld (max %ld) messages=%ld renders=%ld\n",
+        atomic_load(&stats->callbacks), atomic_load(&stats->xruns),
+        atomic_load(&stats->active_voices), atomic_load(&stats->max_voices),
+        atomic_load(&stats->messages), atomic_load(&stats->renders)
+    );
+    printf("  msgq=%ld bytes (max %ld) renderq=%ld (max %ld)\n",
+        atomic_load(&stats->msgq_bytes), atomic_load(&stats->msgq_max_bytes),
+        atomic_load(&stats->renderq_depth), atomic_load(&stats->renderq_max_depth)
+    );
+    print_hist("callback", "ns", &stats->callback_ns);
+    if(budget_ns > 0) {
+        printf("  %-12s p99 is %.1f%% of the %.0fns block budget\n", "",
+            astrid_stats_hist_percentile(&stats->callback_ns, 0.99) / budget_ns * 100, budget_ns);
+    }
+    print_hist("render", "us", &stats->render_usec);
+    print_hist("sem wait", "ns", &stats->sem_wait_ns);
+}
+
+static int sample_instruments(int json, const char * only) {
+    char shmname[NAME_MAX+2];
+    lpstats_t * pages[ASTRID_MAXNAMES];
+    struct dirent * entry;
+    double now = 0;
+    int count = 0, i;
+    DIR * dir;
+
+    if((dir = opendir(ASTRID_STATS_SHMDIR)) == NULL) {
+        fprintf(stderr, "Could not open %s. (%d) %s\n", ASTRID_STATS_SHMDIR, errno, strerror(errno));
+        return -1;
+    }
+
+    while((entry = readdir(dir)) != NULL && count < ASTRID_MAXNAMES) {
+        if(strncmp(entry->d_name, STATS_PREFIX, strlen(STATS_PREFIX)) != 0) continue;
+        if(only != NULL && strcmp(entry->d_name + strlen(STATS_PREFIX), only) != 0) continue;
+
+        snprintf(shmname, sizeof(shmname), "/%s", entry->d_name);
+        if((pages[count] = astrid_stats_attach(shmname)) == NULL) continue;
+        count += 1;
+    }
+    closedir(dir);
+
+    lpscheduler_get_now_seconds(&now);
+
+    if(json) printf("{\n  \"sampled\": %.6f,\n  \"instruments\": [\n", now);
+    for(i=0; i < count; i++) {
+        if(json) {
+            print_stats_json(pages[i], now - pages[i]->started, i == count-1);
+        } else {
+            print_stats(pages[i], now - pages[i]->started);
+        }
+        astrid_stats_detach(pages[i]);
+    }
+    if(json) printf("  ]\n}\n");
+
+    if(!json && count == 0) printf("No running instruments\n");
+
+    return count;
+}
+
+int main(int argc, char * argv[]) {
+    char * only = NULL;
+    double interval = 0;
+    int json = 0, opt;
+
+    while((opt = getopt(argc, argv, "jw:")) != -1) {
+        switch(opt) {
+            case 'j':
+                json = 1;
+                break;
+            case 'w':
+                interval = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-j] [-w <seconds:float>] [instrument_name]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if(optind < argc) only = argv[optind];
+
+    while(1) {
+        if(sample_instruments(json, only) < 0) return 1;
+        if(interval <= 0) break;
+
+        fflush(stdout);
+        usleep((useconds_t)(interval * 1000000));
+        if(!json) printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "astrid.h"
+
+/* Drives the scheduler's voice mixer a block at a time and
+ * checks the gain ramps, the pan law and looping against
+ * the numbers they should come out to. */
+
+#define TEST_VOICE 5
+#define TEST_BLOCKSIZE 64
+#define TEST_LENGTH 256 /* frames in the looping buffer */
+
+static float left[TEST_BLOCKSIZE];
+static float right[TEST_BLOCKSIZE];
+
+/* Schedules a stereo buffer for the test voice where every 
+ * frame holds its own index, or a long one of all 1s when flat */
+static lpscheduler_t * setup(int flat) {
+    lpscheduler_t * s;
+    lpbuffer_t * buf;
+    size_t i, length = flat ? TEST_LENGTH * 4 : TEST_LENGTH;
+
+    s = scheduler_create(0, 2, 48000);
+    buf = LPBuffer.create(length, 2, 48000);
+    for(i=0; i < length; i++) {
+        buf->data[i * 2] = buf->data[i * 2 + 1] = flat ? 1.f : (lpfloat_t)i;
+    }
+
+    scheduler_schedule_event_at(s, buf, 0, TEST_VOICE);
+    return s;
+}
+
+static void send(lpscheduler_t * s, int flags, float gain, float pan, int loop, size_t ramp_frames, size_t fade_frames) {
+    lpvoicecmd_t cmd = {0};
+
+    cmd.voice_id = TEST_VOICE;
+    cmd.flags = flags;
+    cmd.gain = gain;
+    cmd.pan = pan;
+    cmd.loop = loop;
+    cmd.ramp_frames = ramp_frames;
+    cmd.fade_frames = fade_frames;
+    scheduler_send_voice_command(s, &cmd);
+}
+
+static void run_block(lpscheduler_t * s) {
+    size_t i;
+
+    scheduler_begin_block(s, TEST_BLOCKSIZE);
+    for(i=0; i < TEST_BLOCKSIZE; i++) {
+        lpscheduler_tick(s);
+        left[i] = (float)s->current_frame[0];
+        right[i] = (float)s->current_frame[1];
+    }
+}
+
+static int check(const char * what, int frame, float got, float expected) {
+    if(fabsf(got - expected) > 1e-4f) {
+        printf("FAIL %s: frame %d is %f, expected %f\n", what, frame, got, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int test_ramp(void) {
+    lpscheduler_t * s = setup(1);
+    int i, b, failures = 0;
+    float step = 0.5f / (2 * TEST_BLOCKSIZE);
+
+    /* a voice nobody has touched plays at unity on both sides */
+    run_block(s);
+    for(i=0; i < TEST_BLOCKSIZE; i++) {
+        failures += check("untouched left", i, left[i], 1.f);
+        failures += check("untouched right", i, right[i], 1.f);
+    }
+
+    /* gain=0.5 over two blocks is a straight line, one step per frame */
+    send(s, ASTRID_VOICE_SET_GAIN, 0.5f, 0.f, 0, 2 * TEST_BLOCKSIZE, 0);
+    for(b=0; b < 2; b++) {
+        run_block(s);
+        for(i=0; i < TEST_BLOCKSIZE; i++) {
+            failures += check("gain ramp", b * TEST_BLOCKSIZE + i, left[i], 1.f - (b * TEST_BLOCKSIZE + i) * step);
+        }
+    }
+
+    run_block(s);
+    failures += check("gain after the ramp", 0, left[0], 0.5f);
+    failures += check("gain after the ramp", TEST_BLOCKSIZE-1, right[TEST_BLOCKSIZE-1], 0.5f);
+
+    scheduler_destroy(s);
+    return failures;
+}
+
+static int test_pan(void) {
+    lpscheduler_t * s = setup(1);
+    int failures = 0;
+
+    /* balance law: the near side stays at unity, the far side drops */
+    send(s, ASTRID_VOICE_SET_PAN, 0.f, 0.25f, 0, 0, 0);
+    run_block(s);
+    failures += check("pan 0.25 left", 0, left[0], 1.f);
+    failures += check("pan 0.25 right", 0, right[0], 0.5f);
+
+    send(s, ASTRID_VOICE_SET_PAN | ASTRID_VOICE_SET_GAIN, 0.5f, 1.f, 0, 0, 0);
+    run_block(s);
+    failures += check("hard right left", 0, left[0], 0.f);
+    failures += check("hard right right", 0, right[0], 0.5f);
+
+    scheduler_destroy(s);
+    return failures;
+}
+
+static int test_loop(void) {
+    lpscheduler_t * s = setup(0);
+    int i, b, failures = 0;
+
+    /* wraps back to the first frame instead of stopping */
+    send(s, ASTRID_VOICE_SET_LOOP, 0.f, 0.f, 1, 0, 0);
+    for(b=0; b < (TEST_LENGTH / TEST_BLOCKSIZE) * 2; b++) {
+        run_block(s);
+        for(i=0; i < TEST_BLOCKSIZE; i++) {
+            failures += check("loop", b * TEST_BLOCKSIZE + i, left[i], (float)((b * TEST_BLOCKSIZE + i) % TEST_LENGTH));
+        }
+    }
+
+    /* stop fades out over the fade, then the voice is gone */
+    send(s, ASTRID_VOICE_FADEOUT, 0.f, 0.f, 0, 0, TEST_BLOCKSIZE);
+    run_block(s);
+    failures += check("fadeout start", 0, left[0], 0.f);
+    failures += check("fadeout middle", TEST_BLOCKSIZE/2, left[TEST_BLOCKSIZE/2], (TEST_BLOCKSIZE/2) * 0.5f);
+    run_block(s);
+    run_block(s);
+    if(s->playing_stack_head != NULL) {
+        printf("FAIL looping voice still playing after its fadeout\n");
+        failures++;
+    }
+
+    scheduler_destroy(s);
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+
+    failures += test_ramp();
+    failures += test_pan();
+    failures += test_loop();
+
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures > 0;
+}
@@ -0,0 +1,134 @@
+#include "astrid.h"
+
+/* Round trips messages through the compact wire format,
+ * and update params through the typed encoding back to the
+ * text the update callback (and the message log) sees. */
+
+static char received[LPMAXMSG];
+
+static int record_update(void * instrument, char * key, char * val) {
+    size_t len = strlen(received);
+    (void)instrument;
+    snprintf(received + len, LPMAXMSG - len, "%s%s=%s", len > 0 ? " " : "", key, val);
+    return 0;
+}
+
+static int test_messages(void) {
+    lpmsg_t msg, out;
+    unsigned char wire[sizeof(lpmsg_t)];
+    size_t size;
+    int i, k, len, failures = 0;
+
+    srand(3);
+    for(i=0; i < 5000; i++) {
+        memset(&msg, 0, sizeof(lpmsg_t));
+        msg.initiated = (i % 3) ? rand() / 3.0 : 0;
+        msg.scheduled = (i % 5) ? 0.25 * i : 0;
+        msg.max_processing_time = (i % 2) ? 0.1 : 0;
+        msg.onset_delay = i % 11;
+        msg.target_frame = (uint64_t)i * 1234567ULL;
+        msg.voice_id = i * 7;
+        msg.count = i;
+        msg.type = i % 12;
+        if(i % 2) strcpy(msg.instrument_name, "wiretest");
+
+        len = (i * 13) % ((i % 100 == 0) ? LPMAXMSG : 300);
+        for(k=0; k < len; k++) msg.msg[k] = (char)(rand() % 256);
+
+        if((size = astrid_wire_encode(&msg, wire)) == 0) {
+            memcpy(wire, &msg, sizeof(lpmsg_t));
+            size = sizeof(lpmsg_t);
+        }
+
+        if(astrid_wire_decode(wire, size, &out) < 0
+        || memcmp(&msg, &out, offsetof(lpmsg_t, msg)) != 0
+        || memcmp(msg.msg, out.msg, LPMAXMSG) != 0
+        || strncmp(msg.instrument_name, out.instrument_name, LPMAXNAME) != 0) {
+            printf("FAIL message %d did not survive the wire (%ld bytes)\n", i, size);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static int test_update(char * params, char * expected) {
+    lpinstrument_t instrument = {0};
+    lpmsg_t msg = {0};
+    unsigned char wire[sizeof(lpmsg_t)];
+    size_t size;
+
+    strcpy(msg.instrument_name, "wiretest");
+    strcpy(msg.msg, params);
+    msg.type = LPMSG_UPDATE;
+
+    if(astrid_params_encode(&msg) < 0 || (size = astrid_wire_encode(&msg, wire)) == 0) {
+        printf("FAIL could not encode '%s'\n", params);
+        return 1;
+    }
+
+    if(astrid_wire_decode(wire, size, &instrument.msg) < 0) {
+        printf("FAIL could not decode '%s'\n", params);
+        return 1;
+    }
+
+    received[0] = '\0';
+    instrument.update = record_update;
+    if(process_param_updates(&instrument) < 0 || strcmp(received, expected) != 0) {
+        printf("FAIL '%s' arrived as '%s', expected '%s'\n", params, received, expected);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_param_types(void) {
+    lpmsg_t msg = {0};
+    lpmsgparam_t param;
+    size_t pos = 0;
+    int failures = 0;
+    int types[] = {LPPARAM_INT32, LPPARAM_STRING, LPPARAM_DOUBLE, LPPARAM_STRING, LPPARAM_STRING, LPPARAM_NONE};
+
+    strcpy(msg.msg, "a=-12 b=0110 c=0.1 d=1.0 e=0x10 f");
+    if(astrid_params_encode(&msg) < 0) return 1;
+
+    while(astrid_params_next(msg.msg, &pos, &param) > 0) {
+        if(param.type != types[param.key[0] - 'a']) {
+            printf("FAIL param %.*s has type %d\n", (int)param.keylen, param.key, param.type);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static int test_decode(char * params) {
+    lpmsg_t msg = {0};
+    char text[LPMAXMSG];
+
+    strcpy(msg.msg, params);
+    if(astrid_params_encode(&msg) < 0 || astrid_params_decode(msg.msg, text, LPMAXMSG) < 0 || strcmp(text, params) != 0) {
+        printf("FAIL '%s' decoded as '%s'\n", params, text);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    int failures = 0;
+
+    failures += test_messages();
+    failures += test_param_types();
+
+    failures += test_update("freq=440 amp=0.5 neg=-12 name=hello", "freq=440 amp=0.5 neg=-12 name=hello");
+    failures += test_update("pattern=0110 hex=0x10 one=1.0", "pattern=0110 hex=0x10 one=1.0");
+    failures += test_update("third=0.3333333333333333 tiny=1e-07 big=99999999999", "third=0.3333333333333333 tiny=1e-07 big=99999999999");
+    failures += test_update("bare level=-0.25", "level=-0.25");
+
+    failures += test_decode("freq=440 amp=0.5 name=hello");
+    failures += test_decode("bare pattern=0110 third=0.3333333333333333");
+
+    printf("%s\n", failures == 0 ? "ok" : "FAILED");
+    return failures > 0;
+}
@@ -43,6 +43,7 @@ void grain_init(lpgrain_t * grain, lpbuffer_t * src, lpbuffer_t * win) {
     grain->channels = src->channels;
     grain->samplerate = src->samplerate;
     grain->pulsewidth = 1.f;
+    LPRNG.init(&grain->rng, (uint64_t)(LPRand.rand(0, 1) * 0x1.0p53));
 }
 
 lpformation_t * formation_create(int numgrains, lpbuffer_t * src, lpbuffer_t * win) {
@@ -64,6 +65,8 @@ lpformation_t * formation_create(int numgrains, lpbuffer_t * src, lpbuffer_t * w
     f->offset = offset;
     f->speed = speed;
     f->pan = pan;
+    f->amp = 1.f;
+    f->increment = (size_t)(grainlength * src->samplerate);
     
     phaseinc = 1.f/numgrains;
     for(g=0; g < numgrains; g++) {
@@ -115,7 +118,353 @@ void formation_process(lpformation_t * f) {
     while(f->offset >= f->grains[0].src->buf->length) f->offset -= f->grains[0].src->buf->length;
 }
 
+typedef struct lpformationworker_t {
+    struct lpformationrender_t * r;
+    int id;
+} lpformationworker_t;
+
+/* Render state and worker threads, kept on the formation 
+ * between calls to render so the pool is only started once. */
+typedef struct lpformationrender_t {
+    lpformation_t * f;
+    lpformationctl_t * frames; /* per-frame control values for the current chunk */
+    lpfloat_t * scratch; /* one chunk of output per grain */
+    lpbuffer_t ** grainframes; /* one single frame buffer per thread */
+    lpfloat_t * out;
+    size_t nframes;
+    int numthreads; /* threads actually running, including the caller */
+    int requested; /* numthreads asked for when the pool was started */
+    int done;
+    int generation;
+    pthread_t * threads;
+    lpformationworker_t * workers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_barrier_t barrier;
+} lpformationrender_t;
+
+/* Same as the param update in formation_process, but 
+ * using per-frame control values and the grain's own stream */
+static void grain_trigger(lpgrain_t * g, lpformationctl_t * ctl, lpfloat_t pan) {
+    g->pulsewidth = ctl->pulsewidth;
+    g->src->speed = ctl->speed;
+
+    if(ctl->spread > 0) {
+        g->pan = .5f + LPRNG.rand(&g->rng, -.5f, .5f) * ctl->spread;
+    } else {
+        g->pan = pan;
+    }
+
+    if(ctl->grainlength_jitter > 0) {
+        g->grainlength = ctl->grainlength + (size_t)LPRNG.rand(&g->rng, 0, ctl->grainlength_jitter * ctl->grainlength_maxjitter);
+    } else {
+        g->grainlength = ctl->grainlength;
+    }
+
+    if(ctl->grid_jitter > 0) {
+        g->offset = ctl->offset + (size_t)LPRNG.rand(&g->rng, 0, ctl->grid_jitter * ctl->grid_maxjitter);
+    } else {
+        g->offset = ctl->offset;
+    }
+}
+
+/* Jump directly to the given control values without smoothing */
+void formation_setctl(lpformation_t * f, lpformationctl_t * ctl) {
+    f->amp = ctl->amp;
+    f->pulsewidth = ctl->pulsewidth;
+    f->grainlength = ctl->grainlength;
+    f->grainlength_jitter = ctl->grainlength_jitter;
+    f->grainlength_maxjitter = ctl->grainlength_maxjitter;
+    f->speed = ctl->speed;
+    f->spread = ctl->spread;
+    f->grid_jitter = ctl->grid_jitter;
+    f->grid_maxjitter = ctl->grid_maxjitter;
+    f->grid = ctl->grid;
+    if(!f->gridincrement) f->offset = ctl->offset;
+}
+
+static void formation_getctl(lpformation_t * f, lpformationctl_t * ctl) {
+    ctl->amp = f->amp;
+    ctl->pulsewidth = f->pulsewidth;
+    ctl->grainlength = f->grainlength;
+    ctl->grainlength_jitter = f->grainlength_jitter;
+    ctl->grainlength_maxjitter = f->grainlength_maxjitter;
+    ctl->speed = f->speed;
+    ctl->spread = f->spread;
+    ctl->grid_jitter = f->grid_jitter;
+    ctl->grid_maxjitter = f->grid_maxjitter;
+    ctl->grid = f->grid;
+    ctl->offset = f->offset;
+}
+
+/* Per-frame increments to ramp from the current params to ctl over nframes */
+static void formation_ramp(lpformation_t * f, lpformationctl_t * ctl, lpformationctl_t * inc, size_t nframes) {
+    lpfloat_t ib = 1.f / nframes;
+
+    inc->amp = (ctl->amp - f->amp) * ib;
+    inc->pulsewidth = (ctl->pulsewidth - f->pulsewidth) * ib;
+    inc->grainlength = (ctl->grainlength - f->grainlength) * ib;
+    inc->grainlength_jitter = (ctl->grainlength_jitter - f->grainlength_jitter) * ib;
+    inc->grainlength_maxjitter = (ctl->grainlength_maxjitter - f->grainlength_maxjitter) * ib;
+    inc->speed = (ctl->speed - f->speed) * ib;
+    inc->spread = (ctl->spread - f->spread) * ib;
+    inc->grid_jitter = (ctl->grid_jitter - f->grid_jitter) * ib;
+    inc->grid_maxjitter = (ctl->grid_maxjitter - f->grid_maxjitter) * ib;
+    inc->grid = (ctl->grid - f->grid) * ib;
+    inc->offset = (ctl->offset - f->offset) * ib;
+}
+
+/* Step the params one frame along the ramp */
+static void formation_advance(lpformation_t * f, lpformationctl_t * inc) {
+    f->amp += inc->amp;
+    f->pulsewidth += inc->pulsewidth;
+    f->grainlength += inc->grainlength;
+    f->grainlength_jitter += inc->grainlength_jitter;
+    f->grainlength_maxjitter += inc->grainlength_maxjitter;
+    f->speed += inc->speed;
+    f->spread += inc->spread;
+    f->grid_jitter += inc->grid_jitter;
+    f->grid_maxjitter += inc->grid_maxjitter;
+    f->grid += inc->grid;
+
+    if(!f->gridincrement) {
+        f->offset += inc->offset;
+    } else if(f->incpos >= f->increment) {
+        f->offset += f->grid;
+        while(f->incpos >= f->increment) f->incpos -= f->increment;
+        f->increment = (size_t)(f->grainlength * f->current_frame->samplerate);
+        if(f->increment < 1) f->increment = 1;
+    }
+}
+
+/* Render nframes of interleaved output into out, ramping 
+ * the formation params toward ctl across the block. */
+void formation_process_block(lpformation_t * f, lpformationctl_t * ctl, lpfloat_t * out, size_t nframes) {
+    lpformationctl_t inc;
+    size_t i;
+    int c, channels;
+
+    if(nframes == 0) return;
+
+    channels = f->current_frame->channels;
+    formation_ramp(f, ctl, &inc, nframes);
+
+    for(i=0; i < nframes; i++) {
+        formation_advance(f, &inc);
+        formation_process(f);
+        for(c=0; c < channels; c++) {
+            out[i * channels + c] = f->current_frame->data[c] * f->amp;
+        }
+
+        f->incpos += 1;
+    }
+
+    /* land exactly on the targets to avoid drift between blocks */
+    formation_setctl(f, ctl);
+}
+
+/* Give every grain its own random stream derived from the seed */
+void formation_seed(lpformation_t * f, uint64_t seed) {
+    lprng_t master;
+    int g;
+
+    LPRNG.init(&master, seed);
+    for(g=0; g < f->numgrains; g++) {
+        LPRNG.split(&master, &f->grains[g].rng, (uint64_t)g);
+    }
+}
+
+static void formation_render_chunk(lpformationrender_t * r, int id) {
+    lpformation_t * f = r->f;
+    lpbuffer_t * frame = r->grainframes[id];
+    lpfloat_t * dest, sample;
+    size_t i, start, end, stride;
+    int g, c, channels;
+
+    channels = f->current_frame->channels;
+    stride = LPFORMATION_RENDER_CHUNK * channels;
+
+    /* grains are independent given the control frames */
+    for(g=id; g < f->numgrains; g += r->numthreads) {
+        dest = r->scratch + g * stride;
+        for(i=0; i < r->nframes; i++) {
+            memset(frame->data, 0, sizeof(lpfloat_t) * channels);
+            grain_process(&f->grains[g], frame);
+            memcpy(dest + i * channels, frame->data, sizeof(lpfloat_t) * channels);
+            if(f->grains[g].gate) grain_trigger(&f->grains[g], &r->frames[i], f->pan);
+        }
+    }
+
+    pthread_barrier_wait(&r->barrier);
+
+    /* mix a slice of the chunk, always summing in grain order */
+    start = r->nframes * id / r->numthreads;
+    end = r->nframes * (id+1) / r->numthreads;
+    for(i=start; i < end; i++) {
+        for(c=0; c < channels; c++) {
+            sample = 0;
+            for(g=0; g < f->numgrains; g++) {
+                sample += r->scratch[g * stride + i * channels + c];
+            }
+            r->out[i * channels + c] = sample * r->frames[i].amp;
+        }
+    }
+}
+
+static void * formation_render_worker(void * arg) {
+    lpformationworker_t * w = (lpformationworker_t *)arg;
+    lpformationrender_t * r = w->r;
+    int generation = 0;
+
+    while(1) {
+        pthread_mutex_lock(&r->lock);
+        while(r->generation == generation) pthread_cond_wait(&r->wake, &r->lock);
+        generation = r->generation;
+        pthread_mutex_unlock(&r->lock);
+
+        if(r->done) break;
+        formation_render_chunk(r, w->id);
+        pthread_barrier_wait(&r->barrier);
+    }
+
+    return NULL;
+}
+
+static void formation_render_stop(lpformationrender_t * r) {
+    int t;
+
+    if(r == NULL) return;
+
+    if(r->numthreads > 1) {
+        pthread_mutex_lock(&r->lock);
+        r->done = 1;
+        r->generation += 1;
+        pthread_cond_broadcast(&r->wake);
+        pthread_mutex_unlock(&r->lock);
+
+        for(t=1; t < r->numthreads; t++) {
+            pthread_join(r->threads[t], NULL);
+        }
+    }
+
+    pthread_barrier_destroy(&r->barrier);
+    pthread_cond_destroy(&r->wake);
+    pthread_mutex_destroy(&r->lock);
+    for(t=0; t < r->requested; t++) {
+        LPBuffer.destroy(r->grainframes[t]);
+    }
+    LPMemoryPool.free(r->threads);
+    LPMemoryPool.free(r->workers);
+    LPMemoryPool.free(r->grainframes);
+    LPMemoryPool.free(r->scratch);
+    LPMemoryPool.free(r->frames);
+    LPMemoryPool.free(r);
+}
+
+/* Threads that fail to start are left out: their grains 
+ * go to the threads that did, down to just the caller. */
+static lpformationrender_t * formation_render_start(lpformation_t * f, int numthreads) {
+    lpformationrender_t * r;
+    int t, err, channels;
+
+    channels = f->current_frame->channels;
+
+    r = (lpformationrender_t *)LPMemoryPool.alloc(1, sizeof(lpformationrender_t));
+    r->f = f;
+    r->requested = numthreads;
+    r->frames = (lpformationctl_t *)LPMemoryPool.alloc(LPFORMATION_RENDER_CHUNK, sizeof(lpformationctl_t));
+    r->scratch = (lpfloat_t *)LPMemoryPool.alloc((size_t)f->numgrains * LPFORMATION_RENDER_CHUNK * channels, sizeof(lpfloat_t));
+    r->grainframes = (lpbuffer_t **)LPMemoryPool.alloc(numthreads, sizeof(lpbuffer_t *));
+    r->workers = (lpformationworker_t *)LPMemoryPool.alloc(numthreads, sizeof(lpformationworker_t));
+    r->threads = (pthread_t *)LPMemoryPool.alloc(numthreads, sizeof(pthread_t));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+
+    for(t=0; t < numthreads; t++) {
+        r->grainframes[t] = LPBuffer.create(1, channels, f->current_frame->samplerate);
+        r->workers[t].r = r;
+        r->workers[t].id = t;
+    }
+
+    /* the calling thread is worker 0. The workers wait on 
+     * the generation before touching the barrier, so it can 
+     * be sized once we know how many of them started. */
+    r->numthreads = 1;
+    for(t=1; t < numthreads; t++) {
+        err = pthread_create(&r->threads[t], NULL, formation_render_worker, (void *)&r->workers[t]);
+        if(err != 0) {
+            fprintf(stderr, "Could not start formation render thread %d, rendering on %d threads. %s (%d)\n", t, r->numthreads, strerror(err), err);
+            break;
+        }
+        r->numthreads += 1;
+    }
+
+    pthread_barrier_init(&r->barrier, NULL, r->numthreads);
+
+    return r;
+}
+
+void formation_render(lpformation_t * f, lpformationctl_t * ctls, size_t blocksize, lpfloat_t * out, size_t length, int numthreads) {
+    lpformationrender_t * r;
+    lpformationctl_t inc;
+    size_t pos, i, block, blocklength;
+    int channels;
+
+    assert(blocksize > 0);
+    if(length == 0) return;
+    if(numthreads < 1) numthreads = 1;
+
+    if(f->render != NULL && f->render->requested != numthreads) {
+        formation_render_stop(f->render);
+        f->render = NULL;
+    }
+
+    if(f->render == NULL) f->render = formation_render_start(f, numthreads);
+
+    r = f->render;
+    channels = f->current_frame->channels;
+
+    memset(&inc, 0, sizeof(lpformationctl_t));
+    for(pos=0; pos < length; pos += r->nframes) {
+        r->nframes = length - pos;
+        if(r->nframes > LPFORMATION_RENDER_CHUNK) r->nframes = LPFORMATION_RENDER_CHUNK;
+        r->out = out + pos * channels;
+
+        /* The formation params only depend on the control 
+         * targets, so step them serially and hand the grains 
+         * a snapshot for every frame in the chunk. */
+        for(i=0; i < r->nframes; i++) {
+            block = (pos + i) / blocksize;
+            if((pos + i) % blocksize == 0) {
+                blocklength = length - (pos + i);
+                if(blocklength > blocksize) blocklength = blocksize;
+                formation_ramp(f, &ctls[block], &inc, blocklength);
+            }
+
+            formation_advance(f, &inc);
+            formation_getctl(f, &r->frames[i]);
+            while(f->offset >= f->grains[0].src->buf->length) f->offset -= f->grains[0].src->buf->length;
+            f->incpos += 1;
+
+            if((pos + i + 1) % blocksize == 0 || pos + i + 1 == length) {
+                formation_setctl(f, &ctls[block]);
+            }
+        }
+
+        if(r->numthreads > 1) {
+            pthread_mutex_lock(&r->lock);
+            r->generation += 1;
+            pthread_cond_broadcast(&r->wake);
+            pthread_mutex_unlock(&r->lock);
+        }
+
+        formation_render_chunk(r, 0);
+        pthread_barrier_wait(&r->barrier);
+    }
+}
+
 void formation_destroy(lpformation_t * c) {
+    formation_render_stop(c->render);
     LPBuffer.destroy(c->window);
     LPBuffer.destroy(c->source);
     LPBuffer.destroy(c->current_frame);
@@ -175,4 +524,4 @@ int extract_wavesets(
     return 0;
 }
 
-const lpformation_factory_t LPFormation = { formation_create, formation_process, formation_destroy };
+const lpformation_factory_t LPFormation = { formation_create, formation_process, formation_process_block, formation_setctl, formation_seed, formation_render, formation_destroy };
@@ -1,10 +1,14 @@
 #ifndef LP_GRAINS_H
 #define LP_GRAINS_H
 
+#include <pthread.h>
+
 #include "pippicore.h"
 #include "oscs.tape.h"
 
 #define LPFORMATION_MAXGRAINS 512
+#define LPFORMATION_BLOCKSIZE 64
+#define LPFORMATION_RENDER_CHUNK 4096
 
 typedef struct lpgrain_t {
     size_t length;
@@ -20,6 +24,7 @@ typedef struct lpgrain_t {
     lpfloat_t skew; /* phase distortion on the grain window */
 
     int gate;
+    lprng_t rng; /* per-grain random stream for parallel renders */
 
     lptapeosc_t * src;
     lptapeosc_t * win;
@@ -42,14 +47,59 @@ typedef struct lpformation_t {
     lpfloat_t pan;
     lpfloat_t pulsewidth; 
 
+    /* grid increment mode: advance the offset by 
+     * `grid` seconds once every grainlength */
+    int gridincrement;
+    lpfloat_t grid;
+    size_t incpos;
+    size_t increment;
+
     lpbuffer_t * source;
     lpbuffer_t * window;
     lpbuffer_t * current_frame;
+
+    struct lpformationrender_t * render; /* started by the first parallel render */
 } lpformation_t;
 
+/* Control values for block-rate processing. 
+ *
+ * process_block ramps the formation params linearly 
+ * from their current values toward these targets over 
+ * the length of the block, so callers only need to 
+ * read their control curves once per block. */
+typedef struct lpformationctl_t {
+    lpfloat_t amp;
+    lpfloat_t pulsewidth;
+    lpfloat_t grainlength;
+    lpfloat_t grainlength_jitter;
+    lpfloat_t grainlength_maxjitter;
+    lpfloat_t speed;
+    lpfloat_t spread;
+    lpfloat_t grid_jitter;
+    lpfloat_t grid_maxjitter;
+    lpfloat_t grid;
+    lpfloat_t offset; /* ignored in grid increment mode */
+} lpformationctl_t;
+
+/* Parallel offline renders.
+ *
+ * render splits the grains of a formation across numthreads 
+ * worker threads in chunks of LPFORMATION_RENDER_CHUNK frames. 
+ * Each grain draws from its own random stream (see seed) and the 
+ * partial outputs are always summed in grain order, so a given 
+ * seed renders bit-identical output for any number of threads. 
+ * The threads are started by the first render and kept until 
+ * the formation is destroyed.
+ *
+ * ctls holds one set of control targets per block of blocksize 
+ * frames, ramped toward just like process_block. */
 typedef struct lpformation_factory_t {
     lpformation_t * (*create)(int numgrains, lpbuffer_t * src, lpbuffer_t * win);
     void (*process)(lpformation_t *);
+    void (*process_block)(lpformation_t *, lpformationctl_t *, lpfloat_t *, size_t);
+    void (*setctl)(lpformation_t *, lpformationctl_t *);
+    void (*seed)(lpformation_t *, uint64_t);
+    void (*render)(lpformation_t *, lpformationctl_t *, size_t, lpfloat_t *, size_t, int);
     void (*destroy)(lpformation_t *);
 } lpformation_factory_t;
 
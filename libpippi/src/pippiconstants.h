@@ -102,6 +102,16 @@ enum Windows {
     NUM_WINDOWS
 };
 
+enum LPRNGModes {
+    LPRNG_XOSHIRO,
+    LPRNG_LOGISTIC,
+    LPRNG_LORENZ,
+    LPRNG_LORENZX,
+    LPRNG_LORENZY,
+    LPRNG_LORENZZ,
+    NUM_LPRNG_MODES
+};
+
 enum PanMethods {
     PANMETHOD_CONSTANT,
     PANMETHOD_LINEAR,
@@ -116,6 +126,7 @@ enum LPMessageFlags {
     LPFLAG_IS_ENCODED_PARAM=1 << 1,
     LPFLAG_IS_FLOAT_ENCODED=1 << 2,
     LPFLAG_IS_INT32_ENCODED=1 << 3,
+    LPFLAG_IS_REPLAYED     =1 << 4,
 };
 
 enum LPParamTypes {
@@ -141,6 +152,7 @@ enum LPParamTypes {
 #define LOAD_MESSAGE 'l'
 #define SHUTDOWN_MESSAGE 'q'
 #define SET_COUNTER_MESSAGE 'v'
+#define VOICE_MESSAGE 'm'
 
 enum LPMessageTypes {
     LPMSG_EMPTY,
@@ -156,6 +168,8 @@ enum LPMessageTypes {
     LPMSG_SET_COUNTER,
     LPMSG_MIDI_FROM_DEVICE,
     LPMSG_MIDI_TO_DEVICE,
+    LPMSG_RENDER_STREAM,
+    LPMSG_VOICE,
     NUM_LPMESSAGETYPES
 };
 
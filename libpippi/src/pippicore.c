@@ -6,6 +6,7 @@ void rand_preseed(void);
 void rand_seed(int value);
 lpfloat_t rand_base_logistic(lpfloat_t low, lpfloat_t high);
 lpfloat_t rand_base_stdlib(lpfloat_t low, lpfloat_t high);
+lpfloat_t rand_base_xoshiro(lpfloat_t low, lpfloat_t high);
 lpfloat_t rand_rand(lpfloat_t low, lpfloat_t high);
 lpfloat_t rand_base_lorenz(lpfloat_t low, lpfloat_t high);
 lpfloat_t rand_base_lorenzX(lpfloat_t low, lpfloat_t high);
@@ -15,6 +16,21 @@ int rand_randint(int low, int high);
 int rand_randbool(void);
 int rand_choice(int numchoices);
 
+void ugen_init_block(ugen_t * u, size_t blocksize);
+lpfloat_t * ugen_patch(ugen_t * u, int inlet);
+void ugen_process_block(ugen_t * u, size_t nframes);
+void ugen_destroy_block(ugen_t * u);
+
+lprng_t * rng_create(uint64_t seed);
+void rng_init(lprng_t * rng, uint64_t seed);
+void rng_seed(lprng_t * rng, uint64_t seed);
+void rng_split(lprng_t * rng, lprng_t * stream, uint64_t streamid);
+lprng_t * rng_local(void);
+lpfloat_t rng_rand(lprng_t * rng, lpfloat_t low, lpfloat_t high);
+int rng_randint(lprng_t * rng, int low, int high);
+void rng_fill(lprng_t * rng, lpfloat_t * out, size_t length, lpfloat_t low, lpfloat_t high);
+void rng_destroy(lprng_t * rng);
+
 lparray_t * create_array_from(int numvalues, ...);
 lparray_t * create_array(size_t length);
 void destroy_array(lparray_t * array);
@@ -119,13 +135,11 @@ const lpfloat_t LPHANN_WINDOW[] = { 0.0000000000,0.0000005886,0.0000023542,0.000
 #endif
 
 /* Populate interfaces */
-lprand_t LPRand = { LOGISTIC_SEED_DEFAULT, LOGISTIC_X_DEFAULT, \
-    LORENZ_TIMESTEP_DEFAULT, \
-    LORENZ_X_DEFAULT, LORENZ_Y_DEFAULT, LORENZ_Z_DEFAULT, \
-    LORENZ_A_DEFAULT, LORENZ_B_DEFAULT, LORENZ_C_DEFAULT, \
-    rand_preseed, rand_seed, rand_base_stdlib, rand_base_logistic, \
+lprand_t LPRand = { rand_preseed, rand_seed, rand_base_stdlib, rand_base_xoshiro, rand_base_logistic, \
     rand_base_lorenz, rand_base_lorenzX, rand_base_lorenzY, rand_base_lorenzZ, \
     rand_base_stdlib, rand_rand, rand_randint, rand_randbool, rand_choice };
+const lpugen_factory_t LPUgen = { ugen_init_block, ugen_patch, ugen_process_block, ugen_destroy_block };
+const lprng_factory_t LPRNG = { rng_create, rng_init, rng_seed, rng_split, rng_local, rng_rand, rng_randint, rng_fill, rng_destroy };
 lpmemorypool_factory_t LPMemoryPool = { 0, 0, 0, memorypool_init, memorypool_custom_init, memorypool_alloc, memorypool_custom_alloc, memorypool_free };
 const lparray_factory_t LPArray = { create_array, create_array_from, destroy_array };
 const lpbuffer_factory_t LPBuffer = { create_buffer, create_buffer_from_float, create_buffer_from_bytes, copy_buffer, clone_buffer, clear_buffer, split2_buffer, scale_buffer, min_buffer, max_buffer, mag_buffer, play_buffer, pan_stereo_buffer, mix_buffers, remix_buffer, clip_buffer, cut_buffer, cut_into_buffer, varispeed_buffer, resample_buffer, multiply_buffer, scalar_multiply_buffer, add_buffers, scalar_add_buffer, subtract_buffers, scalar_subtract_buffer, divide_buffers, scalar_divide_buffer, concat_buffers, buffers_are_equal, buffers_are_close, dub_buffer, dub_scalar, env_buffer, pad_buffer, taper_buffer, trim_buffer, fill_buffer, repeat_buffer, reverse_buffer, resize_buffer, plot_buffer, destroy_buffer };
@@ -137,26 +151,336 @@ const lpringbuffer_factory_t LPRingBuffer = { ringbuffer_create, ringbuffer_fill
 const lpfx_factory_t LPFX = { read_skewed_buffer, fx_lpf1, fx_hpf1, fx_convolve, fx_norm, fx_crossover, fx_fold, fx_limit, fx_crush };
 const lpfilter_factory_t LPFilter = { fx_butthp_create, fx_butthp, fx_buttlp_create, fx_buttlp };
 
+/* Ugen block processing.
+ *
+ * init_block gives a ugen its outlet buffers and, for ugens 
+ * which only implement the single sample interface, installs 
+ * the fallback adapter below as its process_block callback. */
+void ugen_init_block(ugen_t * u, size_t blocksize) {
+    int i;
+
+    assert(blocksize > 0);
+    if(u->outlets != NULL && u->blocksize >= blocksize) return;
+
+    if(u->outlets == NULL) {
+        u->outlets = (lpfloat_t **)LPMemoryPool.alloc(u->num_outlets+1, sizeof(lpfloat_t *));
+    }
+
+    if(u->inlets == NULL) {
+        u->inlets = (lpfloat_t **)LPMemoryPool.alloc(u->num_inlets+1, sizeof(lpfloat_t *));
+    }
+
+    for(i=0; i < u->num_outlets; i++) {
+        if(u->outlets[i] != NULL) LPMemoryPool.free(u->outlets[i]);
+        u->outlets[i] = (lpfloat_t *)LPMemoryPool.alloc(blocksize, sizeof(lpfloat_t));
+    }
+
+    for(i=0; i < u->num_inlets; i++) {
+        if(u->inlets[i] == NULL) continue;
+        LPMemoryPool.free(u->inlets[i]);
+        u->inlets[i] = (lpfloat_t *)LPMemoryPool.alloc(blocksize, sizeof(lpfloat_t));
+    }
+
+    u->blocksize = blocksize;
+    if(u->process_block == NULL) u->process_block = ugen_process_block;
+}
+
+/* Give an inlet a block buffer to be written into */
+lpfloat_t * ugen_patch(ugen_t * u, int inlet) {
+    assert(u->inlets != NULL);
+    assert(inlet >= 0 && inlet < u->num_inlets);
+
+    if(u->inlets[inlet] == NULL) {
+        u->inlets[inlet] = (lpfloat_t *)LPMemoryPool.alloc(u->blocksize, sizeof(lpfloat_t));
+    }
+
+    return u->inlets[inlet];
+}
+
+/* Single sample fallback: feed the patched inlets through 
+ * set_param and collect every outlet with get_output */
+void ugen_process_block(ugen_t * u, size_t nframes) {
+    size_t i;
+    int k;
+
+    assert(nframes <= u->blocksize);
+
+    for(i=0; i < nframes; i++) {
+        for(k=0; k < u->num_inlets; k++) {
+            if(u->inlets[k] != NULL) u->set_param(u, k, &u->inlets[k][i]);
+        }
+
+        u->process(u);
+
+        for(k=0; k < u->num_outlets; k++) {
+            u->outlets[k][i] = u->get_output(u, k);
+        }
+    }
+}
+
+void ugen_destroy_block(ugen_t * u) {
+    int i;
+
+    if(u->outlets != NULL) {
+        for(i=0; i < u->num_outlets; i++) {
+            if(u->outlets[i] != NULL) LPMemoryPool.free(u->outlets[i]);
+        }
+        LPMemoryPool.free(u->outlets);
+        u->outlets = NULL;
+    }
+
+    if(u->inlets != NULL) {
+        for(i=0; i < u->num_inlets; i++) {
+            if(u->inlets[i] != NULL) LPMemoryPool.free(u->inlets[i]);
+        }
+        LPMemoryPool.free(u->inlets);
+        u->inlets = NULL;
+    }
+
+    u->blocksize = 0;
+}
+
+/* Each thread gets its own default generator, 
+ * seeded from the platform on first use. */
+static _Thread_local lprng_t rng_local_state;
+static _Thread_local int rng_local_ready = 0;
+
+/* splitmix64, used to expand seeds into xoshiro state 
+ * and to derive stream seeds from a master seed */
+static inline uint64_t rng_splitmix(uint64_t * x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rng_rotl(const uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/* xoshiro256** by David Blackman and Sebastiano Vigna (public domain)
+ *      https://prng.di.unimi.it/xoshiro256starstar.c */
+static inline uint64_t rng_next(lprng_t * rng) {
+    const uint64_t result = rng_rotl(rng->s[1] * 5, 7) * 9;
+    const uint64_t t = rng->s[1] << 17;
+
+    rng->s[2] ^= rng->s[0];
+    rng->s[3] ^= rng->s[1];
+    rng->s[1] ^= rng->s[2];
+    rng->s[0] ^= rng->s[3];
+    rng->s[2] ^= t;
+    rng->s[3] = rng_rotl(rng->s[3], 45);
+
+    return result;
+}
+
+/* 0-1 from the top 53 bits */
+static inline lpfloat_t rng_xoshiro(lprng_t * rng) {
+    return (lpfloat_t)((rng_next(rng) >> 11) * 0x1.0p-53);
+}
+
+static inline lpfloat_t rng_logistic(lprng_t * rng) {
+    rng->logistic_x = rng->logistic_seed * rng->logistic_x * (1.f - rng->logistic_x);
+    return rng->logistic_x;
+}
+
+/* The three Lorenz attractor implementations (lorenzX, lorenzY, lorenzZ) 
+ * were lightly adapted with permission from Greg Cope's helpful overview: 
+ *      https://www.algosome.com/articles/lorenz-attractor-programming-code.html
+ * Please consider those routines to be included here under an MIT license.
+ */
+static inline lpfloat_t rng_lorenzX(lprng_t * rng) {
+    rng->lorenz_x = rng->lorenz_x + rng->lorenz_timestep * rng->lorenz_a * (rng->lorenz_y - rng->lorenz_x);
+    return rng->lorenz_x;
+}
+
+static inline lpfloat_t rng_lorenzY(lprng_t * rng) {
+    rng->lorenz_y = rng->lorenz_y + rng->lorenz_timestep * (rng->lorenz_x * (rng->lorenz_b - rng->lorenz_z) - rng->lorenz_y);
+    return rng->lorenz_y;
+}
+
+static inline lpfloat_t rng_lorenzZ(lprng_t * rng) {
+    rng->lorenz_z = rng->lorenz_z + rng->lorenz_timestep * (rng->lorenz_x * rng->lorenz_y - rng->lorenz_c * rng->lorenz_z);
+    return rng->lorenz_z;
+}
+
+static lpfloat_t rng_lorenz(lprng_t * rng, lpfloat_t low, lpfloat_t high) {
+    lpfloat_t val;
+    val = rng_lorenzX(rng) * rng_lorenzY(rng) * rng_lorenzZ(rng);
+    while(val > high) {
+        val -= (high-low);
+    }
+    while(val < low) {
+        val += (high-low);
+    }
+
+    return val;
+}
+
+static lpfloat_t rng_mode_rand(lprng_t * rng, int mode, lpfloat_t low, lpfloat_t high) {
+    lpfloat_t val;
+
+    switch(mode) {
+        case LPRNG_LOGISTIC:
+            return rng_logistic(rng) * (high-low) + low;
+
+        case LPRNG_LORENZ:
+            return rng_lorenz(rng, low, high);
+
+        case LPRNG_LORENZX:
+            val = rng_lorenzX(rng);
+            rng_lorenzY(rng);
+            rng_lorenzZ(rng);
+            return val * (high-low) + low;
+
+        case LPRNG_LORENZY:
+            rng_lorenzX(rng);
+            val = rng_lorenzY(rng);
+            rng_lorenzZ(rng);
+            return val * (high-low) + low;
+
+        case LPRNG_LORENZZ:
+            rng_lorenzX(rng);
+            rng_lorenzY(rng);
+            val = rng_lorenzZ(rng);
+            return val * (high-low) + low;
+
+        default:
+            return rng_xoshiro(rng) * (high-low) + low;
+    }
+}
+
+/* Reseed the xoshiro state only, leaving 
+ * the chaotic generators where they are */
+void rng_seed(lprng_t * rng, uint64_t seed) {
+    uint64_t x = seed;
+    int i;
+
+    rng->seed = seed;
+    for(i=0; i < 4; i++) {
+        rng->s[i] = rng_splitmix(&x);
+    }
+}
+
+/* Reset everything to the defaults and seed */
+void rng_init(lprng_t * rng, uint64_t seed) {
+    rng->mode = LPRNG_XOSHIRO;
+    rng->logistic_seed = LOGISTIC_SEED_DEFAULT;
+    rng->logistic_x = LOGISTIC_X_DEFAULT;
+    rng->lorenz_timestep = LORENZ_TIMESTEP_DEFAULT;
+    rng->lorenz_x = LORENZ_X_DEFAULT;
+    rng->lorenz_y = LORENZ_Y_DEFAULT;
+    rng->lorenz_z = LORENZ_Z_DEFAULT;
+    rng->lorenz_a = LORENZ_A_DEFAULT;
+    rng->lorenz_b = LORENZ_B_DEFAULT;
+    rng->lorenz_c = LORENZ_C_DEFAULT;
+    rng_seed(rng, seed);
+}
+
+lprng_t * rng_create(uint64_t seed) {
+    lprng_t * rng;
+    rng = (lprng_t *)LPMemoryPool.alloc(1, sizeof(lprng_t));
+    rng_init(rng, seed);
+    return rng;
+}
+
+/* Derive an independent stream from the master seed of rng. 
+ *
+ * The xoshiro state of the stream only depends on the master 
+ * seed and the stream id, never on how much of rng has been 
+ * consumed. The chaotic generators are copied from rng as they 
+ * are right now, including their current position, and then 
+ * nudged by the new stream so they don't move in lockstep. 
+ * Split before drawing from the chaotic modes of rng if the 
+ * streams need to be reproducible. */
+void rng_split(lprng_t * rng, lprng_t * stream, uint64_t streamid) {
+    uint64_t x = streamid;
+    lpfloat_t logistic_x;
+
+    x = rng->seed ^ rng_splitmix(&x);
+    memcpy(stream, rng, sizeof(lprng_t));
+    rng_seed(stream, rng_splitmix(&x));
+
+    logistic_x = stream->logistic_x + rng_xoshiro(stream) * 0.01f;
+    if(logistic_x > 0.f && logistic_x < 1.f) stream->logistic_x = logistic_x;
+    stream->lorenz_x += rng_xoshiro(stream) * 0.01f;
+    stream->lorenz_y += rng_xoshiro(stream) * 0.01f;
+    stream->lorenz_z += rng_xoshiro(stream) * 0.01f;
+}
+
+/* The calling thread's default generator */
+lprng_t * rng_local(void) {
+    uint64_t seed = 0;
+
+    if(!rng_local_ready) {
+#ifdef __linux__
+        if(getrandom(&seed, sizeof(uint64_t), 0) != sizeof(uint64_t)) seed = (uint64_t)time(NULL);
+#else
+        seed = (uint64_t)time(NULL);
+#endif
+        seed ^= (uint64_t)(uintptr_t)&rng_local_state;
+        rng_init(&rng_local_state, seed);
+        rng_local_ready = 1;
+    }
+
+    return &rng_local_state;
+}
+
+lpfloat_t rng_rand(lprng_t * rng, lpfloat_t low, lpfloat_t high) {
+    return rng_mode_rand(rng, rng->mode, low, high);
+}
+
+int rng_randint(lprng_t * rng, int low, int high) {
+    float diff, tmp;
+
+    tmp = (float)rng_rand(rng, (lpfloat_t)low, (lpfloat_t)high);
+    diff = (int)tmp - tmp;
+
+    if(diff >= 0.5f) {
+        return (int)ceil(tmp);
+    } else {
+        return (int)floor(tmp);
+    }
+}
+
+/* Fill a whole buffer in one call */
+void rng_fill(lprng_t * rng, lpfloat_t * out, size_t length, lpfloat_t low, lpfloat_t high) {
+    size_t i;
+
+    if(rng->mode == LPRNG_XOSHIRO) {
+        for(i=0; i < length; i++) {
+            out[i] = rng_xoshiro(rng) * (high-low) + low;
+        }
+        return;
+    }
+
+    for(i=0; i < length; i++) {
+        out[i] = rng_mode_rand(rng, rng->mode, low, high);
+    }
+}
+
+void rng_destroy(lprng_t * rng) {
+    LPMemoryPool.free(rng);
+}
+
 /* Platform-specific random seed, called 
  * on program init (and on process pool init) 
  * from python or optionally elsewhere to 
  * seed random with nice bytes. */
 void rand_preseed() {
 #ifdef __linux__
-    unsigned int * buffer;
-    ssize_t bytes_read;
-    size_t buffer_size;
-    buffer_size = sizeof(unsigned int);
-    buffer = LPMemoryPool.alloc(1, buffer_size);
-    bytes_read = getrandom(buffer, buffer_size, 0);
-    if(bytes_read > 0) srand(*buffer);
-    free(buffer);
+    uint64_t seed;
+    if(getrandom(&seed, sizeof(uint64_t), 0) == sizeof(uint64_t)) {
+        srand((unsigned int)seed);
+        rng_seed(rng_local(), seed);
+    }
 #endif
 }
 
 /* User rand seed */
 void rand_seed(int value) {
     srand((unsigned int)value);
+    rng_seed(rng_local(), (uint64_t)value);
 }
 
 /* Default rand_base callback. 
@@ -166,76 +490,43 @@ void rand_seed(int value) {
  * choice and randint.
  *
  * They may be swapped out at runtime by setting 
- * LPRand.rand_base to the desired rand_base pointer;
+ * LPRand.rand_base to the desired rand_base pointer.
+ *
+ * The stdlib base draws from the process-wide rand() 
+ * stream, so seeding from any module or thread makes 
+ * every consumer reproducible. The other bases draw 
+ * from the calling thread's default generator, which 
+ * seed only reaches on the calling thread.
  * */
 lpfloat_t rand_base_stdlib(lpfloat_t low, lpfloat_t high) {
     return (rand()/(lpfloat_t)RAND_MAX) * (high-low) + low;
 }
 
-/* Logistic rand base. */
-lpfloat_t rand_base_logistic(lpfloat_t low, lpfloat_t high) {
-    LPRand.logistic_x = LPRand.logistic_seed * LPRand.logistic_x * (1.f - LPRand.logistic_x);
-    return LPRand.logistic_x * (high-low) + low;
+/* Thread-local xoshiro rand base, for threads 
+ * that shouldn't contend on the stdlib stream. */
+lpfloat_t rand_base_xoshiro(lpfloat_t low, lpfloat_t high) {
+    return rng_mode_rand(rng_local(), LPRNG_XOSHIRO, low, high);
 }
 
-/* The three Lorenz attractor implementations (lorenzX, lorenzY, lorenzZ) 
- * were lightly adapted with permission from Greg Cope's helpful overview: 
- *      https://www.algosome.com/articles/lorenz-attractor-programming-code.html
- * Please consider those routines to be included here under an MIT license.
- */
-lpfloat_t lorenzX(lpfloat_t low, lpfloat_t high) {
-    LPRand.lorenz_x = LPRand.lorenz_x + LPRand.lorenz_timestep * LPRand.lorenz_a * (LPRand.lorenz_y - LPRand.lorenz_x);
-    return LPRand.lorenz_x * (high-low) + low;
-}
-
-lpfloat_t lorenzY(lpfloat_t low, lpfloat_t high) {
-    LPRand.lorenz_y = LPRand.lorenz_y + LPRand.lorenz_timestep * (LPRand.lorenz_x * (LPRand.lorenz_b - LPRand.lorenz_z) - LPRand.lorenz_y);
-    return LPRand.lorenz_y * (high-low) + low;
-}
-
-lpfloat_t lorenzZ(lpfloat_t low, lpfloat_t high) {
-    LPRand.lorenz_z = LPRand.lorenz_z + LPRand.lorenz_timestep * (LPRand.lorenz_x * LPRand.lorenz_y - LPRand.lorenz_c * LPRand.lorenz_z);
-    return LPRand.lorenz_z * (high-low) + low;
+/* Logistic rand base. */
+lpfloat_t rand_base_logistic(lpfloat_t low, lpfloat_t high) {
+    return rng_mode_rand(rng_local(), LPRNG_LOGISTIC, low, high);
 }
 
 lpfloat_t rand_base_lorenzX(lpfloat_t low, lpfloat_t high) {
-    lpfloat_t x;
-    x = lorenzX(low, high);
-    lorenzY(low, high);
-    lorenzZ(low, high);
-    return x;
+    return rng_mode_rand(rng_local(), LPRNG_LORENZX, low, high);
 }
 
 lpfloat_t rand_base_lorenzY(lpfloat_t low, lpfloat_t high) {
-    lpfloat_t y;
-    lorenzX(low, high);
-    y = lorenzY(low, high);
-    lorenzZ(low, high);
-    return y;
+    return rng_mode_rand(rng_local(), LPRNG_LORENZY, low, high);
 }
 
 lpfloat_t rand_base_lorenzZ(lpfloat_t low, lpfloat_t high) {
-    lpfloat_t z;
-    lorenzX(low, high);
-    lorenzY(low, high);
-    z = lorenzZ(low, high);
-    return z;
+    return rng_mode_rand(rng_local(), LPRNG_LORENZZ, low, high);
 }
 
 lpfloat_t rand_base_lorenz(lpfloat_t low, lpfloat_t high) {
-    lpfloat_t x, y, z, val;
-    x = lorenzX(0, 1);
-    y = lorenzY(0, 1);
-    z = lorenzZ(0, 1);
-    val = x * y * z;
-    while(val > high) {
-        val -= (high-low);
-    }
-    while(val < low) {
-        val += (high-low);
-    }
-
-    return val;
+    return rng_mode_rand(rng_local(), LPRNG_LORENZ, low, high);
 }
 
 lpfloat_t rand_rand(lpfloat_t low, lpfloat_t high) {
@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <wchar.h>
 
 /* linux platform includes */
@@ -34,10 +35,18 @@ struct ugen_t {
     int num_outputs;
     int num_inputs;
 
+    // block processing: one buffer of blocksize frames per 
+    // outlet, and one per inlet once it has been patched. 
+    // Unpatched (NULL) inlets keep the last value set.
+    size_t blocksize;
+    lpfloat_t ** outlets;
+    lpfloat_t ** inlets;
+
     void * params;
     lpfloat_t (*get_output)(ugen_t * u, int index);
     void (*set_param)(ugen_t * u, int index, void * value);
     void (*process)(ugen_t * u);
+    void (*process_block)(ugen_t * u, size_t nframes);
     void (*destroy)(ugen_t * u);
 };
 
@@ -55,22 +64,15 @@ typedef struct lpmemorypool_t {
 } lpmemorypool_t;
 
 /* Factories & static interfaces */
+/* LPRand draws from the process-wide rand() stream 
+ * by default. The xoshiro and chaotic bases draw from 
+ * the calling thread's default LPRNG generator. */
 typedef struct lprand_t {
-    lpfloat_t logistic_seed;
-    lpfloat_t logistic_x;
-
-    lpfloat_t lorenz_timestep;
-    lpfloat_t lorenz_x;
-    lpfloat_t lorenz_y;
-    lpfloat_t lorenz_z;
-    lpfloat_t lorenz_a;
-    lpfloat_t lorenz_b;
-    lpfloat_t lorenz_c;
-
     void (*preseed)(void);
     void (*seed)(int);
 
     lpfloat_t (*stdlib)(lpfloat_t, lpfloat_t);
+    lpfloat_t (*xoshiro)(lpfloat_t, lpfloat_t);
     lpfloat_t (*logistic)(lpfloat_t, lpfloat_t);
 
     lpfloat_t (*lorenz)(lpfloat_t, lpfloat_t);
@@ -85,6 +87,25 @@ typedef struct lprand_t {
     int (*choice)(int);
 } lprand_t;
 
+typedef struct lpugen_factory_t {
+    void (*init_block)(ugen_t * u, size_t blocksize);
+    lpfloat_t * (*patch)(ugen_t * u, int inlet);
+    void (*process_block)(ugen_t * u, size_t nframes);
+    void (*destroy_block)(ugen_t * u);
+} lpugen_factory_t;
+
+typedef struct lprng_factory_t {
+    lprng_t * (*create)(uint64_t seed);
+    void (*init)(lprng_t * rng, uint64_t seed);
+    void (*seed)(lprng_t * rng, uint64_t seed);
+    void (*split)(lprng_t * rng, lprng_t * stream, uint64_t streamid);
+    lprng_t * (*local)(void);
+    lpfloat_t (*rand)(lprng_t * rng, lpfloat_t low, lpfloat_t high);
+    int (*randint)(lprng_t * rng, int low, int high);
+    void (*fill)(lprng_t * rng, lpfloat_t * out, size_t length, lpfloat_t low, lpfloat_t high);
+    void (*destroy)(lprng_t * rng);
+} lprng_factory_t;
+
 typedef struct lparray_factory_t {
     lparray_t * (*create)(size_t);
     lparray_t * (*create_from)(int, ...);
@@ -219,6 +240,8 @@ extern const lpfx_factory_t LPFX;
 extern const lpfilter_factory_t LPFilter;
 
 extern lprand_t LPRand;
+extern const lprng_factory_t LPRNG;
+extern const lpugen_factory_t LPUgen;
 extern const lpparam_factory_t LPParam;
 extern lpmemorypool_factory_t LPMemoryPool;
 extern const lpinterpolation_factory_t LPInterpolation;
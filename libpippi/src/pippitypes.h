@@ -54,6 +54,15 @@ typedef struct lpmsg_t {
      * */
     double completed;     
 
+    /* Timestamp when the seq scheduler released the 
+     * message to the renderer. 
+     *
+     * Renders that arrive at the mixer are timed from 
+     * here to estimate how early the next messages in 
+     * the sequence need to be dispatched.
+     * */
+    double dispatched;
+
     /* The longest a message in this sequence has taken 
      * so far to be processed and reach completion.
      *
@@ -76,6 +85,11 @@ typedef struct lpmsg_t {
      * time rounded to nearest frame */
     size_t onset_delay;   
 
+    /* Absolute target time in frames of the JACK clock 
+     * (extended to 64 bits), assigned when the message is 
+     * dispatched. Zero means play as soon as possible. */
+    uint64_t target_frame;
+
     /* The voice ID is also a message sequence ID */
     size_t voice_id;
     size_t count;
@@ -104,6 +118,28 @@ typedef struct lppatternbuf_t {
 } lppatternbuf_t;
 
 
+/* Random number generator state.
+ *
+ * Every thread gets its own default generator 
+ * (see LPRNG.local) and independent streams can 
+ * be split off a master seed for parallel renders. */
+typedef struct lprng_t {
+    uint64_t seed; /* streams are split from this seed */
+    uint64_t s[4]; /* xoshiro256** state */
+    int mode; /* LPRNGModes */
+
+    lpfloat_t logistic_seed;
+    lpfloat_t logistic_x;
+
+    lpfloat_t lorenz_timestep;
+    lpfloat_t lorenz_x;
+    lpfloat_t lorenz_y;
+    lpfloat_t lorenz_z;
+    lpfloat_t lorenz_a;
+    lpfloat_t lorenz_b;
+    lpfloat_t lorenz_c;
+} lprng_t;
+
 /* This filter type is shared among the butterworth 
  * filters ported from Paul Batchelor's Soundpipe.
  * The original Soundpipe annotation is preserved below.
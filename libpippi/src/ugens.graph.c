@@ -0,0 +1,110 @@
+#include "pippi.h"
+#include "ugens.graph.h"
+
+
+lpugenplan_t * create_ugen_plan(int numnodes, size_t blocksize) {
+    lpugenplan_t * plan;
+
+    assert(numnodes >= 0);
+    assert(blocksize > 0);
+
+    plan = (lpugenplan_t *)LPMemoryPool.alloc(1, sizeof(lpugenplan_t));
+    plan->blocksize = blocksize;
+    plan->mix = (lpfloat_t *)LPMemoryPool.alloc(blocksize, sizeof(lpfloat_t));
+    plan->numnodes = numnodes;
+    plan->nodes = (ugen_t **)LPMemoryPool.alloc(numnodes+1, sizeof(ugen_t *));
+    plan->numconnections = (int *)LPMemoryPool.alloc(numnodes+1, sizeof(int));
+    plan->connections = (lpugenconnection_t **)LPMemoryPool.alloc(numnodes+1, sizeof(lpugenconnection_t *));
+
+    return plan;
+}
+
+/* Nodes must be added in execution order */
+void add_ugen_plan(lpugenplan_t * plan, int node, ugen_t * u) {
+    assert(node >= 0 && node < plan->numnodes);
+    LPUgen.init_block(u, plan->blocksize);
+    plan->nodes[node] = u;
+}
+
+void connect_ugen_plan(lpugenplan_t * plan, int node, int outport, ugen_t * dest, int inport, lpfloat_t mult, lpfloat_t add) {
+    lpugenconnection_t * connections;
+    int count;
+
+    assert(node >= 0 && node < plan->numnodes);
+    assert(plan->nodes[node] != NULL);
+    assert(outport >= 0 && outport < plan->nodes[node]->num_outlets);
+
+    if(dest != NULL) LPUgen.patch(dest, inport);
+
+    count = plan->numconnections[node];
+    connections = (lpugenconnection_t *)LPMemoryPool.alloc(count+1, sizeof(lpugenconnection_t));
+    if(plan->connections[node] != NULL) {
+        memcpy(connections, plan->connections[node], sizeof(lpugenconnection_t) * count);
+        LPMemoryPool.free(plan->connections[node]);
+    }
+
+    connections[count].dest = dest;
+    connections[count].outport = outport;
+    connections[count].inport = inport;
+    connections[count].mult = mult;
+    connections[count].add = add;
+
+    plan->connections[node] = connections;
+    plan->numconnections[node] = count + 1;
+}
+
+/* Render nframes of interleaved output, copying the 
+ * (mono) graph output into every channel */
+void process_ugen_plan(lpugenplan_t * plan, lpfloat_t * out, size_t nframes, int channels) {
+    lpugenconnection_t * con;
+    lpfloat_t * src, * dest;
+    ugen_t * u;
+    size_t pos, i, blocklength;
+    int n, k, c;
+
+    for(pos=0; pos < nframes; pos += blocklength) {
+        blocklength = nframes - pos;
+        if(blocklength > plan->blocksize) blocklength = plan->blocksize;
+
+        memset(plan->mix, 0, sizeof(lpfloat_t) * blocklength);
+
+        for(n=0; n < plan->numnodes; n++) {
+            u = plan->nodes[n];
+            u->process_block(u, blocklength);
+
+            for(k=0; k < plan->numconnections[n]; k++) {
+                con = &plan->connections[n][k];
+                src = u->outlets[con->outport];
+                if(con->dest == NULL) {
+                    for(i=0; i < blocklength; i++) plan->mix[i] += src[i] * con->mult + con->add;
+                } else {
+                    dest = con->dest->inlets[con->inport];
+                    for(i=0; i < blocklength; i++) dest[i] = src[i] * con->mult + con->add;
+                }
+            }
+        }
+
+        for(i=0; i < blocklength; i++) {
+            for(c=0; c < channels; c++) {
+                out[(pos + i) * channels + c] = plan->mix[i];
+            }
+        }
+    }
+}
+
+/* The plan doesn't own its ugens */
+void destroy_ugen_plan(lpugenplan_t * plan) {
+    int n;
+
+    for(n=0; n < plan->numnodes; n++) {
+        if(plan->connections[n] != NULL) LPMemoryPool.free(plan->connections[n]);
+    }
+
+    LPMemoryPool.free(plan->connections);
+    LPMemoryPool.free(plan->numconnections);
+    LPMemoryPool.free(plan->nodes);
+    LPMemoryPool.free(plan->mix);
+    LPMemoryPool.free(plan);
+}
+
+const lpugenplan_factory_t LPUgenPlan = { create_ugen_plan, add_ugen_plan, connect_ugen_plan, process_ugen_plan, destroy_ugen_plan };
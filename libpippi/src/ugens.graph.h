@@ -0,0 +1,40 @@
+#ifndef LP_UGEN_GRAPH_H
+#define LP_UGEN_GRAPH_H
+
+/* A compiled ugen graph.
+ *
+ * Nodes are stored in execution order, each with 
+ * the list of connections fed by its outlets. Every 
+ * block, each node is processed and its connected 
+ * outlet buffers are scaled and copied straight into 
+ * the destination inlet buffers (or summed into the 
+ * output). Connections which feed back to an earlier 
+ * node are read on the following block. */
+typedef struct lpugenconnection_t {
+    ugen_t * dest; /* NULL routes to the graph output */
+    int outport;
+    int inport;
+    lpfloat_t mult;
+    lpfloat_t add;
+} lpugenconnection_t;
+
+typedef struct lpugenplan_t {
+    size_t blocksize;
+    lpfloat_t * mix;
+    int numnodes;
+    ugen_t ** nodes;
+    int * numconnections;
+    lpugenconnection_t ** connections;
+} lpugenplan_t;
+
+typedef struct lpugenplan_factory_t {
+    lpugenplan_t * (*create)(int numnodes, size_t blocksize);
+    void (*add)(lpugenplan_t * plan, int node, ugen_t * u);
+    void (*connect)(lpugenplan_t * plan, int node, int outport, ugen_t * dest, int inport, lpfloat_t mult, lpfloat_t add);
+    void (*process)(lpugenplan_t * plan, lpfloat_t * out, size_t nframes, int channels);
+    void (*destroy)(lpugenplan_t * plan);
+} lpugenplan_factory_t;
+
+extern const lpugenplan_factory_t LPUgenPlan;
+
+#endif
@@ -14,9 +14,40 @@ void process_pulsar_ugen(ugen_t * u) {
     params->outputs[UPULSAROUT_PHASE] = params->osc->phase;
 }
 
+void process_pulsar_ugen_block(ugen_t * u, size_t nframes) {
+    lpugenpulsar_t * params;
+    lpfloat_t ** in, ** out;
+    size_t i;
+
+    params = (lpugenpulsar_t *)u->params;
+    in = u->inlets;
+    out = u->outlets;
+
+    for(i=0; i < nframes; i++) {
+        if(in[UPULSARIN_FREQ] != NULL) params->osc->freq = in[UPULSARIN_FREQ][i];
+        if(in[UPULSARIN_PHASE] != NULL) params->osc->phase = in[UPULSARIN_PHASE][i];
+        if(in[UPULSARIN_PULSEWIDTH] != NULL) params->osc->pulsewidth = in[UPULSARIN_PULSEWIDTH][i];
+        if(in[UPULSARIN_SATURATION] != NULL) params->osc->saturation = in[UPULSARIN_SATURATION][i];
+        if(in[UPULSARIN_WTMORPH] != NULL) params->osc->wavetable_morph = in[UPULSARIN_WTMORPH][i];
+        if(in[UPULSARIN_WTMORPHFREQ] != NULL) params->osc->wavetable_morph_freq = in[UPULSARIN_WTMORPHFREQ][i];
+        if(in[UPULSARIN_WINMORPH] != NULL) params->osc->window_morph = in[UPULSARIN_WINMORPH][i];
+        if(in[UPULSARIN_WINMORPHFREQ] != NULL) params->osc->window_morph_freq = in[UPULSARIN_WINMORPHFREQ][i];
+
+        out[UPULSAROUT_MAIN][i] = LPPulsarOsc.process(params->osc);
+        out[UPULSAROUT_FREQ][i] = params->osc->freq;
+        out[UPULSAROUT_PHASE][i] = params->osc->phase;
+    }
+
+    if(nframes == 0) return;
+    params->outputs[UPULSAROUT_MAIN] = out[UPULSAROUT_MAIN][nframes-1];
+    params->outputs[UPULSAROUT_FREQ] = params->osc->freq;
+    params->outputs[UPULSAROUT_PHASE] = params->osc->phase;
+}
+
 void destroy_pulsar_ugen(ugen_t * u) {
     lpugenpulsar_t * params;
     params = (lpugenpulsar_t *)u->params;
+    LPUgen.destroy_block(u);
     free(params->osc);
     free(params);
     free(u);
@@ -144,10 +175,17 @@ ugen_t * create_pulsar_ugen(void) {
 
     u->params = (void *)params;
     u->process = process_pulsar_ugen;
+    u->process_block = process_pulsar_ugen_block;
     u->destroy = destroy_pulsar_ugen;
     u->get_output = get_pulsar_ugen_output;
     u->set_param = set_pulsar_ugen_param;
 
+    u->num_outlets = UPULSAR_NUMOUTPUTS;
+    u->num_inlets = UPULSAR_NUMINPUTS;
+
+    u->num_outputs = 1;
+    u->num_inputs = 0;
+
     return u;
 }
 
@@ -11,9 +11,33 @@ void process_sine_ugen(ugen_t * u) {
     params->outputs[USINEOUT_PHASE] = params->osc->phase;
 }
 
+void process_sine_ugen_block(ugen_t * u, size_t nframes) {
+    lpugensine_t * params;
+    lpfloat_t ** in, ** out;
+    size_t i;
+
+    params = (lpugensine_t *)u->params;
+    in = u->inlets;
+    out = u->outlets;
+
+    for(i=0; i < nframes; i++) {
+        if(in[USINEIN_FREQ] != NULL) params->osc->freq = in[USINEIN_FREQ][i];
+        if(in[USINEIN_PHASE] != NULL) params->osc->phase = in[USINEIN_PHASE][i];
+        out[USINEOUT_MAIN][i] = LPSineOsc.process(params->osc);
+        out[USINEOUT_FREQ][i] = params->osc->freq;
+        out[USINEOUT_PHASE][i] = params->osc->phase;
+    }
+
+    if(nframes == 0) return;
+    params->outputs[USINEOUT_MAIN] = out[USINEOUT_MAIN][nframes-1];
+    params->outputs[USINEOUT_FREQ] = params->osc->freq;
+    params->outputs[USINEOUT_PHASE] = params->osc->phase;
+}
+
 void destroy_sine_ugen(ugen_t * u) {
     lpugensine_t * params;
     params = (lpugensine_t *)u->params;
+    LPUgen.destroy_block(u);
     free(params->osc);
     free(params);
     free(u);
@@ -44,6 +68,7 @@ ugen_t * create_sine_ugen(void) {
 
     u->params = (void *)params;
     u->process = process_sine_ugen;
+    u->process_block = process_sine_ugen_block;
     u->destroy = destroy_sine_ugen;
     u->get_output = get_sine_ugen_output;
     u->set_param = set_sine_ugen_param;
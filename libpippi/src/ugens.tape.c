@@ -16,9 +16,40 @@ void process_tape_ugen(ugen_t * u) {
     params->outputs[UTAPEOUT_PHASE] = params->osc->phase;
 }
 
+void process_tape_ugen_block(ugen_t * u, size_t nframes) {
+    lpugentape_t * params;
+    lpfloat_t ** in, ** out;
+    size_t i;
+
+    params = (lpugentape_t *)u->params;
+    in = u->inlets;
+    out = u->outlets;
+
+    for(i=0; i < nframes; i++) {
+        if(in[UTAPEIN_SPEED] != NULL) params->osc->speed = in[UTAPEIN_SPEED][i];
+        if(in[UTAPEIN_PHASE] != NULL) params->osc->phase = in[UTAPEIN_PHASE][i];
+        if(in[UTAPEIN_PULSEWIDTH] != NULL) params->osc->pulsewidth = in[UTAPEIN_PULSEWIDTH][i];
+        if(in[UTAPEIN_START] != NULL) params->osc->start = in[UTAPEIN_START][i];
+        if(in[UTAPEIN_RANGE] != NULL) params->osc->range = in[UTAPEIN_RANGE][i];
+
+        LPTapeOsc.process(params->osc);
+
+        out[UTAPEOUT_MAIN][i] = params->osc->current_frame->data[0];
+        out[UTAPEOUT_SPEED][i] = params->osc->speed;
+        out[UTAPEOUT_PHASE][i] = params->osc->phase;
+        out[UTAPEOUT_GATE][i] = params->osc->gate;
+    }
+
+    if(nframes == 0) return;
+    params->outputs[UTAPEOUT_MAIN] = out[UTAPEOUT_MAIN][nframes-1];
+    params->outputs[UTAPEOUT_SPEED] = params->osc->speed;
+    params->outputs[UTAPEOUT_PHASE] = params->osc->phase;
+}
+
 void destroy_tape_ugen(ugen_t * u) {
     lpugentape_t * params;
     params = (lpugentape_t *)u->params;
+    LPUgen.destroy_block(u);
     free(params->osc->current_frame);
     free(params->osc);
     free(params);
@@ -91,6 +122,7 @@ ugen_t * create_tape_ugen(void) {
 
     u->params = (void *)params;
     u->process = process_tape_ugen;
+    u->process_block = process_tape_ugen_block;
     u->destroy = destroy_tape_ugen;
     u->get_output = get_tape_ugen_output;
     u->set_param = set_tape_ugen_param;
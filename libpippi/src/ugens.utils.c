@@ -10,9 +10,32 @@ void process_mult_ugen(ugen_t * u) {
     params->outputs[UMULTOUT_B] = params->b;
 }
 
+void process_mult_ugen_block(ugen_t * u, size_t nframes) {
+    lpugenmult_t * params;
+    lpfloat_t ** in, ** out;
+    size_t i;
+
+    params = (lpugenmult_t *)u->params;
+    in = u->inlets;
+    out = u->outlets;
+
+    for(i=0; i < nframes; i++) {
+        if(in[UMULTIN_A] != NULL) params->a = in[UMULTIN_A][i];
+        if(in[UMULTIN_B] != NULL) params->b = in[UMULTIN_B][i];
+        out[UMULTOUT_MAIN][i] = params->a * params->b;
+        out[UMULTOUT_A][i] = params->a;
+        out[UMULTOUT_B][i] = params->b;
+    }
+
+    params->outputs[UMULTOUT_MAIN] = params->a * params->b;
+    params->outputs[UMULTOUT_A] = params->a;
+    params->outputs[UMULTOUT_B] = params->b;
+}
+
 void destroy_mult_ugen(ugen_t * u) {
     lpugenmult_t * params;
     params = (lpugenmult_t *)u->params;
+    LPUgen.destroy_block(u);
     free(params);
     free(u);
 }
@@ -43,10 +66,17 @@ ugen_t * create_mult_ugen(void) {
 
     u->params = (void *)params;
     u->process = process_mult_ugen;
+    u->process_block = process_mult_ugen_block;
     u->destroy = destroy_mult_ugen;
     u->get_output = get_mult_ugen_output;
     u->set_param = set_mult_ugen_param;
 
+    u->num_outlets = 3;
+    u->num_inlets = 2;
+
+    u->num_outputs = 1;
+    u->num_inputs = 0;
+
     return u;
 }
 
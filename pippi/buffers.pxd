@@ -123,21 +123,11 @@ cdef extern from "pippicore.h":
         #void (*destroy_stack)(lpstack_t *)
 
     ctypedef struct lprand_t:
-        lpfloat_t logistic_seed
-        lpfloat_t logistic_x
-
-        lpfloat_t lorenz_timestep
-        lpfloat_t lorenz_x
-        lpfloat_t lorenz_y
-        lpfloat_t lorenz_z
-        lpfloat_t lorenz_a
-        lpfloat_t lorenz_b
-        lpfloat_t lorenz_c
-
         void (*preseed)()
         void (*seed)(int)
 
         lpfloat_t (*stdlib)(lpfloat_t, lpfloat_t)
+        lpfloat_t (*xoshiro)(lpfloat_t, lpfloat_t)
         lpfloat_t (*logistic)(lpfloat_t, lpfloat_t)
 
         lpfloat_t (*lorenz)(lpfloat_t, lpfloat_t)
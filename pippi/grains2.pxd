@@ -1,3 +1,5 @@
+from libc.stdint cimport uint64_t
+
 cdef extern from "pippicore.h":
     cdef enum Windows:
         WIN_NONE,
@@ -106,6 +108,9 @@ cdef extern from "oscs.tape.h":
         int gate
 
 cdef extern from "microsound.h":
+    int LPFORMATION_BLOCKSIZE
+    int LPFORMATION_RENDER_CHUNK
+
     ctypedef struct lpgrain_t:
         size_t length
         int channels
@@ -141,13 +146,35 @@ cdef extern from "microsound.h":
         lpfloat_t pan
         lpfloat_t pulsewidth 
 
+        int gridincrement
+        lpfloat_t grid
+        size_t incpos
+        size_t increment
+
         lpbuffer_t * source
         lpbuffer_t * window
         lpbuffer_t * current_frame
 
+    ctypedef struct lpformationctl_t:
+        lpfloat_t amp
+        lpfloat_t pulsewidth
+        lpfloat_t grainlength
+        lpfloat_t grainlength_jitter
+        lpfloat_t grainlength_maxjitter
+        lpfloat_t speed
+        lpfloat_t spread
+        lpfloat_t grid_jitter
+        lpfloat_t grid_maxjitter
+        lpfloat_t grid
+        lpfloat_t offset
+
     ctypedef struct lpformation_factory_t:
         lpformation_t * (*create)(int numgrains, lpbuffer_t * src, lpbuffer_t * win);
         void (*process)(lpformation_t *)
+        void (*process_block)(lpformation_t *, lpformationctl_t *, lpfloat_t *, size_t) nogil
+        void (*setctl)(lpformation_t *, lpformationctl_t *) nogil
+        void (*seed)(lpformation_t *, uint64_t) nogil
+        void (*render)(lpformation_t *, lpformationctl_t *, size_t, lpfloat_t *, size_t, int) nogil
         void (*destroy)(lpformation_t *)
 
     extern const lpformation_factory_t LPFormation
@@ -169,6 +196,9 @@ cdef class Cloud2:
     cdef double[:] spread
     cdef double[:] grid
     cdef bint gridincrement
+    cdef size_t blocksize
+
+    cdef void _readctl(Cloud2 self, double pos, double length, lpformationctl_t * ctl) noexcept nogil
 
     """
     cdef int[:] mask
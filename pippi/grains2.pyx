@@ -1,7 +1,9 @@
 cimport cython
 cimport numpy as np
 import numpy as np
+from libc.stdlib cimport malloc, free
 
+from pippi cimport rand
 from pippi.soundbuffer cimport SoundBuffer
 from pippi.wavetables cimport Wavetable, to_window
 
@@ -118,6 +120,7 @@ cdef class Cloud2:
             int numgrains=2,
             unsigned int wtsize=4096,
             bint gridincrement=False,
+            size_t blocksize=LPFORMATION_BLOCKSIZE,
         ):
 
         # TODO: 
@@ -157,6 +160,7 @@ cdef class Cloud2:
         self.grainmaxjitter = to_window(grainmaxjitter)
         self.grainjitter = to_window(grainjitter)
         self.gridincrement = gridincrement
+        self.blocksize = max(1, blocksize)
 
         sndlength = <size_t>len(snd.frames)
         srcbuf = LPBuffer.create(sndlength, self.channels, self.samplerate)
@@ -173,43 +177,83 @@ cdef class Cloud2:
             LPBuffer.destroy(self.formation.source)
             LPBuffer.destroy(self.formation.window)
 
-    def play(self, double length):
-        cdef size_t i, c, framelength, incpos, increment
-        cdef SoundBuffer out
-        cdef double pos, amp
+    cdef void _readctl(Cloud2 self, double pos, double length, lpformationctl_t * ctl) noexcept nogil:
+        ctl.amp = _linear_pos(self.amp, pos)
+        ctl.pulsewidth = _linear_pos(self.pulsewidth, pos)
+        ctl.grainlength = _linear_pos(self.grainlength, pos)
+        ctl.grainlength_jitter = _linear_pos(self.grainjitter, pos)
+        ctl.grainlength_maxjitter = _linear_pos(self.grainmaxjitter, pos)
+        ctl.speed = _linear_pos(self.speed, pos)
+        ctl.spread = _linear_pos(self.spread, pos)
+        ctl.grid_jitter = _linear_pos(self.gridjitter, pos)
+        ctl.grid_maxjitter = _linear_pos(self.gridmaxjitter, pos)
+        ctl.grid = _linear_pos(self.grid, pos)
+        ctl.offset = pos * length
+
+    def play(self, double length, int numthreads=1, object seed=None):
+        """ Render the cloud.
+
+            When numthreads > 1 or a seed is given, the grains are 
+            rendered in parallel across numthreads threads. Every grain 
+            gets its own random stream derived from the seed, so the 
+            output for a given seed is identical for any thread count.
+        """
+        cdef size_t i, framelength, blocklength, span, numblocks, b
+        cdef lpformationctl_t ctl
+        cdef lpformationctl_t * ctls = NULL
+        cdef double[:,::1] frames
+        cdef bint parallel = numthreads > 1 or seed is not None
 
-        increment = <size_t>(self.formation.grainlength * self.samplerate)
         framelength = <size_t>(length * self.samplerate)
-        out = SoundBuffer(length=length, channels=self.channels, samplerate=self.samplerate)
-
-        incpos = 0
-        for i in range(framelength):
-            pos = i / <double>framelength
-            amp = _linear_pos(self.amp, pos)
-
-            self.formation.pulsewidth = _linear_pos(self.pulsewidth, pos)
-            self.formation.grainlength = _linear_pos(self.grainlength, pos)
-
-            self.formation.grainlength_jitter = _linear_pos(self.grainjitter, pos)
-            self.formation.grainlength_maxjitter = _linear_pos(self.grainmaxjitter, pos)
-            self.formation.speed = _linear_pos(self.speed, pos)
-            self.formation.spread = _linear_pos(self.spread, pos)
-            self.formation.grid_jitter = _linear_pos(self.gridjitter, pos)
-            self.formation.grid_maxjitter = _linear_pos(self.gridmaxjitter, pos)
-            
-            if not self.gridincrement:
-                self.formation.offset = pos * length
-            elif incpos >= increment:
-                self.formation.offset += _linear_pos(self.grid, pos)
-                while incpos >= increment:
-                    incpos -= increment
-                increment = <size_t>(self.formation.grainlength * self.samplerate)
-
-            LPFormation.process(self.formation)
-            for c in range(self.channels):
-                out.frames[i, c] = self.formation.current_frame.data[c] * amp
-
-            incpos += 1
-
-        return out
+        frames = np.zeros((framelength, self.channels), dtype='d')
+
+        if framelength == 0:
+            return SoundBuffer(frames, channels=self.channels, samplerate=self.samplerate)
+
+        if parallel:
+            if seed is None:
+                seed = rand.randint(0, 2**31-1)
+            LPFormation.seed(self.formation, <uint64_t>(int(seed) & 0xffffffffffffffff))
+
+            # Render in spans of whole blocks so the control 
+            # targets never need to be held for the entire length
+            numblocks = max(1, <size_t>LPFORMATION_RENDER_CHUNK // self.blocksize) * 16
+            span = numblocks * self.blocksize
+            ctls = <lpformationctl_t *>malloc(numblocks * sizeof(lpformationctl_t))
+            if ctls == NULL:
+                raise MemoryError('Could not allocate control blocks for the cloud render')
+
+        with nogil:
+            # Start from the control values at the beginning of the 
+            # curves, then read the curves once per control block and 
+            # let the formation ramp toward them over the block.
+            self._readctl(0, length, &ctl)
+            self.formation.gridincrement = self.gridincrement
+            LPFormation.setctl(self.formation, &ctl)
+            self.formation.incpos = 0
+            self.formation.increment = <size_t>(ctl.grainlength * self.samplerate)
+            if self.formation.increment < 1:
+                self.formation.increment = 1
+
+            if parallel:
+                i = 0
+                while i < framelength:
+                    blocklength = min(span, framelength - i)
+                    numblocks = (blocklength + self.blocksize - 1) // self.blocksize
+                    for b in range(numblocks):
+                        self._readctl(min(i + (b+1) * self.blocksize, framelength) / <double>framelength, length, &ctls[b])
+                    LPFormation.render(self.formation, ctls, self.blocksize, &frames[i,0], blocklength, numthreads)
+                    i += blocklength
+
+                free(ctls)
+
+            else:
+                i = 0
+                while i < framelength:
+                    blocklength = min(self.blocksize, framelength - i)
+                    self._readctl((i + blocklength) / <double>framelength, length, &ctl)
+                    LPFormation.process_block(self.formation, &ctl, &frames[i,0], blocklength)
+                    i += blocklength
+
+        return SoundBuffer(frames, channels=self.channels, samplerate=self.samplerate)
 
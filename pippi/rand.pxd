@@ -1,9 +1,23 @@
 #cython: language_level=3
 
+from libc.stdint cimport uint64_t
+
 cdef extern from "pippicore.h":
     ctypedef double lpfloat_t
 
-    ctypedef struct lprand_t:
+    cdef enum LPRNGModes:
+        LPRNG_XOSHIRO,
+        LPRNG_LOGISTIC,
+        LPRNG_LORENZ,
+        LPRNG_LORENZX,
+        LPRNG_LORENZY,
+        LPRNG_LORENZZ,
+        NUM_LPRNG_MODES
+
+    ctypedef struct lprng_t:
+        uint64_t seed
+        int mode
+
         lpfloat_t logistic_seed
         lpfloat_t logistic_x
 
@@ -15,10 +29,23 @@ cdef extern from "pippicore.h":
         lpfloat_t lorenz_b
         lpfloat_t lorenz_c
 
+    ctypedef struct lprng_factory_t:
+        lprng_t * (*create)(uint64_t seed)
+        void (*init)(lprng_t * rng, uint64_t seed)
+        void (*seed)(lprng_t * rng, uint64_t seed)
+        void (*split)(lprng_t * rng, lprng_t * stream, uint64_t streamid)
+        lprng_t * (*local)()
+        lpfloat_t (*rand)(lprng_t * rng, lpfloat_t low, lpfloat_t high)
+        int (*randint)(lprng_t * rng, int low, int high)
+        void (*fill)(lprng_t * rng, lpfloat_t * out, size_t length, lpfloat_t low, lpfloat_t high)
+        void (*destroy)(lprng_t * rng)
+
+    ctypedef struct lprand_t:
         void (*preseed)()
         void (*seed)(int)
 
         lpfloat_t (*stdlib)(lpfloat_t, lpfloat_t)
+        lpfloat_t (*xoshiro)(lpfloat_t, lpfloat_t)
         lpfloat_t (*logistic)(lpfloat_t, lpfloat_t)
 
         lpfloat_t (*lorenz)(lpfloat_t, lpfloat_t)
@@ -33,6 +60,7 @@ cdef extern from "pippicore.h":
         int (*choice)(int)
 
     extern lprand_t LPRand
+    extern const lprng_factory_t LPRNG
 
 
 cpdef void preseed()
@@ -25,54 +25,59 @@ cpdef void randmethod(str method='normal'):
         LPRand.rand_base = LPRand.lorenzY
     elif method == 'lorenzZ':
         LPRand.rand_base = LPRand.lorenzZ
+    elif method == 'xoshiro':
+        LPRand.rand_base = LPRand.xoshiro
     else:
         LPRand.rand_base = LPRand.stdlib
 
 cpdef dict randdump():
+    cdef lprng_t * rng = LPRNG.local()
     return dict(
-        logistic_seed = LPRand.logistic_seed,
-        logistic_x = LPRand.logistic_x,
-        lorenz_timestep = LPRand.lorenz_timestep,
-        lorenz_x = LPRand.lorenz_x,
-        lorenz_y = LPRand.lorenz_y,
-        lorenz_z = LPRand.lorenz_z,
-        lorenz_a = LPRand.lorenz_a,
-        lorenz_b = LPRand.lorenz_b,
-        lorenz_c = LPRand.lorenz_c
+        logistic_seed = rng.logistic_seed,
+        logistic_x = rng.logistic_x,
+        lorenz_timestep = rng.lorenz_timestep,
+        lorenz_x = rng.lorenz_x,
+        lorenz_y = rng.lorenz_y,
+        lorenz_z = rng.lorenz_z,
+        lorenz_a = rng.lorenz_a,
+        lorenz_b = rng.lorenz_b,
+        lorenz_c = rng.lorenz_c
     )
 
 def randparams(domain=None, **kwargs):
+    cdef lprng_t * rng = LPRNG.local()
+
     if domain is None:
         return None
 
     if domain == 'logistic':
         if 'seed' in kwargs:
-            LPRand.logistic_seed = <double>kwargs['seed']
+            rng.logistic_seed = <double>kwargs['seed']
 
         if 'x' in kwargs:
-            LPRand.logistic_x = <double>kwargs['x']
+            rng.logistic_x = <double>kwargs['x']
 
     if domain == 'lorenz':
         if 'timestep' in kwargs:
-            LPRand.lorenz_timestep = <double>kwargs['timestep']
+            rng.lorenz_timestep = <double>kwargs['timestep']
 
         if 'x' in kwargs:
-            LPRand.lorenz_x = <double>kwargs['x']
+            rng.lorenz_x = <double>kwargs['x']
 
         if 'y' in kwargs:
-            LPRand.lorenz_y = <double>kwargs['y']
+            rng.lorenz_y = <double>kwargs['y']
 
         if 'z' in kwargs:
-            LPRand.lorenz_z = <double>kwargs['z']
+            rng.lorenz_z = <double>kwargs['z']
 
         if 'a' in kwargs:
-            LPRand.lorenz_a = <double>kwargs['a']
+            rng.lorenz_a = <double>kwargs['a']
 
         if 'b' in kwargs:
-            LPRand.lorenz_b = <double>kwargs['b']
+            rng.lorenz_b = <double>kwargs['b']
 
         if 'c' in kwargs:
-            LPRand.lorenz_c = <double>kwargs['c']
+            rng.lorenz_c = <double>kwargs['c']
 
 cpdef double rand(double low=0, double high=1):
     return LPRand.rand(low, high)
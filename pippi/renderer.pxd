@@ -1,6 +1,6 @@
 #cython: language_level=3
 
-from libc.stdint cimport uint16_t, uint32_t, int32_t
+from libc.stdint cimport uint16_t, uint32_t, int32_t, uint64_t
 from pippi.soundbuffer cimport SoundBuffer
 
 cdef extern from "stdint.h":
@@ -10,7 +10,7 @@ cdef extern from "pippicore.h":
     ctypedef double lpfloat_t
 
     lpfloat_t lpzapgremlins(lpfloat_t x);
-    lpfloat_t lpfilternan(lpfloat_t x);
+    lpfloat_t lpfilternan(lpfloat_t x) nogil
     u_int32_t lphashstr(char * str)
 
     ctypedef struct lpbuffer_t:
@@ -64,8 +64,15 @@ cdef extern from "astrid.h":
     cdef enum LPMessageFlags:
         LPFLAG_NONE,
         LPFLAG_IS_SCHEDULED,
+        LPFLAG_IS_ENCODED_PARAM,
         NUM_LPMESSAGEFLAGS
 
+    cdef enum LPParamTypes:
+        LPPARAM_NONE,
+        LPPARAM_STRING,
+        LPPARAM_INT32,
+        LPPARAM_DOUBLE
+
     cdef enum LPMessageTypes:
         LPMSG_EMPTY,
         LPMSG_PLAY,
@@ -80,14 +87,18 @@ cdef extern from "astrid.h":
         LPMSG_SET_COUNTER,
         LPMSG_MIDI_FROM_DEVICE,
         LPMSG_MIDI_TO_DEVICE,
+        LPMSG_RENDER_STREAM,
+        LPMSG_VOICE,
         NUM_LPMESSAGETYPES
 
     ctypedef struct lpmsg_t:
         double initiated
         double scheduled 
         double completed
+        double dispatched
         double max_processing_time
         size_t onset_delay
+        uint64_t target_frame
         size_t voice_id
         size_t count
         uint16_t flags
@@ -107,6 +118,10 @@ cdef extern from "astrid.h":
         char bank_lsb
         char channel
 
+    ctypedef struct lpmsgchannel_t:
+        int mqd
+        int doorbell
+
     ctypedef struct lpinstrument_t:
         const char * name
         int channels
@@ -122,13 +137,33 @@ cdef extern from "astrid.h":
 
         char qname[NAME_MAX]
         char external_relay_name[NAME_MAX]
-        int msgq
-        int exmsgq
+        lpmsgchannel_t msgchannel
+        lpmsgchannel_t exmsgchannel
         lpmsg_t msg
         lpmsg_t cmd
 
+        double param_flush_interval
+
         lpscheduler_t * async_mixer
 
+    ctypedef struct lpbufferslot_t:
+        unsigned char * data
+        size_t size
+
+    ctypedef struct lplatencyhist_t:
+        pass
+
+    ctypedef struct lpstream_t:
+        size_t capacity
+        size_t lead
+        int channels
+        int samplerate
+        lpfloat_t data[]
+
+    ctypedef struct lprenderq_t:
+        lplatencyhist_t wait
+        lplatencyhist_t render
+
     lpbuffer_t * lpsampler_aquire_and_map(char * name);
     int lpsampler_release_and_unmap(char * name, lpbuffer_t * buf);
     int lpsampler_aquire(char * name);
@@ -152,6 +187,20 @@ cdef extern from "astrid.h":
     int astrid_msgq_read(int mqd, lpmsg_t * msg)
     int astrid_msgq_close(int mqd)
 
+    int astrid_msgchannel_read(lpmsgchannel_t * channel, lpmsg_t * msg)
+
+    ctypedef struct lpmsgparam_t:
+        const char * key
+        size_t keylen
+        int type
+        int32_t i
+        double d
+        const char * s
+        size_t slen
+
+    int astrid_params_encode(lpmsg_t * msg)
+    int astrid_params_next(const char * params, size_t * pos, lpmsgparam_t * param)
+
     int lpmidi_setcc(int device_id, int cc, int value)
     int lpmidi_getcc(int device_id, int cc)
     int lpmidi_setnote(int device_id, int note, int velocity)
@@ -172,13 +221,40 @@ cdef extern from "astrid.h":
 
     int astrid_instrument_restore_param_session_snapshot(lpinstrument_t * instrument, int snapshot_id)
     int astrid_instrument_save_param_session_snapshot(lpinstrument_t * instrument, int num_params, int snapshot_id)
+    int astrid_instrument_interpolate_param_session_snapshots(lpinstrument_t * instrument, int from_snapshot_id, int to_snapshot_id, double seconds)
 
     void scheduler_schedule_event(lpscheduler_t * s, lpbuffer_t * buf, size_t delay)
     int lpscheduler_get_now_seconds(double * now)
 
     lpbuffer_t * deserialize_buffer(char * str, lpmsg_t * msg)
+    size_t serialize_buffer_size(size_t length, int channels)
+    size_t serialize_buffer_header(unsigned char * str, size_t length, int channels, int samplerate, int is_looping, size_t onset) nogil
+    int astrid_instrument_reserve_bufstr(char * instrument_name, size_t size, lpbufferslot_t * slot)
+    int astrid_instrument_commit_bufstr(char * instrument_name, lpbufferslot_t * slot)
     int astrid_instrument_publish_bufstr(char * instrument_name, unsigned char * bufstr, size_t size)
 
+    int ASTRID_LATENCY_LOG_INTERVAL
+    int ASTRID_STREAM_LENGTH
+    int ASTRID_STREAM_CHUNK
+    double ASTRID_STREAM_LEAD
+    double ASTRID_STREAM_TIMEOUT
+    double ASTRID_PARAM_FLUSH_INTERVAL
+    int astrid_instrument_stream_open(char * instrument_name, int channels, int samplerate, size_t capacity, size_t lead, lpbufferslot_t * slot)
+    ssize_t astrid_stream_wait(lpstream_t * stream, double timeout) nogil
+    void astrid_stream_commit(lpstream_t * stream, size_t frames) nogil
+    int astrid_instrument_stream_close(lpbufferslot_t * slot)
+
+    lprenderq_t * astrid_renderq_create()
+    int astrid_renderq_push(lprenderq_t * q, lpmsg_t * msg)
+    int astrid_renderq_push_wait(lprenderq_t * q, lpmsg_t * msg) nogil
+    int astrid_renderq_pop(lprenderq_t * q, lpmsg_t * msg, double * wait) nogil
+    size_t astrid_latency_record(lplatencyhist_t * h, double seconds)
+    void astrid_renderq_log_stats(lprenderq_t * q, const char * name)
+    int astrid_renderq_destroy(lprenderq_t * q)
+
+    int astrid_instrument_watch(const char * path)
+    int astrid_instrument_watch_changed(int fd, const char * path)
+
     lpinstrument_t * astrid_instrument_start(
         const char * name, 
         int channels, 
@@ -196,11 +272,13 @@ cdef extern from "astrid.h":
 
     int astrid_instrument_stop(lpinstrument_t * instrument)
     int astrid_instrument_tick(lpinstrument_t * instrument)
+    int astrid_offline_seed(lpinstrument_t * instrument, size_t stream)
     void scheduler_cleanup_nursery(lpscheduler_t * s)
     int relay_message_to_seq(lpinstrument_t * instrument)
     int send_message(char * qname, lpmsg_t msg)
     int send_play_message(lpmsg_t msg)
     int send_serial_message(lpmsg_t msg)
+    int send_play_messages(lpmsg_t * msgs, int count)
 
 cdef class MessageEvent:
     cdef lpmsg_t * msg
@@ -237,6 +315,8 @@ cdef class Instrument:
     cdef public dict cache
     cdef public lpmsg_t msg # a copy of the last message received
     cdef public size_t last_reload
+    cdef int watchfd # inotify watch on the script, per process
+    cdef int watchpid
     cdef public double max_processing_time
     cdef public int channels
     cdef public double samplerate
@@ -246,12 +326,20 @@ cdef class Instrument:
     cdef lpinstrument_t * i
     cpdef EventContext get_event_context(Instrument self, str msgstr=*, bint with_graph=*)
     cpdef lpmsg_t get_message(Instrument self)
+    cdef int reload_if_changed(Instrument self) except -1
     cdef SoundBuffer read_from_adc(Instrument self, double length, double offset=*, int channels=*, int samplerate=*)
     cdef SoundBuffer read_from_resampler(Instrument self, double length, double offset=*, int channels=*, int samplerate=*, str instrument=*)
     cdef SoundBuffer read_block_from_sampler(Instrument self, str name, double length, double offset=*, int channels=*, int samplerate=*)
     cdef SoundBuffer read_from_sampler(Instrument self, str name)
     cdef void save_to_sampler(Instrument self, str name, SoundBuffer snd)
 
+cdef class StreamWriter:
+    cdef lpbufferslot_t slot
+    cdef lpstream_t * stream
+    cdef size_t pos
+    cdef int write(StreamWriter self, SoundBuffer snd) except -1
+    cdef int close(StreamWriter self) except -1
+
 cdef class SessionParamBucket:
     cdef Instrument instrument
 
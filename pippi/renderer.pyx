@@ -4,15 +4,15 @@ import array
 from cpython cimport array
 from libc.stdlib cimport calloc, free
 from libc.string cimport strcpy, memcpy, strncpy
+from posix.unistd cimport close
 import logging
 from logging.handlers import SysLogHandler
 import importlib
 import importlib.util
-from multiprocessing import Process, SimpleQueue
+import multiprocessing
 import os
 from pathlib import Path
 import platform
-import struct
 import subprocess
 import sys
 import time
@@ -27,6 +27,10 @@ from pippi.soundbuffer cimport SoundBuffer
 
 NUM_COMRADES = 32
 
+# The render queue and its latency histograms live in shared 
+# memory mapped before the render pool is forked
+cdef lprenderq_t * renderq = NULL
+
 class InstrumentError(Exception):
     pass
 
@@ -42,39 +46,103 @@ if not logger.handlers:
     warnings.simplefilter('always')
 
 
-cdef bytes serialize_buffer(SoundBuffer buf, int is_looping, lpmsg_t msg):
-    cdef bytearray strbuf
-    cdef size_t audiosize, length, msgsize
-    cdef int channels, samplerate
-    cdef unsigned char[:] msgview
-
-    msgsize = sizeof(lpmsg_t)
+@cython.boundscheck(False)
+@cython.wraparound(False)
+cdef int publish_buffer(char * instrument_name, SoundBuffer buf, int is_looping, lpmsg_t * msg) except -1:
+    """ Serialize the buffer straight into a shared memory 
+        slot and hand it off to the mixer
+    """
+    cdef lpbufferslot_t slot
+    cdef double[:,:] frames = buf.frames
+    cdef size_t length, offset, i
+    cdef int channels, samplerate, c
+    cdef lpfloat_t sample
+    cdef unsigned char * audio
 
     channels = <int>buf.channels
     samplerate = <int>buf.samplerate
     length = <size_t>len(buf)
 
-    # size of audio data 
-    audiosize = length * channels * sizeof(lpfloat_t)
+    if astrid_instrument_reserve_bufstr(instrument_name, serialize_buffer_size(length, channels), &slot) < 0:
+        raise InstrumentError('Could not reserve shared memory for render')
+
+    with nogil:
+        offset = serialize_buffer_header(slot.data, length, channels, samplerate, is_looping, 0)
+
+        # the audio follows a packed header so it may not 
+        # be aligned: write each sample with memcpy
+        audio = slot.data + offset
+        for i in range(length):
+            for c in range(channels):
+                sample = lpfilternan(frames[i,c])
+                memcpy(audio + (i * channels + c) * sizeof(lpfloat_t), &sample, sizeof(lpfloat_t))
+
+        offset += length * channels * sizeof(lpfloat_t)
+        memcpy(slot.data + offset, msg, sizeof(lpmsg_t))
 
-    strbuf = bytearray()
+    if astrid_instrument_commit_bufstr(instrument_name, &slot) < 0:
+        raise InstrumentError('Could not publish render')
 
-    strbuf += struct.pack('N', audiosize)
-    strbuf += struct.pack('N', length)
-    strbuf += struct.pack('i', channels)
-    strbuf += struct.pack('i', samplerate)
-    strbuf += struct.pack('i', is_looping)
-    strbuf += struct.pack('N', 0)
+    return 0
 
-    for i in range(length):
-        for c in range(channels):
-            strbuf += struct.pack('d', lpfilternan(buf.frames[i,c]))
+cdef class StreamWriter:
+    """ Streams a render to the mixer in chunks as it is produced.
 
-    msgview = <unsigned char[:msgsize]>(<unsigned char *>&msg)
-    for i in range(msgsize):
-        strbuf.append(msgview[i])
+        Frames go into a ring in shared memory which the mixer 
+        starts playing once `lead` seconds have been written.
+    """
+    def __cinit__(self, bytes instrument_name, int channels, int samplerate, double lead=ASTRID_STREAM_LEAD):
+        cdef size_t capacity = <size_t>(ASTRID_STREAM_LENGTH * samplerate)
+        self.stream = NULL
+        self.pos = 0
+        if astrid_instrument_stream_open(instrument_name, channels, samplerate, capacity, <size_t>(lead * samplerate), &self.slot) < 0:
+            raise InstrumentError('Could not open render stream')
+        self.stream = <lpstream_t *>self.slot.data
 
-    return bytes(strbuf)
+    def __dealloc__(self):
+        if self.stream != NULL:
+            astrid_instrument_stream_close(&self.slot)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    cdef int write(StreamWriter self, SoundBuffer snd) except -1:
+        cdef double[:,:] frames = snd.frames
+        cdef size_t length = <size_t>len(snd)
+        cdef size_t written = 0, chunk, i, frame
+        cdef int c, channels, sndchannels = <int>snd.channels
+        cdef ssize_t space = 0
+
+        if self.stream == NULL:
+            raise InstrumentError('Render stream is closed')
+
+        channels = self.stream.channels
+
+        with nogil:
+            while written < length:
+                space = astrid_stream_wait(self.stream, ASTRID_STREAM_TIMEOUT)
+                if space < 0:
+                    break
+
+                chunk = min(length - written, <size_t>space, <size_t>ASTRID_STREAM_CHUNK)
+                for i in range(chunk):
+                    frame = (self.pos + i) % self.stream.capacity
+                    for c in range(channels):
+                        self.stream.data[frame * channels + c] = lpfilternan(frames[written + i, c % sndchannels])
+
+                astrid_stream_commit(self.stream, chunk)
+                self.pos += chunk
+                written += chunk
+
+        if space < 0:
+            raise InstrumentError('Render stream stalled: the mixer stopped reading')
+
+        return 0
+
+    cdef int close(StreamWriter self) except -1:
+        if self.stream != NULL:
+            astrid_instrument_stream_close(&self.slot)
+            self.stream = NULL
+        return 0
 
 cdef class MessageEvent:
     def __cinit__(self,
@@ -108,6 +176,10 @@ cdef class MessageEvent:
         strcpy(self.msg.msg, byte_params)
         strcpy(self.msg.instrument_name, byte_instrument_name)
 
+        # Parse update params once here instead of in every reader
+        if msgtype == LPMSG_UPDATE and astrid_params_encode(self.msg) < 0:
+            logger.warning('MessageEvent: could not encode update params, sending them as text')
+
     cpdef int schedule(MessageEvent self, double now=0):
         self.msg.initiated = now
         return send_play_message(self.msg[0])
@@ -400,6 +472,8 @@ cdef class Instrument:
         self.path = path
         self.cache = {}
         self.last_reload = 0
+        self.watchfd = -1
+        self.watchpid = 0
         self.max_processing_time = 0
 
         self.i = astrid_instrument_start(self.ascii_name, channels, 1, adc_length, resampler_length, NULL, NULL, 
@@ -415,6 +489,8 @@ cdef class Instrument:
         self.load_renderer(name, path)
 
     def __dealloc__(self):
+        if self.watchfd >= 0:
+            close(self.watchfd)
         free(self.ascii_name)
 
     def load_renderer(self, name, path):
@@ -453,6 +529,8 @@ cdef class Instrument:
                 else:
                     self.default_midi_device = 1
 
+                self.i.param_flush_interval = getattr(self.renderer, 'PARAM_FLUSH_INTERVAL', ASTRID_PARAM_FLUSH_INTERVAL)
+
                 if hasattr(self.renderer, 'PARAMS'):
                     logger.debug('mapping params...')
                     self.instrument_param_type_map = self.renderer.PARAMS
@@ -478,11 +556,46 @@ cdef class Instrument:
 
     cpdef lpmsg_t get_message(Instrument self):
         cdef lpmsg_t msg
-        if astrid_msgq_read(self.i.exmsgq, &msg) < 0:
+        if astrid_msgchannel_read(&self.i.exmsgchannel, &msg) < 0:
             raise InstrumentError('Could not get the instrument message')
         self.msg = msg # so many copies omg
         return msg
 
+    cdef int reload_if_changed(Instrument self) except -1:
+        """ Reloads the renderer if the script has been saved 
+            since the last reload. Returns 1 if it was reloaded.
+
+            Changes are picked up from an inotify watch owned by 
+            the calling process, falling back to the script mtime 
+            when no watch is available.
+        """
+        cdef size_t last_edit
+        cdef int changed = -1 # unknown: compare the mtime
+        path_byte_string = self.path.encode('UTF-8')
+        cdef char * _path = path_byte_string
+
+        if self.watchpid != os.getpid():
+            # forked processes would share (and steal) each 
+            # other's events, so open a watch of our own
+            if self.watchfd >= 0:
+                close(self.watchfd)
+            self.watchfd = astrid_instrument_watch(_path)
+            self.watchpid = os.getpid()
+
+        elif self.watchfd >= 0:
+            changed = astrid_instrument_watch_changed(self.watchfd, _path)
+
+        if changed == 0:
+            return 0
+
+        last_edit = os.path.getmtime(self.path)
+        if changed > 0 or last_edit > self.last_reload:
+            self.reload()
+            self.last_reload = last_edit
+            return 1
+
+        return 0
+
     cpdef EventContext get_event_context(Instrument self, str msgstr=None, bint with_graph=False):
         cdef bytes render_params = self.msg.msg
 
@@ -684,36 +797,20 @@ cdef class Instrument:
     def set_session_float_param(self, u_int32_t hash_key, float value):
         astrid_instrument_set_param_float(self.i, hash_key, value)
 
-    def handle_update_message(self, str msgstr):
+    def handle_update_message(self, dict params):
         cdef EventContext ctx 
-        cdef dict params
-        cdef str p, k, v
-        cdef size_t last_edit
 
-        last_edit = os.path.getmtime(self.path)
-        if last_edit > self.last_reload:
-            self.reload()
-            self.last_reload = last_edit
+        self.reload_if_changed()
 
         if not hasattr(self.renderer, 'update'):
             logger.warning('Ignoring update message: this instrument has no callback registered')
             return None
 
         ctx = self.get_event_context()
-        params = dict()
 
         try:
-            # read msg body, split and call update with each
-            for p in msgstr.split(' '):
-                if '=' in p:
-                    p = p.strip()
-                    k, v = tuple(p.split('='))
-                else:
-                    v = None
-                    k = p.strip()
-                    if k == '':
-                        continue
-                self.renderer.update(ctx, k.strip(), v.strip())
+            for k, v in params.items():
+                self.renderer.update(ctx, k, v)
         except Exception as e:
             logger.exception('Error during %s update message handling: %s' % (self.name, e))
 
@@ -767,7 +864,9 @@ cdef tuple collect_players(Instrument instrument):
 cdef int render_event(Instrument instrument, str msgstr):
     cdef set players
     cdef bint loop
-    cdef bytes bufstr
+    cdef bint stream
+    cdef double stream_lead
+    cdef StreamWriter writer
     cdef bytes render_params = instrument.msg.msg
     cdef int dacid = 0
     cdef EventContext ctx 
@@ -783,11 +882,17 @@ cdef int render_event(Instrument instrument, str msgstr):
 
     players, loop = collect_players(instrument)
 
+    # Streaming instruments play each player's output 
+    # back as one continuous voice while it renders
+    stream = getattr(instrument.renderer, 'STREAM', False)
+    stream_lead = getattr(instrument.renderer, 'STREAM_LEAD', ASTRID_STREAM_LEAD)
+
     for player in players:
         try:
             ctx.count = 0
             ctx.tick = 0
             generator = player(ctx)
+            writer = None
 
             try:
                 for snd in generator:
@@ -799,12 +904,20 @@ cdef int render_event(Instrument instrument, str msgstr):
                     else:
                         dacid = 0
 
-                    bufstr = serialize_buffer(snd, loop, instrument.msg)
-                    astrid_instrument_publish_bufstr(_instrument_ascii_name, bufstr, len(bufstr))
+                    if stream:
+                        if writer is None:
+                            writer = StreamWriter(instrument_byte_string, snd.channels, snd.samplerate, stream_lead)
+                        writer.write(snd)
+                    else:
+                        publish_buffer(_instrument_ascii_name, snd, loop, &instrument.msg)
 
             except Exception as e:
                 logger.exception('Error during %s generator render: %s' % (instrument.name, e))
                 return 1
+
+            finally:
+                if writer is not None:
+                    writer.close()
         except Exception as e:
             logger.exception('Error allocating generator for %s render: %s' % (instrument.name, e))
             return 1
@@ -836,6 +949,41 @@ cdef set collect_trigger_planners(Instrument instrument):
     
     return planners
 
+cdef dict read_update_params(lpmsg_t * msg):
+    """ Update params as a dict: typed values straight from 
+        the message when the sender encoded them, or strings 
+        split out of the text form otherwise.
+    """
+    cdef dict params = {}
+    cdef lpmsgparam_t param
+    cdef size_t pos = 0
+    cdef str p, k, v
+
+    if msg.flags & LPFLAG_IS_ENCODED_PARAM:
+        while astrid_params_next(msg.msg, &pos, &param) > 0:
+            k = param.key[:param.keylen].decode('utf-8')
+            if param.type == LPPARAM_INT32:
+                params[k] = param.i
+            elif param.type == LPPARAM_DOUBLE:
+                params[k] = param.d
+            elif param.type == LPPARAM_STRING:
+                params[k] = param.s[:param.slen].decode('utf-8')
+            else:
+                params[k] = None
+        return params
+
+    for p in msg.msg.decode('utf-8').split(' '):
+        p = p.strip()
+        if p == '':
+            continue
+        if '=' in p:
+            k, v = tuple(p.split('=', 1))
+            params[k.strip()] = v.strip()
+        else:
+            params[p] = None
+
+    return params
+
 cdef int trigger_events(Instrument instrument):
     """ Collect the trigger functions in the instrument module
         and compute the triggers to be scheduled.
@@ -848,6 +996,8 @@ cdef int trigger_events(Instrument instrument):
     cdef double now = 0
     cdef bytes trigger_params = instrument.msg.msg
     cdef list trigger_events = []
+    cdef lpmsg_t * batch
+    cdef int numbatched = 0
 
     ctx = instrument.get_event_context()
 
@@ -878,43 +1028,67 @@ cdef int trigger_events(Instrument instrument):
         logger.exception('Error getting now seconds during %s trigger scheduling' % ctx.instrument_name)
         now = 0
 
+    # Message events go out together as one batch, the rest one by one
+    batch = <lpmsg_t *>calloc(max(1, len(trigger_events)), sizeof(lpmsg_t))
+    if batch == NULL:
+        logger.error('Could not allocate the %s trigger batch' % ctx.instrument_name)
+        return 1
+
     for t in trigger_events:
         if t is None:
             logger.debug('Got null trigger in event list')
             continue
+        if isinstance(t, MessageEvent):
+            (<MessageEvent>t).msg.initiated = now
+            batch[numbatched] = (<MessageEvent>t).msg[0]
+            numbatched += 1
+            continue
         if t.schedule(now) < 0:
             logger.exception('Error trying to schedule event from %s trigger generation' % ctx.instrument_name)
         #logger.debug('Scheduled event %s' % t)
 
+    if numbatched > 0 and send_play_messages(batch, numbatched) < 0:
+        logger.error('Error trying to schedule %d events from %s trigger generation' % (numbatched, ctx.instrument_name))
+    free(batch)
+
     if hasattr(instrument.renderer, 'trigger_done'):
         instrument.renderer.trigger_done(ctx)
 
     return 0
 
-def render_executor(Instrument instrument, object q, int comrade_id):
-    cdef size_t last_edit
-    cdef double start=0, end=0
+def render_executor(Instrument instrument, int comrade_id):
+    cdef lpmsg_t msg
+    cdef double start=0, end=0, wait=0
+    cdef int err = 0
+    cdef size_t count
 
     # Prevent multiple processes from sharing the same seed
     dsp.seed(time.time() + comrade_id)
 
     while instrument.i.is_running:
-        msg = q.get()
+        with nogil:
+            err = astrid_renderq_pop(renderq, &msg, &wait)
 
-        if msg is None:
+        if err < 0:
+            logger.error('Renderer comrade %d could not read from the render queue' % comrade_id)
+            return
+
+        if msg.type == LPMSG_SHUTDOWN:
             logger.debug('Renderer comrade %d shutting down' % comrade_id)
             break
 
-        last_edit = os.path.getmtime(instrument.path)
-        if last_edit > instrument.last_reload:
-            instrument.reload()
-            instrument.last_reload = last_edit
+        instrument.reload_if_changed()
+        instrument.msg = msg
+
+        # A seeded headless run seeds each render from its voice, 
+        # so it renders the same whichever comrade picks it up
+        astrid_offline_seed(instrument.i, msg.voice_id)
 
         if lpscheduler_get_now_seconds(&start) < 0:
             logger.exception('Error getting now seconds')
             return
 
-        if render_event(instrument, msg) < 0:
+        if render_event(instrument, msg.msg.decode('utf-8')) < 0:
             logger.exception('Error trying to execute python render...')
             return
 
@@ -923,15 +1097,14 @@ def render_executor(Instrument instrument, object q, int comrade_id):
             return
 
         instrument.max_processing_time = max(instrument.max_processing_time, end - start)
-        logger.debug('%s render time: %f seconds' % (instrument.name, end - start))
+        logger.debug('%s render time: %f seconds (queued for %f seconds)' % (instrument.name, end - start, wait))
 
-cdef int astrid_schedule_python_triggers(Instrument instrument) except -1:
-    cdef size_t last_edit = os.path.getmtime(instrument.path)
+        count = astrid_latency_record(&renderq.render, end - start)
+        if count % ASTRID_LATENCY_LOG_INTERVAL == 0:
+            astrid_renderq_log_stats(renderq, instrument.ascii_name)
 
-    # Reload instrument
-    if last_edit > instrument.last_reload:
-        instrument.reload()
-        instrument.last_reload = last_edit
+cdef int astrid_schedule_python_triggers(Instrument instrument) except -1:
+    instrument.reload_if_changed()
 
     try:
         return trigger_events(instrument)
@@ -945,11 +1118,13 @@ def _run_forever(Instrument instrument,
         int channels, 
         double adc_length,
         double resampler_length,
-        object q, 
     ):
     cdef lpmsg_t msg
+    cdef lpmsg_t shutdown
+    cdef int err = 0
 
     logger.info(f'PY: running forever... {script_path=} {instrument_name=}')
+    astrid_offline_seed(instrument.i, 0)
 
     while True:
         logger.debug('PY MSG: waiting for a message...')
@@ -961,13 +1136,19 @@ def _run_forever(Instrument instrument,
 
         if msg.type == LPMSG_SHUTDOWN:
             logger.debug('PY MSG: shutdown')
+            shutdown = msg
             for _ in range(NUM_COMRADES):
-                q.put(None)
+                # The comrades must all see this, so wait 
+                # for them to work through any backlog
+                with nogil:
+                    err = astrid_renderq_push_wait(renderq, &shutdown)
+                if err < 0:
+                    logger.error('PY MSG: Could not queue shutdown for the render pool')
             break
 
         elif msg.type == LPMSG_UPDATE:
             logger.debug('PY MSG: update')
-            instrument.handle_update_message(msg.msg.decode('utf-8'))
+            instrument.handle_update_message(read_update_params(&msg))
 
         elif msg.type == LPMSG_MIDI_FROM_DEVICE:
             logger.debug('PY MSG: midi from device')
@@ -979,7 +1160,8 @@ def _run_forever(Instrument instrument,
         elif msg.type == LPMSG_PLAY:
             logger.debug('PY MSG: play')
             logger.debug('PY MSG: play params: %s' % msg.msg)
-            q.put(msg.msg.decode('utf-8'))
+            if astrid_renderq_push(renderq, &msg) < 0:
+                logger.error('PY MSG: Could not queue play message for the render pool')
 
         elif msg.type == LPMSG_TRIGGER:
             logger.debug('PY MSG: trigger')
@@ -992,10 +1174,7 @@ def _run_forever(Instrument instrument,
                 if instrument is None:
                     instrument = Instrument(instrument_name, script_path, channels, adc_length, resampler_length)
                 else:
-                    last_edit = os.path.getmtime(instrument.path)
-                    if last_edit > instrument.last_reload:
-                        instrument.reload()
-                        instrument.last_reload = last_edit
+                    instrument.reload_if_changed()
             except InstrumentError as e:
                 logger.error('PY: Error trying to reload instrument. Shutting down...')
                 break
@@ -1017,14 +1196,23 @@ def run_forever(str script_path, str instrument_name=None, int channels=2, doubl
         logger.error('PY: Error trying to start instrument. Shutting down...')
         return
 
-    render_pool = []
-    render_q = SimpleQueue()
+    global renderq
+    renderq = astrid_renderq_create()
+    if renderq == NULL:
+        logger.error('PY: Could not create the render queue. Shutting down...')
+        return
+
+    # The render pool shares renderq with this process, 
+    # which only works if the comrades are forked
+    mp = multiprocessing.get_context('fork')
+
+    render_pool = {}
     for i in range(NUM_COMRADES):
-        comrade = Process(target=render_executor, args=(instrument, render_q, i))
+        comrade = mp.Process(target=render_executor, args=(instrument, i))
         comrade.start()
-        render_pool += [ comrade ]
+        render_pool[i] = comrade
 
-    message_process = Process(target=_run_forever, args=(instrument, script_path, instrument_name, channels, adc_length, resampler_length, render_q))
+    message_process = mp.Process(target=_run_forever, args=(instrument, script_path, instrument_name, channels, adc_length, resampler_length))
     message_process.start()
 
     try:
@@ -1036,19 +1224,22 @@ def run_forever(str script_path, str instrument_name=None, int channels=2, doubl
                 time.sleep(2)
                 continue
 
-            for comrade in render_pool:
+            for i, comrade in render_pool.items():
                 if not comrade.is_alive():
-                    render_pool.remove(comrade)
                     logger.error('Our comrade has become exhausted, and is being relieved')
-                    comrade = Process(target=render_executor, args=(instrument, render_q, i))
+                    comrade = mp.Process(target=render_executor, args=(instrument, i))
                     comrade.start()
-                    render_pool += [ comrade ]
+                    render_pool[i] = comrade
 
     except KeyboardInterrupt as e:
         print('PY: Got keyboard interrupt')
 
     print('Shutting down...')
     message_process.join()
-    for r in render_pool:
+    for r in render_pool.values():
         r.join()
+
+    astrid_renderq_log_stats(renderq, instrument.ascii_name)
+    astrid_renderq_destroy(renderq)
+    renderq = NULL
     print('All done!')
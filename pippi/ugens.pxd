@@ -21,10 +21,16 @@ cdef extern from "pippicore.h":
     extern const lpbuffer_factory_t LPBuffer
 
     ctypedef struct ugen_t:
+        int num_outlets
+        int num_inlets
+        size_t blocksize
+        lpfloat_t ** outlets
+        lpfloat_t ** inlets
         void * params
         lpfloat_t (*get_output)(ugen_t * u, int index)
         void (*set_param)(ugen_t * u, int index, void * value)
         void (*process)(ugen_t * u)
+        void (*process_block)(ugen_t * u, size_t nframes)
         void (*destroy)(ugen_t * u)
 
 cdef extern from "oscs.sine.h":
@@ -190,6 +196,32 @@ cdef extern from "ugens.pulsar.h":
     cdef ugen_t * create_pulsar_ugen()
 
 
+cdef extern from "ugens.graph.h":
+    ctypedef struct lpugenconnection_t:
+        ugen_t * dest
+        int outport
+        int inport
+        lpfloat_t mult
+        lpfloat_t add
+
+    ctypedef struct lpugenplan_t:
+        size_t blocksize
+        lpfloat_t * mix
+        int numnodes
+        ugen_t ** nodes
+        int * numconnections
+        lpugenconnection_t ** connections
+
+    ctypedef struct lpugenplan_factory_t:
+        lpugenplan_t * (*create)(int numnodes, size_t blocksize)
+        void (*add)(lpugenplan_t * plan, int node, ugen_t * u)
+        void (*connect)(lpugenplan_t * plan, int node, int outport, ugen_t * dest, int inport, lpfloat_t mult, lpfloat_t add)
+        void (*process)(lpugenplan_t * plan, lpfloat_t * out, size_t nframes, int channels) nogil
+        void (*destroy)(lpugenplan_t * plan)
+
+    extern const lpugenplan_factory_t LPUgenPlan
+
+
 cdef class Node:
     cdef ugen_t * u
     cdef str ugen_name
@@ -201,4 +233,7 @@ cdef class Node:
 cdef class Graph:
     cdef dict nodes
     cdef object outputs
+    cdef size_t blocksize
+    cdef lpugenplan_t * plan
+    cdef int compile(Graph self) except -1
     cdef double next_sample(Graph self)
@@ -10,6 +10,8 @@ from pippi.soundbuffer cimport SoundBuffer
 
 np.import_array()
 
+cdef int UGEN_GRAPH_BLOCKSIZE = 64
+
 cdef dict UGEN_INPUTNAME_MAP = {
     'sine.freq': USINEIN_FREQ,
     'sine.phase': USINEIN_PHASE,
@@ -53,6 +55,7 @@ cdef dict UGEN_OUTPUTNAME_MAP = {
     'tape.speed': UTAPEOUT_SPEED,
     'tape.phase': UTAPEOUT_PHASE,
     'pulsar.main': UPULSAROUT_MAIN,
+    'pulsar.output': UPULSAROUT_MAIN,
     'pulsar.wavetable_morph': UPULSAROUT_WTMORPH,
     'pulsar.wavetable_morph_freq': UPULSAROUT_WTMORPHFREQ,
     'pulsar.window_morph': UPULSAROUT_WINMORPH,
@@ -156,12 +159,19 @@ cdef class Node:
 
 
 cdef class Graph:
-    def __cinit__(self):
+    def __cinit__(self, size_t blocksize=UGEN_GRAPH_BLOCKSIZE):
         self.nodes = {}
         self.outputs = defaultdict(float)
+        self.blocksize = max(1, blocksize)
+        self.plan = NULL
+
+    def __dealloc__(self):
+        if self.plan != NULL:
+            LPUgenPlan.destroy(self.plan)
 
     def add_node(self, str name, str ugen, *args, **kwargs):
         self.nodes[name] = Node(name, ugen, *args, **kwargs)
+        self.invalidate()
 
     def connect(self, str a, str b, object outmin=None, object outmax=None, double inmin=-1, double inmax=1, object mult=None, object add=None):
         cdef double _mult = 1
@@ -181,53 +191,105 @@ cdef class Graph:
             _add = add
 
         self.nodes[anodename].connections[aportname] += [(bnodename, bportname, _mult, _add)]
-
-    cdef double next_sample(Graph self):
-        cdef double sample = 0
-
-        # first process all the nodes
-        for _, node in self.nodes.items():
-            node.process()
-
-            # connect the outputs to the inputs
+        self.invalidate()
+
+    def invalidate(self):
+        """ Drop the compiled plan so it is rebuilt on the next render
+        """
+        if self.plan != NULL:
+            LPUgenPlan.destroy(self.plan)
+            self.plan = NULL
+
+    def order(self):
+        """ Execution order: each node runs after the nodes feeding it. 
+            Ties (and cycles, which are broken where they are found) 
+            fall back to the order the nodes were added in.
+        """
+        cdef list order = []
+        cdef set done = set()
+        cdef dict inputs = {name: set() for name in self.nodes}
+
+        for name, node in self.nodes.items():
+            for connections in node.connections.values():
+                for connode, _, _, _ in connections:
+                    if connode in inputs and connode != name:
+                        inputs[connode].add(name)
+
+        while len(order) < len(self.nodes):
+            nextnode = None
+            for name in self.nodes:
+                if name not in done and inputs[name] <= done:
+                    nextnode = name
+                    break
+
+            if nextnode is None:
+                nextnode = next(name for name in self.nodes if name not in done)
+
+            order += [nextnode]
+            done.add(nextnode)
+
+        return order
+
+    cdef int compile(Graph self) except -1:
+        cdef Node node, dest
+        cdef int n, outport, inport
+        cdef list order = self.order()
+
+        self.invalidate()
+        self.plan = LPUgenPlan.create(<int>len(order), self.blocksize)
+
+        for n, name in enumerate(order):
+            node = self.nodes[name]
+            LPUgenPlan.add(self.plan, n, node.u)
+
+        for n, name in enumerate(order):
+            node = self.nodes[name]
             for portname, connections in node.connections.items():
-                port = node.get_output(portname)
+                outname = '.'.join([node.ugen_name, portname])
+                if outname not in UGEN_OUTPUTNAME_MAP:
+                    self.invalidate()
+                    raise AttributeError('Invalid output port "%s.%s" for %s ugen' % (name, portname, node.ugen_name))
+                outport = UGEN_OUTPUTNAME_MAP[outname]
+
                 for connode, conport, mult, add in connections:
-                    value = port * mult + add
                     if connode == 'main' and conport == 'output':
-                        sample += value
-                    else:
-                        self.nodes[connode].set_param(conport, value)
+                        LPUgenPlan.connect(self.plan, n, outport, NULL, 0, mult, add)
+                        continue
 
-        return sample
+                    if connode not in self.nodes:
+                        self.invalidate()
+                        raise AttributeError('Invalid node "%s" connected from "%s.%s"' % (connode, name, portname))
 
-    def render(Graph self, double length, int samplerate=DEFAULT_SAMPLERATE, int channels=DEFAULT_CHANNELS):
-        cdef size_t framelength = <size_t>(length * samplerate)
+                    dest = self.nodes[connode]
+                    inname = '.'.join([dest.ugen_name, conport])
+                    if inname not in UGEN_INPUTNAME_MAP:
+                        self.invalidate()
+                        raise AttributeError('Invalid input port "%s.%s" for %s ugen' % (connode, conport, dest.ugen_name))
+                    inport = UGEN_INPUTNAME_MAP[inname]
+
+                    LPUgenPlan.connect(self.plan, n, outport, dest.u, inport, mult, add)
+
+        return 0
+
+    cdef double next_sample(Graph self):
         cdef double sample = 0
-        cdef size_t i
-        cdef int c
 
-        cdef double[:,:] out = np.zeros((framelength, channels))
+        if self.plan == NULL:
+            self.compile()
 
-        for i in range(framelength):
-            sample = 0
+        LPUgenPlan.process(self.plan, &sample, 1, 1)
+        return sample
 
-            # first process all the nodes
-            for _, node in self.nodes.items():
-                node.process()
+    def render(Graph self, double length, int samplerate=DEFAULT_SAMPLERATE, int channels=DEFAULT_CHANNELS):
+        cdef size_t framelength = <size_t>(length * samplerate)
+        cdef double[:,::1] out = np.zeros((framelength, channels))
 
-                # connect the outputs to the inputs
-                for portname, connections in node.connections.items():
-                    port = node.get_output(portname)
-                    for connode, conport, mult, add in connections:
-                        value = port * mult + add
-                        if connode == 'main' and conport == 'output':
-                            sample += value
-                        else:
-                            self.nodes[connode].set_param(conport, value)
+        if self.plan == NULL:
+            self.compile()
 
-            for c in range(channels):
-                out[i,c] = sample
+        if framelength > 0:
+            with nogil:
+                LPUgenPlan.process(self.plan, &out[0,0], framelength, channels)
 
         return SoundBuffer(out, samplerate=samplerate, channels=channels)
 
@@ -288,6 +288,7 @@ ext_modules = cythonize([
                 'libpippi/src/ugens.tape.c',
                 'libpippi/src/oscs.pulsar.c',
                 'libpippi/src/ugens.pulsar.c',
+                'libpippi/src/ugens.graph.c',
                 'pippi/ugens.pyx'
             ],
             include_dirs=INCLUDES, 
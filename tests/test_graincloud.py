@@ -28,6 +28,17 @@ class TestCloud(TestCase):
 
         self.assertEqual(len(out), framelength)
 
+    def test_parallel_render_is_deterministic(self):
+        sound = SoundBuffer(filename='tests/sounds/living.wav')
+        grainlength = shapes.win('sine', dsp.MS*10, 0.2)
+
+        length = 5
+        single = grains2.Cloud2(sound, grainlength=grainlength, spread=1, numgrains=16).play(length, numthreads=1, seed=12345)
+        multi = grains2.Cloud2(sound, grainlength=grainlength, spread=1, numgrains=16).play(length, numthreads=8, seed=12345)
+
+        self.assertEqual(len(single), int(length * sound.samplerate))
+        self.assertEqual(bytes(single.frames), bytes(multi.frames))
+
     def test_grainlength_modulation(self):
         snd = dsp.read('tests/sounds/living.wav')
         grainlength = shapes.win('sine', dsp.MS*10, 0.2)
@@ -1,5 +1,6 @@
+import threading
 from unittest import TestCase
-from pippi import dsp
+from pippi import dsp, noise
 
 methods = ['normal', 'logistic', 'lorenz', 'lorenzX', 'lorenzY', 'lorenzZ']
 
@@ -29,3 +30,24 @@ class TestRand(TestCase):
             dsp.win(values).graph('tests/renders/rand_%s_1000values.png' % m) 
         # teardown
         dsp.randmethod('normal')
+
+    def test_seed_is_reproducible(self):
+        # noise.bln draws from LPRand inside the noise 
+        # module, which has its own copy of libpippi
+        def render(out):
+            out += [ bytes(noise.bln('sine', 0.1, 100, 1000).frames) ]
+            out += [ dsp.rand() for _ in range(100) ]
+
+        dsp.randmethod('normal')
+
+        dsp.seed(1234)
+        first = []
+        render(first)
+
+        dsp.seed(1234)
+        second = []
+        t = threading.Thread(target=render, args=(second,))
+        t.start()
+        t.join()
+
+        self.assertEqual(first, second)
@@ -1,7 +1,62 @@
 from unittest import TestCase
 from pippi import dsp, fx, ugens
+from pippi.soundbuffer import SoundBuffer
 import numpy as np
 
+class Nodes(dict):
+    """ Bare nodes with the same add_node and connect calls as Graph
+    """
+    def add_node(self, name, ugen, **kwargs):
+        self[name] = ugens.Node(name, ugen, **kwargs)
+
+    def connect(self, a, b, mult=1, add=0):
+        anode, aport = a.split('.')
+        bnode, bport = b.split('.')
+        self[anode].connections[aport] += [(bnode, bport, mult, add)]
+
+def render_per_sample(nodes, length, samplerate=48000):
+    """ Reference renderer: run the nodes one sample at a time 
+        in the order given, pushing every output to its inputs 
+        through the python Node interface.
+    """
+    out = np.zeros(int(length * samplerate))
+    for i in range(len(out)):
+        for node in nodes.values():
+            node.process()
+            for portname, connections in node.connections.items():
+                port = node.get_output(portname)
+                for connode, conport, mult, add in connections:
+                    value = port * mult + add
+                    if connode == 'main' and conport == 'output':
+                        out[i] += value
+                    else:
+                        nodes[connode].set_param(conport, value)
+    return out
+
+def feedforward(graph):
+    graph.add_node('s0', 'sine', freq=0.5)
+    graph.add_node('s1', 'sine', freq=100)
+    graph.add_node('s2', 'sine', freq=3)
+    graph.add_node('m0', 'mult')
+
+    graph.connect('s0.output', 's1.freq', mult=50, add=150)
+    graph.connect('s1.output', 'm0.a')
+    graph.connect('s2.output', 'm0.b', mult=0.5, add=0.5)
+    graph.connect('m0.output', 'main.output', mult=0.5)
+    graph.connect('s1.freq', 'main.output', mult=0.001)
+
+def tapeline(graph):
+    # a short saw so the tape wraps during the render
+    frames = np.linspace(-1, 1, 1000).reshape(-1, 1)
+    buf = SoundBuffer(frames, channels=1, samplerate=48000)
+
+    graph.add_node('s0', 'sine', freq=5)
+    graph.add_node('t0', 'tape', buf=buf)
+
+    graph.connect('s0.output', 't0.speed', mult=0.5, add=1)
+    graph.connect('t0.output', 'main.output', mult=0.5)
+    graph.connect('t0.phase', 'main.output', mult=0.01)
+
 class TestUgens(TestCase):
     """ There's a better way to handle param updates...
     def test_ugen_pulsar(self):
@@ -82,3 +137,53 @@ class TestUgens(TestCase):
         out = graph.render(10)
         out = fx.norm(out, 1).taper(0.1)
         out.write('tests/renders/ugens_sine.wav')
+
+    def test_compiled_plan_matches_per_sample_path(self):
+        nodes = Nodes()
+        feedforward(nodes)
+        expected = render_per_sample(nodes, 0.1)
+
+        graph = ugens.Graph()
+        feedforward(graph)
+        out = graph.render(0.1, samplerate=48000, channels=1)
+
+        self.assertEqual(len(out), len(expected))
+        np.testing.assert_allclose(np.asarray(out.frames)[:,0], expected, rtol=0, atol=1e-9)
+
+    def test_unknown_port_raises(self):
+        graph = ugens.Graph()
+        graph.add_node('s0', 'sine', freq=1)
+        graph.add_node('s1', 'sine', freq=100)
+        graph.connect('s0.output', 's1.frq')
+        graph.connect('s1.output', 'main.output')
+        with self.assertRaises(AttributeError):
+            graph.render(0.1)
+
+        graph = ugens.Graph()
+        graph.add_node('s0', 'sine', freq=100)
+        graph.connect('s0.outptu', 'main.output')
+        with self.assertRaises(AttributeError):
+            graph.render(0.1)
+
+    def test_block_size_does_not_change_output(self):
+        renders = []
+        for blocksize in (1, 37, 64, 256):
+            for build in (feedforward, tapeline):
+                graph = ugens.Graph(blocksize)
+                build(graph)
+                renders += [(blocksize, build.__name__, bytes(graph.render(0.1, channels=2).frames))]
+
+        for blocksize, name, frames in renders:
+            expected = next(f for b, n, f in renders if b == 1 and n == name)
+            self.assertEqual(frames, expected, '%s differs at blocksize %d' % (name, blocksize))
+
+    def test_native_block_paths_match_per_sample_path(self):
+        nodes = Nodes()
+        tapeline(nodes)
+        expected = render_per_sample(nodes, 0.1)
+
+        graph = ugens.Graph()
+        tapeline(graph)
+        out = graph.render(0.1, samplerate=48000, channels=1)
+
+        np.testing.assert_allclose(np.asarray(out.frames)[:,0], expected, rtol=0, atol=1e-9)